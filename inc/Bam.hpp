@@ -11,13 +11,36 @@ using ghc::filesystem::path;
 
 #include <functional>
 #include <string>
+#include <vector>
 
 using std::function;
 using std::string;
+using std::vector;
 
 
 namespace gfase {
 
+
+/// Minimal per-alignment data needed for contact extraction. The reference is kept as its BAM target id (tid) so
+/// that no names need to be copied or hashed per record.
+class TidAlignment {
+public:
+    int32_t tid;
+    uint8_t mapq;
+};
+
+
+/// Where an alignment lies on its reference and on its read. Query coordinates are on the forward strand of the read,
+/// and exclude clipping. Only collected for tools that need more than the contacts themselves.
+class AlignmentSpan {
+public:
+    int32_t ref_start;
+    int32_t ref_stop;
+    int32_t query_start;
+    int32_t query_stop;
+};
+
+
 class Bam {
     path bam_path;
 
@@ -26,13 +49,59 @@ class Bam {
     hts_itr_t* bam_iterator;
     bam1_t* alignment;
 
+    bool is_usable_for_contacts(const bam1_t* a, const vector<bool>& valid_tids, int8_t min_mapq) const;
+
+    void for_read_group_in_name_grouped_bam(
+            const vector<bool>& valid_tids,
+            int8_t min_mapq,
+            size_t n_threads,
+            bool with_spans,
+            const function<void(size_t thread_index, const vector<TidAlignment>& alignments, const vector<AlignmentSpan>& spans, size_t start, size_t stop)>& f);
+
+    void for_read_group_in_sorted_bam(
+            const vector<bool>& valid_tids,
+            int8_t min_mapq,
+            size_t n_threads,
+            path temp_dir,
+            size_t n_buckets,
+            bool with_spans,
+            const function<void(size_t thread_index, const vector<TidAlignment>& alignments, const vector<AlignmentSpan>& spans, size_t start, size_t stop)>& f);
+
+    void for_read_group_in_bam(
+            const vector<bool>& valid_tids,
+            int8_t min_mapq,
+            size_t n_threads,
+            path temp_dir,
+            bool with_spans,
+            const function<void(size_t thread_index, const vector<TidAlignment>& alignments, const vector<AlignmentSpan>& spans, size_t start, size_t stop)>& f);
+
 public:
     Bam(path bam_path);
+    Bam(path bam_path, size_t n_threads);
     ~Bam();
+    void for_alignment_in_bam(const function<void(const bam1_t* alignment)>& f);
     void for_alignment_in_bam(const function<void(const string& ref_name, const string& query_name, uint8_t map_quality, uint16_t flag)>& f);
     void for_alignment_in_bam(bool get_cigar, const function<void(SamElement& alignment)>& f);
     void for_alignment_in_bam(const function<void(FullAlignmentBlock& a)>& f);
     void for_ref_in_header(const function<void(const string& ref_name, uint32_t length)>& f) const;
+    size_t get_ref_count() const;
+    bool is_coordinate_sorted() const;
+
+    void for_read_group_in_bam(
+            const vector<bool>& valid_tids,
+            int8_t min_mapq,
+            size_t n_threads,
+            path temp_dir,
+            const function<void(size_t thread_index, const vector<TidAlignment>& alignments, size_t start, size_t stop)>& f);
+
+    // Same as above, but `spans` additionally holds the span of each alignment, parallel to `alignments`
+    void for_read_group_in_bam(
+            const vector<bool>& valid_tids,
+            int8_t min_mapq,
+            size_t n_threads,
+            path temp_dir,
+            const function<void(size_t thread_index, const vector<TidAlignment>& alignments, const vector<AlignmentSpan>& spans, size_t start, size_t stop)>& f);
+
     static bool is_first_mate(uint16_t flag);
     static bool is_second_mate(uint16_t flag);
     static bool is_not_primary(uint16_t flag);
@@ -41,10 +110,7 @@ public:
 };
 
 
-template <class T> void update_contact_map(
-        const vector<T>& alignments,
-        MultiContactGraph& contact_graph,
-        IncrementalIdMap<string>& id_map);
+void get_valid_tids(const Bam& reader, const string& required_prefix, vector<bool>& valid_tids);
 
 
 void parse_unpaired_bam_file(
@@ -52,7 +118,9 @@ void parse_unpaired_bam_file(
         MultiContactGraph& contact_graph,
         IncrementalIdMap<string>& id_map,
         string required_prefix,
-        int8_t min_mapq);
+        int8_t min_mapq,
+        size_t n_threads=1,
+        path temp_dir="");
 
 
 }
@@ -3,20 +3,67 @@
 
 #include "bdsg/hash_graph.hpp"
 
-#include <vector>
+#include <unordered_map>
 #include <functional>
+#include <cstdint>
+#include <vector>
 
 using bdsg::HandleGraph;
 using handlegraph::handle_t;
+using handlegraph::nid_t;
 
+using std::unordered_map;
 using std::vector;
 using std::function;
 using std::pair;
 
 namespace gfase {
 
-// return the bridge nodes of the handle graph using Schmidt's (2013)
-// algorithm. assumes that graph is connected. the returned bridges are
+// dense indexes for the nodes of a graph and their sides, along with the bridge nodes of
+// the graph, which are found with an iterative Tarjan low-link search on the bi-edged graph.
+// all of the search state is held in flat arrays indexed by side, so this scales to whole-genome
+// graphs. the graph does not need to be connected, and it must not be modified while the index
+// is in use.
+class BridgeIndex {
+public:
+    BridgeIndex(const HandleGraph& graph);
+    BridgeIndex() = delete;
+    ~BridgeIndex() = default;
+
+    const HandleGraph& get_graph() const;
+
+    size_t get_node_count() const;
+
+    // the dense index of a node, in the order of the graph's handle iteration
+    size_t get_node_index(nid_t node_id) const;
+
+    // sides are identified by the handle that leaves them, so the two sides of node index i are
+    // 2i (forward) and 2i + 1 (reverse)
+    size_t get_side(const handle_t& handle) const;
+    handle_t get_handle(size_t side) const;
+
+    bool is_bridge(nid_t node_id) const;
+
+    // the bridge nodes, all in forward orientation, in the order of the graph's handle iteration
+    vector<handle_t> get_bridges() const;
+
+private:
+
+    const HandleGraph& graph;
+
+    // the forward handle of each node index
+    vector<handle_t> handles;
+
+    // node ID -> node index. if the IDs are compact they are looked up by offset in a vector instead
+    // of hashing
+    vector<uint32_t> compact_node_index;
+    unordered_map<nid_t, uint32_t> node_index;
+    nid_t min_id = 0;
+
+    vector<bool> bridge_flags;
+};
+
+// return the bridge nodes of the handle graph. the returned bridges are
 // all in the forward orientation.
 vector<handle_t> bridge_nodes(const HandleGraph& graph);
 
@@ -24,6 +71,10 @@ vector<handle_t> bridge_nodes(const HandleGraph& graph);
 // the returned unipaths will be ordered / oriented so that they represent a
 // valid walk of the bridge. the bridges argument can be a subset of all bridges.
 // assumes bridges are all provided in the forward orientation.
+vector<vector<handle_t>> consolidate_bridges(const BridgeIndex& index,
+                                             const vector<handle_t>& bridges);
+
+// as above, but indexing the graph first
 vector<vector<handle_t>> consolidate_bridges(const HandleGraph& graph,
                                              const vector<handle_t>& bridges);
 
@@ -33,11 +84,31 @@ vector<vector<handle_t>> consolidate_bridges(const HandleGraph& graph,
 // the bridge component, which are identified by their index in the input vector
 // and the direction from the bridge into the component (true = reverse). if a bridge
 // consists of multiple nodes, then only the innermost one is included in the subgraph.
+void for_each_bridge_component(const BridgeIndex& index,
+                               const vector<vector<handle_t>>& bridges,
+                               const function<void(const HandleGraph&,
+                                                   const vector<pair<size_t, bool>>&)>& f);
+
+// as above, but indexing the graph first
 void for_each_bridge_component(const HandleGraph& graph,
                                const vector<vector<handle_t>>& bridges,
                                const function<void(const HandleGraph&,
                                                    const vector<pair<size_t, bool>>&)>& f);
 
+// like for_each_bridge_component, but the function is executed on multiple components
+// concurrently using n_threads threads, so it must be thread safe. the function is also
+// given the index of the component, which is its position in the order that
+// for_each_bridge_component would have visited it, and the number of threads that it may
+// use itself. threads that are not needed to cover the components are shared among them, so
+// a lone component gets all n_threads. returns the number of components.
+size_t for_each_bridge_component_in_parallel(const BridgeIndex& index,
+                                             const vector<vector<handle_t>>& bridges,
+                                             size_t n_threads,
+                                             const function<void(size_t,
+                                                                 const HandleGraph&,
+                                                                 const vector<pair<size_t, bool>>&,
+                                                                 size_t)>& f);
+
 
 }
 
@@ -0,0 +1,95 @@
+#ifndef GFASE_CONTACTSTORE_HPP
+#define GFASE_CONTACTSTORE_HPP
+
+#include "Filesystem.hpp"
+
+using ghc::filesystem::path;
+
+#include <functional>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <array>
+
+using std::function;
+using std::string;
+using std::vector;
+using std::array;
+
+
+namespace gfase {
+
+
+/// Lower bound (inclusive) of each MAPQ bin. Thresholds that fall between bins are rounded up to the next bin.
+static const size_t n_mapq_bins = 8;
+static const array<uint8_t,n_mapq_bins> mapq_bin_starts = {0, 1, 5, 10, 20, 30, 40, 60};
+
+using mapq_histogram_t = array<uint32_t,n_mapq_bins>;
+
+
+class ContactStoreEntry {
+public:
+    uint64_t key;
+    mapq_histogram_t counts;
+};
+
+
+/// Contact counts for each unordered pair of contigs, stratified by MAPQ. Each pair is stored once, keyed by its two
+/// IDs packed into one integer: (min_id << 32) | max_id, in an open-addressing table with linear probing. IDs index
+/// into `names`, so a serialized store is self-contained and can be reloaded at any MAPQ threshold.
+class ContactStore {
+    vector<ContactStoreEntry> entries;
+    size_t n_entries;
+    uint64_t mask;
+
+    static const uint64_t empty_key;
+    static const uint64_t magic;
+    static const uint32_t version;
+
+    void grow();
+    ContactStoreEntry& find_or_insert(uint64_t key);
+    const ContactStoreEntry* find(uint64_t key) const;
+
+public:
+    /// Attributes ///
+    vector<string> names;
+
+    /// Methods ///
+    ContactStore();
+    ContactStore(path binary_path);
+
+    static uint64_t pack(uint32_t a, uint32_t b);
+    static size_t get_bin(uint8_t mapq);
+
+    // Find the first bin that contains no MAPQ values below min_mapq
+    static size_t get_min_bin(uint8_t min_mapq);
+
+    void reserve(size_t n);
+    void increment(uint32_t a, uint32_t b, uint8_t mapq, uint32_t count=1);
+    void increment(uint64_t key, const mapq_histogram_t& counts);
+
+    // Add all the counts from another store which uses the same IDs
+    void merge(const ContactStore& other);
+
+    // Sum of the counts in all bins at or above the bin for min_mapq
+    uint32_t get_count(uint32_t a, uint32_t b, uint8_t min_mapq=0) const;
+
+    void for_each_contact(const function<void(uint32_t a, uint32_t b, const mapq_histogram_t& counts)>& f) const;
+    void for_each_contact(uint8_t min_mapq, const function<void(uint32_t a, uint32_t b, uint32_t count)>& f) const;
+
+    size_t size() const;
+    void clear();
+
+    void write_to_binary(path output_path) const;
+
+    // One column of counts per MAPQ bin, one line per pair
+    void write_to_csv(path output_path) const;
+
+    // name_a,name_b,q:count q:count ... with each pair listed in both directions, and q the start of each non-empty bin
+    void write_to_mapq_list_csv(path output_path) const;
+};
+
+
+}
+
+#endif //GFASE_CONTACTSTORE_HPP
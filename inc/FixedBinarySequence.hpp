@@ -6,9 +6,11 @@
 #include "MurmurHash2.hpp"
 
 #include <type_traits>
+#include <cstdint>
 #include <ostream>
 #include <vector>
 #include <bitset>
+#include <string_view>
 #include <string>
 #include <deque>
 #include <array>
@@ -17,10 +19,12 @@
 
 using std::runtime_error;
 using std::is_integral;
+using std::make_unsigned_t;
 using std::to_string;
 using std::ostream;
 using std::vector;
 using std::bitset;
+using std::string_view;
 using std::string;
 using std::deque;
 using std::array;
@@ -68,6 +72,20 @@ template <class T, size_t T2> bool operator==(const FixedBinarySequence<T,T2>& a
 }
 
 
+/// Orders sequences as if their words were one big unsigned integer, with the last word most significant, so that the
+/// lesser of a kmer and its reverse complement is the same regardless of word size
+template <class T, size_t T2> bool operator<(const FixedBinarySequence<T,T2>& a, const FixedBinarySequence<T,T2>& b)
+{
+    for (size_t i=T2; i>0; i--){
+        if (a.sequence[i-1] != b.sequence[i-1]){
+            return a.sequence[i-1] < b.sequence[i-1];
+        }
+    }
+
+    return false;
+}
+
+
 template <class T, size_t T2> const array<char,4> FixedBinarySequence<T,T2>::index_to_base = {'A','C','G','T'};
 template <class T, size_t T2> const array<uint16_t,128> FixedBinarySequence<T,T2>::base_to_index = {
         4,4,4,4,4,4,4,4,4,4,      // 0
@@ -275,6 +293,82 @@ template<class T, size_t T2> void get_reverse_complement(const FixedBinarySequen
 }
 
 
+/// Up to 64bp in 2-bit encoding, with base i at bits [2i, 2i+2) counting from the low end of the first word. This is
+/// the same layout as FixedBinarySequence, so any FixedBinarySequence that fits in 128 bits converts to and from it by
+/// shifting whole words. Comparing the high word first gives the same order as operator< on FixedBinarySequence.
+using packed_kmer_t = array<uint64_t,2>;
+
+
+template<class T, size_t T2> void to_packed_kmer(const FixedBinarySequence<T,T2>& s, packed_kmer_t& packed) {
+    static_assert(sizeof(T)*T2 <= sizeof(packed_kmer_t), "ERROR: FixedBinarySequence is wider than packed kmer");
+
+    packed = {0,0};
+
+    // Every word of T lies within a single 64 bit word, so each is one shift
+    for (size_t i=0; i<T2; i++){
+        auto offset = i*sizeof(T)*8;
+        packed[offset/64] |= uint64_t(make_unsigned_t<T>(s.sequence[i])) << (offset%64);
+    }
+}
+
+
+template<class T, size_t T2> void from_packed_kmer(const packed_kmer_t& packed, FixedBinarySequence<T,T2>& s) {
+    static_assert(sizeof(T)*T2 <= sizeof(packed_kmer_t), "ERROR: FixedBinarySequence is wider than packed kmer");
+
+    for (size_t i=0; i<T2; i++){
+        auto offset = i*sizeof(T)*8;
+        s.sequence[i] = T(packed[offset/64] >> (offset%64));
+    }
+}
+
+
+inline void to_packed_kmer(string_view s, packed_kmer_t& packed) {
+    if (s.size() > 64){
+        throw runtime_error("ERROR: cannot pack kmer longer than 64bp: " + string(s));
+    }
+
+    packed = {0,0};
+
+    for (size_t i=0; i<s.size(); i++){
+        uint64_t bits = 4;
+        if (uint8_t(s[i]) < 128){
+            bits = FixedBinarySequence<uint64_t,2>::base_to_index[uint8_t(s[i])];
+        }
+
+        if (bits == 4){
+            throw runtime_error("ERROR: non ACGT character encountered in sequence: " + string(1,s[i]) + " (ord=" + std::to_string(int(s[i])) + ")");
+        }
+
+        packed[(2*i)/64] |= bits << ((2*i)%64);
+    }
+}
+
+
+inline void get_reverse_complement(const packed_kmer_t& fc, packed_kmer_t& rc, size_t length) {
+    rc = {0,0};
+
+    for (size_t i=0; i<length; i++){
+        uint64_t bits = (fc[(2*i)/64] >> ((2*i)%64)) & 3;
+        auto j = 2*(length - i - 1);
+        rc[j/64] |= (3 - bits) << (j%64);
+    }
+}
+
+
+inline bool is_lesser(const packed_kmer_t& a, const packed_kmer_t& b) {
+    return (a[1] < b[1]) or (a[1] == b[1] and a[0] < b[0]);
+}
+
+
+inline void get_canonical(const packed_kmer_t& kmer, packed_kmer_t& canonical, size_t length) {
+    get_reverse_complement(kmer, canonical, length);
+
+    if (not is_lesser(canonical, kmer)){
+        canonical = kmer;
+    }
+}
+
+
 }
 
 
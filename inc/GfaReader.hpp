@@ -4,6 +4,7 @@
 #include "Filesystem.hpp"
 #include <unordered_map>
 #include <unordered_set>
+#include <string_view>
 #include <functional>
 #include <fstream>
 #include <string>
@@ -14,6 +15,7 @@
 using ghc::filesystem::path;
 using std::unordered_map;
 using std::unordered_set;
+using std::string_view;
 using std::function;
 using std::ifstream;
 using std::ofstream;
@@ -35,25 +37,74 @@ public:
 };
 
 
+/// Views of parsed GFA records. All fields point into the memory-mapped GFA, so they are only valid for as long as
+/// the GfaReader exists. `index` is the ordinal of the record among lines of its type, in file order.
+class GfaSequenceView {
+public:
+    string_view name;
+    string_view sequence;
+    size_t index;
+};
+
+
+class GfaLinkView {
+public:
+    string_view node_a;
+    bool reversal_a;
+    string_view node_b;
+    bool reversal_b;
+    string_view cigar;
+    size_t index;
+};
+
+
+class GfaPathView {
+public:
+    string_view name;
+    vector<string_view> nodes;
+    vector<bool> reversals;
+    vector<string_view> cigars;
+    size_t index;
+};
+
+
 class GfaReader {
 public:
     /// Attributes ///
     path gfa_path;
     path gfa_index_path;
     int gfa_file_descriptor;
+
+    // Read-only mapping of the whole GFA
+    const char* data;
+    size_t data_length;
+
+    // Used for building the index
+    size_t n_threads;
+
+    // Read-only mapping of the .gfai, kept so that the node name table can be decoded lazily
+    const char* index_data;
+    size_t index_length;
+    size_t index_names_offset;
+
     vector <GFAIndex> line_offsets;
     map <char, vector <size_t> > line_indexes_by_type;
     unordered_map <string, size_t> sequence_line_indexes_by_node;
 
     static const char EOF_CODE;
+    static const uint64_t INDEX_MAGIC;
+    static const uint32_t INDEX_VERSION;
 
     /// Methods ///
-    GfaReader(path gfa_path);
+    GfaReader(path gfa_path, size_t n_threads=1);
+    GfaReader(const GfaReader& other) = delete;
+    GfaReader& operator=(const GfaReader& other) = delete;
     ~GfaReader();
+    void map_file();
     void index();
-    void read_index();
-    void write_index_to_binary_file();
-    void ensure_index_up_to_date();
+    bool read_index();
+    void write_index_to_binary_file(const vector<string_view>& sequence_names);
+    uint64_t compute_sampled_hash() const;
     void map_sequences_by_node();
     void read_line(string& s, size_t index);
     uint64_t get_sequence_length(string node_name);
@@ -61,6 +112,18 @@ public:
     void for_each_sequence(const function<void(string& name, string& sequence)>& f);
     void for_each_link(const function<void(string& node_a, bool reversal_a, string& node_b, bool reversal_b, string& cigar)>& f);
     void for_each_path(const function<void(string& path_name, vector<string>& nodes, vector<bool>& reversals, vector<string>& cigars)>& f);
+
+    // Zero-copy access. With n_threads > 1, lines are distributed over threads in chunks, so the order of callbacks is
+    // only guaranteed within each thread. With n_threads == 1, callbacks are in file order on the calling thread.
+    string_view get_line(size_t index) const;
+    size_t get_line_count(char type) const;
+    static void parse_sequence(string_view line, GfaSequenceView& s);
+    static void parse_link(string_view line, GfaLinkView& l);
+    static void parse_path(string_view line, GfaPathView& p);
+    void for_each_line_view_of_type(char type, size_t n_threads, const function<void(size_t thread_index, size_t index, string_view line)>& f) const;
+    void for_each_sequence_view(size_t n_threads, const function<void(size_t thread_index, const GfaSequenceView& s)>& f) const;
+    void for_each_link_view(size_t n_threads, const function<void(size_t thread_index, const GfaLinkView& l)>& f) const;
+    void for_each_path_view(size_t n_threads, const function<void(size_t thread_index, const GfaPathView& p)>& f) const;
 };
 
 
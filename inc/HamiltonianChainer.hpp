@@ -29,6 +29,7 @@ class HamiltonianChainer : public AbstractChainer {
 public:
     
     HamiltonianChainer() = default;
+    HamiltonianChainer(size_t n_threads);
     ~HamiltonianChainer() = default;
     
     // add phased haplotype paths to the graph
@@ -51,6 +52,9 @@ public:
     // phased haploid sequence
     double min_haploid_proportion = 0.1;
     
+    // bridge components are phased in parallel with this many threads
+    size_t n_threads = 1;
+    
 private:
     
     // keep track of which of the paths are the phase paths we added
@@ -62,14 +66,16 @@ private:
     // returns the confident left and right sides of the allelic walk through a component.
     // if there is a full-length walk, only the first vector in the pair is filled.
     // walks are all oriented away from the starts, toward the ends.
-    // also records whether the alleles were generated with a hamiltonian walk
+    // also records whether the alleles were generated with a hamiltonian walk.
+    // the hamiltonian path search may use up to n_threads threads
     pair<vector<handle_t>, vector<handle_t>> generate_allelic_semiwalks(const HandleGraph& graph,
                                                                         const IncrementalIdMap<string>& id_map,
                                                                         const unordered_set<nid_t>& in_phase_nodes,
                                                                         const unordered_set<nid_t>& out_phase_nodes,
                                                                         const unordered_set<handle_t>& starts,
                                                                         const unordered_set<handle_t>& ends,
-                                                                        bool& resolved_hamiltonian) const;
+                                                                        bool& resolved_hamiltonian,
+                                                                        size_t n_threads) const;
     
     // generate the path names we use to mark haplotypes
     static string phase_path_name(int haplotype, int path_id);
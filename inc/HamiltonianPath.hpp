@@ -31,12 +31,16 @@ public:
 
 // empty sets for starts or ends indicdate that any start or end node is allowed
 // allowed starts and ends are oriented
+// problems with more than 128 non-prohibited nodes are not attempted (the result is not solved)
+// max_iters limits the number of edges followed while extending walks, and large DP layers are
+// extended using up to n_threads threads
 HamiltonianProblemResult find_hamiltonian_path(const HandleGraph& graph,
                                                const unordered_set<nid_t>& target_nodes,
                                                const unordered_set<nid_t>& prohibited_nodes,
                                                const unordered_set<handle_t>& allowed_starts,
                                                const unordered_set<handle_t>& allowed_ends,
-                                               size_t max_iters = numeric_limits<size_t>::max());
+                                               size_t max_iters = numeric_limits<size_t>::max(),
+                                               size_t n_threads = 1);
 
 }
 
@@ -1,11 +1,14 @@
 #ifndef GFASE_HAPLOTYPEPATHKMER_HPP
 #define GFASE_HAPLOTYPEPATHKMER_HPP
 
+#include "FixedBinarySequence.hpp"
 #include "bdsg/hash_graph.hpp"
 
 #include <functional>
+#include <cstdint>
 #include <deque>
 #include <string>
+#include <array>
 
 using bdsg::HashGraph;
 using handlegraph::MutablePathMutableHandleGraph;
@@ -18,6 +21,7 @@ using handlegraph::handle_t;
 using std::function;
 using std::deque;
 using std::string;
+using std::array;
 
 
 namespace gfase {
@@ -46,6 +50,16 @@ private:
     deque<char> sequence;
     size_t k;
 
+    // Rolling 2-bit encodings of the last k bases in each orientation, only maintained if k <= 64
+    packed_kmer_t forward_kmer;
+    packed_kmer_t reverse_kmer;
+    uint64_t reverse_low_mask;
+    uint64_t reverse_high_mask;
+    size_t n_valid_bases;
+
+    // Append a base to the kmer queue and update the rolling encodings in O(1)
+    void push_base(char c);
+
 public:
     /// Methods ///
     HaplotypePathKmer(const PathHandleGraph& graph, const path_handle_t& path, size_t k);
@@ -58,15 +72,31 @@ public:
 
     void for_each_haploid_kmer(const function<void(deque<char>& sequence)>& f);
 
+    // Same iteration as for_each_haploid_kmer, but each kmer is handed out as the lesser of its forward and reverse
+    // complement encodings, without re-encoding the sequence. Requires k <= 64.
+    void for_each_haploid_kmer(const function<void(const packed_kmer_t& canonical_kmer)>& f);
+    template <class T, size_t T2> void for_each_haploid_kmer(const function<void(const FixedBinarySequence<T,T2>& canonical_kmer)>& f);
+
     bool update_has_diploid();
 
     step_handle_t get_step_of_kmer_start() const;
     step_handle_t get_step_of_kmer_end() const;
     size_t get_index_of_kmer_start() const;
+    const deque<char>& get_sequence() const;
     void print();
 };
 
 
+template <class T, size_t T2> void HaplotypePathKmer::for_each_haploid_kmer(const function<void(const FixedBinarySequence<T,T2>& canonical_kmer)>& f){
+    FixedBinarySequence<T,T2> s;
+
+    for_each_haploid_kmer([&](const packed_kmer_t& canonical_kmer){
+        from_packed_kmer(canonical_kmer, s);
+        f(s);
+    });
+}
+
+
 }
 
 #endif //GFASE_HAPLOTYPEPATHKMER_HPP
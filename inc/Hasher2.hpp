@@ -19,6 +19,7 @@ using spp::sparse_hash_map;
 using handlegraph::HandleGraph;
 
 #include <unordered_set>
+#include <utility>
 #include <map>
 #include <iostream>
 #include <ostream>
@@ -27,6 +28,7 @@ using handlegraph::HandleGraph;
 #include <mutex>
 
 using std::unordered_set;
+using std::pair;
 using std::map;
 using std::numeric_limits;
 using std::stringstream;
@@ -73,24 +75,33 @@ public:
 };
 
 
-// Where to store the names of reads which share hashed-k-mers
-using hash_bins_t = vector <unordered_set <int64_t> >;
+// A sampled k-mer hash and the ID of the sequence it was found in. Sequences that share a hash are found by sorting
+// these, so equal hashes form contiguous groups (bins).
+using hash_entry_t = pair<uint64_t, int64_t>;
 
-// Ultimately where the results of LSH are stored
-using overlaps_t = sparse_hash_map <int64_t, unordered_map <int64_t, int64_t> >;
+// A pair of sequence IDs (a in the high half, b in the low half) and how many bins they co-occurred in
+using pair_count_t = pair<uint64_t, uint32_t>;
 
 
 class Hasher2{
 private:
-    // Each bin corresponds to a k-mer, and contains sequence names
-    hash_bins_t bins;
+    // The (hash, sequence id) entries of the most recent iteration, grouped by hash. Each group corresponds to a k-mer
+    // and contains the IDs of the sequences that contain it.
+    vector<hash_entry_t> bins;
 
-    // Can't use a vector for mutexes, and it's probably more efficient to have fewer anyway. So the bin index
-    // is downsampled (%) to match the number of mutexes.
-    array<mutex,65536> bin_mutexes;
+    // Ultimately where the results of LSH are stored: the number of bins each pair of sequences co-occurred in, as a
+    // sparse matrix in CSR form. Row a is overlap_columns/overlap_counts[overlap_offsets[a], overlap_offsets[a+1]),
+    // with columns in ascending order. The self hit (a,a) is the total number of bins that a was found in.
+    vector<uint64_t> overlap_offsets;
+    vector<uint32_t> overlap_columns;
+    vector<uint32_t> overlap_counts;
 
-    // The result of counting co-occurring sequences in the hash bins
-    overlaps_t overlaps;
+    // Running totals of the pair counts while hashing, sorted, with one vector per contiguous range of row IDs
+    vector <vector<pair_count_t> > pair_counts;
+    size_t rows_per_partition;
+
+    // Number of ranges that hashes and rows are each split into for parallel sorting
+    size_t n_partitions;
 
     // Use IDs instead of strings in the bins
     IncrementalIdMap<string> sequence_id_map;
@@ -111,20 +122,30 @@ private:
     // Skip assigning pairs for any match that has fewer than this many hashes
     const size_t min_hashes = 40;
 
-    // How many more bins than the total length of the observed sequence do we want to have, to prevent collisions?
-    const size_t bins_scaling_factor = 5;
-
     static const vector<uint64_t> seeds;
 
     /// Methods ///
-    void hash_sequence(const Sequence& sequence, int64_t id, size_t hash_index);
+    void hash_sequence(const Sequence& sequence, int64_t id, size_t hash_index, vector<hash_entry_t>& hashes) const;
+    void group_hashes(vector <vector<hash_entry_t> >& thread_hashes);
+    void build_overlap_matrix();
+    void run_in_parallel(size_t n_jobs, const function<void(size_t i)>& f) const;
+
+    // Total number of bins a sequence was found in (its self hit), or 0 if it was never sampled
+    int64_t get_total_hashes(int64_t id) const;
+    void get_sorted_scores(int64_t id, map<int64_t, int64_t>& sorted_scores) const;
+    int64_t n_rows() const;
 
 public:
     Hasher2(size_t k, double sample_rate, size_t n_iterations, size_t n_threads);
 
     // Main algorithm
     uint64_t hash(const BinarySequence<uint64_t>& kmer, size_t seed_index) const;
-    void hash_sequences(const vector<Sequence>& sequences, atomic<size_t>& job_index, size_t hash_index);
+    uint64_t hash(uint64_t kmer, size_t seed_index) const;
+    void hash_sequences(
+            const vector<Sequence>& sequences,
+            atomic<size_t>& job_index,
+            size_t hash_index,
+            vector<hash_entry_t>& hashes) const;
     void hash(const vector<Sequence>& sequences);
     void hash(const HandleGraph& graph, const IncrementalIdMap<string>& id_map);
 
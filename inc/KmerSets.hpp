@@ -1,6 +1,7 @@
 #ifndef GFASE_KMERSETS_HPP
 #define GFASE_KMERSETS_HPP
 
+#include "ParentalKmerTable.hpp"
 #include "graph_utility.hpp"
 #include "Filesystem.hpp"
 #include "Sequence.hpp"
@@ -22,12 +23,13 @@ using ghc::filesystem::path;
 namespace gfase {
 
 
+/// Parental kmers are stored in canonical form (the lesser of the kmer and its reverse complement) in a single table
+/// with a paternal and maternal flag for each, so that a kmer in either orientation is classified with one probe
 template <class T> class KmerSets {
 	/// Attributes ///
 	private:
-		// Sets for each member of the trio
-		sparse_hash_set <T> paternal_kmer_set;
-		sparse_hash_set <T> maternal_kmer_set;
+		// Kmers for both parents of the trio
+		ParentalKmerTable kmer_table;
 
         // < component,  [component_hap_path][parent_hap_index] >
         unordered_map<string, array <array <double,2>, 2> > component_map;
@@ -51,12 +53,23 @@ template <class T> class KmerSets {
 		KmerSets();
 
         // TODO: remove dependency on "path delimiter" for finding bubbles
-		KmerSets(path paternal_kmer_fa_path_arg, path maternal_kmer_fa_path_args, char path_delimiter='.');
-		float get_size_of_kmer_file(path file_path);
-		void load_fasta_into_unordered_set(path file_path, sparse_hash_set<T>& s);
+		KmerSets(path paternal_kmer_fa_path_arg, path maternal_kmer_fa_path_args, char path_delimiter='.', size_t n_threads=1);
+
+        // Load parental kmers from FASTA or plain kmer lists, parsing each file in parallel
+        void load_kmer_text(path paternal_kmer_path, path maternal_kmer_path, size_t n_threads);
+
+        // Load parental kmers from a table that was built by build_parental_kmer_db (mapped, not copied)
+        void load_kmer_db(path kmer_db_path);
 		void increment_parental_kmer_count(string path_hap_string, T child_kmer);
 		void increment_parental_kmer_count(string path_name, unordered_set <T> child_kmers);
         void increment_parental_kmer_count(string component_name, size_t component_haplotype, T child_kmer);
+        void increment_parental_canonical_kmer_count(const string& component_name, size_t component_haplotype, const packed_kmer_t& canonical_kmer);
+
+        // Add a matrix of counts that was accumulated elsewhere (e.g. per thread) to a component's counts
+        void add_component_counts(const string& component_name, const array <array <double,2>, 2>& counts);
+        uint8_t get_parental_flags(const packed_kmer_t& canonical_kmer) const;
+        bool is_maternal_canonical(const packed_kmer_t& canonical_kmer) const;
+        bool is_paternal_canonical(const packed_kmer_t& canonical_kmer) const;
         bool is_maternal(const T& kmer, const T& kmer_reverse_complement) const;
         bool is_paternal(const T& kmer, const T& kmer_reverse_complement) const;
         bool is_maternal(const T& kmer) const;
@@ -79,92 +92,59 @@ template <class T> KmerSets<T>::KmerSets():
 {}
 
 
-template <class T> KmerSets<T>::KmerSets(path paternal_kmer_fa_path, path maternal_kmer_fa_path, char path_delimiter):
+template <class T> KmerSets<T>::KmerSets(path paternal_kmer_fa_path, path maternal_kmer_fa_path, char path_delimiter, size_t n_threads):
         paternal_kmer_fa_path(paternal_kmer_fa_path),
         maternal_kmer_fa_path(maternal_kmer_fa_path),
         path_delimiter(path_delimiter)
 {
-    // Test files for hap1 and hap2 parents
-    ifstream h1_test_stream(this->paternal_kmer_fa_path);
-    if (not h1_test_stream.is_open()){
-        throw runtime_error("ERROR: file could not be opened: " + this->paternal_kmer_fa_path.string());
-    }
-
-    ifstream h2_test_stream(this->maternal_kmer_fa_path);
-    if (not h2_test_stream.is_open()){
-        throw runtime_error("ERROR: file could not be opened: " + this->maternal_kmer_fa_path.string());
-    }
-
-    // Get the number of kmers for each parent
-    num_paternal_kmers=get_size_of_kmer_file(paternal_kmer_fa_path);
-    num_maternal_kmers=get_size_of_kmer_file(maternal_kmer_fa_path);
-    cerr << " hap1 kmer file path: " << paternal_kmer_fa_path << "\n # kmers: " << num_paternal_kmers << endl;
-    cerr << " hap2 kmer file path: " << maternal_kmer_fa_path << "\n # kmers: " << num_maternal_kmers << endl;
-
-    // Fill the kmer sets
-    load_fasta_into_unordered_set(paternal_kmer_fa_path, paternal_kmer_set);
-    load_fasta_into_unordered_set(maternal_kmer_fa_path, maternal_kmer_set);
+    load_kmer_text(paternal_kmer_fa_path, maternal_kmer_fa_path, n_threads);
 }
 
 
-template <class T> size_t KmerSets<T>::get_k(){
-    return k;
-}
+template <class T> void KmerSets<T>::load_kmer_text(path paternal_kmer_path, path maternal_kmer_path, size_t n_threads){
+    kmer_table.clear();
 
+    // Fill the kmer table (the files are checked as they are opened)
+    kmer_table.load_kmers_from_text(paternal_kmer_path, ParentalKmerTable::paternal_flag, n_threads);
+    kmer_table.load_kmers_from_text(maternal_kmer_path, ParentalKmerTable::maternal_flag, n_threads);
 
-template <class T> size_t KmerSets<T>::n_paternal_kmers() const{
-    return num_paternal_kmers;
-}
-
+    k = kmer_table.get_k();
 
-template <class T> size_t KmerSets<T>::n_maternal_kmers() const{
-    return num_maternal_kmers;
+    // Normalize by the number of distinct kmers for each parent, so results don't depend on how the kmers were loaded
+    num_paternal_kmers = double(kmer_table.count(ParentalKmerTable::paternal_flag));
+    num_maternal_kmers = double(kmer_table.count(ParentalKmerTable::maternal_flag));
+    cerr << " hap1 kmer file path: " << paternal_kmer_path << "\n # kmers: " << num_paternal_kmers << endl;
+    cerr << " hap2 kmer file path: " << maternal_kmer_path << "\n # kmers: " << num_maternal_kmers << endl;
 }
 
 
-template <class T> float KmerSets<T>::get_size_of_kmer_file(path file_path){
-    // # of kmers by (total file size/size of 2 lines)
-
-    // Size of 2 fa lines = size of 1 kmer
-    ifstream fileline(file_path, ios::binary );
-    streampos fsize = 0;
-    string line;
+template <class T> void KmerSets<T>::load_kmer_db(path kmer_db_path){
+    kmer_table.load_from_binary(kmer_db_path);
 
-    // Move 1 kmer = 2 lines through file and store size
-    getline(fileline, line);
-    getline(fileline, line);
-    fsize = fileline.tellg() - fsize;
+    if (kmer_table.get_k() > ParentalKmerTable::max_k){
+        throw runtime_error("ERROR: parental kmer table has unsupported k: " + to_string(kmer_table.get_k()));
+    }
 
-    // Move to end
-    fileline.seekg(0,ios_base::end);
-    float size = fileline.tellg()/fsize;
-    fileline.close();
+    k = kmer_table.get_k();
 
-    return size;
+    num_paternal_kmers = double(kmer_table.count(ParentalKmerTable::paternal_flag));
+    num_maternal_kmers = double(kmer_table.count(ParentalKmerTable::maternal_flag));
+    cerr << " kmer db path: " << kmer_db_path << "\n # paternal kmers: " << num_paternal_kmers << "\n # maternal kmers: " << num_maternal_kmers << endl;
 }
 
 
-template <class T> void KmerSets<T>::load_fasta_into_unordered_set(path file_path, sparse_hash_set<T>& s){
+template <class T> size_t KmerSets<T>::get_k(){
+    return k;
+}
 
-    // Read from the text file
-    ifstream KmerFile(file_path);
 
-    string line;
-    // Use a while loop to read the file line by line
-    while (getline (KmerFile, line)) {
-        if (line[0] == '>'){
-            continue;
-        }
+template <class T> size_t KmerSets<T>::n_paternal_kmers() const{
+    return num_paternal_kmers;
+}
 
-        if (k == 0){
-            k = line.size();
-        }
-        else if (line.size() != k){
-            throw runtime_error("ERROR: kmer with unequal size found: " + line);
-        }
 
-        s.emplace(line);
-    }
+template <class T> size_t KmerSets<T>::n_maternal_kmers() const{
+    return num_maternal_kmers;
 }
 
 
@@ -192,50 +172,96 @@ template <class T> void KmerSets<T>::increment_parental_kmer_count(
         component_map.insert({component_name, {{{0, 0}, {0, 0}}}});
     }
 
-    T child_kmer_rc;
-    get_reverse_complement(child_kmer, child_kmer_rc, k);
+    packed_kmer_t kmer;
+    packed_kmer_t canonical_kmer;
+    to_packed_kmer(child_kmer, kmer);
+    get_canonical(kmer, canonical_kmer, k);
 
-    // Find child_kmer in each parent kmer_set
-    component_map[component_name][component_haplotype][paternal_index] += is_paternal(child_kmer, child_kmer_rc);
-    component_map[component_name][component_haplotype][maternal_index] += is_maternal(child_kmer, child_kmer_rc);
+    increment_parental_canonical_kmer_count(component_name, component_haplotype, canonical_kmer);
 }
 
 
-template <class T> bool KmerSets<T>::is_maternal(const T& kmer) const{
-    T rc_kmer;
-    get_reverse_complement(kmer, rc_kmer, k);
+template <class T> void KmerSets<T>::increment_parental_canonical_kmer_count(
+        const string& component_name,
+        size_t component_haplotype,
+        const packed_kmer_t& canonical_kmer) {
+
+    auto flags = kmer_table.get_flags(canonical_kmer);
 
-    bool found_forward = maternal_kmer_set.find(kmer) != maternal_kmer_set.end();
-    bool found_reverse = maternal_kmer_set.find(rc_kmer) != maternal_kmer_set.end();
+    // Zero-initializes the arrays for new components
+    auto& matrix = component_map[component_name];
 
-    return (found_forward or found_reverse);
+    matrix[component_haplotype][paternal_index] += (flags & ParentalKmerTable::paternal_flag) != 0;
+    matrix[component_haplotype][maternal_index] += (flags & ParentalKmerTable::maternal_flag) != 0;
 }
 
 
-template <class T> bool KmerSets<T>::is_paternal(const T& kmer) const{
-    T rc_kmer;
-    get_reverse_complement(kmer, rc_kmer, k);
+template <class T> void KmerSets<T>::add_component_counts(
+        const string& component_name,
+        const array <array <double,2>, 2>& counts) {
+
+    // Zero-initializes the arrays for new components
+    auto& matrix = component_map[component_name];
+
+    for (size_t i=0; i<2; i++){
+        matrix[i][paternal_index] += counts[i][paternal_index];
+        matrix[i][maternal_index] += counts[i][maternal_index];
+    }
+}
+
+
+template <class T> uint8_t KmerSets<T>::get_parental_flags(const packed_kmer_t& canonical_kmer) const{
+    return kmer_table.get_flags(canonical_kmer);
+}
 
-    bool found_forward = paternal_kmer_set.find(kmer) != paternal_kmer_set.end();
-    bool found_reverse = paternal_kmer_set.find(rc_kmer) != paternal_kmer_set.end();
 
-    return (found_forward or found_reverse);
+template <class T> bool KmerSets<T>::is_maternal_canonical(const packed_kmer_t& canonical_kmer) const{
+    return (kmer_table.get_flags(canonical_kmer) & ParentalKmerTable::maternal_flag) != 0;
+}
+
+
+template <class T> bool KmerSets<T>::is_paternal_canonical(const packed_kmer_t& canonical_kmer) const{
+    return (kmer_table.get_flags(canonical_kmer) & ParentalKmerTable::paternal_flag) != 0;
+}
+
+
+template <class T> bool KmerSets<T>::is_maternal(const T& kmer) const{
+    packed_kmer_t packed_kmer;
+    packed_kmer_t canonical_kmer;
+    to_packed_kmer(kmer, packed_kmer);
+    get_canonical(packed_kmer, canonical_kmer, k);
+
+    return is_maternal_canonical(canonical_kmer);
+}
+
+
+template <class T> bool KmerSets<T>::is_paternal(const T& kmer) const{
+    packed_kmer_t packed_kmer;
+    packed_kmer_t canonical_kmer;
+    to_packed_kmer(kmer, packed_kmer);
+    get_canonical(packed_kmer, canonical_kmer, k);
+
+    return is_paternal_canonical(canonical_kmer);
 }
 
 
 template <class T> bool KmerSets<T>::is_maternal(const T& kmer, const T& kmer_reverse_complement) const{
-    bool found_forward = maternal_kmer_set.find(kmer) != maternal_kmer_set.end();
-    bool found_reverse = maternal_kmer_set.find(kmer_reverse_complement) != maternal_kmer_set.end();
+    packed_kmer_t a;
+    packed_kmer_t b;
+    to_packed_kmer(kmer, a);
+    to_packed_kmer(kmer_reverse_complement, b);
 
-    return (found_forward or found_reverse);
+    return is_maternal_canonical(is_lesser(a,b) ? a : b);
 }
 
 
 template <class T> bool KmerSets<T>::is_paternal(const T& kmer, const T& kmer_reverse_complement) const{
-    bool found_forward = paternal_kmer_set.find(kmer) != paternal_kmer_set.end();
-    bool found_reverse = paternal_kmer_set.find(kmer_reverse_complement) != paternal_kmer_set.end();
+    packed_kmer_t a;
+    packed_kmer_t b;
+    to_packed_kmer(kmer, a);
+    to_packed_kmer(kmer_reverse_complement, b);
 
-    return (found_forward or found_reverse);
+    return is_paternal_canonical(is_lesser(a,b) ? a : b);
 }
 
 
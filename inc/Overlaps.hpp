@@ -2,6 +2,7 @@
 #define GFASE_OVERLAPS_HPP
 
 #include "bdsg/hash_graph.hpp"
+#include "sparsepp/spp.h"
 #include <unordered_map>
 #include <string>
 #include <vector>
@@ -12,6 +13,7 @@
 using handlegraph::handle_t;
 using handlegraph::edge_t;
 using std::unordered_map;
+using spp::sparse_hash_map;
 using bdsg::HandleGraph;
 using std::string;
 using std::vector;
@@ -20,6 +22,7 @@ using std::pair;
 
 
 class Cigar; // forward declaration
+class Overlaps; // forward declaration
 
 /*
  * Single operation in a CIGAR string
@@ -35,6 +38,14 @@ public:
     uint32_t ref_length() const;
     uint32_t query_length() const;
     
+    // the same operation with the ref and query roles swapped
+    CigarOperation reverse() const;
+    
+    // pack into 32 bits, with the length in the upper 28 and the type in the lower 4
+    uint32_t pack() const;
+    static CigarOperation unpack(uint32_t packed);
+    static const uint32_t max_packed_length;
+    
 private:
     
     // Map from all possible cigar chars to 0-8
@@ -59,6 +70,7 @@ class Cigar {
 public:
     // parse a CIGAR string
     Cigar(const string& cigar_string);
+    Cigar(vector<CigarOperation>&& operations);
     Cigar() = default;
     ~Cigar() = default;
     
@@ -90,7 +102,52 @@ private:
 };
 
 /*
- * Records overlaps between nodes of a graph
+ * A read-only view of a CIGAR string stored in an Overlaps, in the
+ * orientation that it was requested. Only valid until the Overlaps is modified
+ */
+class CigarView {
+public:
+    CigarView(const uint32_t* operations, uint32_t n_operations, pair<size_t, size_t> lengths, bool reversed);
+    CigarView() = default;
+    ~CigarView() = default;
+    
+    // same interface as Cigar
+    string get_string() const;
+    pair<size_t, size_t> aligned_length() const;
+    bool empty() const;
+    size_t size() const;
+    CigarOperation at(size_t i) const;
+    
+    // copy into a standalone CIGAR
+    Cigar get_cigar() const;
+    
+private:
+    
+    // packed operations, in the stored orientation
+    const uint32_t* operations = nullptr;
+    uint32_t n_operations = 0;
+    // aligned lengths, in the viewed orientation
+    pair<size_t, size_t> lengths = {0, 0};
+    bool reversed = false;
+    
+    friend class Overlaps;
+};
+
+/*
+ * Location of an overlap's CIGAR in the Overlaps arena, along with its
+ * aligned lengths, all in the orientation of the canonical edge
+ */
+class OverlapSpan {
+public:
+    uint32_t offset;
+    uint32_t n_operations;
+    uint32_t ref_length;
+    uint32_t query_length;
+};
+
+/*
+ * Records overlaps between nodes of a graph. The CIGARs are packed into a single
+ * arena of operations, which is indexed by the canonical edge
  */
 class Overlaps {
 public:
@@ -101,6 +158,8 @@ public:
     void record_overlap(const HandleGraph& graph, handle_t a, handle_t b, const string& cigar);
     // record an overlap from an already-parsed CIGAR string
     void record_overlap(const HandleGraph& graph, handle_t a, handle_t b, const Cigar& cigar);
+    // record an overlap from a view, which may come from this Overlaps
+    void record_overlap(const HandleGraph& graph, handle_t a, handle_t b, const CigarView& cigar);
     // remove an overlap if one exists (otherwise do nothing)
     void remove_overlap(const HandleGraph& graph, handle_t a, handle_t b);
     
@@ -114,9 +173,29 @@ public:
     // recorded, then returns an empty CIGAR
     Cigar get_overlap(const HandleGraph& graph, handle_t a, handle_t b) const;
     
+    // as above, but without copying the CIGAR. the view is only valid until
+    // this Overlaps is modified
+    CigarView get_overlap_view(const HandleGraph& graph, handle_t a, handle_t b) const;
+    
+    // the aligned lengths of the (oriented) overlap of a onto b, in the order
+    // (length in a, length in b), without copying the CIGAR. (0, 0) if there is no overlap
+    pair<size_t, size_t> get_overlap_length(const HandleGraph& graph, handle_t a, handle_t b) const;
+    
 private:
     
-    unordered_map<edge_t, Cigar> overlaps;
+    // pack the operations of the overlap of a onto b into the arena, in the orientation
+    // of the canonical edge. get_operation(i) returns the i-th operation of a onto b
+    template<class T> void record_overlap(const HandleGraph& graph, handle_t a, handle_t b, size_t n_operations,
+                                          pair<size_t, size_t> lengths, const T& get_operation);
+    
+    // drop the operations of removed or overwritten overlaps from the arena
+    void compact();
+    
+    sparse_hash_map<edge_t, OverlapSpan> overlaps;
+    vector<uint32_t> operations;
+    
+    // number of operations in the arena that no longer belong to an overlap
+    size_t n_unused = 0;
 };
 
 
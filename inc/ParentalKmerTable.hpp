@@ -0,0 +1,110 @@
+#ifndef GFASE_PARENTALKMERTABLE_HPP
+#define GFASE_PARENTALKMERTABLE_HPP
+
+#include "FixedBinarySequence.hpp"
+#include "Filesystem.hpp"
+
+using ghc::filesystem::path;
+
+#include <cstdint>
+#include <vector>
+#include <array>
+
+using std::vector;
+using std::array;
+
+
+namespace gfase {
+
+
+/// One cache line of slots, so that a probe usually touches a single line and the key comparisons can be unrolled
+class alignas(64) ParentalKmerBucket {
+public:
+    array<packed_kmer_t,4> slots;
+};
+
+
+/// Canonical parental kmers (k <= 63) and which parent(s) they belong to, in one open-addressing table. The
+/// paternal/maternal flags live in the top two bits of each slot's high word, which are never used by a kmer of
+/// k <= 63, and a slot with no flags set is empty. Buckets are probed linearly, and a lookup stops at the first bucket
+/// with an empty slot.
+///
+/// The bucket array is written to disk as-is, so a saved table is loaded with mmap and queried in place (read-only).
+class ParentalKmerTable {
+    vector<ParentalKmerBucket> buckets;
+
+    // Points into `buckets`, or into the mapped file if the table was loaded from disk
+    const ParentalKmerBucket* bucket_data;
+    const char* mapped_data;
+    size_t mapped_length;
+
+    size_t n_entries;
+    uint64_t mask;
+    size_t k;
+
+    // Number of distinct kmers with each flag set, indexed by flag bit
+    array<size_t,2> n_per_flag;
+
+    static const uint64_t flag_shift;
+    static const uint64_t key_mask;
+    static const uint64_t magic;
+    static const uint64_t version;
+
+    void grow();
+    void insert_without_growing(const packed_kmer_t& slot);
+
+    // Insert, probing at most max_buckets buckets. Returns false if no slot was found within them.
+    bool insert_bounded(
+            const packed_kmer_t& canonical_kmer,
+            uint8_t flag,
+            size_t max_buckets,
+            size_t& n_new,
+            array<size_t,2>& n_new_per_flag);
+
+    // Insert many kmers with one flag, using multiple threads on disjoint ranges of the table
+    void insert_in_parallel(vector <vector<packed_kmer_t> >& kmers, uint8_t flag, size_t n_threads);
+    void unmap();
+
+public:
+    /// Attributes ///
+    static const uint8_t paternal_flag;
+    static const uint8_t maternal_flag;
+    static const size_t max_k;
+
+    /// Methods ///
+    ParentalKmerTable();
+    ParentalKmerTable(path binary_path);
+    ParentalKmerTable(const ParentalKmerTable& other) = delete;
+    ParentalKmerTable& operator=(const ParentalKmerTable& other) = delete;
+    ~ParentalKmerTable();
+
+    void reserve(size_t n);
+
+    // Add flag to the kmer's existing flags, inserting it if it is new. Kmer must already be canonical.
+    void insert(const packed_kmer_t& canonical_kmer, uint8_t flag);
+
+    // Flags of a canonical kmer, or 0 if it is absent
+    uint8_t get_flags(const packed_kmer_t& canonical_kmer) const;
+
+    // Number of distinct kmers with the given flag set
+    size_t count(uint8_t flag) const;
+
+    size_t size() const;
+    size_t get_k() const;
+    size_t get_memory_usage() const;
+    bool is_mapped() const;
+    void clear();
+
+    // Parse a FASTA of kmers, or a plain list with one kmer per line (anything after the first whitespace on a line,
+    // such as a count, is ignored). Lines are parsed and canonicalized in parallel, then inserted with the given flag.
+    // Returns the number of kmers read.
+    size_t load_kmers_from_text(path text_path, uint8_t flag, size_t n_threads);
+
+    void write_to_binary(path output_path) const;
+    void load_from_binary(path binary_path);
+};
+
+
+}
+
+#endif //GFASE_PARENTALKMERTABLE_HPP
@@ -18,7 +18,12 @@
 #include "bdsg/hash_graph.hpp"
 #include "bdsg/overlays/packed_subgraph_overlay.hpp"
 
+#include <exception>
+#include <thread>
+#include <atomic>
 #include <string>
+#include <mutex>
+#include <tuple>
 
 using ghc::filesystem::path;
 
@@ -30,7 +35,15 @@ using handlegraph::path_handle_t;
 using handlegraph::step_handle_t;
 using handlegraph::handle_t;
 
+using std::current_exception;
+using std::rethrow_exception;
+using std::exception_ptr;
+using std::lock_guard;
 using std::string;
+using std::thread;
+using std::atomic;
+using std::mutex;
+using std::tuple;
 using std::cout;
 using std::cerr;
 
@@ -55,40 +68,142 @@ namespace gfase {
 //void phase_k(path gfa_path, size_t k, path paternal_kmers, path maternal_kmers, char path_delimiter);
 
 
+/// Count the parental kmers in the haploid regions of each diploid path, and add them to the component matrices in
+/// `ks`. Paths are distributed over threads, and each thread accumulates into its own matrices (indexed by component
+/// ID) which are summed at the end, so the kmer table is the only thing shared between threads and it is read-only.
+/// Paths shorter than min_path_length are skipped.
 template <class T, size_t T2> void count_kmers(
         const PathHandleGraph& graph,
         const IncrementalIdMap<string>& id_map,
         const unordered_map<string,string>& diploid_path_names,
         KmerSets <FixedBinarySequence <T,T2> >& ks,
         size_t k,
-        char path_delimiter) {
+        char path_delimiter,
+        size_t n_threads=1,
+        size_t min_path_length=0) {
+
+    // TODO: stop using names entirely!!
+    // TODO: stop using names entirely!!
+    // TODO: stop using names entirely!!
+    // Resolve all the names up front, so the threads only deal in integer IDs
+    IncrementalIdMap<string> component_ids(true);
+    vector <tuple <path_handle_t, int64_t, size_t> > jobs;
 
-    // Iterate paths and for each node, collect kmers if node is only covered by one path
     for (auto& [path_name, other_path_name]: diploid_path_names) {
         auto p = graph.get_path_handle(path_name);
-        HaplotypePathKmer kmer(graph, p, k);
+
+        if (min_path_length > 0){
+            uint64_t path_length = 0;
+            graph.for_each_step_in_path(p, [&](const step_handle_t& s){
+                path_length += graph.get_length(graph.get_handle_of_step(s));
+            });
+
+            if (path_length < min_path_length){
+                continue;
+            }
+        }
 
         string component_name;
         size_t haplotype;
 
-        // TODO: stop using names entirely!!
-        // TODO: stop using names entirely!!
-        // TODO: stop using names entirely!!
         tie(component_name, haplotype) = parse_path_string(path_name, path_delimiter);
 
-        kmer.for_each_haploid_kmer([&](const deque<char>& sequence){
+        jobs.emplace_back(p, component_ids.try_insert(component_name), haplotype);
+    }
+
+    // < component_id,  [component_hap_path][parent_hap_index] >
+    typedef vector <array <array <uint64_t,2>, 2> > count_matrices_t;
+
+    n_threads = max(size_t(1), n_threads);
+
+    vector<count_matrices_t> thread_counts(n_threads);
+    atomic<size_t> job_index = 0;
+    exception_ptr first_exception = nullptr;
+    mutex exception_mutex;
+
+    auto thread_fn = [&](size_t thread_index){
+        auto& counts = thread_counts[thread_index];
+        counts.resize(component_ids.size(), {{{0,0},{0,0}}});
+
+        size_t i = job_index.fetch_add(1);
+
+        while (i < jobs.size()){
+            auto& [p, component_id, haplotype] = jobs[i];
+            auto& matrix = counts[component_id][haplotype];
+
             try {
-                FixedBinarySequence<T, T2> s(sequence);
+                HaplotypePathKmer kmer(graph, p, k);
 
-                // Compare kmer to parental kmers
-                ks.increment_parental_kmer_count(component_name, haplotype, s);
+                try {
+                    kmer.for_each_haploid_kmer([&](const packed_kmer_t& canonical_kmer){
+                        // Compare kmer to parental kmers
+                        auto flags = ks.get_parental_flags(canonical_kmer);
+
+                        matrix[ks.paternal_index] += (flags & ParentalKmerTable::paternal_flag) != 0;
+                        matrix[ks.maternal_index] += (flags & ParentalKmerTable::maternal_flag) != 0;
+                    });
+                }
+                catch(exception& e){
+                    auto node_name = id_map.get_name(graph.get_id(graph.get_handle_of_step(kmer.get_step_of_kmer_end())));
+
+                    {
+                        lock_guard<mutex> lock(exception_mutex);
+                        cerr << e.what() << '\n';
+                    }
+
+                    throw runtime_error("Error parsing sequence for node: " + node_name);
+                }
             }
-            catch(exception& e){
-                auto node_name = id_map.get_name(graph.get_id(graph.get_handle_of_step(kmer.get_step_of_kmer_end())));
-                cerr << e.what() << '\n';
-                throw runtime_error("Error parsing sequence for node: " + node_name);
+            catch(...){
+                lock_guard<mutex> lock(exception_mutex);
+
+                if (not first_exception){
+                    first_exception = current_exception();
+                }
+
+                // Stop handing out jobs
+                job_index = jobs.size();
+                return;
             }
-        });
+
+            i = job_index.fetch_add(1);
+        }
+    };
+
+    vector<thread> threads;
+
+    // Launch threads
+    for (uint64_t i=0; i<n_threads; i++){
+        try {
+            threads.emplace_back(thread_fn, i);
+        } catch (const exception &e) {
+            cerr << e.what() << "\n";
+            exit(1);
+        }
+    }
+
+    // Wait for threads to finish
+    for (auto& t: threads){
+        t.join();
+    }
+
+    if (first_exception){
+        rethrow_exception(first_exception);
+    }
+
+    // Reduce the per-thread matrices
+    for (int64_t id=0; id<int64_t(component_ids.size()); id++){
+        array <array <double,2>, 2> matrix = {{{0,0},{0,0}}};
+
+        for (auto& counts: thread_counts){
+            for (size_t i=0; i<2; i++){
+                for (size_t j=0; j<2; j++){
+                    matrix[i][j] += double(counts[id][i][j]);
+                }
+            }
+        }
+
+        ks.add_component_counts(component_ids.get_name(id), matrix);
     }
 }
 
@@ -149,7 +264,7 @@ void for_element_in_bubble_chain(
 
 
 template <class T, size_t T2>
-void phase(path gfa_path, size_t k, path paternal_kmers, path maternal_kmers, path output_directory, char path_delimiter) {
+void phase(path gfa_path, size_t k, path paternal_kmers, path maternal_kmers, path output_directory, char path_delimiter, size_t n_threads) {
     if (exists(output_directory)){
         throw runtime_error("ERROR: output directory exists already");
     }
@@ -165,7 +280,7 @@ void phase(path gfa_path, size_t k, path paternal_kmers, path maternal_kmers, pa
     HashGraph graph;
     IncrementalIdMap<string> id_map;
     Overlaps overlaps;
-    KmerSets <FixedBinarySequence <T, T2> > ks(paternal_kmers, maternal_kmers);
+    KmerSets <FixedBinarySequence <T, T2> > ks(paternal_kmers, maternal_kmers, path_delimiter, n_threads);
 
     if (ks.get_k() != k){
         throw runtime_error("ERROR: kmers in file " + to_string(ks.get_k()) + " do not match k " + to_string(k));
@@ -173,7 +288,7 @@ void phase(path gfa_path, size_t k, path paternal_kmers, path maternal_kmers, pa
 
     cerr << "Loading GFA..." << '\n';
 
-    gfa_to_handle_graph(graph, id_map, overlaps, gfa_path, false);
+    gfa_to_handle_graph(graph, id_map, overlaps, gfa_path, false, false, n_threads);
 
     cerr << "\tNumber of components in graph: " << graph.get_path_count() << '\n';
 
@@ -191,7 +306,7 @@ void phase(path gfa_path, size_t k, path paternal_kmers, path maternal_kmers, pa
 
     cerr << "Iterating path kmers..." << '\n';
 
-    count_kmers(graph, id_map, diploid_path_names, ks, k, path_delimiter);
+    count_kmers(graph, id_map, diploid_path_names, ks, k, path_delimiter, n_threads);
 
     cerr << "Un-extending paths..." << '\n';
 
@@ -502,7 +617,7 @@ void phase(path gfa_path, size_t k, path paternal_kmers, path maternal_kmers, pa
 }
 
 
-void phase_k(path gfa_path, size_t k, path paternal_kmers, path maternal_kmers, path output_directory, char path_delimiter='.');
+void phase_k(path gfa_path, size_t k, path paternal_kmers, path maternal_kmers, path output_directory, char path_delimiter='.', size_t n_threads=1);
 
 
 }
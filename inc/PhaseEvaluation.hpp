@@ -0,0 +1,94 @@
+#ifndef GFASE_PHASEEVALUATION_HPP
+#define GFASE_PHASEEVALUATION_HPP
+
+#include "ContactStore.hpp"
+#include "Filesystem.hpp"
+
+using ghc::filesystem::path;
+
+#include <functional>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using std::function;
+using std::string;
+using std::vector;
+
+
+namespace gfase {
+
+
+class Histogram{
+public:
+    vector<int32_t> frequencies;
+    size_t max_value;
+    size_t bin_size;
+
+    Histogram(size_t max_value, size_t bin_size);
+    void for_each_item(const function<void(size_t value, int32_t frequency)>& f) const;
+    void get_reverse_cdf(vector<int32_t>& cdf) const;
+    void update(size_t value);
+    void update(size_t value, int32_t count);
+
+    // Add the frequencies of another histogram with the same max_value and bin_size
+    void merge(const Histogram& other);
+    void write_to_csv(path output_path) const;
+};
+
+
+/// Contacts between contigs scored against a phasing. A contact is consistent if both contigs are phased (nonzero)
+/// and in the same phase, and inconsistent if they are phased differently. Contacts are binned by the lower of the
+/// two mapqs, so that the reverse CDF gives the number of contacts passing each mapq threshold.
+class ContactEvaluation{
+public:
+    Histogram n_consistent_contacts;
+    Histogram n_inconsistent_contacts;
+
+    // Only available when evaluating from alignments
+    Histogram subread_lengths;
+    Histogram subread_counts;
+    Histogram gap_lengths;
+    Histogram mapqs;
+    size_t total_alignments;
+
+    ContactEvaluation();
+
+    void update(int8_t phase_a, int8_t phase_b, uint8_t mapq, int32_t count=1);
+    void merge(const ContactEvaluation& other);
+
+    // Writes phasing_summary.csv, and also contacts_summary.csv, subread_lengths.csv, subread_counts.csv,
+    // gap_lengths.csv and mapq.csv if any alignments were counted
+    void write_to_directory(path output_dir) const;
+};
+
+
+/// Read a CSV of name,phase (any further columns are ignored)
+void for_each_item_in_phase_csv(path csv_path, const function<void(const string& name, int8_t phase)>& f);
+
+
+/// Score the contacts of every read in a BAM in one pass, as in parse_unpaired_bam_file (only primary alignments with
+/// at least min_mapq are used, so secondary and supplementary alignments are not counted in any of the statistics).
+/// Subread lengths are the aligned length of each alignment on its read, and gap lengths are the distances between
+/// the midpoints of a read's alignments to the same contig. Phases are looked up once per reference, and each worker
+/// thread accumulates its own evaluation, which are merged at the end.
+void evaluate_contacts(
+        path bam_path,
+        const function<int8_t(const string& name)>& get_phase,
+        int8_t min_mapq,
+        size_t n_threads,
+        path temp_dir,
+        ContactEvaluation& evaluation);
+
+
+/// Score the contacts of a ContactStore, without any alignments. Each of the store's mapq bins is counted at its lower
+/// bound, so the mapq thresholds are only exact at the bin boundaries.
+void evaluate_contacts(
+        const ContactStore& contacts,
+        const function<int8_t(const string& name)>& get_phase,
+        ContactEvaluation& evaluation);
+
+
+}
+
+#endif //GFASE_PHASEEVALUATION_HPP
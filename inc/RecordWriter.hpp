@@ -0,0 +1,61 @@
+#ifndef GFASE_RECORDWRITER_HPP
+#define GFASE_RECORDWRITER_HPP
+
+#include "htslib/include/htslib/bgzf.h"
+#include "Filesystem.hpp"
+
+using ghc::filesystem::path;
+
+#include <functional>
+#include <fstream>
+#include <string>
+
+using std::function;
+using std::ofstream;
+using std::string;
+
+
+namespace gfase {
+
+
+/// A text file which is written in large blocks, either uncompressed or as bgzip (BGZF) compressed text, which can be
+/// read with gzip and indexed with samtools faidx. Records can be formatted concurrently with write_records, and
+/// they are always written in order.
+class RecordWriter {
+    path output_path;
+    ofstream file;
+    BGZF* bgzf_file;
+
+    // Roughly how many bytes each thread formats before a round of buffers is written
+    static const size_t buffer_size;
+
+public:
+    // With n_threads > 1, compression is also done by htslib in n_threads
+    RecordWriter(path output_path, bool compress=false, size_t n_threads=1);
+    ~RecordWriter();
+
+    RecordWriter(const RecordWriter& other) = delete;
+    RecordWriter& operator=(const RecordWriter& other) = delete;
+
+    void write(const string& buffer);
+
+    // Format the records [0, n_records) with append_record, which must be thread safe. Each thread appends a
+    // contiguous block of records to its own buffer, and the buffers are written in order.
+    void write_records(size_t n_records, size_t n_threads, const function<void(size_t i, string& buffer)>& append_record);
+
+    // Flush all the buffered/compressed data and close the file, throwing on any error
+    void close();
+};
+
+
+/// Appends ".gz" if the output is to be compressed
+path get_output_path(path output_path, bool compress);
+
+
+/// Wrap the sequence into lines of line_width bases, or none if line_width is 0
+void append_fasta_record(string& buffer, const string& name, const string& sequence, size_t line_width=0);
+
+
+}
+
+#endif //GFASE_RECORDWRITER_HPP
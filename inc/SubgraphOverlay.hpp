@@ -4,13 +4,16 @@
 #include "bdsg/hash_graph.hpp"
 
 #include <unordered_set>
+#include <cstdint>
 #include <string>
+#include <vector>
 
 using bdsg::HandleGraph;
 using bdsg::nid_t;
 using bdsg::handle_t;
 using std::string;
 using std::unordered_set;
+using std::vector;
 
 namespace gfase {
 
@@ -100,6 +103,100 @@ protected:
 };
 
 
+
+/**
+ * A SubgraphOverlay that owns a copy of its node subset, held as a sorted member list and,
+ * when the IDs are dense enough, a bitmap over the ID range. Membership checks during edge
+ * traversal are a bit test rather than a hash lookup, handles are iterated in ID order, and
+ * parallel iteration is over the member list.
+ */
+class BitmapSubgraphOverlay : virtual public HandleGraph {
+
+public:
+    /**
+     * Make a new BitmapSubgraphOverlay. The backing graph must not be modified
+     * while the overlay exists, but the subset can be discarded.
+     */
+    BitmapSubgraphOverlay(const HandleGraph* backing, const unordered_set<nid_t>& node_subset);
+    
+    /**
+     * Make a new BitmapSubgraphOverlay from a list of distinct node IDs, taking ownership of it
+     */
+    BitmapSubgraphOverlay(const HandleGraph* backing, vector<nid_t>&& node_subset);
+
+    ~BitmapSubgraphOverlay() = default;
+
+    ////////////////////////////////////////////////////////////////////////////
+    // Handle-based interface
+    ////////////////////////////////////////////////////////////////////////////
+
+    /// Method to check if a node exists by ID
+    bool has_node(nid_t node_id) const;
+   
+    /// Look up the handle for the node with the given ID in the given orientation
+    handle_t get_handle(const nid_t& node_id, bool is_reverse = false) const;
+    
+    /// Get the ID from a handle
+    nid_t get_id(const handle_t& handle) const;
+    
+    /// Get the orientation of a handle
+    bool get_is_reverse(const handle_t& handle) const;
+    
+    /// Invert the orientation of a handle (potentially without getting its ID)
+    handle_t flip(const handle_t& handle) const;
+    
+    /// Get the length of a node
+    size_t get_length(const handle_t& handle) const;
+    
+    /// Get the sequence of a node, presented in the handle's local forward
+    /// orientation.
+    string get_sequence(const handle_t& handle) const;
+    
+    /// Return the number of nodes in the graph
+    size_t get_node_count() const;
+    
+    /// Return the smallest ID in the graph. Return value is unspecified if the graph is empty.
+    nid_t min_node_id() const;
+    
+    /// Return the largest ID in the graph. Return value is unspecified if the graph is empty.
+    nid_t max_node_id() const;
+
+protected:
+    
+    /// Loop over all the handles to next/previous (right/left) nodes. Passes
+    /// them to a callback which returns false to stop iterating and true to
+    /// continue. Returns true if we finished and false if we stopped early.
+    bool follow_edges_impl(const handle_t& handle, bool go_left, const std::function<bool(const handle_t&)>& iteratee) const;
+    
+    /// Loop over all the nodes in the graph in their local forward
+    /// orientations, in ID order. Stop if the iteratee returns false. Can be
+    /// told to run in parallel, in which case stopping after a false return
+    /// value is on a best-effort basis and iteration order is not defined.
+    /// Returns true if we finished and false if we stopped early.
+    bool for_each_handle_impl(const std::function<bool(const handle_t&)>& iteratee, bool parallel = false) const;
+
+private:
+    
+    /// sort the members and build the bitmap
+    void index_members();
+
+protected:
+
+    /// the backing graph
+    const HandleGraph* backing_graph;
+
+    /// the IDs of the nodes in the subgraph, sorted
+    vector<nid_t> members;
+    
+    /// bit i is set if the node with ID min_node + i is in the subgraph. left empty if the IDs
+    /// are too sparse for it to be smaller than the member list, in which case the member list
+    /// is binary searched instead
+    vector<uint64_t> bitmap;
+    
+    nid_t min_node = 0;
+    nid_t max_node = 0;
+};
+
 }
 
 #endif // GFASE_SUBGRAPH_OVERLAY_HPP_INCLUDED
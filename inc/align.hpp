@@ -35,6 +35,22 @@ void print_minimap_alignment_block(
         const string& query);
 
 
+void set_minimap_options(mm_idxopt_t& index_options, mm_mapopt_t& map_options);
+
+
+mm_idx_t* build_minimap_index(const mm_idxopt_t& index_options, const string& target_name, const string& target_sequence);
+
+
+// Map one query to an existing index, using a thread buffer that belongs to the calling thread
+void map_sequence(
+        const mm_idx_t* mi,
+        const mm_mapopt_t& map_options,
+        mm_tbuf_t* tbuf,
+        const string& query_name,
+        const string& query_sequence,
+        AlignmentChain& result);
+
+
 void map_sequence_pair(
         const string& target_name,
         const string& target_sequence,
@@ -49,8 +65,7 @@ void construct_alignment_graph(
         const IncrementalIdMap<string>& id_map,
         MultiContactGraph& alignment_graph,
         double min_similarity,
-        mutex& output_mutex,
-        atomic<size_t>& global_index);
+        size_t n_threads);
 
 
 void get_alignment_candidates(
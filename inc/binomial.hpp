@@ -2,12 +2,55 @@
 #define GFASE_BINOMIAL_HPP
 
 #include <cinttypes>
+#include <vector>
+
+using std::vector;
 
 namespace gfase{
 
+double log_sum_exp(double a, double b);
+double log_binomial_coefficient(double n, double k);
+double log_binomial(double p, double n, double k);
+
 double binomial_coefficient(double n, double k);
 double binomial(double p, double n, double k);
 
+
+/// Precomputed log-space probabilities for Binomial(n,p), so that repeated queries for the same n (e.g. per edge
+/// for a fixed sample size) are O(1) lookups and don't overflow for large n
+class BinomialTable {
+    vector<double> log_pmf;
+    vector<double> log_lower_tail;
+    vector<double> log_upper_tail;
+    int64_t n;
+    double p;
+
+    void assert_in_range(int64_t k) const;
+
+public:
+    BinomialTable(int64_t n, double p=0.5);
+
+    int64_t get_n() const;
+    double get_p() const;
+
+    // P(X = k)
+    double get_log_probability(int64_t k) const;
+    double get_probability(int64_t k) const;
+
+    // P(X <= k) and P(X >= k)
+    double get_log_lower_tail(int64_t k) const;
+    double get_log_upper_tail(int64_t k) const;
+    double get_lower_tail(int64_t k) const;
+    double get_upper_tail(int64_t k) const;
+
+    // Doubled smaller tail, capped at 1
+    double get_two_sided_p_value(int64_t k) const;
+
+    // Batch versions of the above, for evaluating many observations against the same distribution
+    void get_probabilities(const vector<int64_t>& ks, vector<double>& result) const;
+    void get_two_sided_p_values(const vector<int64_t>& ks, vector<double>& result) const;
+};
+
 }
 
 #endif //GFASE_BINOMIAL_HPP
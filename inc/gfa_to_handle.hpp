@@ -35,7 +35,8 @@ void gfa_to_handle_graph(
         Overlaps& overlaps,
         path gfa_file_path,
         bool ignore_singleton_paths=true,
-        bool ignore_paths=false
+        bool ignore_paths=false,
+        size_t n_threads=1
         );
 
 
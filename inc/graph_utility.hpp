@@ -13,7 +13,13 @@
 #include "bdsg/hash_graph.hpp"
 
 #include <functional>
+#include <algorithm>
+#include <exception>
+#include <limits>
 #include <string>
+#include <thread>
+#include <atomic>
+#include <mutex>
 #include <queue>
 
 using gfase::IncrementalIdMap;
@@ -28,7 +34,10 @@ using bdsg::step_handle_t;
 using bdsg::handle_t;
 using bdsg::HashGraph;
 
+using std::exception;
 using std::string;
+using std::thread;
+using std::atomic;
 using std::queue;
 using std::cout;
 using std::cerr;
@@ -77,6 +86,10 @@ void for_edge_in_bfs(
         nid_t start_node,
         const function<void(const handle_t& handle_a, const handle_t& handle_b)>& f);
 
+// Find the connected components with a union-find over the edges, using n_threads. Components are in the order of
+// their first node in the graph's handle iteration, and so are the forward handles within each component.
+void find_connected_components(const HandleGraph& graph, size_t n_threads, vector <vector<handle_t> >& components);
+
 void for_each_connected_component(HandleGraph& graph, const function<void(unordered_set<nid_t>& connected_component)>& f);
 
 void for_each_connected_component_subgraph(HandleGraph& graph, const function<void(const HandleGraph& subgraph)>& f);
@@ -108,11 +121,21 @@ void split_connected_components(
         vector<HashGraph>& graphs,
         bool delete_visited_components);
 
+void write_connected_component_to_gfa(
+        const PathHandleGraph& graph,
+        const IncrementalIdMap<string>& id_map,
+        const Overlaps& overlaps,
+        const vector<handle_t>& component,
+        path output_path);
+
+// Write each component to output_directory/component_i.gfa, numbered from the longest (by total sequence length) to
+// the shortest. Components are written concurrently, longest first, using n_threads.
 void write_connected_components_to_gfas(
         const MutablePathDeletableHandleGraph& graph,
         const IncrementalIdMap<string>& id_map,
         const Overlaps& overlaps,
-        path output_directory);
+        path output_directory,
+        size_t n_threads=1);
 
 void run_command(string& argument_string);
 
@@ -146,7 +169,15 @@ void un_extend_paths(
         const vector <pair<path_handle_t, handle_t> >& to_be_prepended,
         const vector <pair<path_handle_t, handle_t> >& to_be_appended);
 
-void unzip(MutablePathDeletableHandleGraph& graph, IncrementalIdMap<string>& id_map, Overlaps& overlaps, bool keep_paths=false, bool delete_islands=true);
+// Replace each path with a single node containing its concatenated sequence (with overlaps trimmed). The path
+// sequences are built using n_threads threads, and then the graph is modified serially, in path order.
+void unzip(
+        MutablePathDeletableHandleGraph& graph,
+        IncrementalIdMap<string>& id_map,
+        Overlaps& overlaps,
+        bool keep_paths=false,
+        bool delete_islands=true,
+        size_t n_threads=1);
 
 void for_each_tip(const HandleGraph& graph, const function<void(const handle_t& h, bool is_left, bool is_right)>& f);
 
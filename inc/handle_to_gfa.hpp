@@ -4,8 +4,13 @@
 #include "handlegraph/path_handle_graph.hpp"
 #include "handlegraph/handle_graph.hpp"
 #include "IncrementalIdMap.hpp"
+#include "Filesystem.hpp"
 #include "Overlaps.hpp"
 #include <fstream>
+#include <string>
+#include <vector>
+
+using ghc::filesystem::path;
 
 using handlegraph::PathHandleGraph;
 using handlegraph::HandleGraph;
@@ -15,6 +20,7 @@ using handlegraph::edge_t;
 using std::runtime_error;
 using std::ostream;
 using std::string;
+using std::vector;
 
 
 namespace gfase {
@@ -26,20 +32,39 @@ void write_node_to_gfa(const HandleGraph& graph, const handle_t& node, ostream&
 
 void write_node_to_gfa(const HandleGraph& graph, const IncrementalIdMap<string>& id_map, const handle_t& node, ostream& output_file);
 
+void append_node_to_gfa(const HandleGraph& graph, const IncrementalIdMap<string>& id_map, const handle_t& node, string& buffer);
+
 void write_edge_to_gfa(const HandleGraph& graph, const Overlaps& overlaps, const edge_t& edge, ostream& output_file);
 
 void write_edge_to_gfa(const HandleGraph& graph, const IncrementalIdMap<string>& id_map, const Overlaps& overlaps, const edge_t& edge, ostream& output_file);
 
+void append_edge_to_gfa(const HandleGraph& graph, const IncrementalIdMap<string>& id_map, const Overlaps& overlaps, const edge_t& edge, string& buffer);
+
 void write_path_to_gfa(
         const PathHandleGraph& graph,
         const IncrementalIdMap<string>& id_map,
         const path_handle_t& path,
         ostream& output_file);
 
+void append_path_to_gfa(
+        const PathHandleGraph& graph,
+        const IncrementalIdMap<string>& id_map,
+        const path_handle_t& path,
+        string& buffer);
+
 void handle_graph_to_gfa(const HandleGraph& graph, ostream& output_gfa);
 
 void handle_graph_to_gfa(const PathHandleGraph& graph, const IncrementalIdMap<string>& id_map, const Overlaps& overlaps, ostream& output_gfa);
 
+// Records are formatted concurrently and written in order, with bgzip compression if compress is set
+void handle_graph_to_gfa(
+        const PathHandleGraph& graph,
+        const IncrementalIdMap<string>& id_map,
+        const Overlaps& overlaps,
+        path output_path,
+        bool compress,
+        size_t n_threads);
+
 }
 
 #endif //GFASE_HANDLE_TO_GFA_HPP
@@ -55,6 +55,8 @@ string join(const vector <string>& s, char delimiter=' ');
 
 void run_command(const string& argument_string);
 
+// Run the minimap2 and samtools binaries. assign_phases aligns in-process now, these produce the equivalent BAM inputs
+// (used by test_assign_phase to check that both give the same result).
 path align(path output_dir, path ref_path, path query_path, size_t n_threads);
 
 path sam_to_sorted_bam(path sam_path, size_t n_threads, bool remove_sam=true);
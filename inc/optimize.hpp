@@ -4,6 +4,7 @@
 #include "VectorMultiContactGraph.hpp"
 #include "MultiContactGraph.hpp"
 
+#include <random>
 
 namespace gfase{
 
@@ -27,8 +28,31 @@ public:
 void random_phase_search(VectorMultiContactGraph& contact_graph, size_t m_iterations);
 
 
+void compute_spectral_partitions(
+        const VectorMultiContactGraph& contact_graph,
+        vector <pair <int32_t,int8_t> >& partitions,
+        size_t n_threads,
+        size_t max_iterations=300);
+
+
+void compute_spectral_partitions(
+        const VectorMultiContactGraph& contact_graph,
+        vector <pair <int32_t,int8_t> >& partitions,
+        std::mt19937& rng,
+        size_t n_threads,
+        size_t max_iterations=300);
+
+
+void seed_partitions(
+        VectorMultiContactGraph& contact_graph,
+        const vector <pair <int32_t,int8_t> >& partitions,
+        double noise);
+
+
 void sample_with_threads(
         vector<VectorMultiContactGraph>& contact_graphs_per_thread,
+        const vector <pair <int32_t,int8_t> >& spectral_partitions,
+        double spectral_noise,
         size_t core_iterations,
         atomic<size_t>& job_index);
 
@@ -38,7 +62,9 @@ void sample_orientation_distribution(
         MultiContactGraph& contact_graph,
         size_t sample_size,
         size_t n_threads,
-        size_t core_iterations
+        size_t core_iterations,
+        bool use_spectral_init=false,
+        double spectral_noise=0.05
 );
 
 
@@ -49,7 +75,9 @@ void monte_carlo_phase_contacts(
         size_t sample_size,
         size_t n_rounds,
         size_t n_threads,
-        path output_dir
+        path output_dir,
+        bool use_spectral_init=false,
+        double spectral_noise=0.05
 );
 
 
@@ -1,12 +1,34 @@
 #include "Bam.hpp"
+#include "MurmurHash2.hpp"
 
+#include <condition_variable>
+#include <exception>
+#include <algorithm>
+#include <cstring>
 #include <stdexcept>
 #include <iostream>
+#include <thread>
 #include <vector>
+#include <deque>
+#include <mutex>
 
+using ghc::filesystem::create_directories;
+using ghc::filesystem::exists;
+using std::condition_variable;
 using std::runtime_error;
+using std::unique_lock;
+using std::lock_guard;
+using std::to_string;
+using std::ifstream;
+using std::ofstream;
+using std::thread;
+using std::atomic;
 using std::vector;
+using std::sort;
+using std::deque;
+using std::mutex;
 using std::cerr;
+using std::max;
 
 
 namespace gfase{
@@ -30,6 +52,26 @@ Bam::Bam(path bam_path):
 }
 
 
+/// Open a BAM with a pool of BGZF decompression threads attached to it
+Bam::Bam(path bam_path, size_t n_threads):
+    Bam(bam_path)
+{
+    if (n_threads > 1){
+        if (hts_set_threads(bam_file, int(n_threads)) != 0){
+            throw runtime_error("ERROR: could not create thread pool for bam file: " + bam_path.string());
+        }
+    }
+}
+
+
+/// Iterate the raw records without copying any fields, the pointer is only valid for the duration of the call
+void Bam::for_alignment_in_bam(const function<void(const bam1_t* alignment)>& f){
+    while (sam_read1(bam_file, bam_header, alignment) >= 0){
+        f(alignment);
+    }
+}
+
+
 void Bam::for_alignment_in_bam(const function<void(const string& ref_name, const string& query_name, uint8_t map_quality, uint16_t flag)>& f){
     while (sam_read1(bam_file, bam_header, alignment) >= 0){
         string query_name = bam_get_qname(alignment);
@@ -193,81 +235,695 @@ bool Bam::is_supplementary(uint16_t flag){
 }
 
 
-template <class T> void update_contact_map(
-        const vector<T>& alignments,
-        MultiContactGraph& contact_graph,
-        IncrementalIdMap<string>& id_map){
+size_t Bam::get_ref_count() const{
+    return size_t(bam_header->n_targets);
+}
+
 
-    // Iterate one triangle of the all-by-all matrix, adding up mapqs for reads on both end of the pair
-    for (size_t i=0; i<alignments.size(); i++){
-        auto& a = alignments[i];
-        auto ref_id_a = int32_t(id_map.try_insert(a.ref_name));
-        contact_graph.try_insert_node(ref_id_a, 0);
+/// Batch of name-grouped alignments, groups are delimited by [group_starts[i], group_starts[i+1])
+class TidAlignmentBatch {
+public:
+    vector<TidAlignment> alignments;
+    vector<AlignmentSpan> spans;
+    vector<size_t> group_starts;
 
-        contact_graph.increment_coverage(ref_id_a, 1);
+    TidAlignmentBatch():
+        alignments(),
+        spans(),
+        group_starts({0})
+    {}
+};
 
-        for (size_t j=i+1; j<alignments.size(); j++) {
-            auto& b = alignments[j];
-            auto ref_id_b = int32_t(id_map.try_insert(b.ref_name));
-            contact_graph.try_insert_node(ref_id_b, 0);
-            contact_graph.try_insert_edge(ref_id_a, ref_id_b);
-            contact_graph.increment_edge_weight(ref_id_a, ref_id_b, 1);
+
+/// Reference and query coordinates from the CIGAR, the same way as for FullAlignmentBlock
+AlignmentSpan get_alignment_span(const bam1_t* a){
+    int32_t start_clip = 0;
+    int32_t end_clip = 0;
+    int32_t query_length = 0;
+    int32_t ref_length = 0;
+
+    auto cigar_ptr = bam_get_cigar(a);
+
+    for (uint32_t i=0; i<a->core.n_cigar; i++){
+        char type = bam_cigar_opchr(cigar_ptr[i]);
+        auto length = int32_t(bam_cigar_oplen(cigar_ptr[i]));
+
+        if (type == 'M' or type == '=' or type == 'X'){
+            query_length += length;
+            ref_length += length;
         }
+        else if (type == 'I'){
+            query_length += length;
+        }
+        else if (type == 'D'){
+            ref_length += length;
+        }
+        else if (type == 'S' or type == 'H'){
+            if (i == 0){
+                start_clip = length;
+            }
+            else{
+                end_clip = length;
+            }
+        }
+    }
+
+    AlignmentSpan span;
+    span.ref_start = a->core.pos;
+    span.ref_stop = a->core.pos + ref_length;
+
+    if (bam_is_rev(a)){
+        span.query_start = end_clip;
+    }
+    else{
+        span.query_start = start_clip;
     }
+
+    span.query_stop = span.query_start + query_length;
+
+    return span;
 }
 
 
-void parse_unpaired_bam_file(
-        path bam_path,
-        MultiContactGraph& contact_graph,
-        IncrementalIdMap<string>& id_map,
-        string required_prefix,
-        int8_t min_mapq){
+/// Header declares "SO:coordinate", so alignments of the same read are not adjacent
+bool Bam::is_coordinate_sorted() const{
+    string header_text = sam_hdr_str(bam_header);
+
+    // Only the @HD line (always first, if present) carries the sort order
+    if (header_text.compare(0, 3, "@HD") != 0){
+        return false;
+    }
+
+    auto hd_line = header_text.substr(0, header_text.find('\n'));
+
+    return hd_line.find("\tSO:coordinate") != string::npos;
+}
+
 
-    Bam reader(bam_path);
+/// Only primary alignments with mapq >= min_mapq on references marked in valid_tids can contribute contacts
+bool Bam::is_usable_for_contacts(const bam1_t* a, const vector<bool>& valid_tids, int8_t min_mapq) const{
+    auto tid = a->core.tid;
 
-    size_t l = 0;
-    string prev_query_name = "";
-    vector<SamElement> alignments;
+    // Unmapped, or no information about reference contig, this alignment is unusable
+    if (tid < 0 or tid >= bam_header->n_targets or not valid_tids[tid]){
+        return false;
+    }
+
+    // Only allow reads with mapq > min_mapq and not secondary
+    if (int(a->core.qual) < int(min_mapq) or is_not_primary(a->core.flag)){
+        return false;
+    }
+
+    return true;
+}
+
+
+/// Iterate all the usable alignments of each read (see is_usable_for_contacts) as one group. Name-grouped input is
+/// streamed directly, coordinate sorted input is first grouped on disk (see for_read_group_in_sorted_bam), in which
+/// case temp_dir is used for intermediate files (system temp directory if empty). Groups are handed to n_threads
+/// workers, so `f` may accumulate into per-thread storage indexed by thread_index without any locking.
+void Bam::for_read_group_in_bam(
+        const vector<bool>& valid_tids,
+        int8_t min_mapq,
+        size_t n_threads,
+        path temp_dir,
+        const function<void(size_t thread_index, const vector<TidAlignment>& alignments, size_t start, size_t stop)>& f){
+
+    for_read_group_in_bam(valid_tids, min_mapq, n_threads, temp_dir, false, [&](
+            size_t thread_index,
+            const vector<TidAlignment>& alignments,
+            const vector<AlignmentSpan>& spans,
+            size_t start,
+            size_t stop){
+        f(thread_index, alignments, start, stop);
+    });
+}
+
+
+void Bam::for_read_group_in_bam(
+        const vector<bool>& valid_tids,
+        int8_t min_mapq,
+        size_t n_threads,
+        path temp_dir,
+        const function<void(size_t thread_index, const vector<TidAlignment>& alignments, const vector<AlignmentSpan>& spans, size_t start, size_t stop)>& f){
+
+    for_read_group_in_bam(valid_tids, min_mapq, n_threads, temp_dir, true, f);
+}
 
-    reader.for_alignment_in_bam(false, [&](const SamElement& a){
-        if (l == 0){
-            prev_query_name = a.query_name;
+
+/// Spans are only parsed and carried through the grouping if with_spans is set, otherwise `spans` is always empty
+void Bam::for_read_group_in_bam(
+        const vector<bool>& valid_tids,
+        int8_t min_mapq,
+        size_t n_threads,
+        path temp_dir,
+        bool with_spans,
+        const function<void(size_t thread_index, const vector<TidAlignment>& alignments, const vector<AlignmentSpan>& spans, size_t start, size_t stop)>& f){
+
+    if (valid_tids.size() != size_t(bam_header->n_targets)){
+        throw runtime_error("ERROR: valid_tids does not match number of targets in bam header: " + bam_path.string());
+    }
+
+    // For CRAM, skip decoding of everything that isn't needed (has no effect on BAM/SAM)
+    auto required_fields = SAM_QNAME | SAM_FLAG | SAM_RNAME | SAM_MAPQ;
+    if (with_spans){
+        required_fields |= SAM_POS | SAM_CIGAR;
+    }
+
+    hts_set_opt(bam_file, CRAM_OPT_REQUIRED_FIELDS, required_fields);
+
+    if (is_coordinate_sorted()){
+        if (temp_dir.empty()){
+            temp_dir = ghc::filesystem::temp_directory_path();
+        }
+
+        cerr << "Input is coordinate sorted, grouping alignments by read name in: " << temp_dir << '\n';
+
+        for_read_group_in_sorted_bam(valid_tids, min_mapq, n_threads, temp_dir, 256, with_spans, f);
+    }
+    else{
+        for_read_group_in_name_grouped_bam(valid_tids, min_mapq, n_threads, with_spans, f);
+    }
+}
+
+
+/// Group consecutive records that share a query name (the BAM must be grouped by name). The BGZF decoding is done by
+/// the htslib thread pool (if the Bam was constructed with one), and groups are handed to the workers in batches.
+void Bam::for_read_group_in_name_grouped_bam(
+        const vector<bool>& valid_tids,
+        int8_t min_mapq,
+        size_t n_threads,
+        bool with_spans,
+        const function<void(size_t thread_index, const vector<TidAlignment>& alignments, const vector<AlignmentSpan>& spans, size_t start, size_t stop)>& f){
+
+    n_threads = max(size_t(1), n_threads);
+
+    const size_t batch_size = 1 << 18;
+    const size_t max_queue_size = 2*n_threads;
+
+    deque<TidAlignmentBatch> queue;
+    mutex queue_mutex;
+    condition_variable queue_not_empty;
+    condition_variable queue_not_full;
+    bool done = false;
+
+    auto process_batch = [&](size_t thread_index, const TidAlignmentBatch& batch){
+        for (size_t g=0; g+1<batch.group_starts.size(); g++){
+            f(thread_index, batch.alignments, batch.spans, batch.group_starts[g], batch.group_starts[g+1]);
+        }
+    };
+
+    // The first exception thrown by a worker, which also stops the reader and the other workers. Guarded by queue_mutex.
+    std::exception_ptr worker_exception;
+
+    auto consume = [&](size_t thread_index){
+        try {
+            while (true){
+                TidAlignmentBatch batch;
+                {
+                    unique_lock<mutex> lock(queue_mutex);
+                    queue_not_empty.wait(lock, [&]{return done or worker_exception or not queue.empty();});
+
+                    if (worker_exception or queue.empty()){
+                        return;
+                    }
+
+                    batch = std::move(queue.front());
+                    queue.pop_front();
+                }
+
+                queue_not_full.notify_one();
+                process_batch(thread_index, batch);
+            }
+        }
+        catch (...) {
+            {
+                lock_guard<mutex> lock(queue_mutex);
+                if (not worker_exception){
+                    worker_exception = std::current_exception();
+                }
+            }
+            queue_not_full.notify_all();
+            queue_not_empty.notify_all();
         }
+    };
 
-        if (prev_query_name != a.query_name){
-            update_contact_map(alignments, contact_graph, id_map);
-            alignments.clear();
+    auto submit = [&](TidAlignmentBatch& batch){
+        if (n_threads == 1){
+            process_batch(0, batch);
+        }
+        else {
+            unique_lock<mutex> lock(queue_mutex);
+            queue_not_full.wait(lock, [&]{return worker_exception or queue.size() < max_queue_size;});
+
+            // Stop reading, the workers are joined and the exception is rethrown below
+            if (worker_exception){
+                std::rethrow_exception(worker_exception);
+            }
+
+            queue.emplace_back(std::move(batch));
+            lock.unlock();
+            queue_not_empty.notify_one();
+        }
+
+        batch = {};
+        batch.alignments.reserve(batch_size);
+        if (with_spans){
+            batch.spans.reserve(batch_size);
+        }
+    };
+
+    vector<thread> threads;
+    if (n_threads > 1) {
+        for (size_t i=0; i<n_threads; i++){
+            try {
+                threads.emplace_back(consume, i);
+            }
+            catch (const std::exception& e){
+                cerr << e.what() << '\n';
+                exit(1);
+            }
         }
+    }
+
+    TidAlignmentBatch batch;
+    batch.alignments.reserve(batch_size);
+    if (with_spans){
+        batch.spans.reserve(batch_size);
+    }
 
-        // No information about reference contig, this alignment is unusable
-        if (a.ref_name.empty()){
-            return;
+    // Reused between records so that comparing query names does not allocate
+    string prev_query_name;
+
+    auto close_group = [&](){
+        if (batch.alignments.size() > batch.group_starts.back()){
+            batch.group_starts.emplace_back(batch.alignments.size());
         }
+    };
+
+    try {
+        for_alignment_in_bam([&](const bam1_t* a){
+            const char* query_name = bam_get_qname(a);
+
+            if (prev_query_name != query_name){
+                close_group();
 
-        // Optionally filter by the contig names. E.g. "PR" in shasta
-        bool valid_prefix = true;
-        if (not required_prefix.empty()){
-            for (size_t i=0; i<required_prefix.size(); i++){
-                if (a.ref_name[i] != required_prefix[i]){
-                    valid_prefix = false;
-                    break;
+                if (batch.alignments.size() >= batch_size){
+                    submit(batch);
+                }
+
+                prev_query_name.assign(query_name);
+            }
+
+            if (not is_usable_for_contacts(a, valid_tids, min_mapq)){
+                return;
+            }
+
+            batch.alignments.push_back({a->core.tid, a->core.qual});
+
+            if (with_spans){
+                batch.spans.push_back(get_alignment_span(a));
+            }
+        });
+
+        close_group();
+        submit(batch);
+    }
+    catch (...){
+        {
+            lock_guard<mutex> lock(queue_mutex);
+            done = true;
+        }
+        queue_not_empty.notify_all();
+
+        for (auto& t: threads){
+            t.join();
+        }
+
+        throw;
+    }
+
+    {
+        lock_guard<mutex> lock(queue_mutex);
+        done = true;
+    }
+    queue_not_empty.notify_all();
+
+    for (auto& t: threads){
+        t.join();
+    }
+
+    if (worker_exception){
+        std::rethrow_exception(worker_exception);
+    }
+}
+
+
+/// Compact record for grouping alignments by read name out of core, the name itself is reduced to a 64-bit hash
+class SpilledAlignment {
+public:
+    uint64_t read_hash;
+    int32_t tid;
+    uint8_t mapq;
+};
+
+
+/// Group alignments by read name when they are not adjacent in the input (e.g. coordinate sorted BAM/CRAM). One pass
+/// over the file writes compact (read hash, tid, mapq) tuples into n_buckets temporary files, partitioned by read
+/// hash, so that all alignments of a read land in the same bucket. Buckets are then loaded, sorted by hash and
+/// resolved independently by n_threads workers, so peak memory is roughly n_threads buckets rather than the whole
+/// file. With spans, each bucket has a second file of AlignmentSpans, in the same order as its tuples.
+void Bam::for_read_group_in_sorted_bam(
+        const vector<bool>& valid_tids,
+        int8_t min_mapq,
+        size_t n_threads,
+        path temp_dir,
+        size_t n_buckets,
+        bool with_spans,
+        const function<void(size_t thread_index, const vector<TidAlignment>& alignments, const vector<AlignmentSpan>& spans, size_t start, size_t stop)>& f){
+
+    n_threads = max(size_t(1), n_threads);
+    n_buckets = max(size_t(1), n_buckets);
+
+    const size_t buffer_size = 1 << 14;
+
+    // Unique subdirectory so that concurrent runs sharing a temp dir don't collide
+    std::random_device rd;
+    path spill_dir = temp_dir / (bam_path.filename().string() + ".gfase_spill_" + to_string(rd()));
+
+    if (exists(spill_dir)){
+        throw runtime_error("ERROR: temporary directory already exists: " + spill_dir.string());
+    }
+
+    create_directories(spill_dir);
+
+    auto get_bucket_path = [&](size_t b){
+        return spill_dir / (to_string(b) + ".bin");
+    };
+
+    auto get_span_bucket_path = [&](size_t b){
+        return spill_dir / (to_string(b) + ".spans.bin");
+    };
+
+    // Load a whole bucket file of fixed size records, and delete it
+    auto read_bucket = [](const path& bucket_path, auto& items){
+        auto n_bytes = ghc::filesystem::file_size(bucket_path);
+
+        items.resize(n_bytes / sizeof(items[0]));
+
+        ifstream file(bucket_path, std::ios::binary);
+        file.read(reinterpret_cast<char*>(items.data()), std::streamsize(n_bytes));
+
+        if (not file.good() and n_bytes > 0){
+            throw runtime_error("ERROR: could not read file: " + bucket_path.string());
+        }
+
+        file.close();
+        ghc::filesystem::remove(bucket_path);
+    };
+
+    // Any error leaves the spill directory behind unless it is removed here
+    try {
+        // Spill pass
+        {
+            vector<ofstream> files(n_buckets);
+            vector<ofstream> span_files(with_spans ? n_buckets : 0);
+            vector <vector<SpilledAlignment> > buffers(n_buckets);
+            vector <vector<AlignmentSpan> > span_buffers(with_spans ? n_buckets : 0);
+
+            auto open_bucket = [&](ofstream& file, const path& bucket_path){
+                file.open(bucket_path, std::ios::binary);
+
+                if (not file.is_open() or not file.good()){
+                    throw runtime_error("ERROR: could not write to file: " + bucket_path.string());
+                }
+            };
+
+            for (size_t b=0; b<n_buckets; b++){
+                open_bucket(files[b], get_bucket_path(b));
+                buffers[b].reserve(buffer_size);
+
+                if (with_spans){
+                    open_bucket(span_files[b], get_span_bucket_path(b));
+                    span_buffers[b].reserve(buffer_size);
+                }
+            }
+
+            auto flush = [&](size_t b){
+                files[b].write(reinterpret_cast<const char*>(buffers[b].data()), std::streamsize(buffers[b].size()*sizeof(SpilledAlignment)));
+                buffers[b].clear();
+
+                if (with_spans){
+                    span_files[b].write(reinterpret_cast<const char*>(span_buffers[b].data()), std::streamsize(span_buffers[b].size()*sizeof(AlignmentSpan)));
+                    span_buffers[b].clear();
+                }
+            };
+
+            for_alignment_in_bam([&](const bam1_t* a){
+                if (not is_usable_for_contacts(a, valid_tids, min_mapq)){
+                    return;
+                }
+
+                const char* query_name = bam_get_qname(a);
+                auto h = MurmurHash64A(query_name, int(strlen(query_name)), 0);
+                auto b = size_t(h % n_buckets);
+
+                buffers[b].push_back({h, a->core.tid, a->core.qual});
+
+                if (with_spans){
+                    span_buffers[b].push_back(get_alignment_span(a));
+                }
+
+                if (buffers[b].size() == buffer_size){
+                    flush(b);
+                }
+            });
+
+            auto close_bucket = [&](ofstream& file, const path& bucket_path){
+                file.close();
+
+                if (file.fail()){
+                    throw runtime_error("ERROR: could not write to file: " + bucket_path.string());
+                }
+            };
+
+            for (size_t b=0; b<n_buckets; b++){
+                flush(b);
+                close_bucket(files[b], get_bucket_path(b));
+
+                if (with_spans){
+                    close_bucket(span_files[b], get_span_bucket_path(b));
                 }
             }
         }
 
-        if (valid_prefix) {
-            // Only allow reads with mapq > min_mapq and not secondary
-            if (a.mapq >= min_mapq and a.is_primary()) {
-                alignments.emplace_back(a);
+        // Resolve pass, one bucket per job
+        atomic<size_t> job_index = 0;
+        std::exception_ptr worker_exception;
+        mutex exception_mutex;
+
+        auto resolve_buckets = [&](size_t thread_index){
+            vector<SpilledAlignment> spilled;
+            vector<SpilledAlignment> sorted_spilled;
+            vector<TidAlignment> alignments;
+            vector<AlignmentSpan> spilled_spans;
+            vector<AlignmentSpan> spans;
+            vector<uint32_t> order;
+
+            size_t b = job_index.fetch_add(1);
+
+            try {
+                while (b < n_buckets){
+                    read_bucket(get_bucket_path(b), spilled);
+
+                    auto by_hash = [](const SpilledAlignment& x, const SpilledAlignment& y){
+                        return x.read_hash < y.read_hash;
+                    };
+
+                    if (with_spans){
+                        read_bucket(get_span_bucket_path(b), spilled_spans);
+
+                        if (spilled_spans.size() != spilled.size()){
+                            throw runtime_error("ERROR: span file does not match alignment file: " + get_span_bucket_path(b).string());
+                        }
+
+                        // Sort the two files together, by sorting an ordering of them
+                        order.resize(spilled.size());
+                        for (size_t i=0; i<order.size(); i++){
+                            order[i] = uint32_t(i);
+                        }
+
+                        sort(order.begin(), order.end(), [&](uint32_t x, uint32_t y){
+                            return by_hash(spilled[x], spilled[y]);
+                        });
+
+                        spans.resize(spilled.size());
+                        for (size_t i=0; i<order.size(); i++){
+                            spans[i] = spilled_spans[order[i]];
+                        }
+
+                        sorted_spilled.resize(spilled.size());
+                        for (size_t i=0; i<order.size(); i++){
+                            sorted_spilled[i] = spilled[order[i]];
+                        }
+                        spilled.swap(sorted_spilled);
+                    }
+                    else{
+                        sort(spilled.begin(), spilled.end(), by_hash);
+                    }
+
+                    alignments.resize(spilled.size());
+                    for (size_t i=0; i<spilled.size(); i++){
+                        alignments[i] = {spilled[i].tid, spilled[i].mapq};
+                    }
+
+                    size_t start = 0;
+                    for (size_t i=1; i<=spilled.size(); i++){
+                        if (i == spilled.size() or spilled[i].read_hash != spilled[start].read_hash){
+                            f(thread_index, alignments, spans, start, i);
+                            start = i;
+                        }
+                    }
+
+                    b = job_index.fetch_add(1);
+                }
+            }
+            catch (...) {
+                lock_guard<mutex> lock(exception_mutex);
+                if (not worker_exception){
+                    worker_exception = std::current_exception();
+                }
+
+                // Stop handing out buckets
+                job_index = n_buckets;
+            }
+        };
+
+        vector<thread> threads;
+
+        for (size_t i=0; i<n_threads; i++){
+            try {
+                threads.emplace_back(resolve_buckets, i);
             }
+            catch (const std::exception& e){
+                cerr << e.what() << '\n';
+                exit(1);
+            }
+        }
+
+        for (auto& t: threads){
+            t.join();
         }
 
-        l++;
-        prev_query_name = a.query_name;
+        if (worker_exception){
+            std::rethrow_exception(worker_exception);
+        }
+    }
+    catch (...) {
+        std::error_code error;
+        ghc::filesystem::remove_all(spill_dir, error);
+        throw;
+    }
+
+    ghc::filesystem::remove_all(spill_dir);
+}
+
+
+/// Mark which header references pass the (optional) name prefix filter, e.g. "PR" in shasta
+void get_valid_tids(const Bam& reader, const string& required_prefix, vector<bool>& valid_tids){
+    valid_tids.clear();
+    valid_tids.reserve(reader.get_ref_count());
+
+    reader.for_ref_in_header([&](const string& ref_name, uint32_t length){
+        valid_tids.emplace_back(ref_name.compare(0, required_prefix.size(), required_prefix) == 0);
     });
 }
 
 
+/// Build contacts from a BAM (or CRAM) that is grouped by read name or sorted by coordinate. Pair counts are accumulated per thread by tid and only
+/// converted to node IDs once, after merging.
+void parse_unpaired_bam_file(
+        path bam_path,
+        MultiContactGraph& contact_graph,
+        IncrementalIdMap<string>& id_map,
+        string required_prefix,
+        int8_t min_mapq,
+        size_t n_threads,
+        path temp_dir){
+
+    n_threads = max(size_t(1), n_threads);
+
+    Bam reader(bam_path, n_threads);
+
+    vector<string> ref_names;
+    reader.for_ref_in_header([&](const string& ref_name, uint32_t length){
+        ref_names.emplace_back(ref_name);
+    });
+
+    vector<bool> valid_tids;
+    get_valid_tids(reader, required_prefix, valid_tids);
+
+    // Pairs are keyed by their tids packed into one integer: (tid_a << 32) | tid_b, with tid_a <= tid_b
+    vector <sparse_hash_map<uint64_t, int32_t> > pair_counts(n_threads);
+    vector <vector<int64_t> > coverages(n_threads, vector<int64_t>(ref_names.size(), 0));
+
+    reader.for_read_group_in_bam(valid_tids, min_mapq, n_threads, temp_dir, [&](
+            size_t thread_index,
+            const vector<TidAlignment>& alignments,
+            size_t start,
+            size_t stop){
+
+        auto& counts = pair_counts[thread_index];
+        auto& coverage = coverages[thread_index];
+
+        // Iterate one triangle of the all-by-all matrix
+        for (size_t i=start; i<stop; i++){
+            auto tid_a = alignments[i].tid;
+            coverage[tid_a]++;
+
+            for (size_t j=i+1; j<stop; j++) {
+                auto tid_b = alignments[j].tid;
+                auto [min_tid, max_tid] = std::minmax(tid_a, tid_b);
+                counts[(uint64_t(min_tid) << 32) | uint64_t(max_tid)]++;
+            }
+        }
+    });
+
+    // Reduce everything into the first thread's tables
+    for (size_t t=1; t<n_threads; t++){
+        for (auto& [key, count]: pair_counts[t]){
+            pair_counts[0][key] += count;
+        }
+        pair_counts[t].clear();
+
+        for (size_t tid=0; tid<ref_names.size(); tid++){
+            coverages[0][tid] += coverages[t][tid];
+        }
+    }
+
+    // Only now resolve names to IDs, once per reference
+    vector<int32_t> tid_to_id(ref_names.size(), -1);
+
+    for (size_t tid=0; tid<ref_names.size(); tid++){
+        if (coverages[0][tid] == 0){
+            continue;
+        }
+
+        auto id = int32_t(id_map.try_insert(ref_names[tid]));
+        tid_to_id[tid] = id;
+
+        contact_graph.try_insert_node(id, 0);
+        contact_graph.increment_coverage(id, coverages[0][tid]);
+    }
+
+    for (auto& [key, count]: pair_counts[0]){
+        auto id_a = tid_to_id[key >> 32];
+        auto id_b = tid_to_id[key & 0xffffffff];
+
+        contact_graph.try_insert_edge(id_a, id_b);
+        contact_graph.increment_edge_weight(id_a, id_b, count);
+    }
+}
+
 
 }
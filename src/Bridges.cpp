@@ -7,8 +7,15 @@
 #include <unordered_map>
 #include <unordered_set>
 #include <algorithm>
+#include <stdexcept>
 #include <utility>
 #include <iostream>
+#include <limits>
+#include <cassert>
+#include <exception>
+#include <atomic>
+#include <thread>
+#include <mutex>
 
 using std::tuple;
 using std::get;
@@ -18,8 +25,19 @@ using std::make_tuple;
 using std::reverse;
 using std::unordered_map;
 using std::unordered_set;
+using std::numeric_limits;
+using std::runtime_error;
+using std::to_string;
 using std::cerr;
 using std::endl;
+using std::move;
+using std::atomic;
+using std::thread;
+using std::mutex;
+using std::lock_guard;
+using std::exception_ptr;
+using std::current_exception;
+using std::rethrow_exception;
 
 using handlegraph::as_integer;
 using handlegraph::as_handle;
@@ -29,65 +47,161 @@ namespace gfase {
 
 static const bool debug = false;
 
-/*
- * Wrapper for a handle graph that uses the bi-edged formalism instead
- * of a bidirected formalism, which allows a simple undirected graph
- * interface
- */
-class BiedgedGraph {
-public:
-    BiedgedGraph(const HandleGraph& graph);
-    BiedgedGraph() = delete;
+BridgeIndex::BridgeIndex(const HandleGraph& graph) : graph(graph) {
     
-    size_t size() const;
+    handles.reserve(graph.get_node_count());
+    graph.for_each_handle([&](const handle_t& handle) {
+        handles.push_back(handle);
+    });
     
-    // returns an invalid handle if graph is empty
-    handle_t get_arbitrary_node() const;
+    if (handles.size() >= numeric_limits<uint32_t>::max() / 2) {
+        throw runtime_error("ERROR: too many nodes to index for bridge finding: " + to_string(handles.size()));
+    }
     
-    void for_each_node(const function<void(handle_t)>& lambda) const;
-    void for_each_neighbor(handle_t node, const function<void(handle_t)>& lambda) const;
-    bool is_across_node_edge(handle_t node1, handle_t node2) const;
+    // assign the node indexes
+    if (!handles.empty()) {
+        min_id = graph.min_node_id();
+        nid_t max_id = graph.max_node_id();
+        if (max_id >= min_id && size_t(max_id - min_id) < 4 * handles.size()) {
+            compact_node_index.resize(max_id - min_id + 1, numeric_limits<uint32_t>::max());
+            for (size_t i = 0; i < handles.size(); ++i) {
+                compact_node_index[graph.get_id(handles[i]) - min_id] = i;
+            }
+        }
+        else {
+            node_index.reserve(handles.size());
+            for (size_t i = 0; i < handles.size(); ++i) {
+                node_index[graph.get_id(handles[i])] = i;
+            }
+        }
+    }
     
-private:
+    // the bi-edged graph has a vertex for each side and an edge across each node, so we lay
+    // out the adjacencies of the sides in CSR form. an edge h -> next joins side(h) to side(flip(next)).
+    size_t n_sides = 2 * handles.size();
+    vector<uint64_t> offsets(n_sides + 1, 0);
+    for (size_t s = 0; s < n_sides; ++s) {
+        // one for the edge across the node
+        offsets[s + 1] = 1;
+        graph.follow_edges(get_handle(s), false, [&](const handle_t& next) {
+            ++offsets[s + 1];
+        });
+    }
+    for (size_t s = 0; s < n_sides; ++s) {
+        offsets[s + 1] += offsets[s];
+    }
     
-    const HandleGraph& graph;
+    vector<uint32_t> neighbors(offsets.back());
+    for (size_t s = 0; s < n_sides; ++s) {
+        size_t k = offsets[s];
+        neighbors[k++] = s ^ 1;
+        graph.follow_edges(get_handle(s), false, [&](const handle_t& next) {
+            neighbors[k++] = get_side(graph.flip(next));
+        });
+    }
     
-};
-
-BiedgedGraph::BiedgedGraph(const HandleGraph& graph) : graph(graph) {
+    // iterative Tarjan bridge finding, where a node is a bridge if the edge across it is a bridge
+    const uint32_t null = numeric_limits<uint32_t>::max();
+    vector<uint32_t> discovery(n_sides, null);
+    vector<uint32_t> low(n_sides, null);
+    vector<uint32_t> parent(n_sides, null);
+    // the next position in the CSR to search from each side
+    vector<uint64_t> cursor(offsets.begin(), offsets.end() - 1);
+    // whether we've skipped over the tree edge back to the parent (only skipped once, so that
+    // parallel edges count as cycles)
+    vector<bool> skipped_parent(n_sides, false);
+    vector<uint32_t> stack;
+    
+    bridge_flags.resize(handles.size(), false);
     
+    uint32_t next_discovery = 0;
+    for (size_t root = 0; root < n_sides; ++root) {
+        if (discovery[root] != null) {
+            continue;
+        }
+        
+        discovery[root] = low[root] = next_discovery++;
+        stack.push_back(root);
+        
+        while (!stack.empty()) {
+            
+            uint32_t s = stack.back();
+            
+            if (cursor[s] < offsets[s + 1]) {
+                uint32_t next = neighbors[cursor[s]++];
+                
+                if (next == parent[s] && !skipped_parent[s]) {
+                    skipped_parent[s] = true;
+                }
+                else if (discovery[next] == null) {
+                    // add a tree edge
+                    parent[next] = s;
+                    discovery[next] = low[next] = next_discovery++;
+                    stack.push_back(next);
+                }
+                else {
+                    low[s] = std::min(low[s], discovery[next]);
+                }
+            }
+            else {
+                // exhausted edges from this side
+                stack.pop_back();
+                
+                uint32_t p = parent[s];
+                if (p != null) {
+                    low[p] = std::min(low[p], low[s]);
+                    if (low[s] > discovery[p] && (p ^ 1) == s) {
+                        if (debug) {
+                            cerr << "marking edge " << graph.get_id(get_handle(s)) << " as a bridge node" << endl;
+                        }
+                        bridge_flags[s / 2] = true;
+                    }
+                }
+            }
+        }
+    }
 }
 
-size_t BiedgedGraph::size() const {
-    return 2 * graph.get_node_count();
+const HandleGraph& BridgeIndex::get_graph() const {
+    return graph;
 }
 
-handle_t BiedgedGraph::get_arbitrary_node() const {
-    handle_t handle = as_handle(-1); // to avoid uninitialized warnings
-    graph.for_each_handle([&handle](const handle_t& h) {
-        handle = h;
-        return false;
-    });
-    return handle;
+size_t BridgeIndex::get_node_count() const {
+    return handles.size();
 }
 
-void BiedgedGraph::for_each_node(const function<void(handle_t)>& lambda) const {
-    graph.for_each_handle([&](const handle_t& h) {
-        lambda(h);
-        lambda(graph.flip(h));
-    });
+size_t BridgeIndex::get_node_index(nid_t node_id) const {
+    if (!compact_node_index.empty()) {
+        // IDs in range that aren't in the graph are marked with the max value
+        if (node_id < min_id || size_t(node_id - min_id) >= compact_node_index.size()
+            || compact_node_index[node_id - min_id] == numeric_limits<uint32_t>::max()) {
+            throw runtime_error("ERROR: node is not in the bridge index: " + to_string(node_id));
+        }
+        return compact_node_index[node_id - min_id];
+    }
+    return node_index.at(node_id);
 }
 
-void BiedgedGraph::for_each_neighbor(handle_t node, const function<void(handle_t)>& lambda) const {
-    
-    lambda(graph.flip(node));
-    graph.follow_edges(node, false, [&](const handle_t& next) {
-        lambda(graph.flip(next));
-    });
+size_t BridgeIndex::get_side(const handle_t& handle) const {
+    return 2 * get_node_index(graph.get_id(handle)) + (graph.get_is_reverse(handle) ? 1 : 0);
 }
 
-bool BiedgedGraph::is_across_node_edge(handle_t node1, handle_t node2) const {
-    return graph.flip(node1) == node2;
+handle_t BridgeIndex::get_handle(size_t side) const {
+    return (side & 1) ? graph.flip(handles[side / 2]) : handles[side / 2];
+}
+
+bool BridgeIndex::is_bridge(nid_t node_id) const {
+    return bridge_flags[get_node_index(node_id)];
+}
+
+vector<handle_t> BridgeIndex::get_bridges() const {
+    vector<handle_t> bridges;
+    for (size_t i = 0; i < handles.size(); ++i) {
+        if (bridge_flags[i]) {
+            bridges.push_back(handles[i]);
+        }
+    }
+    return bridges;
 }
 
 vector<handle_t> bridge_nodes(const HandleGraph& graph) {
@@ -105,139 +219,14 @@ vector<handle_t> bridge_nodes(const HandleGraph& graph) {
         });
     }
     
-    BiedgedGraph undir_graph(graph);
-    
-    // TODO: should I just make this a class?
-    // records of node -> (parent, traversed upward, dfs index, edges downward)
-    unordered_map<handle_t, tuple<handle_t, bool, size_t, vector<handle_t>>> dfs_tree;
-    vector<handle_t> dfs_order;
-    
-    dfs_tree.reserve(undir_graph.size());
-    dfs_order.reserve(undir_graph.size());
-    
-    // records of (node, next edge idx, edges)
-    vector<tuple<handle_t, size_t, vector<handle_t>>> stack;
-    
-    // enqueue a non-visited node
-    auto enqueue = [&](handle_t node, handle_t parent) {
-        
-        stack.emplace_back(node, 0, vector<handle_t>());
-        
-        // record the order and initialize the tree edges
-        dfs_tree[node] = make_tuple(parent, false, dfs_order.size(), vector<handle_t>());
-        dfs_order.emplace_back(node);
-        
-        undir_graph.for_each_neighbor(node, [&](handle_t nbr) {
-            get<2>(stack.back()).emplace_back(nbr);
-        });
-    };
-    
-    // DFS
-    handle_t root = undir_graph.get_arbitrary_node();
-    if (debug) {
-        cerr << "beginning DFS from " << graph.get_id(root) << (graph.get_is_reverse(root) ? "L" : "R") << endl;
-    }
-    enqueue(root, root);
-    // note: the root doesn't really have a parent, but we use itself as a sentinel
-    while (!stack.empty()) {
-        
-        auto& top = stack.back();
-        
-        if (get<1>(top) == get<2>(top).size()) {
-            // exhausted edges from this node
-            stack.pop_back();
-            continue;
-        }
-        
-        auto next = get<2>(top)[get<1>(top)++];
-        
-        if (!dfs_tree.count(next)) {
-            // the next node hasn't been visited yet, so we add its edge to
-            // the DFS tree and queue it up
-            get<3>(dfs_tree[get<0>(top)]).emplace_back(next);
-            enqueue(next, get<0>(top));
-        }
-    }
-    
-    if (debug) {
-        cerr << "finished making DFS tree:" << endl;
-        for (const auto& node : dfs_tree) {
-            cerr << graph.get_id(node.first) << (graph.get_is_reverse(node.first) ? "L" : "R") << endl;
-            for (auto next : get<3>(node.second)) {
-                cerr << "\t-> " << graph.get_id(next) << (graph.get_is_reverse(next) ? "L" : "R") << endl;
-            }
-        }
-    }
-    
-    for (size_t i = 0; i < dfs_order.size(); ++i) {
-        
-        handle_t node = dfs_order[i];
-        
-        // get the non-tree edges that will initiate chains
-        vector<handle_t> chain_heads;
-        // note: we count on the edges being iterated in the same order as previously
-        const auto& tree_record = dfs_tree[node];
-        size_t j = 0;
-        if (debug) {
-            cerr << "checking for unused edges from " << graph.get_id(node) << (graph.get_is_reverse(node) ? "L" : "R") << endl;
-        }
-        undir_graph.for_each_neighbor(node, [&](handle_t nbr) {
-            if (debug) {
-                cerr << "\t" << graph.get_id(nbr) << (graph.get_is_reverse(nbr) ? "L" : "R");
-            }
-            if (j < get<3>(tree_record).size() && get<3>(tree_record)[j] == nbr) {
-                // this edge was used in the DFS tree
-                ++j;
-                if (debug) {
-                    cerr << " was used in tree" << endl;
-                }
-            }
-            else if (get<2>(dfs_tree[nbr]) > i) {
-                // this edge points down the tree rather than up it
-                chain_heads.emplace_back(nbr);
-                if (debug) {
-                    cerr << " is a downward edge" << endl;
-                }
-            }
-            else {
-                if (debug) {
-                    cerr << " is an upward edge" << endl;
-                }
-            }
-        });
-        
-        // mark nodes in the untraversed portion of this chain's cycle as traversed
-        for (handle_t chain_cursor : chain_heads) {
-            if (debug) {
-                cerr << "beginning upward traversal from " << graph.get_id(chain_cursor) << (graph.get_is_reverse(chain_cursor) ? "L" : "R") << endl;
-            }
-            while (chain_cursor != node && !get<1>(dfs_tree[chain_cursor])) {
-                get<1>(dfs_tree[chain_cursor]) = true;
-                chain_cursor = get<0>(dfs_tree[chain_cursor]);
-            }
-        }
-    }
-    
-    // find the across-node edges that were never traversed in a cycle
-    vector<handle_t> bridges;
-    
-    for (const auto& tree_record : dfs_tree) {
-
-        if (!get<1>(tree_record.second) &&
-            undir_graph.is_across_node_edge(tree_record.first, get<0>(tree_record.second))) {
-            if (debug) {
-                cerr << "marking edge " << graph.get_id(tree_record.first) << " - " << (graph.get_is_reverse(tree_record.first) ? "L" : "R") << " as a bridge node" << endl;
-            }
-            bridges.push_back(graph.forward(tree_record.first));
-        }
-    }
-    
-    return bridges;
+    return BridgeIndex(graph).get_bridges();
 }
 
-vector<vector<handle_t>> consolidate_bridges(const HandleGraph& graph,
+vector<vector<handle_t>> consolidate_bridges(const BridgeIndex& index,
                                              const vector<handle_t>& bridges) {
     
+    const auto& graph = index.get_graph();
+    
     // return a bool if the node has degree 1 in that direction, and if so also
     // the neighbor node
     auto degree_one_neighbor = [&](handle_t n, bool left_side) {
@@ -250,14 +239,18 @@ vector<vector<handle_t>> consolidate_bridges(const HandleGraph& graph,
         });
         return make_pair(count == 1, nbr);
     };
-        
-    unordered_set<handle_t> remaining(bridges.begin(), bridges.end());
+    
+    // the bridges that haven't been consolidated yet, by node index
+    vector<bool> remaining(index.get_node_count(), false);
+    for (handle_t node : bridges) {
+        remaining[index.get_node_index(graph.get_id(node))] = true;
+    }
     
     vector<vector<handle_t>> return_val;
     
     for (handle_t node : bridges) {
         
-        if (!remaining.count(node)) {
+        if (!remaining[index.get_node_index(graph.get_id(node))]) {
             continue;
         }
         
@@ -265,7 +258,7 @@ vector<vector<handle_t>> consolidate_bridges(const HandleGraph& graph,
         
         return_val.emplace_back(1, node);
         auto& consolidated_bridge = return_val.back();
-        remaining.erase(node);
+        remaining[index.get_node_index(graph.get_id(node))] = false;
         
         // try to extend the bridge in both directions
         for (bool to_left : {true, false}) {
@@ -275,7 +268,7 @@ vector<vector<handle_t>> consolidate_bridges(const HandleGraph& graph,
                 bool degree_one;
                 handle_t nbr;
                 tie(degree_one, nbr) = degree_one_neighbor(consolidated_bridge.back(), to_left);
-                if (!degree_one || !remaining.count(graph.forward(nbr))) {
+                if (!degree_one || !remaining[index.get_node_index(graph.get_id(nbr))]) {
                     // there is not a single neighbor, or else it is not a bridge
                     break;
                 }
@@ -284,7 +277,7 @@ vector<vector<handle_t>> consolidate_bridges(const HandleGraph& graph,
                     break;
                 }
                 consolidated_bridge.push_back(nbr);
-                remaining.erase(nbr);
+                remaining[index.get_node_index(graph.get_id(nbr))] = false;
             }
             
             // when we build leftwards, we need to reverse it to keep the
@@ -295,88 +288,195 @@ vector<vector<handle_t>> consolidate_bridges(const HandleGraph& graph,
         }
     }
     
-    assert(remaining.empty());
+    assert(std::find(remaining.begin(), remaining.end(), true) == remaining.end());
     return return_val;
 }
 
+vector<vector<handle_t>> consolidate_bridges(const HandleGraph& graph,
+                                             const vector<handle_t>& bridges) {
+    return consolidate_bridges(BridgeIndex(graph), bridges);
+}
+
 // FIXME: this will not find any bridge-free connected components...
 
-void for_each_bridge_component(const HandleGraph& graph,
-                               const vector<vector<handle_t>>& bridges,
-                               const function<void(const HandleGraph&,
-                                                   const vector<pair<size_t, bool>>&)>& f) {
+// identify each bridge component by its node IDs, without making a subgraph for it
+static void for_each_bridge_component_node_set(const BridgeIndex& index,
+                                               const vector<vector<handle_t>>& bridges,
+                                               const function<void(vector<nid_t>&,
+                                                                   vector<pair<size_t, bool>>&)>& f) {
     
+    const auto& graph = index.get_graph();
+    size_t n_sides = 2 * index.get_node_count();
     
-    unordered_map<handle_t, pair<size_t, bool>> bridge_ends;
-    unordered_set<handle_t> visited;
+    // the bridge (and direction into the component) that ends at each side, encoded as 2 * index + reverse
+    const uint64_t null = numeric_limits<uint64_t>::max();
+    vector<uint64_t> bridge_ends(n_sides, null);
+    vector<bool> visited(n_sides, false);
+    // whether a node has been added to the component it belongs to (bridge nodes belong to several)
+    vector<bool> added(index.get_node_count(), false);
     for (size_t i = 0; i < bridges.size(); ++i) {
         const auto& bridge = bridges[i];
-        bridge_ends[bridge.back()] = make_pair(i, false);
-        bridge_ends[graph.flip(bridge.front())] = make_pair(i, true);
+        bridge_ends[index.get_side(bridge.back())] = 2 * i;
+        bridge_ends[index.get_side(graph.flip(bridge.front()))] = 2 * i + 1;
         
         // we pre-mark the sides we don't want to traverse as visited
         for (size_t j = 0; j < bridge.size(); ++j) {
             if (j != 0) {
-                visited.insert(graph.flip(bridge[j]));
+                visited[index.get_side(graph.flip(bridge[j]))] = true;
             }
             if (j + 1 != bridge.size()) {
-                visited.insert(bridge[j]);
+                visited[index.get_side(bridge[j])] = true;
             }
         }
     }
     
-    
-    graph.for_each_handle([&](const handle_t& node) {
-        for (bool left_side : {false, true}) {
-            
-            handle_t seed = left_side ? graph.flip(node) : node;
-            if (visited.count(seed)) {
-                // we've already traversed this side's component
-                continue;
-            }
-            
-            visited.insert(seed);
+    vector<size_t> stack;
+    for (size_t seed = 0; seed < n_sides; ++seed) {
+        if (visited[seed]) {
+            // we've already traversed this side's component
+            continue;
+        }
+        
+        visited[seed] = true;
+        
+        vector<pair<size_t, bool>> adjacent_bridges;
+        vector<nid_t> node_ids(1, graph.get_id(index.get_handle(seed)));
+        added[seed / 2] = true;
+        stack.assign(1, seed);
+        
+        while (!stack.empty()) {
             
-            vector<pair<size_t, bool>> adjacent_bridges;
-            unordered_set<nid_t> node_ids{graph.get_id(seed)};
-            vector<handle_t> stack(1, seed);
+            size_t side = stack.back();
+            stack.pop_back();
             
-            while (!stack.empty()) {
-                
-                handle_t node = stack.back();
-                stack.pop_back();
-                
-                auto it = bridge_ends.find(node);
-                if (it != bridge_ends.end()) {
-                    // we hit a bridge, don't cross it, but remember which
-                    // bridge it was
-                    adjacent_bridges.push_back(it->second);
+            if (bridge_ends[side] != null) {
+                // we hit a bridge, don't cross it, but remember which
+                // bridge it was
+                adjacent_bridges.emplace_back(bridge_ends[side] / 2, bridge_ends[side] & 1);
+            }
+            else {
+                // this is not a bridge, we can look at the other side
+                size_t across_side = side ^ 1;
+                if (!visited[across_side]) {
+                    stack.push_back(across_side);
+                    visited[across_side] = true;
                 }
-                else {
-                    // this is not a bridge, we can look at the other side
-                    handle_t across_node = graph.flip(node);
-                    if (!visited.count(across_node)) {
-                        stack.push_back(across_node);
-                        visited.insert(across_node);
+            }
+            
+            // we can always look across edges
+            graph.follow_edges(index.get_handle(side), false, [&](const handle_t& next) {
+                handle_t adjacent = graph.flip(next);
+                size_t adjacent_side = index.get_side(adjacent);
+                if (!visited[adjacent_side]) {
+                    if (!added[adjacent_side / 2]) {
+                        node_ids.push_back(graph.get_id(adjacent));
+                        added[adjacent_side / 2] = true;
                     }
+                    visited[adjacent_side] = true;
+                    stack.push_back(adjacent_side);
+                }
+            });
+        }
+        
+        f(node_ids, adjacent_bridges);
+        
+        // bridge nodes can be added again by the components on their other side
+        for (auto& bridge_idx : adjacent_bridges) {
+            const auto& bridge = bridges[bridge_idx.first];
+            added[index.get_node_index(graph.get_id(bridge_idx.second ? bridge.front() : bridge.back()))] = false;
+        }
+    }
+}
+
+void for_each_bridge_component(const BridgeIndex& index,
+                               const vector<vector<handle_t>>& bridges,
+                               const function<void(const HandleGraph&,
+                                                   const vector<pair<size_t, bool>>&)>& f) {
+    
+    for_each_bridge_component_node_set(index, bridges, [&](vector<nid_t>& node_ids,
+                                                           vector<pair<size_t, bool>>& adjacent_bridges) {
+        // make a component subgraph and execute the lambda
+        BitmapSubgraphOverlay bridge_component(&index.get_graph(), move(node_ids));
+        f(bridge_component, adjacent_bridges);
+    });
+}
+
+void for_each_bridge_component(const HandleGraph& graph,
+                               const vector<vector<handle_t>>& bridges,
+                               const function<void(const HandleGraph&,
+                                                   const vector<pair<size_t, bool>>&)>& f) {
+    for_each_bridge_component(BridgeIndex(graph), bridges, f);
+}
+
+size_t for_each_bridge_component_in_parallel(const BridgeIndex& index,
+                                             const vector<vector<handle_t>>& bridges,
+                                             size_t n_threads,
+                                             const function<void(size_t,
+                                                                 const HandleGraph&,
+                                                                 const vector<pair<size_t, bool>>&,
+                                                                 size_t)>& f) {
+    
+    // the traversal itself is cheap compared to what is usually done with the components, so
+    // we find them all up front and then farm them out
+    vector<vector<nid_t>> components;
+    vector<vector<pair<size_t, bool>>> component_bridges;
+    for_each_bridge_component_node_set(index, bridges, [&](vector<nid_t>& node_ids,
+                                                           vector<pair<size_t, bool>>& adjacent_bridges) {
+        components.emplace_back(move(node_ids));
+        component_bridges.emplace_back(move(adjacent_bridges));
+    });
+    
+    if (debug) {
+        cerr << "found " << components.size() << " bridge components, processing with " << n_threads << " threads" << endl;
+    }
+    
+    // any threads beyond one per component are split among the components
+    size_t n_workers = std::max(size_t(1), std::min(n_threads, components.size()));
+    size_t n_component_threads = std::max(size_t(1), n_threads / n_workers);
+    
+    atomic<size_t> job_index = 0;
+    exception_ptr error = nullptr;
+    mutex error_mutex;
+    
+    auto thread_fn = [&]() {
+        size_t i = job_index.fetch_add(1);
+        
+        while (i < components.size()) {
+            try {
+                // the component's IDs are handed off to the subgraph, which frees them when it is done
+                BitmapSubgraphOverlay bridge_component(&index.get_graph(), move(components[i]));
+                f(i, bridge_component, component_bridges[i], n_component_threads);
+            }
+            catch (...) {
+                lock_guard<mutex> lock(error_mutex);
+                if (!error) {
+                    error = current_exception();
                 }
-                
-                // we can always look across edges
-                graph.follow_edges(node, false, [&](const handle_t& next) {
-                    handle_t adjacent = graph.flip(next);
-                    if (!visited.count(adjacent)) {
-                        node_ids.insert(graph.get_id(adjacent));
-                        visited.insert(adjacent);
-                        stack.push_back(adjacent);
-                    }
-                });
             }
             
-            // make a component subgraph and execute the lambda
-            SubgraphOverlay bridge_component(&graph, &node_ids);
-            f(bridge_component, adjacent_bridges);
+            i = job_index.fetch_add(1);
         }
-    });
+    };
+    
+    vector<thread> threads;
+    for (size_t t = 0; t < n_workers; ++t) {
+        try {
+            threads.emplace_back(thread_fn);
+        } catch (const std::exception &e) {
+            cerr << e.what() << "\n";
+            exit(1);
+        }
+    }
+    
+    for (auto& t : threads) {
+        t.join();
+    }
+    
+    if (error) {
+        rethrow_exception(error);
+    }
+    
+    return components.size();
 }
 
 }
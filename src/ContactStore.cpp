@@ -0,0 +1,416 @@
+#include "ContactStore.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <iostream>
+#include <fstream>
+#include <limits>
+
+using std::runtime_error;
+using std::to_string;
+using std::ofstream;
+using std::ifstream;
+using std::cerr;
+using std::max;
+
+
+namespace gfase {
+
+
+const uint64_t ContactStore::empty_key = std::numeric_limits<uint64_t>::max();
+
+// "GFASECS" followed by a null byte, when read as little-endian chars
+const uint64_t ContactStore::magic = 0x0053434553414647;
+
+const uint32_t ContactStore::version = 1;
+
+
+/// Finalizer from MurmurHash3, so that neighboring IDs don't cluster in the table
+uint64_t hash_contact_key(uint64_t key){
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccd;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53;
+    key ^= key >> 33;
+    return key;
+}
+
+
+ContactStore::ContactStore():
+        entries(16, {empty_key, {}}),
+        n_entries(0),
+        mask(15)
+{}
+
+
+uint64_t ContactStore::pack(uint32_t a, uint32_t b){
+    if (a > b){
+        std::swap(a,b);
+    }
+
+    return (uint64_t(a) << 32) | uint64_t(b);
+}
+
+
+size_t ContactStore::get_bin(uint8_t mapq){
+    size_t bin = 0;
+
+    while (bin + 1 < n_mapq_bins and mapq >= mapq_bin_starts[bin + 1]){
+        bin++;
+    }
+
+    return bin;
+}
+
+
+size_t ContactStore::get_min_bin(uint8_t min_mapq){
+    size_t bin = 0;
+
+    while (bin < n_mapq_bins and mapq_bin_starts[bin] < min_mapq){
+        bin++;
+    }
+
+    return bin;
+}
+
+
+void ContactStore::reserve(size_t n){
+    // Keep the load factor at or below 0.5
+    size_t capacity = entries.size();
+    while (capacity < 2*n){
+        capacity *= 2;
+    }
+
+    while (entries.size() < capacity){
+        grow();
+    }
+}
+
+
+void ContactStore::grow(){
+    vector<ContactStoreEntry> old_entries(entries.size()*2, {empty_key, {}});
+    old_entries.swap(entries);
+
+    mask = entries.size() - 1;
+
+    for (auto& entry: old_entries){
+        if (entry.key == empty_key){
+            continue;
+        }
+
+        auto i = hash_contact_key(entry.key) & mask;
+        while (entries[i].key != empty_key){
+            i = (i + 1) & mask;
+        }
+
+        entries[i] = entry;
+    }
+}
+
+
+ContactStoreEntry& ContactStore::find_or_insert(uint64_t key){
+    // Grow before the load factor exceeds 0.75
+    if (4*(n_entries + 1) > 3*entries.size()){
+        grow();
+    }
+
+    auto i = hash_contact_key(key) & mask;
+
+    while (true){
+        auto& entry = entries[i];
+
+        if (entry.key == key){
+            return entry;
+        }
+        else if (entry.key == empty_key){
+            entry.key = key;
+            n_entries++;
+            return entry;
+        }
+
+        i = (i + 1) & mask;
+    }
+}
+
+
+const ContactStoreEntry* ContactStore::find(uint64_t key) const{
+    auto i = hash_contact_key(key) & mask;
+
+    while (true){
+        auto& entry = entries[i];
+
+        if (entry.key == key){
+            return &entry;
+        }
+        else if (entry.key == empty_key){
+            return nullptr;
+        }
+
+        i = (i + 1) & mask;
+    }
+}
+
+
+void ContactStore::increment(uint32_t a, uint32_t b, uint8_t mapq, uint32_t count){
+    find_or_insert(pack(a,b)).counts[get_bin(mapq)] += count;
+}
+
+
+void ContactStore::increment(uint64_t key, const mapq_histogram_t& counts){
+    auto& entry = find_or_insert(key);
+
+    for (size_t i=0; i<n_mapq_bins; i++){
+        entry.counts[i] += counts[i];
+    }
+}
+
+
+void ContactStore::merge(const ContactStore& other){
+    reserve(max(n_entries, other.n_entries));
+
+    for (auto& entry: other.entries){
+        if (entry.key != empty_key){
+            increment(entry.key, entry.counts);
+        }
+    }
+}
+
+
+uint32_t ContactStore::get_count(uint32_t a, uint32_t b, uint8_t min_mapq) const{
+    auto entry = find(pack(a,b));
+
+    if (entry == nullptr){
+        return 0;
+    }
+
+    uint32_t count = 0;
+    for (size_t i=get_min_bin(min_mapq); i<n_mapq_bins; i++){
+        count += entry->counts[i];
+    }
+
+    return count;
+}
+
+
+void ContactStore::for_each_contact(const function<void(uint32_t a, uint32_t b, const mapq_histogram_t& counts)>& f) const{
+    for (auto& entry: entries){
+        if (entry.key != empty_key){
+            f(uint32_t(entry.key >> 32), uint32_t(entry.key & 0xffffffff), entry.counts);
+        }
+    }
+}
+
+
+void ContactStore::for_each_contact(uint8_t min_mapq, const function<void(uint32_t a, uint32_t b, uint32_t count)>& f) const{
+    auto min_bin = get_min_bin(min_mapq);
+
+    if (min_bin < n_mapq_bins and mapq_bin_starts[min_bin] != min_mapq){
+        cerr << "WARNING: min_mapq " << int(min_mapq) << " is not a bin boundary, using contacts with mapq >= "
+             << int(mapq_bin_starts[min_bin]) << '\n';
+    }
+
+    for (auto& entry: entries){
+        if (entry.key == empty_key){
+            continue;
+        }
+
+        uint32_t count = 0;
+        for (size_t i=min_bin; i<n_mapq_bins; i++){
+            count += entry.counts[i];
+        }
+
+        if (count > 0){
+            f(uint32_t(entry.key >> 32), uint32_t(entry.key & 0xffffffff), count);
+        }
+    }
+}
+
+
+size_t ContactStore::size() const{
+    return n_entries;
+}
+
+
+void ContactStore::clear(){
+    entries.assign(16, {empty_key, {}});
+    n_entries = 0;
+    mask = 15;
+}
+
+
+void ContactStore::write_to_binary(path output_path) const{
+    ///
+    /// Layout: magic, version, n_bins, bin starts, names (as n, then length + bytes for each), and then only the
+    /// occupied entries (as n, then key + histogram for each)
+    ///
+
+    ofstream file(output_path, std::ios::binary);
+
+    if (not file.is_open() or not file.good()){
+        throw runtime_error("ERROR: could not write to file: " + output_path.string());
+    }
+
+    auto n_bins = uint32_t(n_mapq_bins);
+    auto n_names = uint64_t(names.size());
+    auto n = uint64_t(n_entries);
+
+    file.write(reinterpret_cast<const char*>(&magic), sizeof(magic));
+    file.write(reinterpret_cast<const char*>(&version), sizeof(version));
+    file.write(reinterpret_cast<const char*>(&n_bins), sizeof(n_bins));
+    file.write(reinterpret_cast<const char*>(mapq_bin_starts.data()), n_mapq_bins);
+
+    file.write(reinterpret_cast<const char*>(&n_names), sizeof(n_names));
+    for (auto& name: names){
+        auto length = uint64_t(name.size());
+        file.write(reinterpret_cast<const char*>(&length), sizeof(length));
+        file.write(name.data(), std::streamsize(length));
+    }
+
+    file.write(reinterpret_cast<const char*>(&n), sizeof(n));
+    for (auto& entry: entries){
+        if (entry.key != empty_key){
+            file.write(reinterpret_cast<const char*>(&entry.key), sizeof(entry.key));
+            file.write(reinterpret_cast<const char*>(entry.counts.data()), sizeof(mapq_histogram_t));
+        }
+    }
+
+    if (not file.good()){
+        throw runtime_error("ERROR: failed while writing file: " + output_path.string());
+    }
+}
+
+
+ContactStore::ContactStore(path binary_path):
+        ContactStore()
+{
+    ifstream file(binary_path, std::ios::binary);
+
+    if (not (file.is_open() and file.good())){
+        throw runtime_error("ERROR: could not read file: " + binary_path.string());
+    }
+
+    auto read = [&](void* destination, size_t n_bytes){
+        file.read(reinterpret_cast<char*>(destination), std::streamsize(n_bytes));
+
+        if (size_t(file.gcount()) != n_bytes){
+            throw runtime_error("ERROR: unexpected end of file: " + binary_path.string());
+        }
+    };
+
+    uint64_t file_magic;
+    uint32_t file_version;
+    uint32_t n_bins;
+    array<uint8_t,n_mapq_bins> bin_starts;
+
+    read(&file_magic, sizeof(file_magic));
+    if (file_magic != magic){
+        throw runtime_error("ERROR: file is not a GFAse contact store: " + binary_path.string());
+    }
+
+    read(&file_version, sizeof(file_version));
+    if (file_version != version){
+        throw runtime_error("ERROR: unsupported contact store version " + to_string(file_version) + " in file: " + binary_path.string());
+    }
+
+    read(&n_bins, sizeof(n_bins));
+    if (n_bins != n_mapq_bins){
+        throw runtime_error("ERROR: contact store has " + to_string(n_bins) + " mapq bins, expected " + to_string(n_mapq_bins));
+    }
+
+    read(bin_starts.data(), n_mapq_bins);
+    if (bin_starts != mapq_bin_starts){
+        throw runtime_error("ERROR: contact store mapq bins do not match: " + binary_path.string());
+    }
+
+    uint64_t n_names;
+    read(&n_names, sizeof(n_names));
+    names.resize(n_names);
+
+    for (auto& name: names){
+        uint64_t length;
+        read(&length, sizeof(length));
+        name.resize(length);
+        read(name.data(), length);
+    }
+
+    uint64_t n;
+    read(&n, sizeof(n));
+    reserve(n);
+
+    for (uint64_t i=0; i<n; i++){
+        ContactStoreEntry entry;
+        read(&entry.key, sizeof(entry.key));
+        read(entry.counts.data(), sizeof(mapq_histogram_t));
+
+        if ((entry.key >> 32) >= names.size() or (entry.key & 0xffffffff) >= names.size()){
+            throw runtime_error("ERROR: contact store entry has ID outside of name table: " + binary_path.string());
+        }
+
+        increment(entry.key, entry.counts);
+    }
+}
+
+
+void ContactStore::write_to_csv(path output_path) const{
+    ofstream file(output_path);
+
+    if (not file.is_open() or not file.good()){
+        throw runtime_error("ERROR: could not write to file: " + output_path.string());
+    }
+
+    file << "name_a,name_b";
+    for (auto& start: mapq_bin_starts){
+        file << ",mapq_" << int(start);
+    }
+    file << '\n';
+
+    for_each_contact([&](uint32_t a, uint32_t b, const mapq_histogram_t& counts){
+        file << names.at(a) << ',' << names.at(b);
+
+        for (auto& count: counts){
+            file << ',' << count;
+        }
+
+        file << '\n';
+    });
+}
+
+
+void ContactStore::write_to_mapq_list_csv(path output_path) const{
+    ofstream file(output_path);
+
+    if (not file.is_open() or not file.good()){
+        throw runtime_error("ERROR: could not write to file: " + output_path.string());
+    }
+
+    auto write_line = [&](uint32_t a, uint32_t b, const mapq_histogram_t& counts){
+        file << names.at(a) << ',' << names.at(b) << ',';
+
+        bool first = true;
+        for (size_t i=0; i<n_mapq_bins; i++){
+            if (counts[i] == 0){
+                continue;
+            }
+
+            if (not first){
+                file << ' ';
+            }
+
+            file << int(mapq_bin_starts[i]) << ':' << counts[i];
+            first = false;
+        }
+
+        file << '\n';
+    };
+
+    for_each_contact([&](uint32_t a, uint32_t b, const mapq_histogram_t& counts){
+        write_line(a, b, counts);
+
+        if (a != b){
+            write_line(b, a, counts);
+        }
+    });
+}
+
+
+}
@@ -1,49 +1,124 @@
 #include "GfaReader.hpp"
+#include "MurmurHash2.hpp"
 #include "BinaryIO.hpp"
 #include <iostream>
 #include <fstream>
 #include <string>
-
+#include <thread>
+#include <atomic>
+#include <cstring>
+#include <exception>
+#include <mutex>
+#include <limits>
+
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <ctime>
 #include <cstdio>
 
 using ::stat;
-using std::difftime;
+using std::thread;
+using std::atomic;
+using std::min;
+using std::max;
+using std::to_string;
 using std::stoi;
 using std::cout;
 using std::ofstream;
 using std::runtime_error;
+using std::exception;
 
 
 const char GfaReader::EOF_CODE = 'X';
 
+// "GFASEIDX" when read as little-endian chars
+const uint64_t GfaReader::INDEX_MAGIC = 0x5844494553414647;
+const uint32_t GfaReader::INDEX_VERSION = 2;
+
+
 GFAIndex::GFAIndex(char type, uint64_t offset){
     this->type = type;
     this->offset = offset;
 }
 
 
-void GfaReader::ensure_index_up_to_date(){
-    struct stat index_file_stat;
-    stat(gfa_index_path.c_str(), &index_file_stat);
+/// LEB128-style variable length integers, 7 bits per byte, so small deltas take 1 byte
+void write_varint(string& s, uint64_t value){
+    while (value >= 0x80){
+        s += char((value & 0x7f) | 0x80);
+        value >>= 7;
+    }
+    s += char(value);
+}
 
-    struct stat gfa_file_stat;
-    stat(gfa_path.c_str(), &gfa_file_stat);
 
-    cerr << "diff index_file_stat, gfa_file_stat: " << difftime(index_file_stat.st_ctime, gfa_file_stat.st_ctime) << '\n';
+bool read_varint(const char*& p, const char* end, uint64_t& value){
+    value = 0;
+
+    for (size_t shift=0; shift<64; shift+=7){
+        if (p >= end){
+            return false;
+        }
+
+        auto byte = uint8_t(*p++);
+        value |= uint64_t(byte & 0x7f) << shift;
 
-    if (difftime(index_file_stat.st_ctime, gfa_file_stat.st_ctime) < 0){
-        throw runtime_error("ERROR index file is older than GFA: " + gfa_index_path.string());
+        if ((byte & 0x80) == 0){
+            return true;
+        }
     }
+
+    return false;
 }
 
 
-GfaReader::GfaReader(path gfa_path){
+bool read_u64(const char*& p, const char* end, uint64_t& value){
+    if (size_t(end - p) < sizeof(uint64_t)){
+        return false;
+    }
+
+    memcpy(&value, p, sizeof(uint64_t));
+    p += sizeof(uint64_t);
+
+    return true;
+}
+
+
+uint64_t GfaReader::compute_sampled_hash() const{
+    ///
+    /// Hash a fixed number of evenly spaced blocks, including the first and last, seeded by the file size. Small files
+    /// are hashed entirely. This catches nearly all edits without having to read a multi-GB GFA on every open.
+    ///
+
+    const size_t n_samples = 64;
+    const size_t sample_length = 4096;
+
+    uint64_t hash = this->data_length;
+
+    if (this->data_length <= n_samples*sample_length){
+        return MurmurHash64A(this->data, int(this->data_length), hash);
+    }
+
+    for (size_t i=0; i<n_samples; i++){
+        size_t start = ((this->data_length - sample_length) * i) / (n_samples - 1);
+        hash = MurmurHash64A(this->data + start, int(sample_length), hash);
+    }
+
+    return hash;
+}
+
+
+GfaReader::GfaReader(path gfa_path, size_t n_threads){
     this->gfa_path = gfa_path;
     this->gfa_index_path = gfa_path;
     this->gfa_index_path.replace_extension("gfai");
     this->gfa_file_descriptor = -1;
+    this->data = nullptr;
+    this->data_length = 0;
+    this->n_threads = max(size_t(1), n_threads);
+    this->index_data = nullptr;
+    this->index_length = 0;
+    this->index_names_offset = 0;
 
     // Test file
     ifstream test_stream(this->gfa_path);
@@ -51,18 +126,25 @@ GfaReader::GfaReader(path gfa_path){
         throw runtime_error("ERROR: file could not be opened: " + this->gfa_path.string());
     }
 
-    // Check if index exists, and generate one if necessary
-    if (!exists(this->gfa_index_path)) {
-        cerr << "No index found, generating .gfai for " << this->gfa_path << " ... ";
+    this->map_file();
 
-        this->index();
-        cerr << "done\n";
-    }
-    // If index is found, load it
-    else{
+    // If an index is found and it matches the GFA, load it, otherwise (re)generate it
+    bool loaded = false;
+
+    if (exists(this->gfa_index_path)) {
         cerr << "Found index, loading from disk: " << this->gfa_index_path << " ... ";
 
-        this->read_index();
+        loaded = this->read_index();
+
+        if (loaded){
+            cerr << "done\n";
+        }
+    }
+
+    if (not loaded){
+        cerr << "Generating .gfai for " << this->gfa_path << " ... ";
+
+        this->index();
         cerr << "done\n";
     }
 
@@ -72,98 +154,608 @@ GfaReader::GfaReader(path gfa_path){
 
 
 GfaReader::~GfaReader(){
-    if (fcntl(this->gfa_file_descriptor, F_GETFD)){
+    if (this->index_data != nullptr){
+        ::munmap(const_cast<char*>(this->index_data), this->index_length);
+    }
+
+    if (this->data != nullptr){
+        ::munmap(const_cast<char*>(this->data), this->data_length);
+    }
+
+    if (this->gfa_file_descriptor != -1){
         ::close(this->gfa_file_descriptor);
     }
 }
 
 
-void GfaReader::read_index(){
-    // Open the input file.
+void GfaReader::map_file(){
+    this->gfa_file_descriptor = ::open(this->gfa_path.c_str(), O_RDONLY);
+
+    if (this->gfa_file_descriptor == -1){
+        throw runtime_error("ERROR: could not open file: " + this->gfa_path.string());
+    }
+
+    struct stat gfa_file_stat;
+    if (fstat(this->gfa_file_descriptor, &gfa_file_stat) != 0){
+        throw runtime_error("ERROR: could not stat file: " + this->gfa_path.string());
+    }
+
+    this->data_length = size_t(gfa_file_stat.st_size);
+
+    // Empty files can't be mapped, but they are valid (empty) GFAs
+    if (this->data_length == 0){
+        return;
+    }
+
+    void* result = ::mmap(nullptr, this->data_length, PROT_READ, MAP_PRIVATE, this->gfa_file_descriptor, 0);
+
+    if (result == MAP_FAILED){
+        throw runtime_error("ERROR: could not mmap file: " + this->gfa_path.string() + " " + string(::strerror(errno)));
+    }
+
+    this->data = static_cast<const char*>(result);
+}
+
+
+bool GfaReader::read_index(){
+    ///
+    /// Map the whole index at once and decode it. Returns false (with a message) if the index is from another version,
+    /// was made for a different GFA, or is truncated, so that the caller can regenerate it.
+    ///
+
     int file_descriptor = ::open(this->gfa_index_path.c_str(), O_RDONLY);
 
-    // Verify it is working
     if(file_descriptor == -1) {
         throw runtime_error("ERROR: could not read " + this->gfa_index_path.string());
     }
 
-    ensure_index_up_to_date();
-
-    // Find file size in bytes, calculate number of entries in file
-    off_t file_length = lseek(file_descriptor, 0, SEEK_END);
-    off_t n_entries = file_length / (sizeof(uint64_t) + sizeof(char));
+    struct stat index_file_stat;
+    if (fstat(file_descriptor, &index_file_stat) != 0){
+        ::close(file_descriptor);
+        throw runtime_error("ERROR: could not stat file: " + this->gfa_index_path.string());
+    }
 
-    // Initialize index to track position in file (AKA cursor)
-    off_t byte_index = 0;
+    size_t length = size_t(index_file_stat.st_size);
+    const char* index = nullptr;
 
-    // Read all the chunks and add them to the index data structures
-    for (off_t i = 0; i < n_entries; i++){
-        char c;
-        uint64_t offset;
+    if (length > 0){
+        void* result = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, file_descriptor, 0);
 
-        pread_value_from_binary(file_descriptor,  c, byte_index);
-        pread_value_from_binary(file_descriptor,  offset, byte_index);
+        if (result == MAP_FAILED){
+            ::close(file_descriptor);
+            throw runtime_error("ERROR: could not mmap file: " + this->gfa_index_path.string() + " " + string(::strerror(errno)));
+        }
 
-        this->line_offsets.emplace_back(c, offset);
-        this->line_indexes_by_type[c].emplace_back(this->line_offsets.size() - 1);
+        index = static_cast<const char*>(result);
     }
 
     ::close(file_descriptor);
+
+    auto reject = [&](const string& reason){
+        cerr << reason << '\n';
+
+        if (index != nullptr){
+            ::munmap(const_cast<char*>(index), length);
+        }
+
+        this->line_offsets.clear();
+        this->line_indexes_by_type.clear();
+
+        return false;
+    };
+
+    const char* p = index;
+    const char* end = index + length;
+
+    uint64_t magic;
+    uint64_t version_and_types;
+    uint64_t gfa_size;
+    uint64_t gfa_hash;
+    uint64_t n_lines;
+
+    if (not (read_u64(p, end, magic) and magic == INDEX_MAGIC)){
+        return reject("index is not in the current format");
+    }
+
+    if (not (read_u64(p, end, version_and_types) and uint32_t(version_and_types) == INDEX_VERSION)){
+        return reject("index version does not match");
+    }
+
+    auto n_types = version_and_types >> 32;
+
+    if (not (read_u64(p, end, gfa_size) and read_u64(p, end, gfa_hash) and read_u64(p, end, n_lines))){
+        return reject("index header is truncated");
+    }
+
+    if (gfa_size != this->data_length or gfa_hash != this->compute_sampled_hash()){
+        return reject("index does not match GFA contents");
+    }
+
+    // Counts are checked against what the remaining bytes could hold before anything is allocated from them. Each type
+    // has a 24 byte header, and every line is at least one byte of the GFA.
+    if (n_types > size_t(end - p)/24 or n_lines > this->data_length){
+        return reject("index has inconsistent counts");
+    }
+
+    // Decode the offsets for each type
+    vector <pair <char, vector<uint64_t> > > offsets_by_type(n_types);
+
+    for (auto& [type, offsets]: offsets_by_type){
+        uint64_t type_code;
+        uint64_t n;
+        uint64_t n_bytes;
+
+        if (not (read_u64(p, end, type_code) and read_u64(p, end, n) and read_u64(p, end, n_bytes)) or n_bytes > size_t(end - p)){
+            return reject("index is truncated");
+        }
+
+        // Every offset is encoded in at least one byte
+        if (n > n_bytes){
+            return reject("index is truncated");
+        }
+
+        type = char(type_code);
+        offsets.resize(n);
+
+        const char* type_end = p + n_bytes;
+        uint64_t offset = 0;
+
+        for (auto& item: offsets){
+            uint64_t delta;
+
+            if (not read_varint(p, type_end, delta)){
+                return reject("index is truncated");
+            }
+
+            offset += delta;
+            item = offset;
+        }
+
+        p = type_end;
+    }
+
+    // Rebuild the file-ordered line index by merging the per-type offsets, which are each sorted
+    this->line_offsets.clear();
+    this->line_offsets.reserve(n_lines + 1);
+    vector<size_t> cursors(n_types, 0);
+
+    for (uint64_t i=0; i<n_lines; i++){
+        size_t min_type = n_types;
+        uint64_t min_offset = std::numeric_limits<uint64_t>::max();
+
+        for (size_t t=0; t<n_types; t++){
+            auto& offsets = offsets_by_type[t].second;
+
+            if (cursors[t] < offsets.size() and offsets[cursors[t]] < min_offset){
+                min_offset = offsets[cursors[t]];
+                min_type = t;
+            }
+        }
+
+        if (min_type == n_types or min_offset >= this->data_length){
+            return reject("index has inconsistent line counts");
+        }
+
+        auto type = offsets_by_type[min_type].first;
+        this->line_offsets.emplace_back(type, min_offset);
+        this->line_indexes_by_type[type].emplace_back(this->line_offsets.size() - 1);
+        cursors[min_type]++;
+    }
+
+    // Append a placeholder to tell the total length of the file
+    this->line_offsets.emplace_back(this->EOF_CODE, this->data_length);
+
+    // Check that the name table is present, but only decode it if map_sequences_by_node is called
+    uint64_t n_names;
+    uint64_t n_name_bytes;
+    auto names_offset = size_t(p - index);
+
+    if (not (read_u64(p, end, n_names) and read_u64(p, end, n_name_bytes)) or n_name_bytes != size_t(end - p)){
+        return reject("index name table is truncated");
+    }
+
+    if (n_names != this->get_line_count('S')){
+        return reject("index name table does not match sequence count");
+    }
+
+    this->index_data = index;
+    this->index_length = length;
+    this->index_names_offset = names_offset;
+
+    return true;
 }
 
 
-void GfaReader::write_index_to_binary_file(){
-    ofstream index_file(this->gfa_index_path);
+void GfaReader::write_index_to_binary_file(const vector<string_view>& sequence_names){
+    ///
+    /// Layout, with all fixed width fields as uint64:
+    ///   magic, version | (n_types << 32), GFA size, GFA sampled hash, n_lines
+    ///   for each line type: type, n, n_bytes, delta encoded offsets as varints
+    ///   n_sequences, n_bytes, (varint length + name) for each S line in file order
+    ///
+
+    string buffer;
+
+    auto append_u64 = [&](uint64_t value){
+        buffer.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    };
+
+    append_u64(INDEX_MAGIC);
+    append_u64(uint64_t(INDEX_VERSION) | (uint64_t(this->line_indexes_by_type.size()) << 32));
+    append_u64(this->data_length);
+    append_u64(this->compute_sampled_hash());
+    append_u64(this->line_offsets.size() - 1);
+
+    string encoded;
+    for (auto& [type, line_indexes]: this->line_indexes_by_type){
+        encoded.clear();
+
+        uint64_t prev = 0;
+        for (auto& i: line_indexes){
+            write_varint(encoded, this->line_offsets[i].offset - prev);
+            prev = this->line_offsets[i].offset;
+        }
+
+        append_u64(uint64_t(uint8_t(type)));
+        append_u64(line_indexes.size());
+        append_u64(encoded.size());
+        buffer += encoded;
+    }
+
+    encoded.clear();
+    for (auto& name: sequence_names){
+        write_varint(encoded, name.size());
+        encoded += name;
+    }
+
+    append_u64(sequence_names.size());
+    append_u64(encoded.size());
+    buffer += encoded;
+
+    // Write to a temporary file and then rename it, so that no other process can see a partially written index
+    path temp_path = this->gfa_index_path.string() + ".tmp" + to_string(::getpid());
 
-    for (auto& item: this->line_offsets){
-        // Write a pair, denoting the line type and the byte offset for the start of that line
-        write_value_to_binary(index_file, item.type);
-        write_value_to_binary(index_file, item.offset);
+    {
+        ofstream index_file(temp_path, std::ios::binary);
+        index_file.write(buffer.data(), std::streamsize(buffer.size()));
+
+        if (not index_file.good()){
+            cerr << "WARNING: could not write index file: " << temp_path << '\n';
+            return;
+        }
+    }
+
+    std::error_code error;
+    rename(temp_path, this->gfa_index_path, error);
+
+    if (error){
+        cerr << "WARNING: could not write index file: " << this->gfa_index_path << " " << error.message() << '\n';
+        remove(temp_path, error);
     }
 }
 
 
 void GfaReader::index() {
-    ifstream gfa_file(this->gfa_path);
-    uint64_t byte_offset = 0;
-    bool newline = true;
-    char gfa_type_code;
-    char c;
-
     // Find all the newlines in the GFA and store each line's byte offset in a vector. Additionally build a map which
     // lists all the positions in the index vector for each line type (e.g. S,L,H,U, etc.), so they can be iterated even
     // if they are not grouped or in order (which is not required by the GFA format spec)
-    while (gfa_file.get(c)){
-        if (c == '\n'){
-            newline = true;
+    //
+    // The mapped file is split into one contiguous range per thread. A line is owned by the range containing the
+    // newline that precedes it, which keeps the per-range results in file order so they can just be concatenated.
+    // memchr does the actual scanning, which is vectorized in any reasonable libc.
+    size_t n_ranges = min(this->n_threads, max(size_t(1), this->data_length / (1024*1024)));
+    vector <vector <GFAIndex> > range_offsets(n_ranges);
+    vector <thread> threads;
+
+    auto scan_range = [&](size_t r){
+        size_t start = (this->data_length * r) / n_ranges;
+        size_t stop = (this->data_length * (r + 1)) / n_ranges;
+
+        auto& offsets = range_offsets[r];
+
+        // The first line in the file has no preceding newline
+        if (r == 0 and this->data_length > 0 and this->data[0] != '\n'){
+            offsets.emplace_back(this->data[0], 0);
         }
-        else{
-            if (newline) {
-                gfa_type_code = c;
-                this->line_offsets.emplace_back(gfa_type_code, byte_offset);
-                this->line_indexes_by_type[gfa_type_code].emplace_back(this->line_offsets.size() - 1);
-                newline = false;
+
+        const char* p = this->data + start;
+        const char* end = this->data + stop;
+
+        while (p < end){
+            auto newline = static_cast<const char*>(memchr(p, '\n', end - p));
+
+            if (newline == nullptr){
+                break;
             }
+
+            size_t line_start = (newline - this->data) + 1;
+
+            // Consecutive newlines (empty lines) are skipped
+            if (line_start < this->data_length and this->data[line_start] != '\n'){
+                offsets.emplace_back(this->data[line_start], line_start);
+            }
+
+            p = newline + 1;
+        }
+    };
+
+    for (size_t r=0; r<n_ranges; r++){
+        threads.emplace_back(scan_range, r);
+    }
+
+    for (auto& t: threads){
+        t.join();
+    }
+
+    size_t n_lines = 0;
+    for (auto& offsets: range_offsets){
+        n_lines += offsets.size();
+    }
+
+    this->line_offsets.clear();
+    this->line_offsets.reserve(n_lines + 1);
+
+    for (auto& offsets: range_offsets){
+        for (auto& item: offsets){
+            this->line_offsets.emplace_back(item);
+            this->line_indexes_by_type[item.type].emplace_back(this->line_offsets.size() - 1);
         }
-        byte_offset++;
+
+        offsets.clear();
+        offsets.shrink_to_fit();
     }
 
     // Append a placeholder to tell the total length of the file
-    this->line_offsets.emplace_back(this->EOF_CODE, byte_offset);
-    this->write_index_to_binary_file();
+    this->line_offsets.emplace_back(this->EOF_CODE, this->data_length);
+
+    vector<string_view> sequence_names(this->get_line_count('S'));
+
+    for_each_sequence_view(this->n_threads, [&](size_t thread_index, const GfaSequenceView& s){
+        sequence_names[s.index] = s.name;
+    });
+
+    this->write_index_to_binary_file(sequence_names);
 }
 
 
 void GfaReader::read_line(string& s, size_t index){
-    if (this->gfa_file_descriptor == -1){
-        this->gfa_file_descriptor = ::open(this->gfa_path.c_str(), O_RDONLY);
+    size_t offset_start = this->line_offsets[index].offset;
+    size_t offset_stop = this->line_offsets[index+1].offset;
+
+    s.assign(this->data + offset_start, offset_stop - offset_start);
+}
+
+
+string_view GfaReader::get_line(size_t index) const{
+    size_t offset_start = this->line_offsets[index].offset;
+    size_t offset_stop = this->line_offsets[index+1].offset;
+
+    // Trim the newline(s) and any carriage return
+    while (offset_stop > offset_start and (this->data[offset_stop-1] == '\n' or this->data[offset_stop-1] == '\r')){
+        offset_stop--;
+    }
+
+    return {this->data + offset_start, offset_stop - offset_start};
+}
+
+
+size_t GfaReader::get_line_count(char type) const{
+    auto result = this->line_indexes_by_type.find(type);
+
+    if (result == this->line_indexes_by_type.end()){
+        return 0;
+    }
+
+    return result->second.size();
+}
+
+
+/// Split a GFA line on whitespace, stopping once max_fields have been found. Like the original character parsers, every
+/// delimiter character starts a new field.
+void split_gfa_line(string_view line, size_t max_fields, vector<string_view>& fields){
+    fields.clear();
+
+    size_t start = 0;
+    for (size_t i=0; i<line.size() and fields.size() + 1 < max_fields; i++){
+        if (isspace(line[i])){
+            fields.emplace_back(line.substr(start, i - start));
+            start = i + 1;
+        }
+    }
+
+    auto stop = start;
+    while (stop < line.size() and not isspace(line[stop])){
+        stop++;
+    }
+
+    fields.emplace_back(line.substr(start, stop - start));
+}
+
+
+void GfaReader::parse_sequence(string_view line, GfaSequenceView& s){
+    thread_local vector<string_view> fields;
+    split_gfa_line(line, 3, fields);
+
+    s.name = fields.size() > 1 ? fields[1] : string_view();
+    s.sequence = fields.size() > 2 ? fields[2] : string_view();
+}
+
+
+void GfaReader::parse_link(string_view line, GfaLinkView& l){
+    thread_local vector<string_view> fields;
+    split_gfa_line(line, 6, fields);
+
+    if (fields.size() < 5){
+        throw runtime_error("ERROR: too few fields in GFA link: " + string(line));
+    }
+
+    l.node_a = fields[1];
+    l.reversal_a = (not fields[2].empty() and fields[2][0] == '-');
+    l.node_b = fields[3];
+    l.reversal_b = (not fields[4].empty() and fields[4][0] == '-');
+    l.cigar = fields.size() > 5 ? fields[5] : string_view();
+}
+
+
+void GfaReader::parse_path(string_view line, GfaPathView& p){
+    thread_local vector<string_view> fields;
+    split_gfa_line(line, 4, fields);
+
+    p.name = fields.size() > 1 ? fields[1] : string_view();
+    p.nodes.clear();
+    p.reversals.clear();
+    p.cigars.clear();
+
+    string_view steps = fields.size() > 2 ? fields[2] : string_view();
+    string_view overlaps = fields.size() > 3 ? fields[3] : string_view();
+
+    while (not steps.empty()){
+        auto comma = steps.find(',');
+        auto step = steps.substr(0, comma);
+
+        if (step.empty() or not (step.back() == '+' or step.back() == '-')){
+            throw runtime_error("ERROR: parsing path " + string(p.name));
+        }
+
+        p.nodes.emplace_back(step.substr(0, step.size() - 1));
+        p.reversals.emplace_back(step.back() == '-');
+
+        if (comma == string_view::npos){
+            break;
+        }
+
+        steps.remove_prefix(comma + 1);
+    }
+
+    // "Cigars' is allowed to be empty if a path has only 1 node, and "*" means that overlaps are unspecified
+    if (overlaps == "*"){
+        for (size_t i=1; i<p.nodes.size(); i++){
+            p.cigars.emplace_back(overlaps);
+        }
+        overlaps = {};
+    }
+
+    while (not overlaps.empty()){
+        auto comma = overlaps.find(',');
+        p.cigars.emplace_back(overlaps.substr(0, comma));
+
+        if (comma == string_view::npos){
+            break;
+        }
+
+        overlaps.remove_prefix(comma + 1);
+    }
+
+    if (p.cigars.size() + 1 != p.nodes.size()){
+        throw runtime_error("ERROR: incorrect quantity of path cigars/overlaps for path: " + string(p.name));
+    }
+}
+
+
+void GfaReader::for_each_line_view_of_type(
+        char type,
+        size_t n_threads,
+        const function<void(size_t thread_index, size_t index, string_view line)>& f) const{
+
+    auto result = this->line_indexes_by_type.find(type);
+
+    if (result == this->line_indexes_by_type.end()){
+        return;
+    }
+
+    auto& line_indexes = result->second;
+
+    if (n_threads <= 1){
+        for (size_t i=0; i<line_indexes.size(); i++){
+            f(0, i, get_line(line_indexes[i]));
+        }
+        return;
     }
 
-    off_t offset_start = this->line_offsets[index].offset;
-    off_t offset_stop = this->line_offsets[index+1].offset;
-    off_t length = offset_stop - offset_start;
+    // Lines are handed out in chunks so that threads don't contend on the job index for short lines
+    const size_t chunk_size = 256;
+    atomic<size_t> job_index = 0;
+    vector<thread> threads;
+
+    // The first exception thrown in any thread (e.g. from parsing a malformed line) is rethrown after joining
+    std::exception_ptr worker_exception;
+    std::mutex exception_mutex;
+
+    auto thread_fn = [&](size_t thread_index){
+        try {
+            size_t start = job_index.fetch_add(chunk_size);
+
+            while (start < line_indexes.size()){
+                auto stop = min(start + chunk_size, line_indexes.size());
+
+                for (size_t i=start; i<stop; i++){
+                    f(thread_index, i, get_line(line_indexes[i]));
+                }
+
+                start = job_index.fetch_add(chunk_size);
+            }
+        }
+        catch (...) {
+            std::lock_guard<std::mutex> lock(exception_mutex);
+            if (not worker_exception){
+                worker_exception = std::current_exception();
+            }
+
+            // Stop handing out chunks
+            job_index = line_indexes.size();
+        }
+    };
+
+    for (size_t n=0; n<n_threads; n++){
+        try {
+            threads.emplace_back(thread_fn, n);
+        } catch (const exception &e) {
+            cerr << e.what() << "\n";
+            exit(1);
+        }
+    }
+
+    for (auto& t: threads){
+        t.join();
+    }
 
-    pread_string_from_binary(this->gfa_file_descriptor, s, length, offset_start);
+    if (worker_exception){
+        std::rethrow_exception(worker_exception);
+    }
+}
+
+
+void GfaReader::for_each_sequence_view(size_t n_threads, const function<void(size_t thread_index, const GfaSequenceView& s)>& f) const{
+    for_each_line_view_of_type('S', n_threads, [&](size_t thread_index, size_t index, string_view line){
+        GfaSequenceView s;
+        parse_sequence(line, s);
+        s.index = index;
+
+        f(thread_index, s);
+    });
+}
+
+
+void GfaReader::for_each_link_view(size_t n_threads, const function<void(size_t thread_index, const GfaLinkView& l)>& f) const{
+    for_each_line_view_of_type('L', n_threads, [&](size_t thread_index, size_t index, string_view line){
+        GfaLinkView l;
+        parse_link(line, l);
+        l.index = index;
+
+        f(thread_index, l);
+    });
+}
+
+
+void GfaReader::for_each_path_view(size_t n_threads, const function<void(size_t thread_index, const GfaPathView& p)>& f) const{
+    for_each_line_view_of_type('P', n_threads, [&](size_t thread_index, size_t index, string_view line){
+        // Reuse the vectors in each path, per thread
+        thread_local GfaPathView p;
+        parse_path(line, p);
+        p.index = index;
+
+        f(thread_index, p);
+    });
 }
 
 
@@ -181,165 +773,44 @@ void GfaReader::for_each_line_of_type(char type, const function<void(string& lin
 
 
 void GfaReader::for_each_sequence(const function<void(string& name, string& sequence)>& f) {
-    for_each_line_of_type('S', [&](string& line){
-        size_t n_delimiters = 0;
-        size_t position = 0;
-        size_t start_position = 0;
-        size_t stop_position = 0;
-        string name;
-
-        for (auto& c: line){
-            if (isspace(c)){
-                if (n_delimiters == 0){
-                    start_position = position + 1;
-                }
-                else if (n_delimiters == 1){
-                    stop_position = position;
-                    name = line.substr(start_position, stop_position - start_position);
+    string name;
+    string sequence;
 
-                    start_position = stop_position + 1;
-                }
-                else if (n_delimiters == 2){
-                    stop_position = position;
-                }
-
-                n_delimiters++;
-            }
-
-            position++;
-        }
+    for_each_sequence_view(1, [&](size_t thread_index, const GfaSequenceView& s){
+        name.assign(s.name);
+        sequence.assign(s.sequence);
 
-        // Trim the line and send that in the "sequence" field to avoid copying the string again.
-        line.erase(stop_position);
-        line.erase(0, start_position);
-
-        f(name, line);
+        f(name, sequence);
     });
 }
 
 
 void GfaReader::for_each_link(const function<void(string& node_a, bool reversal_a, string& node_b, bool reversal_b, string& cigar)>& f) {
-    size_t n_delimiters = 0;
     string node_a;
     string node_b;
     string cigar;
-    bool reversal_a;
-    bool reversal_b;
-
-    for_each_line_of_type('L', [&](string& line){
-        n_delimiters = 0;
-        node_a.resize(0);
-        node_b.resize(0);
-        cigar.resize(0);
-
-        for (auto& c: line){
-            if (not isspace(c)){
-                if (n_delimiters == 1){
-                    node_a += c;
-                }
-                else if (n_delimiters == 2){
-                    reversal_a = (c == '-');
-                }
-                else if (n_delimiters == 3){
-                    node_b += c;
-                }
-                else if (n_delimiters == 4){
-                    reversal_b = (c == '-');
-                }
-                else if (n_delimiters == 5){
-                    cigar += c;
-                }
-            }
-            else{
-                n_delimiters++;
-            }
-        }
 
-        f(node_a, reversal_a, node_b, reversal_b, cigar);
+    for_each_link_view(1, [&](size_t thread_index, const GfaLinkView& l){
+        node_a.assign(l.node_a);
+        node_b.assign(l.node_b);
+        cigar.assign(l.cigar);
+
+        f(node_a, l.reversal_a, node_b, l.reversal_b, cigar);
     });
 }
 
 
 void GfaReader::for_each_path(const function<void(string& path_name, vector<string>& nodes, vector<bool>& reversals, vector<string>& cigars)>& f) {
-    size_t n_delimiters = 0;
-    size_t n_subdelimiters = 0;
     string path_name;
     vector<string> nodes;
     vector<string> cigars;
     vector<bool> reversals;
 
-    for_each_line_of_type('P', [&](string& line){
-        n_delimiters = 0;
-        n_subdelimiters = 0;
-        path_name.resize(0);
-        nodes.resize(0);
-        nodes.emplace_back();
-        cigars.resize(0);
-        reversals.resize(0);
-        size_t index = 0;
-
-        for (auto& c: line){
-            if (not isspace(c)){
-//                cerr << c << ' ' << n_delimiters << ' ' << path_name << '\n';
-
-                if (n_delimiters == 1){
-                    path_name += c;
-                }
-                else if (n_delimiters == 2){
-                    if (c != ','){
-                        if ((c == '+' or c == '-')){
-                            // TODO: check that reversal is always present
-                            if (line[index+1] == ',') {
-                                // Add the reversal for the current node
-                                reversals.emplace_back((c == '-'));
-
-                                // Add another entry to the back of the path to prepare for next node name
-                                nodes.emplace_back();
-                            }
-                            if (isspace(line[index+1])) {
-                                // Add the reversal for the current node ONLY
-                                reversals.emplace_back((c == '-'));
-                            }
-                        }
-                        else{
-                            nodes.back() += c;
-                        }
-                    }
-                    else{
-                        if (nodes.size() != n_subdelimiters + 2){
-                            throw runtime_error("ERROR: parsing path " + path_name);
-                        }
-
-                        n_subdelimiters++;
-                    }
-                }
-                else if (n_delimiters == 3){
-                    if (c == ','){
-                        // Add another entry to the back of the path to prepare for next node name
-                        cigars.emplace_back();
-                    }
-                    else{
-                        if (cigars.empty()){
-                            // "Cigars' is allowed to be empty if a path has only 1 node, so it should only be
-                            // appended if a real cigar is found
-                            cigars.emplace_back();
-                        }
-
-                        cigars.back() += c;
-                    }
-                }
-            }
-            else{
-                n_delimiters++;
-                n_subdelimiters = 0;
-            }
-
-            index++;
-        }
-
-        if (cigars.size() != nodes.size() - 1){
-            throw runtime_error("ERROR: incorrect quantity of path cigars/overlaps for path: " + path_name);
-        }
+    for_each_path_view(1, [&](size_t thread_index, const GfaPathView& p){
+        path_name.assign(p.name);
+        nodes.assign(p.nodes.begin(), p.nodes.end());
+        cigars.assign(p.cigars.begin(), p.cigars.end());
+        reversals = p.reversals;
 
         f(path_name, nodes, reversals, cigars);
     });
@@ -349,29 +820,32 @@ void GfaReader::for_each_path(const function<void(string& path_name, vector<stri
 void GfaReader::map_sequences_by_node(){
     cerr << "Mapping GFA S lines to node names... ";
 
-    ifstream gfa_file(this->gfa_path);
-    string token;
-    char c = 0;
+    // Create the mapping that tells where in the file to find each node's sequence data
+    if (this->line_indexes_by_type.count('S') > 0) {
+        auto& line_indexes = this->line_indexes_by_type.at('S');
+        this->sequence_line_indexes_by_node.reserve(line_indexes.size());
 
-    // For every sequence line that has been indexed, jump to their offset in the file and read just the node names
-    for (size_t i=0; i<this->line_indexes_by_type.at('S').size(); i++){
-        auto line_index = this->line_indexes_by_type.at('S')[i];
-        auto offset_start = this->line_offsets[line_index].offset + 2;  // Skip the line type character and tab
-        token.resize(0);
+        // If the index was loaded from disk, its name table already lists the names in order, without any parsing
+        if (this->index_data != nullptr){
+            const char* p = this->index_data + this->index_names_offset + 2*sizeof(uint64_t);
+            const char* end = this->index_data + this->index_length;
 
-        gfa_file.seekg(offset_start);
+            for (auto& line_index: line_indexes){
+                uint64_t length;
 
-        // Parse the node name
-        while (gfa_file.get(c)){
-            if (c == '\t'){
-                break;
+                if (not read_varint(p, end, length) or length > size_t(end - p)){
+                    throw runtime_error("ERROR: index name table is truncated: " + this->gfa_index_path.string());
+                }
+
+                this->sequence_line_indexes_by_node[string(p, length)] = line_index;
+                p += length;
             }
-            token += c;
         }
-
-        // Create the mapping that tells where in the file to find each node's sequence data
-        this->sequence_line_indexes_by_node[token] = line_index;
-        c = 0;
+        else {
+            for_each_sequence_view(1, [&](size_t thread_index, const GfaSequenceView& s){
+                this->sequence_line_indexes_by_node[string(s.name)] = line_indexes[s.index];
+            });
+        }
     }
 
     cerr << "done\n";
@@ -379,30 +853,10 @@ void GfaReader::map_sequences_by_node(){
 
 
 uint64_t GfaReader::get_sequence_length(string node_name){
-    auto vector_index = this->sequence_line_indexes_by_node.at(node_name);
-    auto start_index = this->line_offsets[vector_index].offset;
-
-    char c;
-    uint64_t length = 0;
-    uint64_t n_separators = 0;
-    ifstream file(this->gfa_path);
-
-    file.seekg(start_index);
-
-    // Count only characters in the sequence (not before or after)
-    while(file.get(c)) {
-        if (c == '\t' or c == '\n') {
-            n_separators++;
-        } else {
-            if (n_separators == 2) {
-                length++;
-            }
-            else if (n_separators > 2){
-                break;
-            }
-        }
-    }
+    auto line_index = this->sequence_line_indexes_by_node.at(node_name);
 
-    return length;
-}
+    GfaSequenceView s;
+    parse_sequence(get_line(line_index), s);
 
+    return s.sequence.size();
+}
@@ -21,11 +21,16 @@ using handlegraph::path_handle_t;
 #include <algorithm>
 #include <iostream>
 #include <stdexcept>
+#include <mutex>
+#include <map>
 
 using std::vector;
 using std::unordered_set;
 using std::unordered_map;
 using std::set;
+using std::map;
+using std::mutex;
+using std::lock_guard;
 using std::move;
 using std::deque;
 using std::array;
@@ -67,6 +72,27 @@ struct ChainableComponent {
     array<bool, 2> hamiltonian_exists{false, false};
 };
 
+/*
+ * The chainable components found in one bridge component
+ */
+struct BridgeComponentLinks {
+    BridgeComponentLinks() = default;
+    ~BridgeComponentLinks() = default;
+    
+    // if true, there is one link, which was walked with hamiltonian alleles between the bridges
+    // that border the bridge component. otherwise the links are all simple bubbles
+    bool is_hamiltonian = false;
+    
+    vector<ChainableComponent> chain_links;
+    
+    // the full unipath boundaries of each simple bubble, left side then right side
+    vector<vector<handle_t>> bubble_unipath_boundaries;
+};
+
+HamiltonianChainer::HamiltonianChainer(size_t n_threads) :
+    n_threads(n_threads)
+{}
+
 bool HamiltonianChainer::has_phase_chain(const string& name) const {
     if (!path_graph || !path_graph->has_path(name)) {
         return false;
@@ -108,18 +134,17 @@ void HamiltonianChainer::generate_chain_paths(MutablePathDeletableHandleGraph& g
      */
     
     // find bridges that are not assigned to one or the other haplotype
+    BridgeIndex bridge_index(graph);
     vector<handle_t> nonhaploid_bridges;
-    for_each_connected_component_subgraph(graph, [&](const HandleGraph& component) {
-        for (handle_t bridge : bridge_nodes(component)) {
-            if (!contact_graph.has_node(graph.get_id(bridge)) ||
-                !contact_graph.has_alt(graph.get_id(bridge))) {
-                nonhaploid_bridges.push_back(bridge);
-            }
+    for (handle_t bridge : bridge_index.get_bridges()) {
+        if (!contact_graph.has_node(graph.get_id(bridge)) ||
+            !contact_graph.has_alt(graph.get_id(bridge))) {
+            nonhaploid_bridges.push_back(bridge);
         }
-    });
+    }
     
     // merge into unipath bridges
-    auto unipath_bridges = consolidate_bridges(graph, nonhaploid_bridges);
+    auto unipath_bridges = consolidate_bridges(bridge_index, nonhaploid_bridges);
     if (debug) {
         cerr << "identified unipath bridges:" << endl;
         for (const auto& bridge : unipath_bridges) {
@@ -148,15 +173,18 @@ void HamiltonianChainer::generate_chain_paths(MutablePathDeletableHandleGraph& g
      * non-bridge-bordered simple bubbles
      */
     
-    // we'll try to fill these out for each bridge component
-    unordered_map<handle_t, size_t> boundary_to_chain_link;
-    vector<ChainableComponent> chain_links;
-    
-    vector<vector<handle_t>> bubble_unipath_boundaries;
+    // the bridge components are analyzed in parallel, and the results are kept by component index
+    // so that they can be added in a deterministic order
+    map<size_t, BridgeComponentLinks> component_links;
+    mutex component_links_mutex;
     
-    for_each_bridge_component(graph, unipath_bridges,
-                              [&](const HandleGraph& bridge_component,
-                                  const vector<pair<size_t, bool>>& incident_bridges) {
+    for_each_bridge_component_in_parallel(bridge_index, unipath_bridges, n_threads,
+                                          [&](size_t component_index,
+                                              const HandleGraph& bridge_component,
+                                              const vector<pair<size_t, bool>>& incident_bridges,
+                                              size_t n_component_threads) {
+        
+        BridgeComponentLinks links;
         
         if (debug) {
             cerr << "phasing in component bordering bridges:" << endl;
@@ -298,7 +326,8 @@ void HamiltonianChainer::generate_chain_paths(MutablePathDeletableHandleGraph& g
                                                             phase_0_nodes,
                                                             phase_1_nodes,
                                                             start, end,
-                                                            resolved_hamiltonian_0);
+                                                            resolved_hamiltonian_0,
+                                                            n_component_threads);
             
             bool resolved_hamiltonian_1;
             auto phase_1_walks = generate_allelic_semiwalks(bridge_component,
@@ -306,7 +335,8 @@ void HamiltonianChainer::generate_chain_paths(MutablePathDeletableHandleGraph& g
                                                             phase_1_nodes,
                                                             phase_0_nodes,
                                                             start, end,
-                                                            resolved_hamiltonian_1);
+                                                            resolved_hamiltonian_1,
+                                                            n_component_threads);
             
             // we'll consider this bridge component fully solved (even without unique alleles)
             // if we found a hamiltonian path for either of the phases
@@ -318,17 +348,16 @@ void HamiltonianChainer::generate_chain_paths(MutablePathDeletableHandleGraph& g
                 // smaller simple bubbles contained in the component...
                 
                 // record the result of the allele identification
-                chain_links.emplace_back();
-                auto& link = chain_links.back();
+                links.is_hamiltonian = true;
+                links.chain_links.emplace_back();
+                auto& link = links.chain_links.back();
                 if (!start.empty()) {
                     link.has_left_side = true;
                     link.left_side = *start.begin();
-                    boundary_to_chain_link[link.left_side] = chain_links.size() - 1;
                 }
                 if (!end.empty()) {
                     link.has_right_side = true;
                     link.right_side = bridge_component.flip(*end.begin());
-                    boundary_to_chain_link[link.right_side] = chain_links.size() - 1;
                 }
                 link.allele_from_left[0] = move(phase_0_walks.first);
                 link.allele_from_right[0] = move(phase_0_walks.second);
@@ -448,8 +477,8 @@ void HamiltonianChainer::generate_chain_paths(MutablePathDeletableHandleGraph& g
                     
                     // we've fully checked the local topology, this looks like a phased bubble
                     
-                    chain_links.emplace_back();
-                    auto& link = chain_links.back();
+                    links.chain_links.emplace_back();
+                    auto& link = links.chain_links.back();
                     link.has_left_side = true;
                     link.left_side = side;
                     link.has_right_side = true;
@@ -465,10 +494,10 @@ void HamiltonianChainer::generate_chain_paths(MutablePathDeletableHandleGraph& g
                     link.hamiltonian_exists[1] = true;
                     
                     // walk out the full unipath boundary (i.e. not just the inward-facing node)
-                    bubble_unipath_boundaries.push_back(walk_diploid_unipath(bridge_component, contact_graph,
-                                                                             link.left_side, true));
-                    bubble_unipath_boundaries.push_back(walk_diploid_unipath(bridge_component, contact_graph,
-                                                                             link.right_side, false));
+                    links.bubble_unipath_boundaries.push_back(walk_diploid_unipath(bridge_component, contact_graph,
+                                                                                   link.left_side, true));
+                    links.bubble_unipath_boundaries.push_back(walk_diploid_unipath(bridge_component, contact_graph,
+                                                                                   link.right_side, false));
                     
                     if (debug) {
                         cerr << "found a chainable simple bubble consisting of alleles:" << endl;
@@ -489,8 +518,39 @@ void HamiltonianChainer::generate_chain_paths(MutablePathDeletableHandleGraph& g
                 }
             });
         }
+        
+        if (!links.chain_links.empty()) {
+            lock_guard<mutex> lock(component_links_mutex);
+            component_links.emplace(component_index, move(links));
+        }
     });
     
+    // add the chainable components to the graph-wide structures, in component order
+    unordered_map<handle_t, size_t> boundary_to_chain_link;
+    vector<ChainableComponent> chain_links;
+    
+    vector<vector<handle_t>> bubble_unipath_boundaries;
+    
+    for (auto& [component_index, links] : component_links) {
+        if (links.is_hamiltonian) {
+            // only the hamiltonian links are found by their bridge boundaries
+            const auto& link = links.chain_links.front();
+            if (link.has_left_side) {
+                boundary_to_chain_link[link.left_side] = chain_links.size();
+            }
+            if (link.has_right_side) {
+                boundary_to_chain_link[link.right_side] = chain_links.size();
+            }
+        }
+        for (auto& link : links.chain_links) {
+            chain_links.emplace_back(move(link));
+        }
+        for (auto& unipath_boundary : links.bubble_unipath_boundaries) {
+            bubble_unipath_boundaries.emplace_back(move(unipath_boundary));
+        }
+    }
+    component_links.clear();
+    
     // move the unipath boundaries from the bubbles to the same list as the bridges (even though
     // they're technically not bridges)
     // note: we don't need to worry about re-identifying a bridge because if a bridge satisfied
@@ -902,7 +962,8 @@ HamiltonianChainer::generate_allelic_semiwalks(const HandleGraph& graph,
                                                const unordered_set<nid_t>& out_phase_nodes,
                                                const unordered_set<handle_t>& starts,
                                                const unordered_set<handle_t>& ends,
-                                               bool& resolved_hamiltonian) const {
+                                               bool& resolved_hamiltonian,
+                                               size_t n_threads) const {
     
     if (debug) {
         cerr << "finding alleles for in-phase nodes:" << endl;
@@ -925,7 +986,7 @@ HamiltonianChainer::generate_allelic_semiwalks(const HandleGraph& graph,
     auto hamiltonian = find_hamiltonian_path(graph,
                                              in_phase_nodes,
                                              out_phase_nodes,
-                                             starts, ends, hamiltonian_max_iters);
+                                             starts, ends, hamiltonian_max_iters, n_threads);
     
     if (hamiltonian.is_solved && !hamiltonian.hamiltonian_path.empty()) {
         // this phase can be walked out as a hamiltonian path
@@ -953,7 +1014,7 @@ HamiltonianChainer::generate_allelic_semiwalks(const HandleGraph& graph,
             auto rev_hamiltonian = find_hamiltonian_path(graph,
                                                          in_phase_nodes,
                                                          out_phase_nodes,
-                                                         rev_starts, rev_ends, hamiltonian_max_iters);
+                                                         rev_starts, rev_ends, hamiltonian_max_iters, n_threads);
             
             // TODO: does solvability within the max iters guarantee it for the other side?
             // should I additionally fall back to the unambiguous walk if this fails?
@@ -1,18 +1,36 @@
 #include "HamiltonianPath.hpp"
 
 #include <unordered_map>
+#include <algorithm>
+#include <stdexcept>
+#include <exception>
 #include <limits>
 #include <bitset>
 #include <utility>
 #include <iostream>
 #include <cassert>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <iterator>
+#include <array>
 
 using std::unordered_map;
 using std::numeric_limits;
-using std::function;
-using std::pair;
+using std::exception_ptr;
+using std::current_exception;
+using std::rethrow_exception;
+using std::lock_guard;
+using std::inplace_merge;
+using std::binary_search;
+using std::back_inserter;
+using std::merge;
 using std::bitset;
-using std::make_pair;
+using std::atomic;
+using std::thread;
+using std::mutex;
+using std::array;
+using std::sort;
 using std::cerr;
 using std::endl;
 
@@ -20,103 +38,270 @@ namespace gfase {
 
 static const bool debug = false;
 
-vector<handle_t> bitset_to_handles(uint64_t set, const unordered_map<handle_t, size_t>& handle_number) {
-    vector<handle_t> handles;
-    for (const auto& record : handle_number) {
-        if ((uint64_t(1) << record.second) & set) {
-            handles.push_back(record.first);
-        }
+
+/// A set of handles as a fixed-width bitset over dense handle indices, where the two strands of a node are always
+/// adjacent (2i and 2i+1)
+template <size_t n_words> class HandleSet {
+public:
+    array<uint64_t,n_words> words{};
+
+    void insert(size_t i){
+        words[i/64] |= uint64_t(1) << (i%64);
     }
-    return handles;
-}
 
-void print_dp_table(const unordered_set<pair<uint64_t, handle_t>>& dp_table,
-                    const unordered_map<handle_t, size_t>& handle_number,
-                    const HandleGraph& graph) {
-    
-    
-    for (const auto& entry : dp_table) {
-        cerr << "\tfinal: " << graph.get_id(entry.second) << (graph.get_is_reverse(entry.second) ? "-" : "+") << endl;
-        cerr << "\tset:" << endl;
-        for (auto handle : bitset_to_handles(entry.first, handle_number)) {
-            cerr << "\t\t" << graph.get_id(handle) << (graph.get_is_reverse(handle) ? "-" : "+") << endl;
-        }
+    void erase(size_t i){
+        words[i/64] &= ~(uint64_t(1) << (i%64));
     }
-}
 
-HamiltonianProblemResult find_hamiltonian_path(const HandleGraph& graph,
-                                              const unordered_set<nid_t>& target_nodes,
-                                              const unordered_set<nid_t>& prohibited_nodes,
-                                              const unordered_set<handle_t>& allowed_starts,
-                                              const unordered_set<handle_t>& allowed_ends,
-                                              size_t max_iters) {
-    
-    if (debug) {
-        cerr << "beginning hamiltonian path problem with max iterations " << max_iters << endl;
-        cerr << "target nodes:" << endl;
-        for (auto nid : target_nodes) {
-            cerr << "\t" << nid << endl;
-        }
-        cerr << "prohibited nodes:" << endl;
-        for (auto nid : prohibited_nodes) {
-            cerr << "\t" << nid << endl;
+    bool contains(size_t i) const{
+        return (words[i/64] >> (i%64)) & 1;
+    }
+
+    // Add the opposite strand of every handle in the set
+    HandleSet with_both_strands() const{
+        // int with alternating bits with 0 in 1s place
+        static const uint64_t altern_0 = 0xaaaaaaaaaaaaaaaa;
+        // int with alternating bits with 1 in 1s place
+        static const uint64_t altern_1 = 0x5555555555555555;
+
+        HandleSet result;
+        for (size_t i=0; i<n_words; i++){
+            auto w = words[i];
+            result.words[i] = w | ((w & altern_1) << 1) | ((w & altern_0) >> 1);
         }
-        cerr << "allowed starts" << endl;
-        for (auto handle : allowed_starts) {
-            cerr << "\t" << graph.get_id(handle) << (graph.get_is_reverse(handle) ? "-" : "+") << endl;
+        return result;
+    }
+
+    size_t count() const{
+        size_t n = 0;
+        for (auto w: words){
+            n += bitset<64>(w).count();
         }
-        cerr << "allowed ends" << endl;
-        for (auto handle : allowed_ends) {
-            cerr << "\t" << graph.get_id(handle) << (graph.get_is_reverse(handle) ? "-" : "+") << endl;
+        return n;
+    }
+
+    bool empty() const{
+        for (auto w: words){
+            if (w){
+                return false;
+            }
         }
+        return true;
     }
-    
-    HamiltonianProblemResult result;
-    
-    if (target_nodes.empty() && allowed_ends.empty() && allowed_starts.empty()) {
-        // the empty walk solves this problem
-        result.is_solved = true;
+
+    HandleSet operator&(const HandleSet& other) const{
+        HandleSet result;
+        for (size_t i=0; i<n_words; i++){
+            result.words[i] = words[i] & other.words[i];
+        }
         return result;
     }
-    
-    unordered_map<handle_t, size_t> handle_number;
-    graph.for_each_handle([&](const handle_t& h) {
-        if (prohibited_nodes.count(graph.get_id(h))) {
-            return;
-        }
-        handle_number[h] = handle_number.size();
-        handle_number[graph.flip(h)] = handle_number.size();
-    });
-    
-    
-    if (handle_number.size() > 64) {
-        // we can't fit the allowed handles into our bitset
-        if (debug) {
-            cerr << "exiting because cannot fit all " << handle_number.size() << " handles into 64-bit bitset" << endl;
+
+    HandleSet operator~() const{
+        HandleSet result;
+        for (size_t i=0; i<n_words; i++){
+            result.words[i] = ~words[i];
         }
         return result;
     }
-    
-    function<uint64_t(const handle_t&)> bitcode = [&handle_number](const handle_t& h) {
-        return uint64_t(1) << handle_number[h];
-    };
-    function<bool(uint64_t)> contains_reversal = [](uint64_t set) {
-        // int with alternating bits with 0 in 1s place
-        static const uint64_t altern_0 = 0xaaaaaaaaaaaaaaaa;
-        // int with alternating bits with 1 in 1s place
-        static const uint64_t altern_1 = 0x5555555555555555;
-        // the two strands are always in alternating positions in the sets
-        // so this is only non-zero if they have both 1s set
-        return (set & altern_1) & ((set & altern_0) >> 1);
+
+    bool operator==(const HandleSet& other) const{
+        return words == other.words;
+    }
+
+    bool operator<(const HandleSet& other) const{
+        return words < other.words;
+    }
+};
+
+
+/// One DP entry: the set of handles visited by a walk, and the (dense index of the) handle the walk ends in
+template <size_t n_words> class HamiltonianState {
+public:
+    HandleSet<n_words> set;
+    uint32_t last;
+
+    bool operator==(const HamiltonianState& other) const{
+        return last == other.last and set == other.set;
+    }
+
+    bool operator<(const HamiltonianState& other) const{
+        return set < other.set or (set == other.set and last < other.last);
+    }
+};
+
+
+template <size_t n_words> void print_dp_table(
+        const vector<HamiltonianState<n_words> >& dp_table,
+        const vector<handle_t>& handles,
+        const HandleGraph& graph){
+
+    for (const auto& entry : dp_table) {
+        auto h = handles[entry.last];
+        cerr << "\tfinal: " << graph.get_id(h) << (graph.get_is_reverse(h) ? "-" : "+") << endl;
+        cerr << "\tset:" << endl;
+        for (size_t i=0; i<handles.size(); i++) {
+            if (entry.set.contains(i)) {
+                cerr << "\t\t" << graph.get_id(handles[i]) << (graph.get_is_reverse(handles[i]) ? "-" : "+") << endl;
+            }
+        }
+    }
+}
+
+
+template <size_t n_words> void sort_and_deduplicate(vector<HamiltonianState<n_words> >& states){
+    sort(states.begin(), states.end());
+    states.erase(std::unique(states.begin(), states.end()), states.end());
+}
+
+
+/// The DP for graphs whose non-prohibited handles fit in a bitset of n_words words. Handles are given by their dense
+/// index, so handles[i] is the handle with index i, and handles[2j] and handles[2j+1] are the two strands of node j.
+template <size_t n_words> HamiltonianProblemResult find_hamiltonian_path(
+        const HandleGraph& graph,
+        const vector<handle_t>& handles,
+        const unordered_map<handle_t, size_t>& handle_index,
+        const unordered_set<nid_t>& target_nodes,
+        const unordered_set<handle_t>& allowed_starts,
+        const unordered_set<handle_t>& allowed_ends,
+        size_t max_iters,
+        size_t n_threads){
+
+    using set_t = HandleSet<n_words>;
+    using state_t = HamiltonianState<n_words>;
+
+    // Layers smaller than this are not worth distributing over threads
+    static const size_t min_parallel_layer_size = 4096;
+
+    HamiltonianProblemResult result;
+
+    size_t n_handles = handles.size();
+    size_t n_nodes = n_handles / 2;
+
+    auto index_of = [&](const handle_t& h){
+        return handle_index.at(h);
     };
-    
+
     // we need to break strand symmetry when starts/ends don't do it for us
     nid_t forced_forward = -1;
     if (allowed_starts.empty() && allowed_ends.empty() && !target_nodes.empty()) {
         forced_forward = *target_nodes.begin();
     }
-    
-    vector<unordered_set<pair<uint64_t, handle_t>>> dp_table(1);
+
+    // Successors of each handle that a walk is allowed to extend into, and the total number of edges that have to be
+    // followed to find them, which is what max_iters is counted in
+    vector<vector<uint32_t> > successors(n_handles);
+    vector<vector<uint32_t> > predecessors(n_handles);
+    vector<size_t> n_edges(n_handles, 0);
+
+    for (size_t i=0; i<n_handles; i++) {
+        graph.follow_edges(handles[i], false, [&](const handle_t& next) {
+            n_edges[i]++;
+
+            if (graph.get_id(next) == forced_forward && graph.get_is_reverse(next)) {
+                return;
+            }
+
+            auto result = handle_index.find(next);
+            if (result != handle_index.end()) {
+                successors[i].emplace_back(uint32_t(result->second));
+            }
+        });
+
+        graph.follow_edges(handles[i], true, [&](const handle_t& prev) {
+            auto result = handle_index.find(prev);
+            if (result != handle_index.end()) {
+                predecessors[i].emplace_back(uint32_t(result->second));
+            }
+        });
+    }
+
+    // All handles that can be reached from each handle by a walk of at least one step, allowing either strand of a
+    // node to be used any number of times. This is a superset of what any path can reach, so it is safe to prune with.
+    vector<set_t> reachable(n_handles);
+    vector<uint32_t> stack;
+    for (size_t i=0; i<n_handles; i++) {
+        auto& r = reachable[i];
+        stack.assign(successors[i].begin(), successors[i].end());
+
+        while (not stack.empty()) {
+            auto j = stack.back();
+            stack.pop_back();
+
+            if (r.contains(j)) {
+                continue;
+            }
+            r.insert(j);
+
+            for (auto next: successors[j]) {
+                if (not r.contains(next)) {
+                    stack.emplace_back(next);
+                }
+            }
+        }
+    }
+
+    set_t completion_code;
+    for (nid_t node_id : target_nodes) {
+        for (bool reverse : {true, false}) {
+            auto result = handle_index.find(graph.get_handle(node_id, reverse));
+            if (result != handle_index.end()) {
+                completion_code.insert(result->second);
+            }
+        }
+    }
+
+    set_t end_code;
+    vector<bool> is_allowed_end(n_handles, false);
+    vector<bool> is_necessary_end(n_handles, false);
+    for (size_t i=0; i<n_handles; i++) {
+        auto h = handles[i];
+        is_allowed_end[i] = allowed_ends.empty() || allowed_ends.count(h);
+
+        // we only allow the path to end in a non-target node if that node was provided as a
+        // an allowed end (this prevents unnecessary elongation into non-target nodes)
+        is_necessary_end[i] = allowed_ends.count(h) || target_nodes.count(graph.get_id(h)) || allowed_starts.count(h);
+
+        if (allowed_ends.count(h)) {
+            end_code.insert(i);
+        }
+    }
+
+    auto is_complete = [&](const set_t& set) {
+        return (set & completion_code).count() == target_nodes.size();
+    };
+
+    // A state is dead if some target node that it has not visited can't be reached from where it ends, or if it can
+    // never arrive at an allowed end. Dead states can't contribute to a solution, so they are not stored.
+    auto is_viable = [&](const state_t& state) {
+        auto missing = completion_code & ~state.set.with_both_strands();
+        if (not (missing & ~reachable[state.last].with_both_strands()).empty()) {
+            return false;
+        }
+        if (not allowed_ends.empty() && not end_code.contains(state.last) && (end_code & reachable[state.last]).empty()) {
+            return false;
+        }
+        return true;
+    };
+
+    auto extend = [&](const state_t& entry, vector<state_t>& new_states) {
+        for (auto next: successors[entry.last]) {
+            if (entry.set.contains(next) || entry.set.contains(next ^ 1)) {
+                // already in the set, or its reverse is
+                continue;
+            }
+
+            state_t new_state = entry;
+            new_state.set.insert(next);
+            new_state.last = next;
+
+            if (is_viable(new_state)) {
+                new_states.emplace_back(new_state);
+            }
+        }
+    };
+
+    vector<vector<state_t> > dp_table(1);
     if (allowed_starts.empty()) {
         // we don't allow unnecesarily long paths, so we still prohibit starting
         // at an unrequired node
@@ -125,176 +310,226 @@ HamiltonianProblemResult find_hamiltonian_path(const HandleGraph& graph,
                 if (node_id == forced_forward && reverse) {
                     continue;
                 }
-                handle_t handle = graph.get_handle(node_id, reverse);
-                dp_table[0].emplace(bitcode(handle), handle);
+                auto result = handle_index.find(graph.get_handle(node_id, reverse));
+                if (result == handle_index.end()) {
+                    continue;
+                }
+                state_t state;
+                state.set.insert(result->second);
+                state.last = uint32_t(result->second);
+                dp_table[0].emplace_back(state);
             }
         }
     }
     else {
         for (handle_t handle : allowed_starts) {
-            dp_table[0].emplace(bitcode(handle), handle);
-            assert(!prohibited_nodes.count(graph.get_id(handle)));
-        }
-    }
-    if (!allowed_ends.empty()) {
-        for (handle_t handle : allowed_ends) {
-            assert(!prohibited_nodes.count(graph.get_id(handle)));
+            state_t state;
+            state.set.insert(index_of(handle));
+            state.last = uint32_t(index_of(handle));
+            dp_table[0].emplace_back(state);
         }
     }
-    
+
+    // Starts are kept even if they look dead, so that a single-node walk is still considered by the traceback
+    sort_and_deduplicate(dp_table[0]);
+
     if (debug) {
         cerr << "initialized DP structure:" << endl;
-        print_dp_table(dp_table[0], handle_number, graph);
+        print_dp_table(dp_table[0], handles, graph);
     }
-    
-    // TODO: if i decide that i don't care about verifying uniqueness, i could stop
-    // iterating after the first full solution is found
-    
+
     // stop if we've hit the longest possible hamiltonian (because we don't allow
     // traversing both strands of a node) or when there are no hamiltonian paths of
     // length n - 1
     size_t iter_num = 0;
-    while (dp_table.size() < handle_number.size() / 2 && !dp_table.back().empty()
-           && iter_num < max_iters) {
-        
-        dp_table.emplace_back();
-        
-        auto& new_table = dp_table.back();
-        auto& prev_table = dp_table[dp_table.size() - 2];
-        
+    while (dp_table.size() < n_nodes && !dp_table.back().empty() && iter_num < max_iters) {
+        const auto& prev_table = dp_table.back();
+
+        // give up if this goes on too long, counting every edge that would be followed from this layer
+        size_t n_layer_edges = 0;
+        for (const auto& entry : prev_table) {
+            n_layer_edges += n_edges[entry.last];
+        }
+        if (n_layer_edges >= max_iters - iter_num) {
+            if (debug) {
+                cerr << "hit max iter count of " << max_iters << ", aborting" << endl;
+            }
+            iter_num = max_iters;
+            break;
+        }
+        iter_num += n_layer_edges;
+
         if (debug) {
-            cerr << "extending DP structure to paths of length " << dp_table.size() << endl;
+            cerr << "extending DP structure to paths of length " << dp_table.size() + 1 << endl;
         }
-        
-        for (const auto& entry : prev_table) {
-            bool keep_going = graph.follow_edges(entry.second, false, [&](const handle_t& next) {
-                
-                if (!(graph.get_id(next) == forced_forward && graph.get_is_reverse(next))) {
-                    // TODO: i actually only really need to look for the opposite bitcode,
-                    // not any arbitrary reversals...
-                    uint64_t new_set = entry.first | bitcode(next);
-                    if (new_set != entry.first && // was already in set
-                        !contains_reversal(new_set) && // reverse is in set
-                        !prohibited_nodes.count(graph.get_id(next))) {
-                        // extension is valid
-                        new_table.emplace(new_set, next);
+
+        vector<state_t> new_table;
+
+        if (n_threads < 2 || prev_table.size() < min_parallel_layer_size) {
+            for (const auto& entry : prev_table) {
+                extend(entry, new_table);
+            }
+            sort_and_deduplicate(new_table);
+        }
+        else {
+            // Each chunk of the previous layer is extended, sorted and deduplicated by whichever thread takes it, and
+            // then the sorted chunks are merged
+            size_t n_chunks = std::min(n_threads*4, prev_table.size());
+            size_t chunk_size = (prev_table.size() + n_chunks - 1) / n_chunks;
+            n_chunks = (prev_table.size() + chunk_size - 1) / chunk_size;
+
+            vector<vector<state_t> > chunk_results(n_chunks);
+            atomic<size_t> job_index = 0;
+            exception_ptr error = nullptr;
+            mutex error_mutex;
+
+            auto thread_fn = [&]() {
+                size_t c = job_index.fetch_add(1);
+
+                while (c < n_chunks) {
+                    try {
+                        auto start = c*chunk_size;
+                        auto stop = std::min(start + chunk_size, prev_table.size());
+
+                        for (size_t i=start; i<stop; i++) {
+                            extend(prev_table[i], chunk_results[c]);
+                        }
+                        sort_and_deduplicate(chunk_results[c]);
                     }
+                    catch (...) {
+                        lock_guard<mutex> lock(error_mutex);
+                        if (not error) {
+                            error = current_exception();
+                        }
+                    }
+
+                    c = job_index.fetch_add(1);
                 }
-                // give up if this goes on too long
-                ++iter_num;
-                return iter_num < max_iters;
-            });
-            if (!keep_going) {
-                if (debug) {
-                    cerr << "hit max iter count of " << max_iters << ", aborting" << endl;
+            };
+
+            vector<thread> threads;
+            for (size_t t=0; t<std::min(n_threads, n_chunks); t++) {
+                try {
+                    threads.emplace_back(thread_fn);
+                } catch (const std::exception &e) {
+                    cerr << e.what() << "\n";
+                    exit(1);
+                }
+            }
+
+            for (auto& t: threads){
+                t.join();
+            }
+
+            if (error) {
+                rethrow_exception(error);
+            }
+
+            // Merge the sorted chunks pairwise, so that each state is only moved O(log(n_chunks)) times
+            for (size_t width=1; width<n_chunks; width*=2) {
+                for (size_t c=0; c+width<n_chunks; c+=2*width) {
+                    auto& a = chunk_results[c];
+                    auto& b = chunk_results[c+width];
+
+                    vector<state_t> merged;
+                    merged.reserve(a.size() + b.size());
+                    merge(a.begin(), a.end(), b.begin(), b.end(), back_inserter(merged));
+
+                    a = std::move(merged);
+                    vector<state_t>().swap(b);
                 }
-                break;
             }
+
+            new_table = std::move(chunk_results[0]);
+            new_table.erase(std::unique(new_table.begin(), new_table.end()), new_table.end());
         }
+
+        dp_table.emplace_back(std::move(new_table));
+
         if (debug) {
             cerr << "extended DP structure" << endl;
-            print_dp_table(dp_table.back(), handle_number, graph);
+            print_dp_table(dp_table.back(), handles, graph);
         }
     }
-    
+
     if (iter_num < max_iters) {
-        
+
         if (debug) {
             cerr << "completed DP within iteration limit" << endl;
         }
-        
+
         // we completed the problem (even if a valid path didn't exist)
         result.is_solved = true;
-        
-        // TODO: the popcount instruction might be faster if i switch to 32-bit integers, but
-        // that would require me to template all of this out...
-        
-        uint64_t completion_code = 0;
-        for (nid_t node_id : target_nodes) {
-            for (bool reverse : {true, false}) {
-                completion_code |= bitcode(graph.get_handle(node_id, reverse));
-            }
-        }
-        auto is_complete = [&](uint64_t set) {
-            // c++20 has a template popcount function that could be faster than this, and
-            // there are also non-compiler-dependent algorithms, e.g.
-            // https://stackoverflow.com/questions/109023/count-the-number-of-set-bits-in-a-32-bit-integer
-            return bitset<64>(set & completion_code).count() == target_nodes.size();
-        };
-        
+
         // traceback routine
-        
-        // all of the DP entrys that are part of a traceback in each step
-        vector<unordered_set<pair<uint64_t, handle_t>>> traceback_clouds(dp_table.size());
+
+        // all of the DP entrys that are part of a traceback in each step, kept sorted
+        vector<vector<state_t> > traceback_clouds(dp_table.size());
         // a single traceback
-        vector<pair<uint64_t, handle_t>> traceback;
+        vector<state_t> traceback;
         for (int64_t i = dp_table.size() - 1; i >= 0; --i) {
-            
+
             if (debug) {
                 cerr << "doing traceback for paths of length " << i + 1 << endl;
             }
-            
+
             auto& table = dp_table[i];
             auto& cloud = traceback_clouds[i];
-            
+            size_t n_inherited = cloud.size();
+
             // find complete, valid hamiltonian paths
-            // we only allow the path to end in a non-target node if that node was provided as a
-            // an allowed end (this prevents unnecessary elongation into non-target nodes)
             // it must also not be a part of a traceback that we're already extending
             for (const auto& entry : table) {
+                bool in_cloud = binary_search(cloud.begin(), cloud.begin() + n_inherited, entry);
+
                 if (debug) {
-                    cerr << "checking for new traceback in entry ending in " << graph.get_id(entry.second) << (graph.get_is_reverse(entry.second) ? "-" : "+") << endl;
-                    cerr << "\tat specified end? " << allowed_ends.count(entry.second) << endl;
-                    cerr << "\tat a target node? " << target_nodes.count(graph.get_id(entry.second)) << endl;
-                    cerr << "\tin the current cloud? " << cloud.count(entry) << endl;
-                    cerr << "\tis complete? " << is_complete(entry.first) << endl;
+                    auto h = handles[entry.last];
+                    cerr << "checking for new traceback in entry ending in " << graph.get_id(h) << (graph.get_is_reverse(h) ? "-" : "+") << endl;
+                    cerr << "\tat specified end? " << allowed_ends.count(h) << endl;
+                    cerr << "\tat a target node? " << target_nodes.count(graph.get_id(h)) << endl;
+                    cerr << "\tin the current cloud? " << in_cloud << endl;
+                    cerr << "\tis complete? " << is_complete(entry.set) << endl;
                 }
-                if ((allowed_ends.empty() || allowed_ends.count(entry.second)) && // allowed ending
-                    (allowed_ends.count(entry.second)
-                     || target_nodes.count(graph.get_id(entry.second))
-                     || allowed_starts.count(entry.second)) && // ends in a necessary node (to ensure shortest)
-                    !cloud.count(entry) && // not a shorted traceback TODO: is this condition necessary?
-                    is_complete(entry.first)) { // is hamiltonian
-                    
+                if (is_allowed_end[entry.last] && // allowed ending
+                    is_necessary_end[entry.last] && // ends in a necessary node (to ensure shortest)
+                    !in_cloud && // not a shorted traceback TODO: is this condition necessary?
+                    is_complete(entry.set)) { // is hamiltonian
+
                     if (debug) {
                         cerr << "found a new complete DP entry, (re)starting main traceback" << endl;
-                        for (handle_t handle : bitset_to_handles(entry.first, handle_number)) {
-                            cerr << "\t" << graph.get_id(handle) << (graph.get_is_reverse(handle) ? "-" : "+") << endl;
-                        }
                     }
-                    
-                    traceback_clouds[i].emplace(entry);
-                    
+
+                    cloud.emplace_back(entry);
+
                     // we always start the single traceback over if we find a new ending, this ensures
                     // that we get the shortest possible path
                     traceback.clear();
                     traceback.push_back(entry);
                 }
             }
-            
+
+            // the new entries come from a sorted table, so they only need to be merged with the inherited ones
+            inplace_merge(cloud.begin(), cloud.begin() + n_inherited, cloud.end());
+
             if (i > 0) {
                 // try to find a predecessor for the ongoing tracebacks
                 auto& prev_table = dp_table[i - 1];
                 auto& prev_cloud = traceback_clouds[i - 1];
-                
+
                 for (const auto& dp_entry : cloud) {
                     // remove the final node's bit
-                    uint64_t prev_set = dp_entry.first ^ bitcode(dp_entry.second);
-                    if (debug) {
-                        cerr << "looking for traceback predecessors to set ending in " << graph.get_id(dp_entry.second) << ", containing:"  << endl;
-                        for (auto handle : bitset_to_handles(dp_entry.first, handle_number)) {
-                            cerr << "\t" << graph.get_id(handle) << (graph.get_is_reverse(handle) ? "-" : "+") << endl;
-                        }
-                    }
-                    graph.follow_edges(dp_entry.second, true, [&](const handle_t& prev) {
-                        auto prev_entry = make_pair(prev_set, prev);
-                        if (prev_table.count(prev_entry)) {
-                            
+                    state_t prev_entry = dp_entry;
+                    prev_entry.set.erase(dp_entry.last);
+
+                    for (auto prev : predecessors[dp_entry.last]) {
+                        prev_entry.last = prev;
+                        if (binary_search(prev_table.begin(), prev_table.end(), prev_entry)) {
+
                             if (debug) {
-                                cerr << "found a trace from set ending in " << graph.get_id(dp_entry.second) << " to set ending in " << graph.get_id(prev) << endl;
+                                cerr << "found a trace from set ending in " << graph.get_id(handles[dp_entry.last]) << " to set ending in " << graph.get_id(handles[prev]) << endl;
                             }
-                            prev_cloud.emplace(prev_entry);
-                            
+                            prev_cloud.emplace_back(prev_entry);
+
                             if (!traceback.empty() && dp_entry == traceback.back()) {
                                 if (debug) {
                                     cerr << "adding to main traceback" << endl;
@@ -302,36 +537,108 @@ HamiltonianProblemResult find_hamiltonian_path(const HandleGraph& graph,
                                 traceback.push_back(prev_entry);
                             }
                         }
-                    });
+                    }
                 }
+
+                sort_and_deduplicate(prev_cloud);
             }
         }
-        
-        // FIXME: we will never get a unique hamiltonian if we don't specify any starts or ends
-        // because the orientation can be reversed. we need to break symmetry by insisting on
-        // a particular strand for one required node
-        
+
         if (!traceback.empty()) {
             // populate the path in the result
             bool all_unique = true;
             size_t i = 0;
             result.hamiltonian_path.reserve(traceback.size());
             for (auto it = traceback.rbegin(); it != traceback.rend(); ++it) {
-                
-                result.hamiltonian_path.push_back(it->second);
-                
+
+                result.hamiltonian_path.push_back(handles[it->last]);
+
                 // check for uniqueness
                 all_unique = all_unique && traceback_clouds[i].size() == 1;
                 if (all_unique) {
-                    result.unique_prefix.push_back(it->second);
+                    result.unique_prefix.push_back(handles[it->last]);
                 }
                 ++i;
             }
         }
     }
-    
-    // we skip to the end if we run into the maximum number of iterations in the inner loop
+
+    // we skip to the end if we run into the maximum number of iterations
     return result;
 }
 
+
+HamiltonianProblemResult find_hamiltonian_path(const HandleGraph& graph,
+                                               const unordered_set<nid_t>& target_nodes,
+                                               const unordered_set<nid_t>& prohibited_nodes,
+                                               const unordered_set<handle_t>& allowed_starts,
+                                               const unordered_set<handle_t>& allowed_ends,
+                                               size_t max_iters,
+                                               size_t n_threads) {
+
+    if (debug) {
+        cerr << "beginning hamiltonian path problem with max iterations " << max_iters << endl;
+        cerr << "target nodes:" << endl;
+        for (auto nid : target_nodes) {
+            cerr << "\t" << nid << endl;
+        }
+        cerr << "prohibited nodes:" << endl;
+        for (auto nid : prohibited_nodes) {
+            cerr << "\t" << nid << endl;
+        }
+        cerr << "allowed starts" << endl;
+        for (auto handle : allowed_starts) {
+            cerr << "\t" << graph.get_id(handle) << (graph.get_is_reverse(handle) ? "-" : "+") << endl;
+        }
+        cerr << "allowed ends" << endl;
+        for (auto handle : allowed_ends) {
+            cerr << "\t" << graph.get_id(handle) << (graph.get_is_reverse(handle) ? "-" : "+") << endl;
+        }
+    }
+
+    if (target_nodes.empty() && allowed_ends.empty() && allowed_starts.empty()) {
+        // the empty walk solves this problem
+        HamiltonianProblemResult result;
+        result.is_solved = true;
+        return result;
+    }
+
+    for (handle_t handle : allowed_starts) {
+        assert(!prohibited_nodes.count(graph.get_id(handle)));
+    }
+    for (handle_t handle : allowed_ends) {
+        assert(!prohibited_nodes.count(graph.get_id(handle)));
+    }
+
+    // Dense indexes for the handles, with the two strands of each node adjacent to each other
+    vector<handle_t> handles;
+    unordered_map<handle_t, size_t> handle_index;
+    graph.for_each_handle([&](const handle_t& h) {
+        if (prohibited_nodes.count(graph.get_id(h))) {
+            return;
+        }
+        handle_index[h] = handles.size();
+        handles.emplace_back(h);
+        handle_index[graph.flip(h)] = handles.size();
+        handles.emplace_back(graph.flip(h));
+    });
+
+    if (handles.size() <= 64) {
+        return find_hamiltonian_path<1>(graph, handles, handle_index, target_nodes, allowed_starts, allowed_ends, max_iters, n_threads);
+    }
+    else if (handles.size() <= 128) {
+        return find_hamiltonian_path<2>(graph, handles, handle_index, target_nodes, allowed_starts, allowed_ends, max_iters, n_threads);
+    }
+    else if (handles.size() <= 256) {
+        return find_hamiltonian_path<4>(graph, handles, handle_index, target_nodes, allowed_starts, allowed_ends, max_iters, n_threads);
+    }
+
+    // we can't fit the allowed handles into our bitset
+    if (debug) {
+        cerr << "exiting because cannot fit all " << handles.size() << " handles into 256-bit bitset" << endl;
+    }
+
+    return {};
+}
+
 }
@@ -61,12 +61,23 @@ HaplotypePathKmer::HaplotypePathKmer(const PathHandleGraph& graph, const path_ha
         graph(graph),
         has_diploid(false),
         path(path),
-        k(k)
+        k(k),
+        forward_kmer({0,0}),
+        reverse_kmer({0,0}),
+        reverse_low_mask(0),
+        reverse_high_mask(0),
+        n_valid_bases(0)
 {
     if (k < 1){
         throw runtime_error("ERROR: k must be at least 1");
     }
 
+    // The reverse complement grows from the low end, so it is masked to 2k bits after each shift
+    if (k <= 64) {
+        reverse_low_mask = (k >= 32) ? ~uint64_t(0) : (uint64_t(1) << (2*k)) - 1;
+        reverse_high_mask = (k <= 32) ? 0 : ((k == 64) ? ~uint64_t(0) : (uint64_t(1) << (2*(k - 32))) - 1);
+    }
+
     auto first_step = graph.path_begin(path);
     initialize(first_step, 0);
 }
@@ -81,6 +92,10 @@ void HaplotypePathKmer::initialize(step_handle_t s, size_t index){
     is_diploid.clear();
     sequence.clear();
 
+    forward_kmer = {0,0};
+    reverse_kmer = {0,0};
+    n_valid_bases = 0;
+
     step_is_diploid = is_haplotype_bubble(graph, s);
 
     steps.emplace_back(s);
@@ -88,7 +103,7 @@ void HaplotypePathKmer::initialize(step_handle_t s, size_t index){
     is_diploid.emplace_back(step_is_diploid);
 
     if (lengths.back() > 0) {
-        sequence.emplace_back(graph.get_base(h, index));
+        push_base(graph.get_base(h, index));
     }
 
     update_has_diploid();
@@ -137,6 +152,69 @@ void HaplotypePathKmer::for_each_haploid_kmer(const function<void(deque<char>& s
 }
 
 
+void HaplotypePathKmer::for_each_haploid_kmer(const function<void(const packed_kmer_t& canonical_kmer)>& f){
+    if (k > 64){
+        throw runtime_error("ERROR: packed kmer iteration requires k <= 64, k = " + to_string(k));
+    }
+
+    while (step()) {
+        if (has_diploid) {
+            // Paths shorter than k never fill the queue
+            if (sequence.size() < k){
+                continue;
+            }
+
+            if (n_valid_bases < k){
+                throw runtime_error("ERROR: non ACGT character encountered in kmer");
+            }
+
+            f(is_lesser(reverse_kmer, forward_kmer) ? reverse_kmer : forward_kmer);
+        }
+        else {
+            auto h = graph.get_handle_of_step(steps.back());
+            auto length = graph.get_length(h);
+
+            // Skip to the end of long nodes if they are not diploid
+            if (length > k + 1) {
+                initialize(steps.back(), length - k + 1);
+            }
+        }
+    }
+}
+
+
+void HaplotypePathKmer::push_base(char c){
+    sequence.emplace_back(c);
+
+    if (k > 64){
+        return;
+    }
+
+    uint64_t bits = 4;
+    if (uint8_t(c) < 128){
+        bits = FixedBinarySequence<uint64_t,2>::base_to_index[uint8_t(c)];
+    }
+
+    // Non ACGT bases are encoded as A, and invalidate any kmer that contains them
+    if (bits == 4){
+        bits = 0;
+        n_valid_bases = 0;
+    }
+    else{
+        n_valid_bases++;
+    }
+
+    // Forward: the oldest base falls off the low end and the new one enters at position k-1
+    forward_kmer[0] = (forward_kmer[0] >> 2) | (forward_kmer[1] << 62);
+    forward_kmer[1] >>= 2;
+    forward_kmer[(2*(k-1))/64] |= bits << ((2*(k-1))%64);
+
+    // Reverse complement: the complement of the new base enters at position 0 and the oldest falls off position k-1
+    reverse_kmer[1] = ((reverse_kmer[1] << 2) | (reverse_kmer[0] >> 62)) & reverse_high_mask;
+    reverse_kmer[0] = ((reverse_kmer[0] << 2) | (3 - bits)) & reverse_low_mask;
+}
+
+
 void HaplotypePathKmer::print(){
     cerr << "start: " << start_index << '\n';
     cerr << "stop: " << stop_index << '\n';
@@ -180,7 +258,7 @@ bool HaplotypePathKmer::step(){
         stop_index++;
 
         auto h = graph.get_handle_of_step(steps.back());
-        sequence.emplace_back(graph.get_base(h,stop_index));
+        push_base(graph.get_base(h,stop_index));
 
         // Use the deque like a cyclic queue
         if (sequence.size() > k) {
@@ -201,7 +279,7 @@ bool HaplotypePathKmer::step(){
             is_diploid.emplace_back(step_is_diploid);
 
             if (lengths.back() > 0) {
-                sequence.emplace_back(graph.get_base(next_handle, 0));
+                push_base(graph.get_base(next_handle, 0));
             }
             else{
                 found_empty_node = true;
@@ -279,4 +357,9 @@ size_t HaplotypePathKmer::get_index_of_kmer_start() const{
 }
 
 
+const deque<char>& HaplotypePathKmer::get_sequence() const{
+    return sequence;
+}
+
+
 }
\ No newline at end of file
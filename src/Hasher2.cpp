@@ -38,6 +38,13 @@ Hasher2::Hasher2(size_t k, double sample_rate, size_t n_iterations, size_t n_thr
 
     n_bins = round(double(n_possible_bins)*iteration_sample_rate);
 
+    n_partitions = 1;
+    while (n_partitions < 4*n_threads){
+        n_partitions *= 2;
+    }
+
+    rows_per_partition = 1;
+
     cerr << "Using " << n_bins << " of " << n_possible_bins << " possible bins, for " << n_iterations
          << " iterations at a rate of " << iteration_sample_rate << '\n';
 }
@@ -85,64 +92,47 @@ uint64_t Hasher2::hash(const BinarySequence<uint64_t>& kmer, size_t seed_index)
 }
 
 
+/// Hash a k-mer packed into one word in the same layout as BinarySequence<uint64_t> (first base in the lowest bits), so
+/// that this gives the same result as hashing the equivalent BinarySequence
+uint64_t Hasher2::hash(uint64_t kmer, size_t seed_index) const{
+    return MurmurHash64A(&kmer, int((2*k)/8 + ((2*k) % 8 != 0)), seeds[seed_index]);
+}
+
+
 ///
 /// \param sequence
 /// \param i iteration of hashing to compute, corresponding to a hash function
-void Hasher2::hash_sequence(const Sequence& sequence, int64_t id, const size_t hash_index) {
-    BinarySequence<uint64_t> kmer;
+/// \param hashes thread-local buffer to append the sampled (hash, id) entries to
+void Hasher2::hash_sequence(const Sequence& sequence, int64_t id, const size_t hash_index, vector<hash_entry_t>& hashes) const{
+    // The forward kmer and its reverse complement are both rolled along the sequence in one pass
+    uint64_t forward_kmer = 0;
+    uint64_t reverse_kmer = 0;
+    uint64_t mask = (k == 32) ? numeric_limits<uint64_t>::max() : (uint64_t(1) << (2*k)) - 1;
+    size_t n_valid_bases = 0;
 
-    // Forward iteration
     for (auto& c: sequence.sequence) {
-        if (BinarySequence<uint64_t>::base_to_index.at(c) == 4){
+        uint64_t bits = BinarySequence<uint64_t>::base_to_index.at(c);
+
+        if (bits == 4){
             // Reset kmer and don't hash any region with non ACGT chars
-            kmer = {};
+            n_valid_bases = 0;
             continue;
         }
 
-        if (kmer.length < k) {
-            kmer.push_back(c);
-        } else {
-            kmer.shift(c);
-            uint64_t h = hash(kmer, hash_index);
-
-            if (h < n_bins){
-                auto bin_index = h % bins.size();
-                auto& m = bin_mutexes.at(bin_index % bin_mutexes.size());
-                auto& bin = bins[bin_index];
-
-                m.lock();
-                if (bin.size() < max_bin_size + 1){
-                    bin.emplace(id);
-                }
-                m.unlock();
-            }
-        }
-    }
+        // Newest base goes in the highest position of the forward kmer, and (complemented) the lowest of the reverse
+        forward_kmer = (forward_kmer >> 2) | (bits << (2*(k-1)));
+        reverse_kmer = ((reverse_kmer << 2) | (3 - bits)) & mask;
+        n_valid_bases++;
 
-    // Reverse complement iteration
-    for (auto iter = sequence.sequence.rbegin(); iter != sequence.sequence.rend(); iter++) {
-        if (BinarySequence<uint64_t>::base_to_index.at(*iter) == 4){
-            // Reset kmer and don't hash any region with non ACGT chars
-            kmer = {};
+        if (n_valid_bases < k) {
             continue;
         }
 
-        if (kmer.length < k) {
-            kmer.push_back(get_reverse_complement(*iter));
-        } else {
-            kmer.shift(get_reverse_complement(*iter));
+        for (auto kmer: {forward_kmer, reverse_kmer}){
             uint64_t h = hash(kmer, hash_index);
 
             if (h < n_bins){
-                auto bin_index = h % bins.size();
-                auto& m = bin_mutexes.at(bin_index % bin_mutexes.size());
-                auto& bin = bins[bin_index];
-
-                m.lock();
-                if (bin.size() < max_bin_size + 1){
-                    bin.emplace(id);
-                }
-                m.unlock();
+                hashes.emplace_back(h, id);
             }
         }
     }
@@ -152,8 +142,21 @@ void Hasher2::hash_sequence(const Sequence& sequence, int64_t id, const size_t h
 void Hasher2::write_hash_frequency_distribution() const{
     map <size_t, size_t> distribution;
 
-    for (auto& b: bins){
-        distribution[b.size()]++;
+    // Bins are contiguous runs of equal hashes, and may contain repeated IDs
+    size_t i = 0;
+    while (i < bins.size()){
+        size_t size = 0;
+        size_t j = i;
+
+        while (j < bins.size() and bins[j].first == bins[i].first){
+            if (j == i or bins[j].second != bins[j-1].second){
+                size++;
+            }
+            j++;
+        }
+
+        distribution[size]++;
+        i = j;
     }
 
     for (auto& [size, frequency]: distribution){
@@ -162,17 +165,253 @@ void Hasher2::write_hash_frequency_distribution() const{
 }
 
 
-void Hasher2::hash_sequences(const vector<Sequence>& sequences, atomic<size_t>& job_index, const size_t hash_index){
+void Hasher2::hash_sequences(
+        const vector<Sequence>& sequences,
+        atomic<size_t>& job_index,
+        const size_t hash_index,
+        vector<hash_entry_t>& hashes) const{
+
     size_t i = job_index.fetch_add(1);
 
     while (i < sequences.size()){
         auto id = sequence_id_map.get_id(sequences[i].name);
-        hash_sequence(sequences[i], id, hash_index);
+        hash_sequence(sequences[i], id, hash_index, hashes);
         i = job_index.fetch_add(1);
     }
 }
 
 
+void Hasher2::run_in_parallel(size_t n_jobs, const function<void(size_t i)>& f) const{
+    atomic<size_t> job_index = 0;
+
+    auto thread_fn = [&](){
+        size_t i = job_index.fetch_add(1);
+
+        while (i < n_jobs){
+            f(i);
+            i = job_index.fetch_add(1);
+        }
+    };
+
+    vector<thread> threads;
+
+    // Launch threads
+    for (uint64_t t=0; t<min(n_threads, n_jobs); t++){
+        try {
+            threads.emplace_back(thread_fn);
+        } catch (const exception &e) {
+            cerr << e.what() << "\n";
+            exit(1);
+        }
+    }
+
+    // Wait for threads to finish
+    for (auto& t: threads){
+        t.join();
+    }
+}
+
+
+///
+/// Group the sampled hashes into bins and count the pairs of sequences in each bin, without any locking:
+///     1. The thread-local buffers are scattered into one array, partitioned by the low bits of the hash (radix pass)
+///     2. Each hash partition is sorted independently, so that equal hashes (bins) become contiguous, and every bin
+///        that is small enough emits a packed (a,b) pair for each ordered combination of its IDs, into a buffer for
+///        the row range of a
+///     3. Each row range sorts its pairs, counts runs of equal pairs, and merges them into its running totals
+///
+void Hasher2::group_hashes(vector <vector<hash_entry_t> >& thread_hashes){
+    uint64_t partition_mask = n_partitions - 1;
+
+    // Count the entries of each buffer that fall in each partition
+    vector <vector<size_t> > offsets(thread_hashes.size(), vector<size_t>(n_partitions, 0));
+
+    run_in_parallel(thread_hashes.size(), [&](size_t t){
+        for (auto& [h, id]: thread_hashes[t]){
+            offsets[t][h & partition_mask]++;
+        }
+    });
+
+    // Convert the counts to write positions, ordered by partition and then by buffer
+    vector<size_t> partition_starts(n_partitions + 1, 0);
+    size_t n = 0;
+
+    for (size_t p=0; p<n_partitions; p++){
+        partition_starts[p] = n;
+
+        for (size_t t=0; t<thread_hashes.size(); t++){
+            auto count = offsets[t][p];
+            offsets[t][p] = n;
+            n += count;
+        }
+    }
+
+    partition_starts[n_partitions] = n;
+
+    bins.clear();
+    bins.resize(n);
+
+    run_in_parallel(thread_hashes.size(), [&](size_t t){
+        auto& offset = offsets[t];
+
+        for (auto& entry: thread_hashes[t]){
+            bins[offset[entry.first & partition_mask]++] = entry;
+        }
+
+        thread_hashes[t] = {};
+    });
+
+    // For each hash partition, and each row range, the packed pairs emitted by the bins
+    vector <vector <vector<uint64_t> > > pairs(n_partitions, vector <vector<uint64_t> >(n_partitions));
+
+    run_in_parallel(n_partitions, [&](size_t p){
+        auto begin = bins.begin() + int64_t(partition_starts[p]);
+        auto end = bins.begin() + int64_t(partition_starts[p+1]);
+
+        sort(begin, end);
+
+        vector<int64_t> items;
+
+        auto iter = begin;
+        while (iter != end){
+            items.clear();
+
+            auto h = iter->first;
+            for (; iter != end and iter->first == h; ++iter){
+                if (items.empty() or items.back() != iter->second){
+                    items.emplace_back(iter->second);
+                }
+            }
+
+            // Don't iterate bins with too many hashes
+            if (items.size() > max_bin_size){
+                continue;
+            }
+
+            // Iterate all combinations of names found in this bin, including self hits, bc they'll be used as a
+            // normalization denominator later.
+            for (auto& a: items){
+                auto& buffer = pairs[p][size_t(a)/rows_per_partition];
+
+                for (auto& b: items){
+                    buffer.emplace_back((uint64_t(a) << 32) | uint64_t(b));
+                }
+            }
+        }
+    });
+
+    run_in_parallel(n_partitions, [&](size_t r){
+        vector<uint64_t> keys;
+
+        for (size_t p=0; p<n_partitions; p++){
+            keys.insert(keys.end(), pairs[p][r].begin(), pairs[p][r].end());
+            pairs[p][r] = {};
+        }
+
+        sort(keys.begin(), keys.end());
+
+        // Merge the counts of this iteration with the running totals, which are both sorted
+        auto& totals = pair_counts[r];
+        vector<pair_count_t> result;
+        result.reserve(totals.size() + keys.size());
+
+        auto t = totals.begin();
+        auto k_iter = keys.begin();
+
+        while (k_iter != keys.end()){
+            auto key = *k_iter;
+            uint32_t count = 0;
+
+            for (; k_iter != keys.end() and *k_iter == key; ++k_iter){
+                count++;
+            }
+
+            for (; t != totals.end() and t->first < key; ++t){
+                result.emplace_back(*t);
+            }
+
+            if (t != totals.end() and t->first == key){
+                count += t->second;
+                ++t;
+            }
+
+            result.emplace_back(key, count);
+        }
+
+        result.insert(result.end(), t, totals.end());
+        result.shrink_to_fit();
+
+        totals = std::move(result);
+    });
+}
+
+
+void Hasher2::build_overlap_matrix(){
+    auto n_ids = sequence_id_map.size();
+
+    // The row ranges are contiguous and each one is sorted, so concatenating them gives the matrix in row-major order
+    vector<size_t> partition_starts(n_partitions + 1, 0);
+    for (size_t r=0; r<n_partitions; r++){
+        partition_starts[r+1] = partition_starts[r] + pair_counts[r].size();
+    }
+
+    overlap_offsets.clear();
+    overlap_offsets.resize(n_ids + 1, 0);
+    overlap_columns.resize(partition_starts.back());
+    overlap_counts.resize(partition_starts.back());
+
+    run_in_parallel(n_partitions, [&](size_t r){
+        auto i = partition_starts[r];
+
+        for (auto& [key, count]: pair_counts[r]){
+            overlap_offsets[(key >> 32) + 1]++;
+            overlap_columns[i] = uint32_t(key);
+            overlap_counts[i] = count;
+            i++;
+        }
+
+        pair_counts[r] = {};
+    });
+
+    for (size_t a=0; a<n_ids; a++){
+        overlap_offsets[a+1] += overlap_offsets[a];
+    }
+}
+
+
+int64_t Hasher2::n_rows() const{
+    return overlap_offsets.empty() ? 0 : int64_t(overlap_offsets.size() - 1);
+}
+
+
+/// Other sequences in the row of `id`, keyed by the number of bins they share with it. Only one sequence is kept for
+/// each score, the one with the lowest ID.
+void Hasher2::get_sorted_scores(int64_t id, map<int64_t, int64_t>& sorted_scores) const{
+    for (auto i=overlap_offsets[id]; i<overlap_offsets[id+1]; i++){
+        // Skip self-hits
+        if (int64_t(overlap_columns[i]) == id){
+            continue;
+        }
+
+        sorted_scores.emplace(overlap_counts[i], overlap_columns[i]);
+    }
+}
+
+
+int64_t Hasher2::get_total_hashes(int64_t id) const{
+    auto begin = overlap_columns.begin() + int64_t(overlap_offsets[id]);
+    auto end = overlap_columns.begin() + int64_t(overlap_offsets[id+1]);
+
+    auto result = lower_bound(begin, end, uint32_t(id));
+
+    if (result == end or *result != uint32_t(id)){
+        return 0;
+    }
+
+    return overlap_counts[result - overlap_columns.begin()];
+}
+
+
 void Hasher2::hash(const vector<Sequence>& sequences){
     size_t max_kmers_in_sequence = 0;
     for (auto& sequence: sequences) {
@@ -185,22 +424,30 @@ void Hasher2::hash(const vector<Sequence>& sequences){
     max_kmers_in_sequence = size_t(double(max_kmers_in_sequence) * total_sample_rate);
 
     cerr << max_kmers_in_sequence << " kmers after downsampling" << '\n';
-    cerr << max_kmers_in_sequence * bins_scaling_factor << " bins allocated" << '\n';
 
     // Build ID map for sequence names
     for(auto& sequence: sequences){
         sequence_id_map.try_insert(sequence.name);
     }
 
+    if (sequence_id_map.size() > numeric_limits<uint32_t>::max()){
+        throw runtime_error("ERROR: too many sequences for Hasher2: " + to_string(sequence_id_map.size()));
+    }
+
+    // Any results of a previous call are replaced
+    pair_counts.clear();
+    pair_counts.resize(n_partitions);
+    rows_per_partition = max(size_t(1), (sequence_id_map.size() + n_partitions - 1)/n_partitions);
+
     // Aggregate results
     for (size_t h=0; h<n_iterations; h++){
         cerr << "Beginning iteration: " << h << '\n';
 
-        bins.clear();
-        bins.resize(max_kmers_in_sequence * bins_scaling_factor);
+        // Each thread fills its own buffer. Both strands are sampled, at the per-iteration rate.
+        vector <vector<hash_entry_t> > thread_hashes(n_threads);
 
-        for (auto& b: bins){
-            bins.reserve(max_bin_size+2);
+        for (auto& item: thread_hashes){
+            item.reserve(size_t(2*double(max_kmers_in_sequence)/double(n_iterations*n_threads)));
         }
 
         // Thread-related variables
@@ -215,7 +462,8 @@ void Hasher2::hash(const vector<Sequence>& sequences){
                         this,
                         ref(sequences),
                         ref(job_index),
-                        h
+                        h,
+                        ref(thread_hashes[t])
                 ));
             } catch (const exception &e) {
                 cerr << e.what() << "\n";
@@ -228,34 +476,11 @@ void Hasher2::hash(const vector<Sequence>& sequences){
             t.join();
         }
 
-        // Iterate all hash bins for this iteration (unique hash function)
-        for (auto& bin: bins){
-            if (bin.size() > max_bin_size){
-                continue;
-            }
-
-            vector <int64_t> items(bin.size());
-
-            size_t n = 0;
-            for (auto& id: bin){
-                items[n] = id;
-                n++;
-            }
-
-            // Iterate all combinations of names found in this bin, including self hits, bc they'll be used as a
-            // normalization denominator later.
-            for (size_t a=0; a<items.size(); a++){
-                for (size_t b=a; b<items.size(); b++){
-                    overlaps[items[a]][items[b]]++;
-
-                    // Only increment the reciprocal if it's not a self hit
-                    if (a != b) {
-                        overlaps[items[b]][items[a]]++;
-                    }
-                }
-            }
-        }
+        // Group the hashes into bins and count co-occurring sequences in each
+        group_hashes(thread_hashes);
     }
+
+    build_overlap_matrix();
 }
 
 
@@ -277,23 +502,15 @@ void Hasher2::hash(const HandleGraph& graph, const IncrementalIdMap<string>& gra
 
 
 void Hasher2::get_best_matches(map<string, string>& matches, double certainty_threshold) const{
-    for (auto& [id, results]: overlaps){
-        auto total_hashes = double(results.at(id));
+    for (int64_t id=0; id<n_rows(); id++){
+        auto total_hashes = double(get_total_hashes(id));
 
         if (total_hashes < double(min_hashes)){
             continue;
         }
 
-        map <size_t, int64_t> sorted_scores;
-
-        for (auto& [other_id, score]: results){
-            // Skip self-hits
-            if (other_id == id){
-                continue;
-            }
-
-            sorted_scores.emplace(score,other_id);
-        }
+        map <int64_t, int64_t> sorted_scores;
+        get_sorted_scores(id, sorted_scores);
 
         if (sorted_scores.empty()){
             continue;
@@ -319,11 +536,11 @@ void Hasher2::convert_to_contact_graph(
         size_t minimum_hashes,
         size_t max_overlaps) const {
 
-    for (auto& [id, results]: overlaps){
-        auto total_hashes = double(results.at(id));
+    for (int64_t id=0; id<n_rows(); id++){
+        auto total_hashes = double(get_total_hashes(id));
 
         // Don't add every result to the graph. Only consider those with at least a certain number of hashes
-        if (total_hashes < double(minimum_hashes)){
+        if (total_hashes == 0 or total_hashes < double(minimum_hashes)){
             continue;
         }
 
@@ -332,16 +549,8 @@ void Hasher2::convert_to_contact_graph(
         contact_graph.try_insert_node(int32_t(id_a));
         contact_graph.set_node_coverage(int32_t(id_a), int64_t(total_hashes));
 
-        map <size_t, int64_t> sorted_scores;
-
-        for (auto& [other_id, score]: results){
-            // Skip self-hits
-            if (other_id == id){
-                continue;
-            }
-
-            sorted_scores.emplace(score,other_id);
-        }
+        map <int64_t, int64_t> sorted_scores;
+        get_sorted_scores(id, sorted_scores);
 
         if (sorted_scores.empty()){
             continue;
@@ -395,13 +604,17 @@ int64_t Hasher2::get_intersection_size(const string& a, const string& b) const{
     int64_t intersection = 0;
 
     auto id_a = sequence_id_map.get_id(a);
-    auto result_a = overlaps.find(id_a);
+    auto id_b = sequence_id_map.get_id(b);
+
+    if (id_a < n_rows()){
+        auto begin = overlap_columns.begin() + int64_t(overlap_offsets[id_a]);
+        auto end = overlap_columns.begin() + int64_t(overlap_offsets[id_a+1]);
 
-    if (result_a != overlaps.end()){
-        auto id_b = sequence_id_map.get_id(b);
-        auto result_b = result_a->second.find(id_b);
+        auto result = lower_bound(begin, end, uint32_t(id_b));
 
-        intersection = result_b->second;
+        if (result != end and *result == uint32_t(id_b)){
+            intersection = overlap_counts[result - overlap_columns.begin()];
+        }
     }
 
     return intersection;
@@ -413,30 +626,16 @@ void Hasher2::for_each_overlap(
         double min_similarity,
         const function<void(const string& a, const string& b, int64_t n_hashes, int64_t total_hashes)>& f) const{
 
-    for (auto& [id, results]: overlaps){
+    for (int64_t id=0; id<n_rows(); id++){
         // Self-hit is the total number of hashes the parent sequence had
-        auto self_hit = results.find(id);
+        auto total_hashes = double(get_total_hashes(id));
 
-        if (self_hit == results.end()){
-            continue;
-        }
-
-        auto total_hashes = double(results.at(id));
-
-        if (total_hashes < double(min_hashes)){
+        if (total_hashes == 0 or total_hashes < double(min_hashes)){
             continue;
         }
 
         map <int64_t, int64_t> sorted_scores;
-
-        for (auto& [other_id, score]: results){
-            // Skip self-hits
-            if (other_id == id){
-                continue;
-            }
-
-            sorted_scores.emplace(score,other_id);
-        }
+        get_sorted_scores(id, sorted_scores);
 
         if (sorted_scores.empty()){
             continue;
@@ -481,20 +680,16 @@ void Hasher2::write_results(path output_directory) const{
 
     overlaps_file << "name" << ',' << "other_name" << ',' << "score" << ',' << "total_hashes" << ',' << "similarity" << '\n';
 
-    for (auto& [id, results]: overlaps){
-        int64_t total_hashes = results.at(id);
-
-        map <int64_t, int64_t> sorted_scores;
-
-        for (auto& [other_id, score]: results){
-            // Skip self-hits
-            if (other_id == id){
-                continue;
-            }
+    for (int64_t id=0; id<n_rows(); id++){
+        int64_t total_hashes = get_total_hashes(id);
 
-            sorted_scores.emplace(score,other_id);
+        if (total_hashes == 0){
+            continue;
         }
 
+        map <int64_t, int64_t> sorted_scores;
+        get_sorted_scores(id, sorted_scores);
+
         int64_t i = 0;
 
         // Report the top hits by % Jaccard similarity for each
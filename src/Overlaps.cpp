@@ -2,10 +2,13 @@
 
 #include <stdlib.h>
 #include <stdexcept>
+#include <functional>
+#include <limits>
 
 using std::to_string;
 using std::make_pair;
 using std::runtime_error;
+using std::numeric_limits;
 using std::move;
 
 ///
@@ -56,6 +59,8 @@ const array<bool, 9> CigarOperation::is_query_move = {
 
 const array<char, 9> CigarOperation::cigar_type = {'M','I','D','N','S','H','P','=','X'};
 
+const uint32_t CigarOperation::max_packed_length = (uint32_t(1) << 28) - 1;
+
 
 CigarOperation::CigarOperation(uint32_t length, char type):
     code(cigar_code[type]),
@@ -82,6 +87,34 @@ uint32_t CigarOperation::query_length() const {
     return is_query_move[code] ? op_length : 0;
 }
 
+CigarOperation CigarOperation::reverse() const {
+    CigarOperation reversed = *this;
+    if (type() == 'S' || type() == 'H' || type() == 'N' || type() == 'P') {
+        throw runtime_error("Clipped or unaligned CIGARs cannot be trivially reversed");
+    }
+    else if (type() == 'I') {
+        reversed.code = cigar_code['D'];
+    }
+    else if (type() == 'D') {
+        reversed.code = cigar_code['I'];
+    }
+    return reversed;
+}
+
+uint32_t CigarOperation::pack() const {
+    if (op_length > max_packed_length) {
+        throw runtime_error("ERROR: cigar operation length " + to_string(op_length) + " exceeds maximum of " + to_string(max_packed_length));
+    }
+    return (op_length << 4) | code;
+}
+
+CigarOperation CigarOperation::unpack(uint32_t packed) {
+    CigarOperation op;
+    op.code = uint8_t(packed & 15);
+    op.op_length = packed >> 4;
+    return op;
+}
+
 Cigar::Cigar(const std::string& cigar_string) {
     
     if (cigar_string == "*") {
@@ -104,6 +137,10 @@ Cigar::Cigar(const std::string& cigar_string) {
     }
 }
 
+Cigar::Cigar(vector<CigarOperation>&& operations) :
+    operations(move(operations))
+{}
+
 string Cigar::get_string() const {
     
     string s;
@@ -124,18 +161,7 @@ string Cigar::get_string() const {
 Cigar Cigar::reverse() const {
     Cigar reversed;
     for (auto it = operations.rbegin(); it != operations.rend(); ++it) {
-        if (it->type() == 'S' || it->type() == 'H' || it->type() == 'N' || it->type() == 'P') {
-            throw runtime_error("Clipped or unaligned CIGARs cannot be trivially reversed");
-        }
-        else if (it->type() == 'I') {
-            reversed.operations.emplace_back(it->length(), 'D');
-        }
-        else if (it->type() == 'D') {
-            reversed.operations.emplace_back(it->length(), 'I');
-        }
-        else {
-            reversed.operations.emplace_back(it->length(), it->type());
-        }
+        reversed.operations.emplace_back(it->reverse());
     }
     return reversed;
 }
@@ -169,20 +195,155 @@ Cigar::iterator Cigar::end() const {
     return operations.end();
 }
 
+CigarView::CigarView(const uint32_t* operations, uint32_t n_operations, pair<size_t, size_t> lengths, bool reversed) :
+    operations(operations),
+    n_operations(n_operations),
+    lengths(lengths),
+    reversed(reversed)
+{}
+
+string CigarView::get_string() const {
+    
+    string s;
+    
+    for (size_t i = 0; i < n_operations; ++i) {
+        auto c = at(i);
+        s += to_string(c.length());
+        s += c.type();
+    }
+    
+    if (s.empty()) {
+        s = "0M";
+    }
+    
+    return s;
+}
+
+pair<size_t, size_t> CigarView::aligned_length() const {
+    return lengths;
+}
+
+bool CigarView::empty() const {
+    return n_operations == 0;
+}
+
+size_t CigarView::size() const {
+    return n_operations;
+}
+
+CigarOperation CigarView::at(size_t i) const {
+    if (reversed) {
+        return CigarOperation::unpack(operations[n_operations - 1 - i]).reverse();
+    }
+    else {
+        return CigarOperation::unpack(operations[i]);
+    }
+}
+
+Cigar CigarView::get_cigar() const {
+    vector<CigarOperation> cigar_operations;
+    cigar_operations.reserve(n_operations);
+    for (size_t i = 0; i < n_operations; ++i) {
+        cigar_operations.emplace_back(at(i));
+    }
+    return Cigar(move(cigar_operations));
+}
+
+template<class T> void Overlaps::record_overlap(const HandleGraph& graph, handle_t a, handle_t b, size_t n_operations,
+                                                pair<size_t, size_t> lengths, const T& get_operation) {
+    
+    if (operations.size() + n_operations > numeric_limits<uint32_t>::max()) {
+        throw runtime_error("ERROR: too many CIGAR operations to store in Overlaps");
+    }
+    
+    // overlaps are stored in the orientation of the canonical edge, and reversed when
+    // they are queried from the other side
+    auto edge = graph.edge_handle(a, b);
+    bool reverse = (edge.first != a);
+    
+    OverlapSpan span;
+    span.offset = operations.size();
+    span.n_operations = n_operations;
+    span.ref_length = reverse ? lengths.second : lengths.first;
+    span.query_length = reverse ? lengths.first : lengths.second;
+    
+    for (size_t i = 0; i < n_operations; ++i) {
+        if (reverse) {
+            operations.emplace_back(get_operation(n_operations - 1 - i).reverse().pack());
+        }
+        else {
+            operations.emplace_back(get_operation(i).pack());
+        }
+    }
+    
+    auto result = overlaps.emplace(edge, span);
+    if (!result.second) {
+        // replace an existing overlap
+        n_unused += result.first->second.n_operations;
+        result.first->second = span;
+        
+        if (n_unused > 1024 && n_unused > operations.size() / 2) {
+            compact();
+        }
+    }
+}
+
+void Overlaps::compact() {
+    vector<uint32_t> compacted;
+    compacted.reserve(operations.size() - n_unused);
+    
+    for (auto& [edge, span] : overlaps) {
+        auto begin = operations.begin() + span.offset;
+        span.offset = compacted.size();
+        compacted.insert(compacted.end(), begin, begin + span.n_operations);
+    }
+    
+    operations = move(compacted);
+    n_unused = 0;
+}
+
 void Overlaps::record_overlap(const HandleGraph& graph, handle_t a, handle_t b, const string& cigar) {
     record_overlap(graph, a, b, Cigar(cigar));
 }
 
 void Overlaps::record_overlap(const HandleGraph& graph, handle_t a, handle_t b, const Cigar& cigar) {
     if (!cigar.empty()) {
-        overlaps[graph.edge_handle(a, b)] = cigar;
+        record_overlap(graph, a, b, cigar.size(), cigar.aligned_length(), [&](size_t i) {
+            return cigar.at(i);
+        });
+    }
+}
+
+void Overlaps::record_overlap(const HandleGraph& graph, handle_t a, handle_t b, const CigarView& cigar) {
+    if (!cigar.empty()) {
+        auto view = cigar;
+        
+        // if the view points into this arena, it has to be re-pointed after the arena grows
+        bool is_internal = !operations.empty() &&
+                           !std::less<const uint32_t*>()(cigar.operations, operations.data()) &&
+                           std::less<const uint32_t*>()(cigar.operations, operations.data() + operations.size());
+        
+        if (is_internal) {
+            size_t offset = cigar.operations - operations.data();
+            operations.reserve(operations.size() + cigar.size());
+            view.operations = operations.data() + offset;
+        }
+        
+        record_overlap(graph, a, b, view.size(), view.aligned_length(), [&](size_t i) {
+            return view.at(i);
+        });
     }
 }
 
 void Overlaps::remove_overlap(const HandleGraph& graph, handle_t a, handle_t b) {
     auto it = overlaps.find(graph.edge_handle(a, b));
     if (it != overlaps.end()) {
+        n_unused += it->second.n_operations;
         overlaps.erase(it);
+        
+        if (n_unused > 1024 && n_unused > operations.size() / 2) {
+            compact();
+        }
     }
 }
 
@@ -197,17 +358,35 @@ bool Overlaps::is_blunt() const {
 
 
 Cigar Overlaps::get_overlap(const HandleGraph& graph, handle_t a, handle_t b) const {
-    Cigar cigar;
+    return get_overlap_view(graph, a, b).get_cigar();
+}
+
+CigarView Overlaps::get_overlap_view(const HandleGraph& graph, handle_t a, handle_t b) const {
+    CigarView cigar;
     auto it = overlaps.find(graph.edge_handle(a, b));
     if (it != overlaps.end()) {
-        if (it->first.first == a) {
-            cigar = it->second;
-        }
-        else {
-            cigar = it->second.reverse();
+        auto& span = it->second;
+        bool reversed = (it->first.first != a);
+        pair<size_t, size_t> lengths(span.ref_length, span.query_length);
+        if (reversed) {
+            std::swap(lengths.first, lengths.second);
         }
+        cigar = CigarView(operations.data() + span.offset, span.n_operations, lengths, reversed);
     }
     return cigar;
 }
 
+pair<size_t, size_t> Overlaps::get_overlap_length(const HandleGraph& graph, handle_t a, handle_t b) const {
+    pair<size_t, size_t> lengths(0, 0);
+    auto it = overlaps.find(graph.edge_handle(a, b));
+    if (it != overlaps.end()) {
+        lengths = {it->second.ref_length, it->second.query_length};
+        if (it->first.first != a) {
+            // reversing the CIGAR swaps the roles of the ref and query
+            std::swap(lengths.first, lengths.second);
+        }
+    }
+    return lengths;
+}
+
 
@@ -0,0 +1,645 @@
+#include "ParentalKmerTable.hpp"
+
+#include <exception>
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <thread>
+#include <functional>
+#include <atomic>
+#include <mutex>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+using std::exception_ptr;
+using std::exception;
+using std::runtime_error;
+using std::to_string;
+using std::ofstream;
+using std::thread;
+using std::atomic;
+using std::mutex;
+using std::cerr;
+using std::function;
+using std::max;
+using std::min;
+
+
+namespace gfase {
+
+
+const uint64_t ParentalKmerTable::flag_shift = 62;
+const uint64_t ParentalKmerTable::key_mask = (uint64_t(1) << 62) - 1;
+
+// "GFASEPKT" when read as little-endian chars
+const uint64_t ParentalKmerTable::magic = 0x544B504553414647;
+const uint64_t ParentalKmerTable::version = 1;
+
+const uint8_t ParentalKmerTable::paternal_flag = 1;
+const uint8_t ParentalKmerTable::maternal_flag = 2;
+const size_t ParentalKmerTable::max_k = 63;
+
+
+/// Finalizer from MurmurHash3, applied to each word, so that similar kmers don't cluster in the table
+uint64_t mix_kmer_word(uint64_t key){
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccd;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53;
+    key ^= key >> 33;
+    return key;
+}
+
+
+uint64_t hash_kmer(const packed_kmer_t& kmer){
+    return mix_kmer_word(kmer[0] ^ mix_kmer_word(kmer[1] & ((uint64_t(1) << 62) - 1)));
+}
+
+
+ParentalKmerTable::ParentalKmerTable():
+        buckets(4),
+        bucket_data(buckets.data()),
+        mapped_data(nullptr),
+        mapped_length(0),
+        n_entries(0),
+        mask(3),
+        k(0),
+        n_per_flag({0,0})
+{}
+
+
+ParentalKmerTable::ParentalKmerTable(path binary_path):
+        ParentalKmerTable()
+{
+    load_from_binary(binary_path);
+}
+
+
+ParentalKmerTable::~ParentalKmerTable(){
+    unmap();
+}
+
+
+void ParentalKmerTable::unmap(){
+    if (mapped_data != nullptr){
+        ::munmap(const_cast<char*>(mapped_data), mapped_length);
+        mapped_data = nullptr;
+        mapped_length = 0;
+    }
+}
+
+
+void ParentalKmerTable::reserve(size_t n){
+    if (is_mapped()){
+        throw runtime_error("ERROR: cannot resize a parental kmer table that was loaded from disk");
+    }
+
+    // Keep the load factor at or below 0.5
+    size_t capacity = buckets.size();
+    while (4*capacity < 2*n){
+        capacity *= 2;
+    }
+
+    while (buckets.size() < capacity){
+        grow();
+    }
+}
+
+
+void ParentalKmerTable::grow(){
+    vector<ParentalKmerBucket> old_buckets(buckets.size()*2);
+    old_buckets.swap(buckets);
+
+    bucket_data = buckets.data();
+    mask = buckets.size() - 1;
+
+    for (auto& bucket: old_buckets){
+        for (auto& slot: bucket.slots){
+            if ((slot[1] >> flag_shift) != 0){
+                insert_without_growing(slot);
+            }
+        }
+    }
+}
+
+
+void ParentalKmerTable::insert_without_growing(const packed_kmer_t& slot){
+    auto b = hash_kmer(slot) & mask;
+
+    while (true){
+        for (auto& s: buckets[b].slots){
+            if ((s[1] >> flag_shift) == 0){
+                s = slot;
+                return;
+            }
+        }
+
+        b = (b + 1) & mask;
+    }
+}
+
+
+void ParentalKmerTable::insert(const packed_kmer_t& canonical_kmer, uint8_t flag){
+    if (is_mapped()){
+        throw runtime_error("ERROR: cannot insert into a parental kmer table that was loaded from disk");
+    }
+
+    if ((canonical_kmer[1] >> flag_shift) != 0){
+        throw runtime_error("ERROR: kmer is too long for parental kmer table, max k is " + std::to_string(max_k));
+    }
+
+    // Grow before the load factor exceeds 0.75
+    if (4*(n_entries + 1) > 3*4*buckets.size()){
+        grow();
+    }
+
+    insert_bounded(canonical_kmer, flag, buckets.size(), n_entries, n_per_flag);
+}
+
+
+bool ParentalKmerTable::insert_bounded(
+        const packed_kmer_t& canonical_kmer,
+        uint8_t flag,
+        size_t max_buckets,
+        size_t& n_new,
+        array<size_t,2>& n_new_per_flag){
+
+    auto flag_bits = uint64_t(flag) << flag_shift;
+    auto b = hash_kmer(canonical_kmer) & mask;
+
+    for (size_t i=0; i<max_buckets; i++){
+        for (auto& s: buckets[b].slots){
+            if ((s[1] >> flag_shift) == 0){
+                s = {canonical_kmer[0], canonical_kmer[1] | flag_bits};
+                n_new++;
+                n_new_per_flag[0] += (flag & 1);
+                n_new_per_flag[1] += (flag & 2) >> 1;
+                return true;
+            }
+            else if (s[0] == canonical_kmer[0] and (s[1] & key_mask) == canonical_kmer[1]){
+                auto new_flags = uint8_t(flag & ~(s[1] >> flag_shift));
+                n_new_per_flag[0] += (new_flags & 1);
+                n_new_per_flag[1] += (new_flags & 2) >> 1;
+
+                s[1] |= flag_bits;
+                return true;
+            }
+        }
+
+        b = (b + 1) & mask;
+    }
+
+    return false;
+}
+
+
+void ParentalKmerTable::insert_in_parallel(vector <vector<packed_kmer_t> >& kmers, uint8_t flag, size_t n_threads){
+    ///
+    /// The buckets are split into an even number of contiguous ranges, and each kmer is binned by the range of its
+    /// home bucket. Even ranges are filled concurrently, then odd ranges. A kmer may only probe into the range after
+    /// its own, which no other thread is writing during that phase, and the rare kmer that would need to probe further
+    /// is inserted serially at the end. Duplicates share a home bucket, so they always meet in the same thread.
+    ///
+
+    size_t n = 0;
+    for (auto& item: kmers){
+        n += item.size();
+    }
+
+    reserve(n_entries + n);
+
+    size_t n_buckets = buckets.size();
+    size_t n_ranges = 2;
+    while (n_ranges < 2*n_threads and n_ranges*1024 <= n_buckets){
+        n_ranges *= 2;
+    }
+
+    if (n_threads < 2 or n_ranges*1024 > n_buckets){
+        for (auto& item: kmers){
+            for (auto& kmer: item){
+                insert(kmer, flag);
+            }
+        }
+        return;
+    }
+
+    size_t range_size = n_buckets/n_ranges;
+
+    // Bin the kmers of each chunk by range
+    vector <vector <vector<packed_kmer_t> > > binned_kmers(kmers.size(), vector <vector<packed_kmer_t> >(n_ranges));
+
+    // Per range results, reduced after all threads finish
+    vector <vector<packed_kmer_t> > leftovers(n_ranges);
+    vector<size_t> n_new(n_ranges, 0);
+    vector <array<size_t,2> > n_new_per_flag(n_ranges, {0,0});
+
+    auto run_in_parallel = [&](size_t n_jobs, const function<void(size_t i)>& f){
+        atomic<size_t> job_index = 0;
+
+        auto thread_fn = [&](){
+            size_t i = job_index.fetch_add(1);
+
+            while (i < n_jobs){
+                f(i);
+                i = job_index.fetch_add(1);
+            }
+        };
+
+        vector<thread> threads;
+
+        // Launch threads
+        for (uint64_t i=0; i<min(n_threads, n_jobs); i++){
+            try {
+                threads.emplace_back(thread_fn);
+            } catch (const exception &e) {
+                cerr << e.what() << "\n";
+                exit(1);
+            }
+        }
+
+        // Wait for threads to finish
+        for (auto& t: threads){
+            t.join();
+        }
+    };
+
+    run_in_parallel(kmers.size(), [&](size_t c){
+        for (auto& kmer: kmers[c]){
+            binned_kmers[c][(hash_kmer(kmer) & mask) / range_size].emplace_back(kmer);
+        }
+
+        kmers[c].clear();
+        kmers[c].shrink_to_fit();
+    });
+
+    for (size_t phase=0; phase<2; phase++){
+        run_in_parallel(n_ranges/2, [&](size_t i){
+            auto r = 2*i + phase;
+
+            for (auto& chunk: binned_kmers){
+                for (auto& kmer: chunk[r]){
+                    auto home = hash_kmer(kmer) & mask;
+
+                    // Distance from the home bucket to the end of the next range
+                    auto max_buckets = (r + 2)*range_size - home;
+
+                    if (not insert_bounded(kmer, flag, max_buckets, n_new[r], n_new_per_flag[r])){
+                        leftovers[r].emplace_back(kmer);
+                    }
+                }
+
+                chunk[r].clear();
+                chunk[r].shrink_to_fit();
+            }
+        });
+    }
+
+    for (size_t r=0; r<n_ranges; r++){
+        n_entries += n_new[r];
+        n_per_flag[0] += n_new_per_flag[r][0];
+        n_per_flag[1] += n_new_per_flag[r][1];
+    }
+
+    for (auto& item: leftovers){
+        for (auto& kmer: item){
+            insert(kmer, flag);
+        }
+    }
+}
+
+
+uint8_t ParentalKmerTable::get_flags(const packed_kmer_t& canonical_kmer) const{
+    auto b = hash_kmer(canonical_kmer) & mask;
+
+    while (true){
+        auto& slots = bucket_data[b].slots;
+
+        // Compare the whole bucket before branching, so the loop can be unrolled/vectorized
+        uint8_t result = 0;
+        bool has_empty = false;
+        for (size_t i=0; i<slots.size(); i++){
+            bool is_match = slots[i][0] == canonical_kmer[0] and (slots[i][1] & key_mask) == canonical_kmer[1];
+            result |= uint8_t(is_match) * uint8_t(slots[i][1] >> flag_shift);
+            has_empty |= (slots[i][1] >> flag_shift) == 0;
+        }
+
+        if (result != 0 or has_empty){
+            return result;
+        }
+
+        b = (b + 1) & mask;
+    }
+}
+
+
+size_t ParentalKmerTable::count(uint8_t flag) const{
+    if (flag == paternal_flag){
+        return n_per_flag[0];
+    }
+    else if (flag == maternal_flag){
+        return n_per_flag[1];
+    }
+    else{
+        throw runtime_error("ERROR: can only count kmers for a single parental flag, not: " + to_string(flag));
+    }
+}
+
+
+size_t ParentalKmerTable::size() const{
+    return n_entries;
+}
+
+
+size_t ParentalKmerTable::get_k() const{
+    return k;
+}
+
+
+size_t ParentalKmerTable::get_memory_usage() const{
+    return (mask + 1)*sizeof(ParentalKmerBucket);
+}
+
+
+bool ParentalKmerTable::is_mapped() const{
+    return mapped_data != nullptr;
+}
+
+
+void ParentalKmerTable::clear(){
+    unmap();
+    buckets.assign(4, {});
+    bucket_data = buckets.data();
+    n_entries = 0;
+    n_per_flag = {0,0};
+    mask = 3;
+    k = 0;
+}
+
+
+size_t ParentalKmerTable::load_kmers_from_text(path text_path, uint8_t flag, size_t n_threads){
+    int file_descriptor = ::open(text_path.c_str(), O_RDONLY);
+
+    if (file_descriptor == -1){
+        throw runtime_error("ERROR: could not open file: " + text_path.string());
+    }
+
+    struct stat file_stat;
+    if (fstat(file_descriptor, &file_stat) != 0){
+        ::close(file_descriptor);
+        throw runtime_error("ERROR: could not stat file: " + text_path.string());
+    }
+
+    size_t length = size_t(file_stat.st_size);
+
+    if (length == 0){
+        ::close(file_descriptor);
+        return 0;
+    }
+
+    void* result = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, file_descriptor, 0);
+    ::close(file_descriptor);
+
+    if (result == MAP_FAILED){
+        throw runtime_error("ERROR: could not mmap file: " + text_path.string() + " " + string(::strerror(errno)));
+    }
+
+    auto data = static_cast<const char*>(result);
+    auto end = data + length;
+
+    // Return the kmer on this line, or an empty view if the line is a header or blank
+    auto get_kmer = [&](const char* line_start, const char* line_end){
+        if (line_end > line_start and line_end[-1] == '\r'){
+            line_end--;
+        }
+
+        if (line_start == line_end or *line_start == '>'){
+            return string_view();
+        }
+
+        auto token_end = line_start;
+        while (token_end < line_end and *token_end != ' ' and *token_end != '\t'){
+            token_end++;
+        }
+
+        return string_view(line_start, size_t(token_end - line_start));
+    };
+
+    // Find k from the first kmer in the file, so that every thread can validate its lines
+    for (auto line_start = data; line_start < end and k == 0;){
+        auto line_end = static_cast<const char*>(memchr(line_start, '\n', size_t(end - line_start)));
+        if (line_end == nullptr){
+            line_end = end;
+        }
+
+        auto kmer = get_kmer(line_start, line_end);
+
+        if (not kmer.empty()){
+            if (kmer.size() > max_k){
+                ::munmap(result, length);
+                throw runtime_error("ERROR: parental kmers longer than " + to_string(max_k) + "bp are not supported: " + string(kmer));
+            }
+
+            k = kmer.size();
+        }
+
+        line_start = line_end + 1;
+    }
+
+    // Split the file into chunks which start at line boundaries
+    size_t n_chunks = max(size_t(1), n_threads*8);
+    vector<const char*> chunk_starts = {data};
+
+    for (size_t i=1; i<n_chunks; i++){
+        auto p = data + (length*i)/n_chunks;
+
+        if (p <= chunk_starts.back()){
+            continue;
+        }
+
+        auto newline = static_cast<const char*>(memchr(p, '\n', size_t(end - p)));
+        if (newline == nullptr){
+            break;
+        }
+
+        if (newline + 1 > chunk_starts.back() and newline + 1 < end){
+            chunk_starts.emplace_back(newline + 1);
+        }
+    }
+
+    chunk_starts.emplace_back(end);
+
+    vector <vector<packed_kmer_t> > chunk_kmers(chunk_starts.size() - 1);
+    atomic<size_t> job_index = 0;
+    exception_ptr first_exception = nullptr;
+    mutex exception_mutex;
+
+    auto thread_fn = [&](){
+        size_t i = job_index.fetch_add(1);
+
+        while (i < chunk_kmers.size()){
+            try {
+                auto line_start = chunk_starts[i];
+                auto chunk_end = chunk_starts[i+1];
+
+                while (line_start < chunk_end){
+                    auto line_end = static_cast<const char*>(memchr(line_start, '\n', size_t(chunk_end - line_start)));
+                    if (line_end == nullptr){
+                        line_end = chunk_end;
+                    }
+
+                    auto kmer = get_kmer(line_start, line_end);
+
+                    if (not kmer.empty()){
+                        if (kmer.size() != k){
+                            throw runtime_error("ERROR: kmer with unequal size found: " + string(kmer));
+                        }
+
+                        packed_kmer_t packed;
+                        packed_kmer_t canonical;
+                        to_packed_kmer(kmer, packed);
+                        get_canonical(packed, canonical, k);
+
+                        chunk_kmers[i].emplace_back(canonical);
+                    }
+
+                    line_start = line_end + 1;
+                }
+            }
+            catch (...){
+                std::lock_guard<mutex> lock(exception_mutex);
+                if (not first_exception){
+                    first_exception = std::current_exception();
+                }
+                return;
+            }
+
+            i = job_index.fetch_add(1);
+        }
+    };
+
+    vector<thread> threads;
+
+    // Launch threads
+    for (uint64_t i=0; i<n_threads; i++){
+        try {
+            threads.emplace_back(thread_fn);
+        } catch (const exception &e) {
+            cerr << e.what() << "\n";
+            exit(1);
+        }
+    }
+
+    // Wait for threads to finish
+    for (auto& t: threads){
+        t.join();
+    }
+
+    ::munmap(result, length);
+
+    if (first_exception){
+        std::rethrow_exception(first_exception);
+    }
+
+    size_t n = 0;
+    for (auto& kmers: chunk_kmers){
+        n += kmers.size();
+    }
+
+    insert_in_parallel(chunk_kmers, flag, n_threads);
+
+    return n;
+}
+
+
+void ParentalKmerTable::write_to_binary(path output_path) const{
+    ///
+    /// Layout: a 64 byte header of u64s (magic, version, k, n_entries, n_paternal, n_maternal, n_buckets, unused),
+    /// followed by the raw buckets, which stay 64 byte aligned when the file is mapped
+    ///
+
+    ofstream file(output_path, std::ios::binary);
+
+    if (not file.is_open() or not file.good()){
+        throw runtime_error("ERROR: could not write to file: " + output_path.string());
+    }
+
+    array<uint64_t,8> header = {magic, version, k, n_entries, n_per_flag[0], n_per_flag[1], mask + 1, 0};
+
+    file.write(reinterpret_cast<const char*>(header.data()), sizeof(header));
+    file.write(reinterpret_cast<const char*>(bucket_data), std::streamsize((mask + 1)*sizeof(ParentalKmerBucket)));
+
+    if (not file.good()){
+        throw runtime_error("ERROR: failed while writing file: " + output_path.string());
+    }
+}
+
+
+void ParentalKmerTable::load_from_binary(path binary_path){
+    clear();
+
+    int file_descriptor = ::open(binary_path.c_str(), O_RDONLY);
+
+    if (file_descriptor == -1){
+        throw runtime_error("ERROR: could not open file: " + binary_path.string());
+    }
+
+    struct stat file_stat;
+    if (fstat(file_descriptor, &file_stat) != 0){
+        ::close(file_descriptor);
+        throw runtime_error("ERROR: could not stat file: " + binary_path.string());
+    }
+
+    size_t length = size_t(file_stat.st_size);
+    array<uint64_t,8> header;
+
+    if (length < sizeof(header)){
+        ::close(file_descriptor);
+        throw runtime_error("ERROR: file is not a GFAse parental kmer table: " + binary_path.string());
+    }
+
+    void* result = ::mmap(nullptr, length, PROT_READ, MAP_SHARED, file_descriptor, 0);
+    ::close(file_descriptor);
+
+    if (result == MAP_FAILED){
+        throw runtime_error("ERROR: could not mmap file: " + binary_path.string() + " " + string(::strerror(errno)));
+    }
+
+    memcpy(header.data(), result, sizeof(header));
+
+    auto reject = [&](const string& reason){
+        ::munmap(result, length);
+        throw runtime_error("ERROR: " + reason + ": " + binary_path.string());
+    };
+
+    if (header[0] != magic){
+        reject("file is not a GFAse parental kmer table");
+    }
+    if (header[1] != version){
+        reject("unsupported parental kmer table version " + to_string(header[1]));
+    }
+
+    auto n_buckets = header[6];
+
+    if (n_buckets == 0 or (n_buckets & (n_buckets - 1)) != 0 or length != sizeof(header) + n_buckets*sizeof(ParentalKmerBucket)){
+        reject("parental kmer table is truncated or corrupt");
+    }
+
+    mapped_data = static_cast<const char*>(result);
+    mapped_length = length;
+    bucket_data = reinterpret_cast<const ParentalKmerBucket*>(mapped_data + sizeof(header));
+
+    k = header[2];
+    n_entries = header[3];
+    n_per_flag = {header[4], header[5]};
+    mask = n_buckets - 1;
+
+    // The owned buckets are not used while mapped
+    buckets.clear();
+    buckets.shrink_to_fit();
+}
+
+
+}
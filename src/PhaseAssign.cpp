@@ -3,13 +3,25 @@
 #include "misc.hpp"
 #include "Bam.hpp"
 #include "Sam.hpp"
+#include "Sequence.hpp"
+#include "minimap.h"
 
+#include <exception>
 #include <iomanip>
 #include <iostream>
+#include <atomic>
+#include <thread>
+#include <memory>
+#include <mutex>
 #include <map>
 
 using ghc::filesystem::create_directories;
 using std::setprecision;
+using std::exception_ptr;
+using std::unique_ptr;
+using std::atomic;
+using std::thread;
+using std::mutex;
 using std::min;
 using std::max;
 using std::map;
@@ -75,14 +87,17 @@ ostream& operator<<(ostream& o, const CigarSummary& c){
 }
 
 
+/// Only queries that already have an entry in phased_cigar_summaries are updated, and only the summary of the given
+/// phase, so the two parental BAMs can be parsed concurrently
 void parse_bam_cigars(
         path bam_path,
         unordered_map <string, array<CigarSummary,2> >& phased_cigar_summaries,
         const string& required_prefix,
-        bool phase){
+        bool phase,
+        size_t n_threads){
 
     cerr << "Reading: " << bam_path.string() << '\n';
-    Bam reader(bam_path);
+    Bam reader(bam_path, n_threads);
 
     size_t l = 0;
     reader.for_alignment_in_bam(true, [&](SamElement& e){
@@ -101,12 +116,20 @@ void parse_bam_cigars(
                 return;
             }
 
+            auto result = phased_cigar_summaries.find(e.query_name);
+
+            if (result == phased_cigar_summaries.end()){
+                return;
+            }
+
+            auto& summary = result->second[phase];
+
             if (not e.is_supplementary()){
-                phased_cigar_summaries[e.query_name][phase].primary_ref = e.ref_name;
+                summary.primary_ref = e.ref_name;
             }
 
             e.for_each_cigar([&](char type, uint32_t length){
-                phased_cigar_summaries[e.query_name][phase].update(type, length, 20);
+                summary.update(type, length, 20);
             });
         }
         l++;
@@ -114,6 +137,261 @@ void parse_bam_cigars(
 }
 
 
+/// Read a FASTA in batches of whole sequences, each with at least max_batch_length bases (except the last). Sequences
+/// that are not in `names` are skipped.
+void for_batch_in_fasta(
+        path fasta_path,
+        const map<string,size_t>& names,
+        size_t max_batch_length,
+        const function<void(vector<Sequence>& batch)>& f){
+
+    ifstream file(fasta_path);
+
+    if (not (file.is_open() and file.good())){
+        throw runtime_error("ERROR: could not read input file: " + fasta_path.string());
+    }
+
+    vector<Sequence> batch;
+    size_t batch_length = 0;
+    bool skip = true;
+
+    string line;
+    while (getline(file, line)){
+        if (line.empty()){
+            continue;
+        }
+
+        if (line[0] == '>'){
+            if (not batch.empty() and batch_length >= max_batch_length){
+                f(batch);
+                batch.clear();
+                batch_length = 0;
+            }
+
+            // Trim any trailing tokens from the fasta header, keep only the name
+            string name = line.substr(1, line.find_first_of(" \t\n") - 1);
+
+            skip = (names.count(name) == 0);
+
+            if (not skip){
+                batch.emplace_back();
+                batch.back().name = name;
+                batch.back().sequence.reserve(names.at(name));
+            }
+        }
+        else if (not skip){
+            if (isspace(line.back())){
+                line.pop_back();
+            }
+
+            batch.back().sequence += line;
+            batch_length += line.size();
+        }
+    }
+
+    if (not batch.empty()){
+        f(batch);
+    }
+}
+
+
+/// Fold the primary and supplementary alignments of one query into its CigarSummary for one parent, the same way
+/// parse_bam_cigars does for a BAM
+void map_query_to_parent(
+        const mm_idx_t* mi,
+        const mm_mapopt_t& map_options,
+        mm_tbuf_t* tbuf,
+        const Sequence& query,
+        CigarSummary& summary){
+
+    int n_reg;
+    mm_reg1_t* reg = mm_map(mi, int(query.sequence.size()), query.sequence.c_str(), &n_reg, tbuf, &map_options, query.name.c_str());
+
+    for (int j = 0; j < n_reg; ++j) {
+        mm_reg1_t* r = &reg[j];
+
+        // Secondary alignments are skipped, and sam_pri distinguishes the primary from the supplementaries
+        if (r->id == r->parent and r->mapq > 0 and r->p != nullptr){
+            if (r->sam_pri){
+                summary.primary_ref = mi->seq[r->rid].name;
+            }
+
+            for (uint32_t k = 0; k < r->p->n_cigar; ++k) {
+                uint32_t length = r->p->cigar[k] >> 4;
+                char operation = MM_CIGAR_STR[r->p->cigar[k] & 0xf];
+
+                summary.update(operation, length, 20);
+            }
+        }
+
+        free(r->p);
+    }
+    free(reg);
+}
+
+
+/// Frees a minimap2 index when its owner goes out of scope, so that it is not leaked when mapping throws
+class MinimapIndexDeleter {
+public:
+    void operator()(mm_idx_t* mi) const{
+        mm_idx_destroy(mi);
+    }
+};
+
+using minimap_index_ptr_t = unique_ptr<mm_idx_t, MinimapIndexDeleter>;
+
+
+/// Load a whole FASTA into a single minimap2 index (it is never split into parts, to match aligning against the whole
+/// reference in one run)
+mm_idx_t* load_minimap_index(path fasta_path, const mm_idxopt_t& index_options, size_t n_threads){
+    auto reader = mm_idx_reader_open(fasta_path.string().c_str(), &index_options, nullptr);
+
+    if (reader == nullptr){
+        throw runtime_error("ERROR: could not open reference for indexing: " + fasta_path.string());
+    }
+
+    auto mi = mm_idx_reader_read(reader, int(n_threads));
+    mm_idx_reader_close(reader);
+
+    if (mi == nullptr){
+        throw runtime_error("ERROR: could not index reference: " + fasta_path.string());
+    }
+
+    return mi;
+}
+
+
+/// Align the queries to both parental references with the minimap2 library, without any intermediate SAM/BAM files.
+/// The queries are read in batches, and each (query, parent) pair is a job, so both references are mapped to
+/// concurrently. Every job writes only to its own CigarSummary, so the threads don't need to synchronize.
+void map_to_parental_references(
+        path pat_ref_path,
+        path mat_ref_path,
+        path query_path,
+        const map<string,size_t>& query_lengths,
+        size_t n_threads,
+        unordered_map <string, array<CigarSummary,2> >& phased_cigar_summaries){
+
+    n_threads = max(size_t(1), n_threads);
+
+    // Equivalent to `minimap2 -a -x asm20 --eqx`
+    mm_idxopt_t index_options;
+    mm_mapopt_t base_map_options;
+    mm_set_opt(0, &index_options, &base_map_options);
+    mm_set_opt("asm20", &index_options, &base_map_options);
+    base_map_options.flag |= MM_F_CIGAR;
+    base_map_options.flag |= MM_F_EQX;
+
+    // Don't split large references into multiple index parts
+    index_options.batch_size = 0x7fffffffffffffffL;
+
+    array<path,2> ref_paths = {pat_ref_path, mat_ref_path};
+    array<minimap_index_ptr_t,2> indexes;
+    array<mm_mapopt_t,2> map_options = {base_map_options, base_map_options};
+
+    exception_ptr e;
+    mutex e_mutex;
+
+    // Build the two indexes concurrently, splitting the threads between them
+    {
+        vector<thread> threads;
+
+        for (size_t phase=0; phase<2; phase++){
+            try {
+                threads.emplace_back([&, phase](){
+                    try {
+                        cerr << "Indexing: " << ref_paths[phase].string() << '\n';
+                        indexes[phase].reset(load_minimap_index(ref_paths[phase], index_options, max(size_t(1), n_threads/2)));
+                        mm_mapopt_update(&map_options[phase], indexes[phase].get());
+                    }
+                    catch (...) {
+                        std::lock_guard lock(e_mutex);
+                        if (not e){
+                            e = std::current_exception();
+                        }
+                    }
+                });
+            }
+            catch (const exception& ex) {
+                cerr << ex.what() << '\n';
+                exit(1);
+            }
+        }
+
+        for (auto& t: threads){
+            t.join();
+        }
+    }
+
+    if (e){
+        std::rethrow_exception(e);
+    }
+
+    // Roughly the number of query bases held in memory at once
+    size_t max_batch_length = 1'000'000'000;
+
+    for_batch_in_fasta(query_path, query_lengths, max_batch_length, [&](vector<Sequence>& batch){
+        cerr << "Mapping " << batch.size() << " queries to both parental references" << '\n';
+
+        // The summaries were already initialized for every query, so their locations are stable while mapping
+        vector<array<CigarSummary,2>*> summaries;
+        summaries.reserve(batch.size());
+        for (auto& query: batch){
+            summaries.emplace_back(&phased_cigar_summaries.at(query.name));
+        }
+
+        atomic<size_t> job_index = 0;
+        size_t n_jobs = 2*batch.size();
+
+        auto thread_fn = [&](){
+            mm_tbuf_t* tbuf = mm_tbuf_init();
+
+            size_t i = job_index.fetch_add(1);
+
+            while (i < n_jobs){
+                size_t q = i/2;
+                size_t phase = i%2;
+
+                try {
+                    map_query_to_parent(indexes[phase].get(), map_options[phase], tbuf, batch[q], (*summaries[q])[phase]);
+                }
+                catch (...) {
+                    std::lock_guard lock(e_mutex);
+                    if (not e){
+                        e = std::current_exception();
+                    }
+                    job_index = n_jobs;
+                }
+
+                i = job_index.fetch_add(1);
+            }
+
+            mm_tbuf_destroy(tbuf);
+        };
+
+        vector<thread> threads;
+
+        for (size_t n=0; n<min(n_threads, n_jobs); n++){
+            try {
+                threads.emplace_back(thread_fn);
+            }
+            catch (const exception& ex) {
+                cerr << ex.what() << '\n';
+                exit(1);
+            }
+        }
+
+        for (auto& t: threads){
+            t.join();
+        }
+
+        if (e){
+            std::rethrow_exception(e);
+        }
+    });
+}
+
+
 void bin_fasta_sequence(string& name, string& sequence, int bin, ofstream& file0, ofstream& file1){
     if (not sequence.empty()){
         if (bin == 0){
@@ -255,17 +533,47 @@ void assign_phases(
         phased_cigar_summaries.emplace(name, c);
     }
 
-    // If no alignments are provided, do the alignment with minimap2
+    // If no alignments are provided, do the alignment in-process with the minimap2 library
     if (query_vs_pat_bam.empty() and query_vs_mat_bam.empty()) {
-        auto query_vs_pat_sam = align(output_dir, pat_ref_path, query_path, n_threads);
-        auto query_vs_mat_sam = align(output_dir, mat_ref_path, query_path, n_threads);
-
-        query_vs_pat_bam = sam_to_sorted_bam(query_vs_pat_sam, n_threads);
-        query_vs_mat_bam = sam_to_sorted_bam(query_vs_mat_sam, n_threads);
+        map_to_parental_references(pat_ref_path, mat_ref_path, query_path, query_lengths, n_threads, phased_cigar_summaries);
     }
+    else {
+        array<path,2> bam_paths = {query_vs_pat_bam, query_vs_mat_bam};
+
+        exception_ptr e;
+        mutex e_mutex;
+
+        // Parse the two BAMs concurrently, splitting the decompression threads between them
+        vector<thread> threads;
+
+        for (size_t phase=0; phase<2; phase++){
+            try {
+                threads.emplace_back([&, phase](){
+                    try {
+                        parse_bam_cigars(bam_paths[phase], phased_cigar_summaries, required_prefix, phase, max(size_t(1), n_threads/2));
+                    }
+                    catch (...) {
+                        std::lock_guard lock(e_mutex);
+                        if (not e){
+                            e = std::current_exception();
+                        }
+                    }
+                });
+            }
+            catch (const exception& ex) {
+                cerr << ex.what() << '\n';
+                exit(1);
+            }
+        }
 
-    parse_bam_cigars(query_vs_pat_bam, phased_cigar_summaries, required_prefix, 0);
-    parse_bam_cigars(query_vs_mat_bam, phased_cigar_summaries, required_prefix, 1);
+        for (auto& t: threads){
+            t.join();
+        }
+
+        if (e){
+            std::rethrow_exception(e);
+        }
+    }
 
     path output_path = output_dir / "phase_assignments.csv";
     ofstream output_file(output_path);
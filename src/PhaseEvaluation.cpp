@@ -0,0 +1,298 @@
+#include "PhaseEvaluation.hpp"
+#include "Bam.hpp"
+
+#include <stdexcept>
+#include <fstream>
+#include <iostream>
+
+using std::runtime_error;
+using std::ifstream;
+using std::ofstream;
+using std::cerr;
+using std::min;
+using std::max;
+
+
+namespace gfase {
+
+
+Histogram::Histogram(size_t max_value, size_t bin_size):
+    frequencies(max_value/bin_size + 1),
+    max_value(max_value),
+    bin_size(bin_size)
+{}
+
+
+void Histogram::update(size_t value){
+    if (value <= max_value){
+        frequencies[value/bin_size]++;
+    }
+}
+
+
+void Histogram::update(size_t value, int32_t count){
+    if (value <= max_value){
+        frequencies[value/bin_size]+= count;
+    }
+}
+
+
+void Histogram::merge(const Histogram& other){
+    if (other.max_value != max_value or other.bin_size != bin_size){
+        throw runtime_error("ERROR: cannot merge histograms with different bins");
+    }
+
+    for (size_t i=0; i<frequencies.size(); i++){
+        frequencies[i] += other.frequencies[i];
+    }
+}
+
+
+void Histogram::for_each_item(const function<void(size_t value, int32_t frequency)>& f) const{
+    for (size_t i=0; i<frequencies.size(); i++){
+        f(i*bin_size, frequencies[i]);
+    }
+}
+
+
+void Histogram::write_to_csv(path output_path) const{
+    ofstream file(output_path);
+
+    if (not (file.is_open() and file.good())){
+        throw runtime_error("ERROR: could not write to file: " + output_path.string());
+    }
+
+    for (size_t i=0; i<frequencies.size(); i++){
+        if (frequencies[i] == 0){
+            continue;
+        }
+        file << i*bin_size << ',' << frequencies[i] << '\n';
+    }
+}
+
+
+void Histogram::get_reverse_cdf(vector<int32_t>& cdf) const{
+    cdf.clear();
+    cdf.resize(frequencies.size());
+
+    int64_t i = int64_t(frequencies.size()) - 1;
+    int32_t prev = 0;
+    for (auto it = frequencies.rbegin(); it<frequencies.rend(); it++){
+        cdf[i] = *it + prev;
+        prev = cdf[i];
+        i--;
+    }
+}
+
+
+ContactEvaluation::ContactEvaluation():
+    n_consistent_contacts(60,1),
+    n_inconsistent_contacts(60,1),
+    subread_lengths(10000000,50),
+    subread_counts(10000,1),
+    gap_lengths(1000000000,10000),
+    mapqs(100,1),
+    total_alignments(0)
+{}
+
+
+void ContactEvaluation::update(int8_t phase_a, int8_t phase_b, uint8_t mapq, int32_t count){
+    if ((phase_a != 0) and (phase_b != 0)){
+        if (phase_a == phase_b){
+            n_consistent_contacts.update(mapq, count);
+        }
+        else{
+            n_inconsistent_contacts.update(mapq, count);
+        }
+    }
+}
+
+
+void ContactEvaluation::merge(const ContactEvaluation& other){
+    n_consistent_contacts.merge(other.n_consistent_contacts);
+    n_inconsistent_contacts.merge(other.n_inconsistent_contacts);
+    subread_lengths.merge(other.subread_lengths);
+    subread_counts.merge(other.subread_counts);
+    gap_lengths.merge(other.gap_lengths);
+    mapqs.merge(other.mapqs);
+    total_alignments += other.total_alignments;
+}
+
+
+void ContactEvaluation::write_to_directory(path output_dir) const{
+    path output_path;
+
+    if (total_alignments > 0){
+        output_path = output_dir / "subread_lengths.csv";
+        subread_lengths.write_to_csv(output_path);
+        output_path = output_dir / "subread_counts.csv";
+        subread_counts.write_to_csv(output_path);
+        output_path = output_dir / "gap_lengths.csv";
+        gap_lengths.write_to_csv(output_path);
+        output_path = output_dir / "mapq.csv";
+        mapqs.write_to_csv(output_path);
+
+        output_path = output_dir / "contacts_summary.csv";
+        ofstream contacts_summary_file(output_path);
+
+        if (not (contacts_summary_file.is_open() and contacts_summary_file.good())){
+            throw runtime_error("ERROR: could not write to file: " + output_path.string());
+        }
+
+        contacts_summary_file << "total_alignments" << ',' << total_alignments << '\n';
+        contacts_summary_file << "singletons" << ',' << subread_counts.frequencies[1] << '\n';
+    }
+
+    output_path = output_dir / "phasing_summary.csv";
+    ofstream phasing_summary_file(output_path);
+
+    if (not (phasing_summary_file.is_open() and phasing_summary_file.good())){
+        throw runtime_error("ERROR: could not write to file: " + output_path.string());
+    }
+
+    // Number of contacts passing each mapq threshold
+    vector<int32_t> consistent;
+    vector<int32_t> inconsistent;
+    n_consistent_contacts.get_reverse_cdf(consistent);
+    n_inconsistent_contacts.get_reverse_cdf(inconsistent);
+
+    phasing_summary_file << "" << ',';
+    n_consistent_contacts.for_each_item([&](size_t value, int32_t frequency){
+        phasing_summary_file << value << ',';
+    });
+    phasing_summary_file << '\n';
+
+    phasing_summary_file << "n_consistent_contacts" << ',';
+    for (auto& n: consistent){
+        phasing_summary_file << n << ',';
+    }
+    phasing_summary_file << '\n';
+
+    phasing_summary_file << "n_inconsistent_contacts" << ',';
+    for (auto& n: inconsistent){
+        phasing_summary_file << n << ',';
+    }
+    phasing_summary_file << '\n';
+
+    phasing_summary_file << "signal_ratio" << ',';
+    for (size_t i=0; i<consistent.size(); i++){
+        auto a = double(consistent[i]);
+        auto b = double(inconsistent[i]);
+        phasing_summary_file << a/b << ',';
+    }
+    phasing_summary_file << '\n';
+}
+
+
+void for_each_item_in_phase_csv(path csv_path, const function<void(const string& name, int8_t phase)>& f){
+    string line;
+    string name;
+    string phase;
+
+    ifstream file(csv_path);
+
+    if (not (file.is_open() and file.good())){
+        throw runtime_error("ERROR: couldn't read file: " + csv_path.string());
+    }
+
+    while (getline(file,line)){
+        auto pos = line.find_first_of(',');
+        name = line.substr(0,pos);
+        line = line.substr(pos+1);
+        phase = line.substr(0,min(line.size(), line.find_first_of(',')));
+
+        f(name, int8_t(stoi(phase)));
+    }
+}
+
+
+void evaluate_contacts(
+        path bam_path,
+        const function<int8_t(const string& name)>& get_phase,
+        int8_t min_mapq,
+        size_t n_threads,
+        path temp_dir,
+        ContactEvaluation& evaluation){
+
+    n_threads = max(size_t(1), n_threads);
+
+    Bam reader(bam_path, n_threads);
+
+    vector<int8_t> phases;
+    reader.for_ref_in_header([&](const string& ref_name, uint32_t length){
+        phases.emplace_back(get_phase(ref_name));
+    });
+
+    vector<bool> valid_tids(phases.size(), true);
+
+    vector<ContactEvaluation> thread_evaluations(n_threads);
+
+    reader.for_read_group_in_bam(valid_tids, min_mapq, n_threads, temp_dir, [&](
+            size_t thread_index,
+            const vector<TidAlignment>& alignments,
+            const vector<AlignmentSpan>& spans,
+            size_t start,
+            size_t stop){
+
+        auto& e = thread_evaluations[thread_index];
+
+        e.subread_counts.update(stop - start);
+        e.total_alignments += stop - start;
+
+        // Skip processing singleton chains, but note them in the chain length distribution
+        if (stop - start == 1){
+            return;
+        }
+
+        // Iterate one triangle of the all-by-all matrix
+        for (size_t i=start; i<stop; i++){
+            auto& a = alignments[i];
+            auto& a_span = spans[i];
+
+            for (size_t j=i+1; j<stop; j++) {
+                auto& b = alignments[j];
+                e.update(phases[a.tid], phases[b.tid], min(a.mapq, b.mapq));
+
+                if (a.tid == b.tid){
+                    auto& b_span = spans[j];
+                    auto a_middle = (a_span.ref_stop + a_span.ref_start)/2;
+                    auto b_middle = (b_span.ref_stop + b_span.ref_start)/2;
+
+                    e.gap_lengths.update(size_t(max(a_middle,b_middle) - min(a_middle,b_middle)));
+                }
+            }
+
+            e.subread_lengths.update(size_t(a_span.query_stop - a_span.query_start));
+            e.mapqs.update(a.mapq);
+        }
+    });
+
+    for (auto& e: thread_evaluations){
+        evaluation.merge(e);
+    }
+}
+
+
+void evaluate_contacts(
+        const ContactStore& contacts,
+        const function<int8_t(const string& name)>& get_phase,
+        ContactEvaluation& evaluation){
+
+    vector<int8_t> phases;
+    phases.reserve(contacts.names.size());
+
+    for (auto& name: contacts.names){
+        phases.emplace_back(get_phase(name));
+    }
+
+    contacts.for_each_contact([&](uint32_t a, uint32_t b, const mapq_histogram_t& counts){
+        for (size_t i=0; i<n_mapq_bins; i++){
+            if (counts[i] > 0){
+                evaluation.update(phases[a], phases[b], mapq_bin_starts[i], int32_t(counts[i]));
+            }
+        }
+    });
+}
+
+
+}
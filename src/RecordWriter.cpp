@@ -0,0 +1,207 @@
+#include "RecordWriter.hpp"
+
+#include <stdexcept>
+#include <exception>
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <mutex>
+
+using std::runtime_error;
+using std::exception;
+using std::thread;
+using std::vector;
+using std::mutex;
+using std::cerr;
+using std::min;
+using std::max;
+
+
+namespace gfase {
+
+
+const size_t RecordWriter::buffer_size = 16*1024*1024;
+
+
+RecordWriter::RecordWriter(path output_path, bool compress, size_t n_threads):
+    output_path(output_path),
+    bgzf_file(nullptr)
+{
+    if (compress){
+        bgzf_file = bgzf_open(output_path.string().c_str(), "w");
+
+        if (bgzf_file == nullptr){
+            throw runtime_error("ERROR: could not write to file: " + output_path.string());
+        }
+
+        if (n_threads > 1 and bgzf_mt(bgzf_file, int(n_threads), 256) < 0){
+            bgzf_close(bgzf_file);
+            throw runtime_error("ERROR: could not start compression threads for file: " + output_path.string());
+        }
+    }
+    else {
+        file.open(output_path);
+
+        if (not (file.is_open() and file.good())){
+            throw runtime_error("ERROR: could not write to file: " + output_path.string());
+        }
+    }
+}
+
+
+RecordWriter::~RecordWriter(){
+    try {
+        close();
+    }
+    catch (const exception& e){
+        cerr << e.what() << '\n';
+    }
+}
+
+
+void RecordWriter::write(const string& buffer){
+    if (buffer.empty()){
+        return;
+    }
+
+    if (bgzf_file != nullptr){
+        if (bgzf_write(bgzf_file, buffer.data(), buffer.size()) < 0){
+            throw runtime_error("ERROR: could not write to file: " + output_path.string());
+        }
+    }
+    else {
+        file.write(buffer.data(), std::streamsize(buffer.size()));
+
+        if (not file.good()){
+            throw runtime_error("ERROR: could not write to file: " + output_path.string());
+        }
+    }
+}
+
+
+void RecordWriter::write_records(
+        size_t n_records,
+        size_t n_threads,
+        const function<void(size_t i, string& buffer)>& append_record){
+
+    n_threads = max(size_t(1), n_threads);
+
+    // Buffers keep their capacity between rounds, so they only grow until they fit the largest block
+    vector<string> buffers(n_threads);
+
+    // Start with one record per buffer, and then adjust to the average record size seen so far
+    size_t records_per_buffer = 1;
+    size_t n_bytes = 0;
+    size_t start = 0;
+
+    std::exception_ptr worker_exception;
+    mutex exception_mutex;
+
+    auto worker = [&](size_t thread_index){
+        try {
+            auto& buffer = buffers[thread_index];
+            buffer.clear();
+
+            auto a = start + thread_index*records_per_buffer;
+            auto b = min(n_records, a + records_per_buffer);
+
+            for (size_t i=a; i<b; i++){
+                append_record(i, buffer);
+            }
+        }
+        catch (...) {
+            std::lock_guard lock(exception_mutex);
+            if (not worker_exception){
+                worker_exception = std::current_exception();
+            }
+        }
+    };
+
+    while (start < n_records){
+        size_t n_blocks = min(n_threads, (n_records - start + records_per_buffer - 1)/records_per_buffer);
+
+        if (n_blocks == 1){
+            worker(0);
+        }
+        else {
+            vector<thread> threads;
+
+            for (size_t t=0; t<n_blocks; t++){
+                try {
+                    threads.emplace_back(worker, t);
+                }
+                catch (const exception& e) {
+                    cerr << e.what() << '\n';
+                    exit(1);
+                }
+            }
+
+            for (auto& t: threads){
+                t.join();
+            }
+        }
+
+        if (worker_exception){
+            std::rethrow_exception(worker_exception);
+        }
+
+        for (size_t t=0; t<n_blocks; t++){
+            write(buffers[t]);
+            n_bytes += buffers[t].size();
+        }
+
+        start = min(n_records, start + n_blocks*records_per_buffer);
+
+        auto bytes_per_record = max(size_t(1), n_bytes/start);
+        records_per_buffer = max(size_t(1), buffer_size/bytes_per_record);
+    }
+}
+
+
+void RecordWriter::close(){
+    if (bgzf_file != nullptr){
+        auto result = bgzf_close(bgzf_file);
+        bgzf_file = nullptr;
+
+        if (result < 0){
+            throw runtime_error("ERROR: could not write to file: " + output_path.string());
+        }
+    }
+    else if (file.is_open()){
+        file.close();
+
+        if (file.fail()){
+            throw runtime_error("ERROR: could not write to file: " + output_path.string());
+        }
+    }
+}
+
+
+path get_output_path(path output_path, bool compress){
+    if (compress){
+        output_path += ".gz";
+    }
+
+    return output_path;
+}
+
+
+void append_fasta_record(string& buffer, const string& name, const string& sequence, size_t line_width){
+    buffer += '>';
+    buffer += name;
+    buffer += '\n';
+
+    if (line_width == 0){
+        buffer += sequence;
+        buffer += '\n';
+        return;
+    }
+
+    for (size_t i=0; i<sequence.size(); i+=line_width){
+        buffer.append(sequence, i, line_width);
+        buffer += '\n';
+    }
+}
+
+
+}
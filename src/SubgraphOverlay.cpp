@@ -1,5 +1,7 @@
 #include "SubgraphOverlay.hpp"
 
+#include <algorithm>
+#include <stdexcept>
 #include <atomic>
 #include <vector>
 
@@ -102,4 +104,123 @@ bool SubgraphOverlay::for_each_handle_impl(const std::function<bool(const handle
     }
 }
 
+
+BitmapSubgraphOverlay::BitmapSubgraphOverlay(const HandleGraph* backing, const unordered_set<nid_t>& node_subset) :
+    backing_graph(backing),
+    members(node_subset.begin(), node_subset.end()) {
+    index_members();
+}
+
+BitmapSubgraphOverlay::BitmapSubgraphOverlay(const HandleGraph* backing, vector<nid_t>&& node_subset) :
+    backing_graph(backing),
+    members(std::move(node_subset)) {
+    index_members();
+}
+
+void BitmapSubgraphOverlay::index_members() {
+    std::sort(members.begin(), members.end());
+    
+    if (members.empty()) {
+        return;
+    }
+    
+    min_node = members.front();
+    max_node = members.back();
+    
+    // only worth it if the bitmap is no bigger than the member list
+    uint64_t range = uint64_t(max_node - min_node) + 1;
+    if (range <= 64 * members.size()) {
+        bitmap.resize((range + 63) / 64, 0);
+        for (auto node_id : members) {
+            uint64_t i = node_id - min_node;
+            bitmap[i / 64] |= uint64_t(1) << (i % 64);
+        }
+    }
+}
+
+bool BitmapSubgraphOverlay::has_node(nid_t node_id) const {
+    if (node_id < min_node || node_id > max_node || members.empty()) {
+        return false;
+    }
+    if (!bitmap.empty()) {
+        uint64_t i = node_id - min_node;
+        return (bitmap[i / 64] >> (i % 64)) & 1;
+    }
+    return std::binary_search(members.begin(), members.end(), node_id);
+}
+
+handle_t BitmapSubgraphOverlay::get_handle(const nid_t& node_id, bool is_reverse) const {
+    if (has_node(node_id)) {
+        return backing_graph->get_handle(node_id, is_reverse);
+    } else {
+        throw runtime_error("Node " + std::to_string(node_id) + " not in subgraph overlay");
+    }
+}
+
+nid_t BitmapSubgraphOverlay::get_id(const handle_t& handle) const {
+    return backing_graph->get_id(handle);
+}
+
+bool BitmapSubgraphOverlay::get_is_reverse(const handle_t& handle) const {
+    return backing_graph->get_is_reverse(handle);
+}
+
+handle_t BitmapSubgraphOverlay::flip(const handle_t& handle) const {
+    return backing_graph->flip(handle);
+}
+
+size_t BitmapSubgraphOverlay::get_length(const handle_t& handle) const {
+    return backing_graph->get_length(handle);
+}
+
+std::string BitmapSubgraphOverlay::get_sequence(const handle_t& handle) const {
+    return backing_graph->get_sequence(handle);
+}
+
+size_t BitmapSubgraphOverlay::get_node_count() const {
+    return members.size();
+}
+
+nid_t BitmapSubgraphOverlay::min_node_id() const {
+    return min_node;
+}
+
+nid_t BitmapSubgraphOverlay::max_node_id() const {
+    return max_node;
+}
+
+bool BitmapSubgraphOverlay::follow_edges_impl(const handle_t& handle, bool go_left, const std::function<bool(const handle_t&)>& iteratee) const {
+    
+    if (!has_node(backing_graph->get_id(handle))) {
+        return true;
+    }
+    return backing_graph->follow_edges(handle, go_left, [&](const handle_t& next) {
+        if (has_node(backing_graph->get_id(next))) {
+            return iteratee(next);
+        }
+        return true;
+    });
+}
+
+bool BitmapSubgraphOverlay::for_each_handle_impl(const std::function<bool(const handle_t&)>& iteratee, bool parallel) const {
+    
+    if (!parallel) {
+        for (auto node_id : members) {
+            if (!iteratee(backing_graph->get_handle(node_id, false))) {
+                return false;
+            }
+        }
+        return true;
+    } else {
+        std::atomic<bool> keep_going(true);
+#pragma omp parallel for schedule(dynamic, 256)
+        for (size_t i = 0; i < members.size(); ++i) {
+            if (keep_going.load(std::memory_order_relaxed) && !iteratee(backing_graph->get_handle(members[i], false))) {
+                keep_going = false;
+            }
+        }
+        return keep_going;
+    }
+}
+
 }
@@ -18,208 +18,277 @@ void print_minimap_alignment_block(mm_mapopt_t& map_options, mm_idx_t* mi, mm_re
 }
 
 
-void map_sequence_pair(
-        const string& target_name,
-        const string& target_sequence,
-        const string& query_name,
-        const string& query_sequence,
-        AlignmentChain& result
-        ){
-    result = {};
-
-    const vector<string>& targets = {target_sequence};
-    const vector<string>& target_names = {target_name};
-    const vector<string>& queries = {query_sequence};
-    const vector<string>& query_names = {query_name};
-
-    vector<const char*> c_targets;
-    vector<const char*> c_names;
-
-    c_targets.reserve(targets.size());
-    c_names.reserve(targets.size());
-
-    for (size_t t = 0; t < targets.size(); t++) {
-        c_targets.push_back(targets[t].c_str());
-        c_names.push_back(target_names[t].c_str());
-    }
-
-    mm_idxopt_t index_options;
-    mm_mapopt_t map_options;
-
+void set_minimap_options(mm_idxopt_t& index_options, mm_mapopt_t& map_options){
     mm_set_opt(0, &index_options, &map_options);
     mm_set_opt("asm10", &index_options, &map_options);
 
     index_options.k = 21;
     map_options.flag |= MM_F_CIGAR; // perform alignment
     map_options.flag |= MM_F_EQX;
+}
 
-    mm_idx_t *mi = mm_idx_str(
+
+mm_idx_t* build_minimap_index(const mm_idxopt_t& index_options, const string& target_name, const string& target_sequence){
+    const char* c_target = target_sequence.c_str();
+    const char* c_name = target_name.c_str();
+
+    return mm_idx_str(
             index_options.w,
             index_options.k,
             int(0),
             index_options.bucket_bits,
-            int(targets.size()),
-            c_targets.data(),
-            c_names.data()
+            1,
+            &c_target,
+            &c_name
     );
+}
 
-    mm_tbuf_t *tbuf = mm_tbuf_init(); // thread buffer; for multi-threading, allocate one tbuf for each thread
-    for (size_t q=0; q<queries.size(); q++) {
-        auto& query = queries[q];
-        auto& name = query_names[q];
-
-        //        cerr << "ALIGNING" << '\n';
-        //        cerr << target_names[0] << " " << query_names[i] << ' ' << query.size() << ' ' << targets[0].size() << '\n';
-
-        mm_mapopt_update(&map_options, mi); // this sets the maximum minimizer occurrence; TODO: set a better default in mm_mapopt_init()!
-
-        int n_reg;
-        mm_reg1_t *reg;
-        reg = mm_map(mi, query.size(), query.c_str(), &n_reg, tbuf, &map_options, name.c_str()); // get all hits for the query
-
-        for (int j = 0; j < n_reg; ++j) { // traverse hits
-            mm_reg1_t *r2 = &reg[j];
-
-            assert(r2->p); // with MM_F_CIGAR, this should not be NULL
-
-            if (r2->id == r2->parent){
-                AlignmentBlock block(
-                        r2->rs,
-                        r2->re,
-                        r2->qs,
-                        r2->qe,
-                        0,
-                        0,
-                        0,
-                        0,
-                        r2->rev);
-
-                for (uint32_t k = 0; k < r2->p->n_cigar; ++k) { // IMPORTANT: this gives the CIGAR in the aligned regions. NO soft/hard clippings!
-                    uint32_t length = r2->p->cigar[k] >> 4;
-                    char operation = MM_CIGAR_STR[r2->p->cigar[k] & 0xf];
-
-                    if (operation == '='){
-                        block.n_matches += length;
-                    }
-                    else if (operation == 'X'){
-                        block.n_mismatches += length;
-                    }
-                    else if (operation == 'I'){
-                        block.n_inserts += length;
-                    }
-                    else if (operation == 'D'){
-                        block.n_deletes += length;
-                    }
-                }
 
-                result.chain.emplace_back(block);
+void map_sequence(
+        const mm_idx_t* mi,
+        const mm_mapopt_t& map_options,
+        mm_tbuf_t* tbuf,
+        const string& query_name,
+        const string& query_sequence,
+        AlignmentChain& result
+        ){
+    result = {};
 
-                free(r2->p);
+    int n_reg;
+    mm_reg1_t *reg;
+    reg = mm_map(mi, int(query_sequence.size()), query_sequence.c_str(), &n_reg, tbuf, &map_options, query_name.c_str()); // get all hits for the query
+
+    for (int j = 0; j < n_reg; ++j) { // traverse hits
+        mm_reg1_t *r2 = &reg[j];
+
+        assert(r2->p); // with MM_F_CIGAR, this should not be NULL
+
+        if (r2->id == r2->parent){
+            AlignmentBlock block(
+                    r2->rs,
+                    r2->re,
+                    r2->qs,
+                    r2->qe,
+                    0,
+                    0,
+                    0,
+                    0,
+                    r2->rev);
+
+            for (uint32_t k = 0; k < r2->p->n_cigar; ++k) { // IMPORTANT: this gives the CIGAR in the aligned regions. NO soft/hard clippings!
+                uint32_t length = r2->p->cigar[k] >> 4;
+                char operation = MM_CIGAR_STR[r2->p->cigar[k] & 0xf];
+
+                if (operation == '='){
+                    block.n_matches += length;
+                }
+                else if (operation == 'X'){
+                    block.n_mismatches += length;
+                }
+                else if (operation == 'I'){
+                    block.n_inserts += length;
+                }
+                else if (operation == 'D'){
+                    block.n_deletes += length;
+                }
             }
+
+            result.chain.emplace_back(block);
         }
-        free(reg);
+
+        // Secondary hits also own their CIGAR, even though they aren't used
+        free(r2->p);
     }
+    free(reg);
+}
+
+
+void map_sequence_pair(
+        const string& target_name,
+        const string& target_sequence,
+        const string& query_name,
+        const string& query_sequence,
+        AlignmentChain& result
+        ){
+
+    mm_idxopt_t index_options;
+    mm_mapopt_t map_options;
+    set_minimap_options(index_options, map_options);
+
+    mm_idx_t *mi = build_minimap_index(index_options, target_name, target_sequence);
+    mm_mapopt_update(&map_options, mi); // this sets the maximum minimizer occurrence; TODO: set a better default in mm_mapopt_init()!
+
+    mm_tbuf_t *tbuf = mm_tbuf_init(); // thread buffer; for multi-threading, allocate one tbuf for each thread
+    map_sequence(mi, map_options, tbuf, query_name, query_sequence, result);
 
     mm_tbuf_destroy(tbuf);
     mm_idx_destroy(mi);
 }
 
 
+class AlignmentEdge{
+public:
+    size_t candidate_index;
+    size_t length_a;
+    size_t length_b;
+    size_t total_matches;
+
+    AlignmentEdge(size_t candidate_index, size_t length_a, size_t length_b, size_t total_matches):
+            candidate_index(candidate_index),
+            length_a(length_a),
+            length_b(length_b),
+            total_matches(total_matches)
+    {}
+};
+
+
+///
+/// Candidates are grouped by target (the longer node), so that each target's minimap2 index is built once and all of
+/// its queries are mapped against it in one batch. Each thread owns one minimap2 thread buffer and collects its
+/// passing alignments locally, and they are added to alignment_graph after all threads finish, in candidate order.
+///
 void construct_alignment_graph(
         const vector <HashResult>& to_be_aligned,
         const HandleGraph& graph,
         const IncrementalIdMap<string>& id_map,
         MultiContactGraph& alignment_graph,
         double min_similarity,
-        mutex& output_mutex,
-        atomic<size_t>& global_index
+        size_t n_threads
 ){
+    // Group the candidates by target, ordered by first appearance so that the longest targets still go first
+    vector <vector<size_t> > targets;
+    unordered_map<string, size_t> target_indexes;
+
+    for (size_t i=0; i<to_be_aligned.size(); i++){
+        auto result = target_indexes.emplace(to_be_aligned[i].a, targets.size());
+
+        if (result.second){
+            targets.emplace_back();
+        }
 
-    size_t thread_index;
-    while (global_index < to_be_aligned.size()){
-        thread_index = global_index.fetch_add(1);
+        targets[result.first->second].emplace_back(i);
+    }
 
-        AlignmentChain result;
+    mm_idxopt_t index_options;
+    mm_mapopt_t base_map_options;
+    set_minimap_options(index_options, base_map_options);
 
-        auto& item = to_be_aligned.at(thread_index);
-        auto& target_name = item.a;
-        auto& query_name = item.b;
+    vector <vector<AlignmentEdge> > thread_edges(n_threads);
+    atomic<size_t> job_index = 0;
 
-//        output_mutex.lock();
-//        cerr << global_index << ' ' << thread_index << ' ' << target_name << ' ' << query_name << '\n';
-//        output_mutex.unlock();
+    auto thread_fn = [&](size_t thread_index){
+        auto& edges = thread_edges[thread_index];
 
-        auto seq_a = graph.get_sequence(graph.get_handle(id_map.get_id(target_name)));
-        auto seq_b = graph.get_sequence(graph.get_handle(id_map.get_id(query_name)));
+        mm_tbuf_t *tbuf = mm_tbuf_init();
 
-        // Longer length is first
-        auto length_a = seq_a.size();
-        auto length_b = seq_b.size();
+        size_t i = job_index.fetch_add(1);
 
-        double size_ratio = double(length_b) / double(length_a);
+        while (i < targets.size()){
+            auto& target_name = to_be_aligned[targets[i].front()].a;
+            auto seq_a = graph.get_sequence(graph.get_handle(id_map.get_id(target_name)));
 
-        if (size_ratio < min_similarity){
-            // Don't align reads with a size_ratio that would make min_similarity impossible during alignment
-            // Occasionally needed where hash similarity is not predictive due to repetitiveness
-            continue;
-        }
+            // Longer length is first
+            auto length_a = seq_a.size();
 
-        map_sequence_pair(target_name, seq_a, query_name, seq_b, result);
-
-        result.sort_chains(true);
-
-        if (not result.empty()) {
-//            output_mutex.lock();
-//
-//            cerr << target_name << ' ' << query_name << '\n';
-//            for (auto& item: result.chain) {
-//                cerr << item.get_reversal_char() << '\t' << '(' << item.ref_start << ',' << item.ref_stop << ")\t("
-//                     << item.query_start << ',' << item.query_stop << ')' << '\t' << item.get_identity() << '\n';
-//            }
-//            cerr << '\n';
-//            output_mutex.unlock();
-
-            // Make sure to retain the ordering by size
-            auto id_a = int32_t(id_map.get_id(target_name));
-            auto id_b = int32_t(id_map.get_id(query_name));
-
-            // Clip maximum matches to the length of the longer node
-            auto total_matches = min(length_a, result.get_approximate_non_overlapping_matches());
-
-            auto alignment_coverage = double(total_matches) / double(length_a);
-
-//            output_mutex.lock();
-//            cerr << "total_matches: " << total_matches << '\n';
-//            cerr << "alignment_coverage: " << alignment_coverage << '\n';
-//            cerr << "length_a: " << length_a << '\n';
-//            cerr << "length_b: " << length_b << '\n';
-//            output_mutex.unlock();
-
-            if (alignment_coverage < min_similarity){
-                // Skip alignments which don't have at least min_similarity matches relative to larger node
-//                cerr << "Skipping alignment with insufficient matches: " << target_name << ',' << query_name << '\n';
-                continue;
-            }
+            mm_idx_t *mi = nullptr;
+            mm_mapopt_t map_options = base_map_options;
+
+            for (auto c: targets[i]){
+                auto& query_name = to_be_aligned[c].b;
+                auto seq_b = graph.get_sequence(graph.get_handle(id_map.get_id(query_name)));
+                auto length_b = seq_b.size();
+
+                double size_ratio = double(length_b) / double(length_a);
+
+                if (size_ratio < min_similarity){
+                    // Don't align reads with a size_ratio that would make min_similarity impossible during alignment
+                    // Occasionally needed where hash similarity is not predictive due to repetitiveness
+                    continue;
+                }
+
+                // Only index the target if at least one of its queries needs it
+                if (mi == nullptr){
+                    mi = build_minimap_index(index_options, target_name, seq_a);
+                    mm_mapopt_update(&map_options, mi); // this sets the maximum minimizer occurrence
+                }
+
+                AlignmentChain result;
+                map_sequence(mi, map_options, tbuf, query_name, seq_b, result);
 
-            output_mutex.lock();
+                result.sort_chains(true);
 
-            // Update the graph
-            alignment_graph.try_insert_node(id_a);
-            alignment_graph.try_insert_node(id_b);
+                if (result.empty()){
+                    continue;
+                }
+
+                // Clip maximum matches to the length of the longer node
+                auto total_matches = min(length_a, result.get_approximate_non_overlapping_matches());
 
-            alignment_graph.set_node_coverage(id_a, 0);
-            alignment_graph.set_node_coverage(id_b, 0);
+                auto alignment_coverage = double(total_matches) / double(length_a);
 
-            alignment_graph.try_insert_edge(id_a, id_b, total_matches);
+                if (alignment_coverage < min_similarity){
+                    // Skip alignments which don't have at least min_similarity matches relative to larger node
+                    continue;
+                }
 
-            alignment_graph.set_node_length(id_a, length_a);
-            alignment_graph.set_node_length(id_b, length_b);
+                edges.emplace_back(c, length_a, length_b, total_matches);
+            }
 
-//            cerr << "adding alignment: " << target_name << ',' << query_name << ',' << length_a << ',' << length_b << ',' << total_matches << '\n';
-//            cerr << "from graph: " << alignment_graph.get_node_length(id_a) << ',' << alignment_graph.get_node_length(id_b) << '\n';
+            if (mi != nullptr){
+                mm_idx_destroy(mi);
+            }
 
-            output_mutex.unlock();
+            i = job_index.fetch_add(1);
         }
+
+        mm_tbuf_destroy(tbuf);
+    };
+
+    vector<thread> threads;
+
+    // Launch threads
+    for (uint64_t n=0; n<n_threads; n++){
+        try {
+            threads.emplace_back(thread_fn, n);
+        } catch (const exception &e) {
+            cerr << e.what() << "\n";
+            exit(1);
+        }
+    }
+
+    // Wait for threads to finish
+    for (auto& n: threads){
+        n.join();
+    }
+
+    vector<AlignmentEdge> edges;
+    for (auto& item: thread_edges){
+        edges.insert(edges.end(), item.begin(), item.end());
+        item = {};
+    }
+
+    // Update the graph in the order of the candidates, so the result doesn't depend on thread timing
+    sort(edges.begin(), edges.end(), [](const AlignmentEdge& a, const AlignmentEdge& b){
+        return a.candidate_index < b.candidate_index;
+    });
+
+    for (auto& e: edges){
+        auto& item = to_be_aligned[e.candidate_index];
+
+        // Make sure to retain the ordering by size
+        auto id_a = int32_t(id_map.get_id(item.a));
+        auto id_b = int32_t(id_map.get_id(item.b));
+
+        alignment_graph.try_insert_node(id_a);
+        alignment_graph.try_insert_node(id_b);
+
+        alignment_graph.set_node_coverage(id_a, 0);
+        alignment_graph.set_node_coverage(id_b, 0);
+
+        alignment_graph.try_insert_edge(id_a, id_b, int32_t(e.total_matches));
+
+        alignment_graph.set_node_length(id_a, int32_t(e.length_a));
+        alignment_graph.set_node_length(id_b, int32_t(e.length_b));
     }
 }
 
@@ -1,36 +1,179 @@
 #include "binomial.hpp"
 #include <stdexcept>
 #include <iostream>
+#include <string>
 #include <cmath>
 
 using std::runtime_error;
-using std::pow;
-using std::beta;
+using std::to_string;
+using std::lgamma;
+using std::log1p;
 using std::round;
+using std::isinf;
 using std::cerr;
+using std::exp;
+using std::log;
+using std::min;
+using std::max;
 
 
 namespace gfase{
 
-double binomial_coefficient(double n, double k){
+
+double log_sum_exp(double a, double b){
+    if (isinf(a) and a < 0){
+        return b;
+    }
+    if (isinf(b) and b < 0){
+        return a;
+    }
+
+    auto m = max(a,b);
+
+    return m + log1p(exp(min(a,b) - m));
+}
+
+
+double log_binomial_coefficient(double n, double k){
     if (k > n){
         throw runtime_error("ERROR: cannot compute binomial coefficient for k > n");
     }
 
-    double intermediate = (1.0/(n+1.0)) * (1.0/beta(k+1.0, (n-k)+1.0));
-    auto result = double(round(intermediate));
+    return lgamma(n + 1.0) - lgamma(k + 1.0) - lgamma(n - k + 1.0);
+}
+
+
+double log_binomial(double p, double n, double k){
+    auto c = log_binomial_coefficient(n,k);
 
-    return result;
+    // Avoid 0*log(0) at the boundaries of p
+    double a = (k > 0) ? k*log(p) : 0;
+    double b = (n - k > 0) ? (n - k)*log1p(-p) : 0;
+
+    return c + a + b;
+}
+
+
+double binomial_coefficient(double n, double k){
+    return round(exp(log_binomial_coefficient(n,k)));
 }
 
 
 double binomial(double p, double n, double k){
-    auto c = binomial_coefficient(n,k);
+    return exp(log_binomial(p,n,k));
+}
 
-    auto a = pow(p,k);
-    auto b = pow((1-p),(n-k));
 
-    return c*a*b;
+BinomialTable::BinomialTable(int64_t n, double p):
+        log_pmf(n+1),
+        log_lower_tail(n+1),
+        log_upper_tail(n+1),
+        n(n),
+        p(p)
+{
+    if (n < 0){
+        throw runtime_error("ERROR: cannot construct binomial table for negative n: " + to_string(n));
+    }
+    if (not (p > 0 and p < 1)){
+        throw runtime_error("ERROR: binomial table requires 0 < p < 1, got: " + to_string(p));
+    }
+
+    for (int64_t k=0; k<=n; k++){
+        log_pmf[k] = log_binomial(p, double(n), double(k));
+    }
+
+    log_lower_tail[0] = log_pmf[0];
+    for (int64_t k=1; k<=n; k++){
+        log_lower_tail[k] = log_sum_exp(log_lower_tail[k-1], log_pmf[k]);
+    }
+
+    log_upper_tail[n] = log_pmf[n];
+    for (int64_t k=n-1; k>=0; k--){
+        log_upper_tail[k] = log_sum_exp(log_upper_tail[k+1], log_pmf[k]);
+    }
+
+    // Tails are probabilities, don't let rounding push them past 1
+    for (int64_t k=0; k<=n; k++){
+        log_lower_tail[k] = min(log_lower_tail[k], 0.0);
+        log_upper_tail[k] = min(log_upper_tail[k], 0.0);
+    }
+}
+
+
+void BinomialTable::assert_in_range(int64_t k) const{
+    if (k < 0 or k > n){
+        throw runtime_error("ERROR: k out of range for binomial table: " + to_string(k) + " n=" + to_string(n));
+    }
+}
+
+
+int64_t BinomialTable::get_n() const{
+    return n;
+}
+
+
+double BinomialTable::get_p() const{
+    return p;
+}
+
+
+double BinomialTable::get_log_probability(int64_t k) const{
+    assert_in_range(k);
+    return log_pmf[k];
+}
+
+
+double BinomialTable::get_probability(int64_t k) const{
+    return exp(get_log_probability(k));
+}
+
+
+double BinomialTable::get_log_lower_tail(int64_t k) const{
+    assert_in_range(k);
+    return log_lower_tail[k];
+}
+
+
+double BinomialTable::get_log_upper_tail(int64_t k) const{
+    assert_in_range(k);
+    return log_upper_tail[k];
+}
+
+
+double BinomialTable::get_lower_tail(int64_t k) const{
+    return exp(get_log_lower_tail(k));
+}
+
+
+double BinomialTable::get_upper_tail(int64_t k) const{
+    return exp(get_log_upper_tail(k));
+}
+
+
+double BinomialTable::get_two_sided_p_value(int64_t k) const{
+    assert_in_range(k);
+
+    auto log_tail = min(log_lower_tail[k], log_upper_tail[k]);
+
+    return min(1.0, 2*exp(log_tail));
+}
+
+
+void BinomialTable::get_probabilities(const vector<int64_t>& ks, vector<double>& result) const{
+    result.resize(ks.size());
+
+    for (size_t i=0; i<ks.size(); i++){
+        result[i] = get_probability(ks[i]);
+    }
+}
+
+
+void BinomialTable::get_two_sided_p_values(const vector<int64_t>& ks, vector<double>& result) const{
+    result.resize(ks.size());
+
+    for (size_t i=0; i<ks.size(); i++){
+        result[i] = get_two_sided_p_value(ks[i]);
+    }
 }
 
 
@@ -0,0 +1,74 @@
+#include "ParentalKmerTable.hpp"
+#include "Filesystem.hpp"
+#include "Timer.hpp"
+#include "CLI11.hpp"
+
+#include <string>
+
+using gfase::ParentalKmerTable;
+using gfase::Timer;
+using ghc::filesystem::path;
+
+using std::string;
+using std::cerr;
+
+
+void build_parental_kmer_db(path paternal_kmers, path maternal_kmers, path output_path, size_t n_threads){
+    Timer t;
+    ParentalKmerTable table;
+
+    cerr << t << "Loading paternal kmers..." << '\n';
+    auto n_paternal = table.load_kmers_from_text(paternal_kmers, ParentalKmerTable::paternal_flag, n_threads);
+
+    cerr << t << "Loading maternal kmers..." << '\n';
+    auto n_maternal = table.load_kmers_from_text(maternal_kmers, ParentalKmerTable::maternal_flag, n_threads);
+
+    cerr << "k: " << table.get_k() << '\n';
+    cerr << "paternal kmers read: " << n_paternal << " distinct: " << table.count(ParentalKmerTable::paternal_flag) << '\n';
+    cerr << "maternal kmers read: " << n_maternal << " distinct: " << table.count(ParentalKmerTable::maternal_flag) << '\n';
+    cerr << "table size (bytes): " << table.get_memory_usage() << '\n';
+
+    cerr << t << "Writing " << output_path << "..." << '\n';
+    table.write_to_binary(output_path);
+
+    cerr << t << "Done" << '\n';
+}
+
+
+int main (int argc, char* argv[]){
+    path paternal_kmers;
+    path maternal_kmers;
+    path output_path;
+    size_t n_threads = 1;
+
+    CLI::App app{"Convert parental kmers into a binary table that can be mapped directly by trio phasing tools"};
+
+    app.add_option(
+            "-p,--paternal_kmers",
+            paternal_kmers,
+            "Paternal kmers in FASTA format, or as a plain list with one kmer per line")
+            ->required();
+
+    app.add_option(
+            "-m,--maternal_kmers",
+            maternal_kmers,
+            "Maternal kmers in FASTA format, or as a plain list with one kmer per line")
+            ->required();
+
+    app.add_option(
+            "-o,--output",
+            output_path,
+            "Path of the binary parental kmer table to write")
+            ->required();
+
+    app.add_option(
+            "-t,--threads",
+            n_threads,
+            "Maximum number of threads to use");
+
+    CLI11_PARSE(app, argc, argv);
+
+    build_parental_kmer_db(paternal_kmers, maternal_kmers, output_path, n_threads);
+
+    return 0;
+}
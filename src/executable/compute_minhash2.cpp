@@ -18,7 +18,7 @@ int compute_minhash(path gfa_path, path output_directory, double sample_rate, si
     HashGraph graph;
     IncrementalIdMap<string> id_map;
     Overlaps gfa_overlaps;
-    gfa_to_handle_graph(graph, id_map, gfa_overlaps, gfa_path);
+    gfa_to_handle_graph(graph, id_map, gfa_overlaps, gfa_path, true, false, n_threads);
 
     Hasher2 hasher(k, sample_rate, n_iterations, n_threads);
 
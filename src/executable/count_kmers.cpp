@@ -12,6 +12,7 @@ using ghc::filesystem::path;
 
 using gfase::FixedBinarySequence;
 using gfase::HaplotypePathKmer;
+using gfase::packed_kmer_t;
 using gfase::KmerSets;
 
 using gfase::find_diploid_paths;
@@ -29,15 +30,28 @@ void count_kmers(
         size_t k,
         path paternal_kmers,
         path maternal_kmers,
+        path kmer_db,
         size_t min_path_length,
+        size_t n_threads,
         char path_delimiter = '.') {
 
     HashGraph graph;
     IncrementalIdMap<string> id_map;
     Overlaps overlaps;
-    KmerSets <FixedBinarySequence <uint64_t, 2> > ks(paternal_kmers, maternal_kmers);
+    KmerSets <FixedBinarySequence <uint64_t, 2> > ks;
 
-    gfa_to_handle_graph(graph, id_map, overlaps, gfa_path);
+    if (not kmer_db.empty()){
+        ks.load_kmer_db(kmer_db);
+    }
+    else{
+        ks.load_kmer_text(paternal_kmers, maternal_kmers, n_threads);
+    }
+
+    if (ks.get_k() != k){
+        throw runtime_error("ERROR: kmers in file " + to_string(ks.get_k()) + " do not match k " + to_string(k));
+    }
+
+    gfa_to_handle_graph(graph, id_map, overlaps, gfa_path, true, false, n_threads);
 
     cerr << "Identifying diploid paths..." << '\n';
 
@@ -55,36 +69,8 @@ void count_kmers(
 
     cerr << "\tNumber of components in graph: " << graph.get_path_count() << '\n';
 
-    // Iterate paths and for each node, collect kmers if node is only covered by one path
-    for (auto& [path_name, other_path_name]: diploid_path_names) {
-        auto p = graph.get_path_handle(path_name);
-
-        uint64_t path_length = 0;
-        graph.for_each_step_in_path(p, [&](const step_handle_t& s){
-            path_length += graph.get_length(graph.get_handle_of_step(s));
-        });
-
-        if (path_length < min_path_length){
-            // Skip to next path
-            continue;
-        }
-
-        HaplotypePathKmer kmer(graph, p, k);
-
-        string component_name;
-        size_t haplotype;
-
-        tie(component_name, haplotype) = parse_path_string(path_name, path_delimiter);
-
-        cerr << path_name << " " << component_name << " " << haplotype << '\n';
-
-        kmer.for_each_haploid_kmer([&](const deque<char>& sequence){
-            FixedBinarySequence<uint64_t,2> s(sequence);
-
-            // Compare kmer to parental kmers
-            ks.increment_parental_kmer_count(component_name, haplotype, s);
-        });
-    }
+    // Count kmers in the haploid regions of each path, distributing paths over threads
+    gfase::count_kmers(graph, id_map, diploid_path_names, ks, k, path_delimiter, n_threads, min_path_length);
 
     // Open file and print header
     ofstream component_matrix_outfile("kmer_counts.csv");
@@ -107,6 +93,8 @@ int main (int argc, char* argv[]){
     size_t min_path_length;
     path paternal_kmers;
     path maternal_kmers;
+    path kmer_db;
+    size_t n_threads = 1;
     vector<string> c;
 
     CLI::App app{"App description"};
@@ -129,26 +117,40 @@ int main (int argc, char* argv[]){
             "Minimum length of path to print information for")
             ->required();
 
-    app.add_option(
+    auto paternal_option = app.add_option(
             "-p,--paternal_kmers",
             paternal_kmers,
-            "Paternal kmers in FASTA format")
-            ->required();
+            "Paternal kmers in FASTA format, or as a plain list with one kmer per line");
 
-    app.add_option(
+    auto maternal_option = app.add_option(
             "-m,--maternal_kmers",
             maternal_kmers,
-            "Maternal kmers in FASTA format")
-            ->required();
+            "Maternal kmers in FASTA format, or as a plain list with one kmer per line");
+
+    app.add_option(
+            "-d,--kmer_db",
+            kmer_db,
+            "Parental kmer table built by build_parental_kmer_db, which is used instead of -p and -m")
+            ->excludes(paternal_option)
+            ->excludes(maternal_option);
 
     app.add_option(
             "-c,--components",
             c,
             "List of components to print (space separated)");
 
+    app.add_option(
+            "-t,--threads",
+            n_threads,
+            "Maximum number of threads to use");
+
     CLI11_PARSE(app, argc, argv);
 
-    count_kmers(gfa_path, k, paternal_kmers, maternal_kmers, min_path_length);
+    if (kmer_db.empty() and (paternal_kmers.empty() or maternal_kmers.empty())){
+        throw runtime_error("ERROR: must provide either --kmer_db, or both --paternal_kmers and --maternal_kmers");
+    }
+
+    count_kmers(gfa_path, k, paternal_kmers, maternal_kmers, kmer_db, min_path_length, n_threads);
 
     return 0;
 }
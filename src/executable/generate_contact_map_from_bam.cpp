@@ -1,3 +1,4 @@
+#include "ContactStore.hpp"
 #include "BubbleGraph.hpp"
 #include "IncrementalIdMap.hpp"
 #include "Filesystem.hpp"
@@ -5,10 +6,13 @@
 #include "Sam.hpp"
 #include "Bam.hpp"
 
+using gfase::ContactStore;
 using gfase::BubbleGraph;
 using gfase::IncrementalIdMap;
 using gfase::unpaired_mappings_t;
 using gfase::unpaired_mappings_t;
+using gfase::get_valid_tids;
+using gfase::TidAlignment;
 using gfase::SamElement;
 using gfase::Bam;
 
@@ -22,85 +26,59 @@ using CLI::App;
 using std::ofstream;
 using std::cerr;
 using std::min;
+using std::max;
 using std::map;
 
-using weighted_contact_map_t = sparse_hash_map <int32_t, sparse_hash_map<int32_t, map <uint8_t, int32_t> > >;
 using mappings_per_read_t = sparse_hash_map <string, map <size_t, map <uint8_t, int64_t> > >;
 
 
-void update_contact_map(
-        vector<SamElement>& alignments,
-        weighted_contact_map_t& contact_map,
-        IncrementalIdMap<string>& id_map){
-
-    // Iterate one triangle of the all-by-all matrix, adding up mapqs for reads on both end of the pair
-    for (size_t i=0; i<alignments.size(); i++){
-//        cerr << alignments[i] << '\n';
-
-        for (size_t j=i+1; j<alignments.size(); j++) {
-            auto& a = alignments[i];
-            auto& b = alignments[j];
-
-            auto ref_id_a = id_map.try_insert(a.ref_name);
-            auto ref_id_b = id_map.try_insert(b.ref_name);
-
-            // TODO: split left and right mapq?
-            contact_map[ref_id_a][ref_id_b][min(a.mapq,b.mapq)]++;
-            contact_map[ref_id_b][ref_id_a][min(a.mapq,b.mapq)]++;
-        }
-    }
-}
-
-
 void parse_unpaired_bam_file(
         path bam_path,
-        weighted_contact_map_t& contact_map,
-        IncrementalIdMap<string>& id_map,
+        ContactStore& contacts,
         string required_prefix,
-        int8_t min_mapq){
+        int8_t min_mapq,
+        size_t n_threads,
+        path temp_dir){
 
-    Bam reader(bam_path);
+    n_threads = max(size_t(1), n_threads);
 
-    size_t l = 0;
-    string prev_query_name = "";
-    vector<SamElement> alignments;
+    Bam reader(bam_path, n_threads);
 
-    reader.for_alignment_in_bam(false, [&](const SamElement& a){
-        if (l == 0){
-            prev_query_name = a.query_name;
-        }
+    // Contacts are keyed by tid, so the header order is the name table of the store
+    contacts.names.clear();
+    reader.for_ref_in_header([&](const string& ref_name, uint32_t length){
+        contacts.names.emplace_back(ref_name);
+    });
 
-        if (prev_query_name != a.query_name){
-            if (alignments.size() > 1){
-                update_contact_map(alignments, contact_map, id_map);
-            }
-            alignments.clear();
-        }
+    vector<bool> valid_tids;
+    get_valid_tids(reader, required_prefix, valid_tids);
 
-        // No information about reference contig, this alignment is unusable
-        if (a.ref_name.empty()){
-            return;
-        }
+    vector<ContactStore> thread_contacts(n_threads);
 
-        bool valid_prefix = true;
-        if (not required_prefix.empty()){
-            for (size_t i=0; i<required_prefix.size(); i++){
-                if (a.ref_name[i] != required_prefix[i]){
-                    valid_prefix = false;
-                    break;
-                }
-            }
-        }
+    reader.for_read_group_in_bam(valid_tids, min_mapq, n_threads, temp_dir, [&](
+            size_t thread_index,
+            const vector<TidAlignment>& alignments,
+            size_t start,
+            size_t stop){
+
+        auto& store = thread_contacts[thread_index];
 
-        if (valid_prefix) {
-            if (a.mapq >= min_mapq and a.is_primary()) {
-                alignments.emplace_back(a);
+        // Iterate one triangle of the all-by-all matrix, adding up mapqs for reads on both end of the pair
+        for (size_t i=start; i<stop; i++){
+            for (size_t j=i+1; j<stop; j++) {
+                auto& a = alignments[i];
+                auto& b = alignments[j];
+
+                // TODO: split left and right mapq?
+                store.increment(uint32_t(a.tid), uint32_t(b.tid), min(a.mapq,b.mapq));
             }
         }
-
-        l++;
-        prev_query_name = a.query_name;
     });
+
+    for (auto& store: thread_contacts){
+        contacts.merge(store);
+        store.clear();
+    }
 }
 
 
@@ -120,36 +98,15 @@ void remove_singleton_reads(unpaired_mappings_t& mappings){
 }
 
 
-void write_contact_map(
-        path output_path,
-        const weighted_contact_map_t& contact_map,
-        const IncrementalIdMap<string>& id_map){
-    ofstream output_file(output_path);
-
-    if (not output_file.is_open() or not output_file.good()){
-        throw std::runtime_error("ERROR: could not write to file: " + output_path.string());
-    }
-
-    for (const auto& [id,map2]: contact_map){
-        for (const auto& [id2,map3]: map2){
-            output_file << id_map.get_name(id) << ',' << id_map.get_name(id2) << ',';
-
-            auto max_key = map3.rbegin()->first;
-
-            for (const auto& [q,count]: map3) {
-                 output_file << int(q) << ':' << count;
-
-                 if (q != max_key){
-                    output_file << ' ';
-                 }
-            }
-            output_file << '\n';
-        }
-    }
-}
-
+void generate_contact_map_from_bam(
+        path output_dir,
+        path sam_path,
+        path gfa_path,
+        string required_prefix,
+        int8_t min_mapq,
+        size_t n_threads,
+        bool write_csv){
 
-void generate_contact_map_from_bam(path output_dir, path sam_path, path gfa_path, string required_prefix, int8_t min_mapq, size_t n_threads){
     if (exists(output_dir)){
         throw runtime_error("ERROR: output directory exists already");
     }
@@ -157,24 +114,26 @@ void generate_contact_map_from_bam(path output_dir, path sam_path, path gfa_path
         create_directories(output_dir);
     }
 
-    // Id-to-name bimap for reference contigs
-    IncrementalIdMap<string> id_map(false);
-
-    // Datastructures to represent linkages from hiC
-    weighted_contact_map_t contact_map;
-    vector <vector <int32_t> > adjacency;
+    // Linkages from hiC, one histogram of mapqs per pair of contigs
+    ContactStore contacts;
 
     cerr << "Loading alignments as contact map..." << '\n';
 
-    if (sam_path.extension() == ".bam"){
-        parse_unpaired_bam_file(sam_path, contact_map, id_map, required_prefix, min_mapq);
+    if (sam_path.extension() == ".bam" or sam_path.extension() == ".cram"){
+        parse_unpaired_bam_file(sam_path, contacts, required_prefix, min_mapq, n_threads, output_dir);
     }
     else{
         throw runtime_error("ERROR: unrecognized extension for SAM/BAM input file: " + sam_path.extension().string());
     }
 
-    path output_path = output_dir / "contacts.csv";
-    write_contact_map(output_path, contact_map, id_map);
+    cerr << "Writing " << contacts.size() << " contacts..." << '\n';
+
+    contacts.write_to_binary(output_dir / "contacts.bin");
+    contacts.write_to_mapq_list_csv(output_dir / "contacts.csv");
+
+    if (write_csv){
+        contacts.write_to_csv(output_dir / "contacts_by_mapq_bin.csv");
+    }
 }
 
 
@@ -185,13 +144,14 @@ int main (int argc, char* argv[]){
     string required_prefix;
     int8_t min_mapq = 0;
     size_t n_threads = 1;
+    bool write_csv = false;
 
     CLI::App app{"App description"};
 
     app.add_option(
             "-i,--input",
             sam_path,
-            "Path to SAM or BAM containing filtered, paired HiC reads")
+            "Path to BAM or CRAM containing filtered, paired HiC reads. Either grouped by read name, or coordinate sorted (as declared in the header), in which case reads are grouped using temporary files in the output directory.")
             ->required();
 
     app.add_option(
@@ -218,11 +178,16 @@ int main (int argc, char* argv[]){
     app.add_option(
             "-t,--threads",
             n_threads,
-            "Maximum number of threads to use");
+            "Maximum number of threads to use, for both BAM decompression and contact counting");
+
+    app.add_flag(
+            "--csv",
+            write_csv,
+            "Also write contacts_by_mapq_bin.csv: one line per pair of contigs, with a column of counts for each mapq bin");
 
     CLI11_PARSE(app, argc, argv);
 
-    generate_contact_map_from_bam(output_dir, sam_path, gfa_path, required_prefix, min_mapq, n_threads);
+    generate_contact_map_from_bam(output_dir, sam_path, gfa_path, required_prefix, min_mapq, n_threads, write_csv);
 
     return 0;
 }
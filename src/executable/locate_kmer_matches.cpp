@@ -12,6 +12,8 @@ using ghc::filesystem::path;
 
 using gfase::FixedBinarySequence;
 using gfase::HaplotypePathKmer;
+using gfase::ParentalKmerTable;
+using gfase::packed_kmer_t;
 using gfase::KmerSets;
 
 using gfase::find_diploid_paths;
@@ -42,6 +44,7 @@ void locate_kmer_matches(
         size_t k,
         path paternal_kmers,
         path maternal_kmers,
+        path kmer_db,
         size_t min_path_length,
         set<string>& components,
         bool write_kmer_sequence,
@@ -52,7 +55,18 @@ void locate_kmer_matches(
     Overlaps overlaps;
 
     cerr << "Loading kmers into sets..." << '\n';
-    KmerSets<FixedBinarySequence<uint64_t, 2> > ks(paternal_kmers, maternal_kmers);
+    KmerSets<FixedBinarySequence<uint64_t, 2> > ks;
+
+    if (not kmer_db.empty()){
+        ks.load_kmer_db(kmer_db);
+    }
+    else{
+        ks.load_kmer_text(paternal_kmers, maternal_kmers, 1);
+    }
+
+    if (ks.get_k() != k){
+        throw runtime_error("ERROR: kmers in file " + to_string(ks.get_k()) + " do not match k " + to_string(k));
+    }
 
     gfa_to_handle_graph(graph, id_map, overlaps, gfa_path);
 
@@ -123,9 +137,7 @@ void locate_kmer_matches(
         ofstream file(output_path);
         file << "path_index" << ',' << "is_paternal" << ',' << "is_maternal" << '\n';
 
-        kmer.for_each_haploid_kmer([&](const deque<char>& sequence){
-            FixedBinarySequence<uint64_t,2> s(sequence);
-
+        kmer.for_each_haploid_kmer([&](const packed_kmer_t& canonical_kmer){
             // Get location of current kmer
             auto step = kmer.get_step_of_kmer_start();
             auto index = kmer.get_index_of_kmer_start();
@@ -133,14 +145,15 @@ void locate_kmer_matches(
             size_t path_position = path_distance_map.at(step) + index;
 
             // Get is_mat/is_pat
-            bool is_paternal = ks.is_paternal(s);
-            bool is_maternal = ks.is_maternal(s);
+            auto flags = ks.get_parental_flags(canonical_kmer);
+            bool is_paternal = (flags & ParentalKmerTable::paternal_flag) != 0;
+            bool is_maternal = (flags & ParentalKmerTable::maternal_flag) != 0;
 
             file << path_position << ',' << int(is_paternal) << ',' << int(is_maternal);
 
             if (write_kmer_sequence){
                 file << ',';
-                for (const auto& c: sequence){
+                for (const auto& c: kmer.get_sequence()){
                     file << c;
                 }
             }
@@ -157,6 +170,7 @@ int main (int argc, char* argv[]){
     size_t min_path_length;
     path paternal_kmers;
     path maternal_kmers;
+    path kmer_db;
     vector<string> c;
     set<string> components;
     bool write_kmer_sequence;
@@ -181,17 +195,22 @@ int main (int argc, char* argv[]){
             "Minimum length of path to print information for")
             ->required();
 
-    app.add_option(
+    auto paternal_option = app.add_option(
             "-p,--paternal_kmers",
             paternal_kmers,
-            "Paternal kmers in FASTA format")
-            ->required();
+            "Paternal kmers in FASTA format, or as a plain list with one kmer per line");
 
-    app.add_option(
+    auto maternal_option = app.add_option(
             "-m,--maternal_kmers",
             maternal_kmers,
-            "Maternal kmers in FASTA format")
-            ->required();
+            "Maternal kmers in FASTA format, or as a plain list with one kmer per line");
+
+    app.add_option(
+            "-d,--kmer_db",
+            kmer_db,
+            "Parental kmer table built by build_parental_kmer_db, which is used instead of -p and -m")
+            ->excludes(paternal_option)
+            ->excludes(maternal_option);
 
     app.add_option(
             "-c,--components",
@@ -205,11 +224,15 @@ int main (int argc, char* argv[]){
 
     CLI11_PARSE(app, argc, argv);
 
+    if (kmer_db.empty() and (paternal_kmers.empty() or maternal_kmers.empty())){
+        throw runtime_error("ERROR: must provide either --kmer_db, or both --paternal_kmers and --maternal_kmers");
+    }
+
     for (const auto& item: c){
         components.emplace(item);
     }
 
-    locate_kmer_matches(gfa_path, k, paternal_kmers, maternal_kmers, min_path_length, components, write_kmer_sequence);
+    locate_kmer_matches(gfa_path, k, paternal_kmers, maternal_kmers, kmer_db, min_path_length, components, write_kmer_sequence);
 
     return 0;
 }
@@ -251,7 +251,7 @@ void phase_hic(path output_dir, path sam_path, path gfa_path, string required_pr
         cerr << t << "GFA provided - Loading graph..." << '\n';
 
         // Construct graph from GFA
-        gfa_to_handle_graph(graph, id_map, overlaps, gfa_path, false);
+        gfa_to_handle_graph(graph, id_map, overlaps, gfa_path, false, false, n_threads);
 
         cerr << t << "Constructing bubble graph..." << '\n';
 
@@ -1,6 +1,7 @@
 #include "MultiContactGraph.hpp"
 #include "IncrementalIdMap.hpp"
 #include "Sequence.hpp"
+#include "RecordWriter.hpp"
 #include "gfa_to_handle.hpp"
 #include "handle_to_gfa.hpp"
 #include "graph_utility.hpp"
@@ -16,6 +17,7 @@
 #include "Sam.hpp"
 #include "Bam.hpp"
 
+using gfase::parse_unpaired_bam_file;
 using gfase::for_element_in_sam_file;
 using gfase::contact_map_t;
 using gfase::unzip;
@@ -28,6 +30,9 @@ using gfase::HamiltonianChainer;
 using gfase::MultiContactGraph;
 using gfase::IncrementalIdMap;
 using gfase::AbstractChainer;
+using gfase::RecordWriter;
+using gfase::append_fasta_record;
+using gfase::get_output_path;
 using gfase::SamElement;
 using gfase::Sequence;
 using gfase::HashResult;
@@ -90,73 +95,6 @@ using std::set;
 using weighted_contact_map_t = sparse_hash_map <int32_t, sparse_hash_map<int32_t, map <uint8_t, int32_t> > >;
 
 
-void update_contact_map(
-        vector<SamElement>& alignments,
-        contact_map_t& contact_map,
-        IncrementalIdMap<string>& id_map){
-
-    // Iterate one triangle of the all-by-all matrix, adding up mapqs for reads on both end of the pair
-    for (size_t i=0; i<alignments.size(); i++){
-//        cerr << alignments[i] << '\n';
-
-        for (size_t j=i+1; j<alignments.size(); j++) {
-            auto& a = alignments[i];
-            auto& b = alignments[j];
-
-            auto ref_id_a = id_map.try_insert(a.ref_name);
-            auto ref_id_b = id_map.try_insert(b.ref_name);
-
-            // TODO: split left and right mapq instead of taking min?
-            contact_map[ref_id_a][ref_id_b]++;
-            contact_map[ref_id_b][ref_id_a]++;
-        }
-    }
-}
-
-
-void parse_unpaired_bam_file(
-        path bam_path,
-        MultiContactGraph& contact_graph,
-        IncrementalIdMap<string>& id_map,
-        int8_t min_mapq){
-
-    Bam reader(bam_path);
-
-    size_t l = 0;
-    string prev_query_name = "";
-    vector<SamElement> alignments;
-
-    reader.for_alignment_in_bam(false, [&](const SamElement& a){
-        if (l == 0){
-            prev_query_name = a.query_name;
-        }
-
-        if (prev_query_name != a.query_name){
-            update_contact_map(alignments, contact_graph, id_map);
-            alignments.clear();
-        }
-
-        // No information about reference contig, this alignment is unusable
-        if (a.ref_name.empty()){
-            return;
-        }
-
-        // Only allow reads with mapq > min_mapq and not secondary
-        if (a.mapq >= min_mapq and a.is_primary()) {
-            alignments.emplace_back(a);
-        }
-
-        l++;
-        prev_query_name = a.query_name;
-    });
-
-    // Collect final read's contacts
-    if (not alignments.empty()){
-        update_contact_map(alignments, contact_graph, id_map);
-    }
-}
-
-
 void write_contact_map(
         path output_path,
         const contact_map_t& contact_map,
@@ -202,15 +140,15 @@ void write_config(
 }
 
 
-void write_gfa_to_file(PathHandleGraph& graph, IncrementalIdMap<string>& id_map, Overlaps& overlaps, path output_gfa_path){
-    ofstream chained_gfa(output_gfa_path);
-
-    if (not (chained_gfa.is_open() and chained_gfa.good())){
-        throw runtime_error("ERROR: could not write to file: " + output_gfa_path.string());
-    }
-
-    handle_graph_to_gfa(graph, id_map, overlaps, chained_gfa);
+void write_gfa_to_file(
+        const PathHandleGraph& graph,
+        const IncrementalIdMap<string>& id_map,
+        const Overlaps& overlaps,
+        path output_gfa_path,
+        bool compress,
+        size_t n_threads){
 
+    handle_graph_to_gfa(graph, id_map, overlaps, get_output_path(output_gfa_path, compress), compress, n_threads);
 }
 
 
@@ -219,28 +157,20 @@ void write_nodes_to_fasta(
         const IncrementalIdMap<string>& id_map,
         const MultiContactGraph& contact_graph,
         const AbstractChainer& chainer,
-        path output_dir
+        path output_dir,
+        size_t line_width,
+        bool compress,
+        size_t n_threads
         ){
 
-    path phase_0_fasta_path = output_dir / "phase_0.fasta";
-    path phase_1_fasta_path = output_dir / "phase_1.fasta";
-    path unphased_fasta_path = output_dir / "unphased.fasta";
-
-    ofstream phase_0_fasta(phase_0_fasta_path);
-    ofstream phase_1_fasta(phase_1_fasta_path);
-    ofstream unphased_fasta(unphased_fasta_path);
-
-    if (not (phase_0_fasta.is_open() and phase_0_fasta.good())){
-        throw runtime_error("ERROR: file could not be written: " + phase_0_fasta_path.string());
-    }
-
-    if (not (phase_1_fasta.is_open() and phase_1_fasta.good())){
-        throw runtime_error("ERROR: file could not be written: " + phase_1_fasta_path.string());
-    }
+    array<path,3> fasta_paths = {
+            get_output_path(output_dir / "phase_0.fasta", compress),
+            get_output_path(output_dir / "phase_1.fasta", compress),
+            get_output_path(output_dir / "unphased.fasta", compress)
+    };
 
-    if (not (unphased_fasta.is_open() and unphased_fasta.good())){
-        throw runtime_error("ERROR: file could not be written: " + unphased_fasta_path.string());
-    }
+    // The handles that go to each file: phase 0, phase 1, or unphased
+    array<vector<handle_t>,3> handles;
 
     graph.for_each_handle([&](const handle_t& h){
         auto id = graph.get_id(h);
@@ -266,18 +196,26 @@ void write_nodes_to_fasta(
         }
 
         if (partition == -1){
-            phase_0_fasta << '>' << name << '\n';
-            phase_0_fasta << graph.get_sequence(h) << '\n';
+            handles[0].emplace_back(h);
         }
         else if (partition == 1){
-            phase_1_fasta << '>' << name << '\n';
-            phase_1_fasta << graph.get_sequence(h) << '\n';
+            handles[1].emplace_back(h);
         }
         else{
-            unphased_fasta << '>' << name << '\n';
-            unphased_fasta << graph.get_sequence(h) << '\n';
+            handles[2].emplace_back(h);
         }
     });
+
+    for (size_t f=0; f<fasta_paths.size(); f++){
+        RecordWriter writer(fasta_paths[f], compress, n_threads);
+
+        writer.write_records(handles[f].size(), n_threads, [&](size_t i, string& buffer){
+            auto h = handles[f][i];
+            append_fasta_record(buffer, id_map.get_name(graph.get_id(h)), graph.get_sequence(h), line_width);
+        });
+
+        writer.close();
+    }
 }
 
 
@@ -366,36 +304,9 @@ void find_unlabeled_alts(
     MultiContactGraph alignment_graph;
     MultiContactGraph symmetrical_alignment_graph;
 
-    // Thread-related variables
-    atomic<size_t> job_index = 0;
-    vector<thread> threads;
-    mutex output_mutex;
-
     mm_verbose = 0; // disable message output to stderr
 
-    // Launch threads
-    for (uint64_t n=0; n<n_threads; n++){
-        try {
-            threads.emplace_back(thread(
-                    construct_alignment_graph,
-                    ref(to_be_aligned),
-                    ref(graph),
-                    ref(id_map),
-                    ref(alignment_graph),
-                    min_similarity,
-                    ref(output_mutex),
-                    ref(job_index)
-            ));
-        } catch (const exception &e) {
-            cerr << e.what() << "\n";
-            exit(1);
-        }
-    }
-
-    // Wait for threads to finish
-    for (auto& n: threads){
-        n.join();
-    }
+    construct_alignment_graph(to_be_aligned, graph, id_map, alignment_graph, min_similarity, n_threads);
 
     get_best_overlaps(min_similarity, id_map, alignment_graph, symmetrical_alignment_graph);
     write_alignment_results_to_file(id_map, alignment_graph, symmetrical_alignment_graph, output_dir);
@@ -437,7 +348,9 @@ void phase(
         double sample_rate = 0.04,
         size_t n_iterations = 6,
         size_t k = 22,
-        double min_hash_similarity = 0.7
+        double min_hash_similarity = 0.7,
+        size_t fasta_line_width = 0,
+        bool compress_output = false
 ){
     Timer t;
 
@@ -472,7 +385,7 @@ void phase(
     // For finding and unzipping bubble chains
     unique_ptr<AbstractChainer> chainer;
     if (use_hamiltonian_chainer) {
-        chainer = unique_ptr<AbstractChainer>(new HamiltonianChainer());
+        chainer = unique_ptr<AbstractChainer>(new HamiltonianChainer(n_threads));
     }
     else {
         chainer = unique_ptr<AbstractChainer>(new Chainer());
@@ -481,7 +394,7 @@ void phase(
     cerr << t << "Loading GFA..." << '\n';
 
     // Construct graph from GFA
-    gfa_to_handle_graph(graph, id_map, overlaps, gfa_path, false, true);
+    gfa_to_handle_graph(graph, id_map, overlaps, gfa_path, false, true, n_threads);
 
     cerr << t << "Writing IDs to file..." << '\n';
 
@@ -489,8 +402,8 @@ void phase(
 
     cerr << t << "Loading alignments as contact map..." << '\n';
 
-    if (sam_path.extension() == ".bam"){
-        parse_unpaired_bam_file(sam_path, contact_graph, id_map, min_mapq);
+    if (sam_path.extension() == ".bam" or sam_path.extension() == ".cram"){
+        parse_unpaired_bam_file(sam_path, contact_graph, id_map, "", min_mapq, n_threads, output_dir);
     }
     else{
         throw runtime_error("ERROR: unrecognized extension for BAM input file: " + sam_path.extension().string());
@@ -566,18 +479,18 @@ void phase(
 
     cerr << t << "Writing GFA... " << '\n';
 
-    write_gfa_to_file(graph, id_map, overlaps, chained_gfa_path);
+    write_gfa_to_file(graph, id_map, overlaps, chained_gfa_path, compress_output, n_threads);
 
     if (not skip_unzip) {
         cerr << t << "Unzipping chains... " << '\n';
 
-        unzip(graph, id_map, overlaps, false, false);
-        write_gfa_to_file(graph, id_map, overlaps, unzipped_gfa_path);
+        unzip(graph, id_map, overlaps, false, false, n_threads);
+        write_gfa_to_file(graph, id_map, overlaps, unzipped_gfa_path, compress_output, n_threads);
     }
 
     cerr << t << "Writing FASTA... " << '\n';
 
-    write_nodes_to_fasta(graph, id_map, contact_graph, *chainer, output_dir);
+    write_nodes_to_fasta(graph, id_map, contact_graph, *chainer, output_dir, fasta_line_width, compress_output, n_threads);
 
     cerr << t << "Done" << '\n';
 }
@@ -599,13 +512,15 @@ int main (int argc, char* argv[]){
     size_t n_iterations = 6;
     size_t k = 22;
     double min_hash_similarity = 0.7;
+    size_t fasta_line_width = 0;
+    bool compress_output = false;
 
     CLI::App app{"App description"};
 
     app.add_option(
             "-i,--input",
             sam_path,
-            "Path to BAM containing proximity linked reads. MUST be grouped by read name. Does not need index or regional sorting.")
+            "Path to BAM or CRAM containing proximity linked reads. Either grouped by read name, or coordinate sorted (as declared in the header), in which case reads are grouped using temporary files in the output directory. Does not need index.")
             ->required();
 
     app.add_option(
@@ -680,6 +595,16 @@ int main (int argc, char* argv[]){
             "(Default = " + to_string(skip_unzip) + ")\tAfter phasing nodes in the graph, DON'T unzip/concatenate haplotypes before writing to fasta. "
             "Unzipping should be skipped when using overlapped GFAs because no stitching is performed.");
 
+    app.add_option(
+            "--fasta_line_width",
+            fasta_line_width,
+            "(Default = " + to_string(fasta_line_width) + ")\tWrap the output FASTA sequences into lines of this many bases. 0 = no wrapping.");
+
+    app.add_flag(
+            "--bgzip",
+            compress_output,
+            "(Default = " + to_string(compress_output) + ")\tCompress the output GFAs and FASTAs with bgzip (BGZF), adding a .gz extension.");
+
     CLI11_PARSE(app, argc, argv);
 
     phase(
@@ -697,7 +622,9 @@ int main (int argc, char* argv[]){
             sample_rate,
             n_iterations,
             k,
-            min_hash_similarity
+            min_hash_similarity,
+            fasta_line_width,
+            compress_output
     );
 
     return 0;
@@ -19,6 +19,7 @@ int main (int argc, char* argv[]){
     size_t k;
     path paternal_kmers;
     path maternal_kmers;
+    size_t n_threads = 1;
 
     CLI::App app{"App description"};
 
@@ -52,9 +53,14 @@ int main (int argc, char* argv[]){
             "maternal kmers in FASTA format")
             ->required();
 
+    app.add_option(
+            "-t,--threads",
+            n_threads,
+            "Maximum number of threads to use");
+
     CLI11_PARSE(app, argc, argv);
 
-    gfase::phase_k(gfa_path, k, paternal_kmers, maternal_kmers, output_directory);
+    gfase::phase_k(gfa_path, k, paternal_kmers, maternal_kmers, output_directory, '.', n_threads);
 
     return 0;
 }
@@ -1,4 +1,6 @@
 #include "MultiContactGraph.hpp"
+#include "ContactStore.hpp"
+#include "PhaseEvaluation.hpp"
 #include "IncrementalIdMap.hpp"
 #include "optimize.hpp"
 #include "CLI11.hpp"
@@ -6,6 +8,9 @@
 using gfase::NonBipartiteEdgeException;
 using gfase::IncrementalIdMap;
 using gfase::MultiContactGraph;
+using gfase::ContactStore;
+using gfase::ContactEvaluation;
+using gfase::evaluate_contacts;
 using gfase::alt_component_t;
 using ghc::filesystem::path;
 using CLI::App;
@@ -19,24 +24,39 @@ int main(int argc, char* argv[]){
 
     path id_path;
     path graph_path;
+    path contacts_path;
+    int min_mapq = 0;
     path output_dir;
     size_t n_threads = 1;
     size_t core_iterations = 200;
     size_t sample_size = 30;
     size_t n_rounds = 2;
-    
+    string init_mode = "random";
+    double init_noise = 0.05;
+    bool evaluate = false;
+
 
     CLI::App app{"App description"};
-    app.add_option(
+    auto id_option = app.add_option(
         "-i,--id_path",
         id_path,
-        "")
-        ->required();
-    app.add_option(
+        "");
+    auto graph_option = app.add_option(
         "-g,--graph_path",
         graph_path,
-        "")
-        ->required();
+        "");
+    auto contacts_option = app.add_option(
+        "--contacts",
+        contacts_path,
+        "Binary contact store (contacts.bin) from generate_contact_map_from_bam, to use instead of the ID and graph CSVs")
+        ->excludes(id_option)
+        ->excludes(graph_option);
+    app.add_option(
+        "-m,--min_mapq",
+        min_mapq,
+        "(Default = " + to_string(min_mapq) + ")\tWith --contacts, only count contacts with at least this mapq. Rounded up to the next mapq bin of the store.")
+        ->needs(contacts_option)
+        ->check(CLI::Range(0,255));
     app.add_option(
         "-o,--output_dir",
         output_dir,
@@ -56,17 +76,66 @@ int main(int argc, char* argv[]){
             "-r,--n_rounds",
             n_rounds,
             "(Default = " + to_string(n_rounds) + ")\tHow many rounds to sample and merge.");
+    app.add_option(
+            "--init",
+            init_mode,
+            "(Default = " + init_mode + ")\tHow to initialize each sample: 'random' for uniformly random partitions, or 'spectral' to seed from the sign pattern of the leading eigenvector of the (alt-folded) contact matrix.")
+            ->check(CLI::IsMember({"random", "spectral"}));
+    app.add_option(
+            "--init_noise",
+            init_noise,
+            "(Default = " + to_string(init_noise) + ")\tWith spectral initialization, the probability of flipping each bubble away from its seeded partition, so that samples differ.");
     app.add_option(
             "-t,--threads",
             n_threads,
             "(Default = " + to_string(n_threads) + ")\tMaximum number of threads to use.");
+    app.add_flag(
+            "--evaluate",
+            evaluate,
+            "Score the final phasing against all the contacts of the store (at every mapq threshold) and write phasing_summary.csv to the output directory")
+            ->needs(contacts_option);
     CLI11_PARSE(app, argc, argv);
 
-    cerr << "Load ID map" << '\n';
-    IncrementalIdMap<string> id_map(id_path);
+    IncrementalIdMap<string> id_map(false);
+    MultiContactGraph contact_graph;
+    ContactStore contacts;
+
+    if (not contacts_path.empty()){
+        cerr << "Load contacts with min_mapq " << min_mapq << '\n';
+        contacts = ContactStore(contacts_path);
+
+        // Only contigs that have at least one usable contact are given IDs
+        vector<int32_t> ids(contacts.names.size(), -1);
+
+        auto get_id = [&](uint32_t index){
+            if (ids[index] == -1){
+                ids[index] = int32_t(id_map.try_insert(contacts.names[index]));
+                contact_graph.try_insert_node(ids[index]);
+            }
+            return ids[index];
+        };
+
+        contacts.for_each_contact(uint8_t(min_mapq), [&](uint32_t a, uint32_t b, uint32_t count){
+            auto id_a = get_id(a);
+            auto id_b = get_id(b);
+            contact_graph.try_insert_edge(id_a, id_b, int32_t(count));
+        });
+
+        // The store is only needed after optimization if the result is to be evaluated
+        if (not evaluate){
+            contacts = ContactStore();
+        }
+    }
+    else if (not id_path.empty() and not graph_path.empty()){
+        cerr << "Load ID map" << '\n';
+        id_map = IncrementalIdMap<string>(id_path);
 
-    cerr << "Load graph" << '\n';
-    MultiContactGraph contact_graph(graph_path, id_map);
+        cerr << "Load graph" << '\n';
+        contact_graph = MultiContactGraph(graph_path, id_map);
+    }
+    else{
+        throw runtime_error("ERROR: must provide either --contacts, or both --id_path and --graph_path");
+    }
 
     cerr << "Infer alts from Shasta names" << '\n';
     contact_graph.get_alts_from_shasta_names(id_map);
@@ -101,7 +170,26 @@ int main(int argc, char* argv[]){
             sample_size,
             n_rounds,
             n_threads,
-            output_dir);
+            output_dir,
+            init_mode == "spectral",
+            init_noise);
+
+    if (evaluate){
+        cerr << "Evaluating phases..." << '\n';
+
+        // Contigs without any usable contacts, or which were removed from the graph, are unphased
+        ContactEvaluation evaluation;
+        evaluate_contacts(contacts, [&](const string& name){
+            if (not id_map.exists(name)){
+                return int8_t(0);
+            }
+
+            auto id = int32_t(id_map.get_id(name));
+            return contact_graph.has_node(id) ? contact_graph.get_partition(id) : int8_t(0);
+        }, evaluation);
+
+        evaluation.write_to_directory(output_dir);
+    }
 
     return 0;
 }
\ No newline at end of file
@@ -33,7 +33,7 @@ using std::cerr;
 // TODO: fix for whole genome, missing nodes/links in path ??
 
 
-void split_gfa_components(path gfa_path){
+void split_gfa_components(path gfa_path, size_t n_threads){
     HashGraph graph;
     IncrementalIdMap<string> id_map;
     Overlaps overlaps;
@@ -46,12 +46,13 @@ void split_gfa_components(path gfa_path){
     cerr << "Writing subgraph GFAs to: " << output_directory << '\n';
     create_directories(output_directory);
 
-    write_connected_components_to_gfas(graph, id_map, overlaps, output_directory);
+    write_connected_components_to_gfas(graph, id_map, overlaps, output_directory, n_threads);
 }
 
 
 int main (int argc, char* argv[]){
     path gfa_path;
+    size_t n_threads = 1;
 
     CLI::App app{"App description"};
 
@@ -61,9 +62,14 @@ int main (int argc, char* argv[]){
             "Path to GFA containing phased non-overlapping segments")
             ->required();
 
+    app.add_option(
+            "-t,--threads",
+            n_threads,
+            "Maximum number of threads to use, for both finding and writing components");
+
     CLI11_PARSE(app, argc, argv);
 
-    split_gfa_components(gfa_path);
+    split_gfa_components(gfa_path, n_threads);
 
     return 0;
 }
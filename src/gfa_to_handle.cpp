@@ -24,110 +24,166 @@ nid_t parse_gfa_sequence_id(const string& s, IncrementalIdMap<string>& id_map) {
 }
 
 
+/// Resolved link, ready to be added to the graph. The CIGAR is parsed off the main thread.
+class ParsedGfaLink {
+public:
+    handle_t a;
+    handle_t b;
+    Cigar cigar;
+    string_view cigar_string;
+    bool malformed = false;
+};
+
+
+/// Resolved path steps, ready to be added to the graph
+class ParsedGfaPath {
+public:
+    string name;
+    vector<handle_t> handles;
+};
+
+
 void gfa_to_handle_graph(
         MutablePathMutableHandleGraph& graph,
         IncrementalIdMap<string>& id_map,
         Overlaps& overlaps,
         path gfa_file_path,
         bool ignore_singleton_paths,
-        bool ignore_paths
+        bool ignore_paths,
+        size_t n_threads
         ){
-    
+    ///
+    /// Mutating the graph is inherently serial, so all of the parsing, name lookups, CIGAR parsing and validation is
+    /// done in parallel over records of each type, into batches indexed by their order in the file. Then the batches
+    /// are added to the graph in file order, so the result (including IDs) is the same for any number of threads.
+    ///
+
     static const int malformed_cigar_warn_limit = 10;
     int malformed_cigar_warnings = 0;
 
-    GfaReader gfa_reader(gfa_file_path);
+    n_threads = max(size_t(1), n_threads);
+
+    GfaReader gfa_reader(gfa_file_path, n_threads);
 
     cerr << "Creating nodes..." << '\n';
-    // Create all the nodes/sequences
-    gfa_reader.for_each_sequence([&](string& name, string& sequence){
+
+    // Names are assigned IDs in file order, which is also the order they would have been given if parsed serially
+    auto n_sequences = gfa_reader.get_line_count('S');
+    id_map.names.reserve(id_map.names.size() + n_sequences);
+    id_map.ids.reserve(id_map.ids.size() + n_sequences);
+
+    string sequence;
+    gfa_reader.for_each_sequence_view(1, [&](size_t thread_index, const GfaSequenceView& s){
         // TODO: check if node name is empty or node sequence is empty
-        auto id = parse_gfa_sequence_id(name, id_map);
+        auto id = parse_gfa_sequence_id(string(s.name), id_map);
+
+        sequence.assign(s.sequence);
         graph.create_handle(sequence, id);
     });
 
-    cerr << "Creating edges..." << '\n';
-    // Create all the edges between nodes
-    gfa_reader.for_each_link([&](string& node_a, bool reversal_a, string& node_b, bool reversal_b, string& cigar){
-        const nid_t source_id = parse_gfa_sequence_id(node_a, id_map);
-        const nid_t sink_id = parse_gfa_sequence_id(node_b, id_map);
-
-        if (not graph.has_node(source_id)){
-            throw runtime_error("ERROR: gfa link (" + node_a + "->" + node_b + ") "
-                                "contains non-existent node: " + node_a);
+    // Const lookups only from here on, which are safe to do concurrently
+    const auto& ids = id_map.ids;
+
+    auto find_node = [&](string_view name, const string& context){
+        auto result = ids.find(string(name));
+
+        if (result == ids.end() or not graph.has_node(result->second)){
+            throw runtime_error("ERROR: " + context + " contains non-existent node: " + string(name));
         }
 
-        if (not graph.has_node(sink_id)){
-            throw runtime_error("ERROR: gfa link (" + node_a + "->" + node_b + ") "
-                                "contains non-existent node: " + node_b);
+        return nid_t(result->second);
+    };
+
+    cerr << "Creating edges..." << '\n';
+
+    vector<ParsedGfaLink> links(gfa_reader.get_line_count('L'));
+
+    gfa_reader.for_each_link_view(n_threads, [&](size_t thread_index, const GfaLinkView& l){
+        string context = "gfa link (" + string(l.node_a) + "->" + string(l.node_b) + ")";
+
+        auto& link = links[l.index];
+        link.a = graph.get_handle(find_node(l.node_a, context), l.reversal_a);
+        link.b = graph.get_handle(find_node(l.node_b, context), l.reversal_b);
+        link.cigar = Cigar(string(l.cigar));
+        link.cigar_string = l.cigar;
+
+        // Check CIGAR validity
+        if (not link.cigar.empty()) {
+            auto lens = link.cigar.aligned_length();
+            link.malformed = (lens.first > graph.get_length(link.a) || lens.second > graph.get_length(link.b));
         }
+    });
 
+    for (auto& link: links){
         // note: we're counting on implementations de-duplicating edges
-        handle_t a = graph.get_handle(source_id, reversal_a);
-        handle_t b = graph.get_handle(sink_id, reversal_b);
-        graph.create_edge(a, b);
-        overlaps.record_overlap(graph, a, b, cigar);
-        
-        if (overlaps.has_overlap(graph, a, b)) {
-            // check CIGAR validity
-            auto lens = overlaps.get_overlap(graph, a, b).aligned_length();
-            if (malformed_cigar_warnings < malformed_cigar_warn_limit &&
-                (lens.first > graph.get_length(a) || lens.second > graph.get_length(b))) {
-                
-                cerr << "warning: CIGAR string " << cigar << " has impossible aligned lengths " << lens.first << " and " << lens.second << " between sequences " << id_map.get_name(graph.get_id(a)) << " and " << id_map.get_name(graph.get_id(b)) << " with lengths " << graph.get_length(a) << " and " << graph.get_length(b) << ", GFA is probably invalid\n";
-                
-                ++malformed_cigar_warnings;
-                if (malformed_cigar_warnings == malformed_cigar_warn_limit) {
-                    cerr << "suppressing further warnings...\n";
-                }
+        graph.create_edge(link.a, link.b);
+        overlaps.record_overlap(graph, link.a, link.b, link.cigar);
+
+        if (link.malformed and malformed_cigar_warnings < malformed_cigar_warn_limit) {
+            auto lens = link.cigar.aligned_length();
+            auto& a = link.a;
+            auto& b = link.b;
+
+            cerr << "warning: CIGAR string " << link.cigar_string << " has impossible aligned lengths " << lens.first << " and " << lens.second << " between sequences " << id_map.get_name(graph.get_id(a)) << " and " << id_map.get_name(graph.get_id(b)) << " with lengths " << graph.get_length(a) << " and " << graph.get_length(b) << ", GFA is probably invalid\n";
+
+            ++malformed_cigar_warnings;
+            if (malformed_cigar_warnings == malformed_cigar_warn_limit) {
+                cerr << "suppressing further warnings...\n";
             }
         }
-    });
+    }
+
+    links.clear();
+    links.shrink_to_fit();
 
     if (ignore_paths){
         return;
     }
 
     cerr << "Creating paths..." << '\n';
-    // Construct paths
-    gfa_reader.for_each_path([&](string& path_name, vector<string>& nodes, vector<bool>& reversals, vector<string>& cigars){
-        if (ignore_singleton_paths and nodes.size() == 1){
-            return;
-        }
 
-        path_handle_t p = graph.create_path_handle(path_name);
+    vector<ParsedGfaPath> paths(gfa_reader.get_line_count('P'));
 
-        handle_t prev_handle;
+    // Allow overlaps bc doesn't terribly affect phasing for long nodes
+    gfa_reader.for_each_path_view(n_threads, [&](size_t thread_index, const GfaPathView& p){
+        if (ignore_singleton_paths and p.nodes.size() == 1){
+            return;
+        }
 
-        // Allow overlaps bc doesn't terribly affect phasing for long nodes
-//        for (auto& cigar: cigars){
-//            if (not (cigar == "0M" or cigar == "*")){
-//                throw runtime_error("ERROR: cigar in path " + path_name + " contains non-empty overlap");
-//            }
-//        }
+        auto& parsed = paths[p.index];
+        parsed.name = p.name;
+        parsed.handles.reserve(p.nodes.size());
 
-        for (size_t i=0; i<nodes.size(); i++){
-            nid_t node_id;
+        for (size_t i=0; i<p.nodes.size(); i++){
+            auto result = ids.find(string(p.nodes[i]));
 
-            try {
-                node_id = id_map.get_id(nodes[i]);
-            }
-            catch (const std::exception& e){
-                cerr << e.what() << '\n';
-                throw runtime_error("EEROR: node in path not found in GFA: " + nodes[i]);
+            if (result == ids.end()){
+                throw runtime_error("EEROR: node in path not found in GFA: " + string(p.nodes[i]));
             }
 
-            handle_t handle = graph.get_handle(node_id, reversals[i]);
+            handle_t handle = graph.get_handle(result->second, p.reversals[i]);
 
-            if (i > 0 and not graph.has_edge(prev_handle, handle)){
+            if (i > 0 and not graph.has_edge(parsed.handles.back(), handle)){
                 throw runtime_error("ERROR: graph has no edge between successive nodes in path: "
-                                    + nodes[i-1] + (reversals[i-1] ? "-" : "+") + " -> " + nodes[i] + (reversals[i] ? "-" : "+"));
+                                    + string(p.nodes[i-1]) + (p.reversals[i-1] ? "-" : "+") + " -> " + string(p.nodes[i]) + (p.reversals[i] ? "-" : "+"));
             }
 
-            graph.append_step(p, handle);
-            prev_handle = handle;
+            parsed.handles.emplace_back(handle);
         }
     });
+
+    // Construct paths
+    for (auto& parsed: paths){
+        if (parsed.handles.empty()){
+            continue;
+        }
+
+        path_handle_t p = graph.create_path_handle(parsed.name);
+
+        for (auto& handle: parsed.handles){
+            graph.append_step(p, handle);
+        }
+    }
 }
 
 
@@ -1,4 +1,5 @@
 #include "graph_utility.hpp"
+#include "RecordWriter.hpp"
 
 namespace gfase {
 
@@ -179,24 +180,169 @@ void for_edge_in_bfs(
 }
 
 
-void for_each_connected_component(HandleGraph& graph, const function<void(unordered_set<nid_t>& connected_component)>& f) {
-    unordered_set<nid_t> all_nodes;
+/// Find the root of the set containing x, halving the path along the way. Roots are only ever linked underneath a root
+/// with a lower index, so parents only decrease, and concurrent finds/unions can't form a cycle.
+uint32_t find_root(vector <atomic<uint32_t> >& parents, uint32_t x){
+    while (true){
+        auto p = parents[x].load();
+
+        if (p == x){
+            return x;
+        }
+
+        auto gp = parents[p].load();
+
+        if (gp != p){
+            parents[x].compare_exchange_weak(p, gp);
+        }
+
+        x = gp;
+    }
+}
+
+
+void unite(vector <atomic<uint32_t> >& parents, uint32_t a, uint32_t b){
+    while (true){
+        a = find_root(parents, a);
+        b = find_root(parents, b);
+
+        if (a == b){
+            return;
+        }
+
+        if (a < b){
+            std::swap(a,b);
+        }
+
+        // Retry if another thread linked this root somewhere else in the meantime
+        auto expected = a;
+        if (parents[a].compare_exchange_strong(expected, b)){
+            return;
+        }
+    }
+}
 
+
+void find_connected_components(const HandleGraph& graph, size_t n_threads, vector <vector<handle_t> >& components){
+    components.clear();
+
+    vector<handle_t> handles;
+    handles.reserve(graph.get_node_count());
     graph.for_each_handle([&](const handle_t& h) {
-        auto n = graph.get_id(h);
-        all_nodes.emplace(n);
+        handles.emplace_back(h);
     });
 
-    while (not all_nodes.empty()) {
-        unordered_set<nid_t> connected_component;
-        auto iter = all_nodes.begin();
+    if (handles.empty()){
+        return;
+    }
 
-        for_node_in_bfs(graph, *iter, [&](const handle_t& h) {
-            auto n = graph.get_id(h);
+    if (handles.size() >= numeric_limits<uint32_t>::max()){
+        throw runtime_error("ERROR: too many nodes to find connected components: " + to_string(handles.size()));
+    }
 
-            connected_component.emplace(n);
-            all_nodes.erase(n);
-        });
+    // Node ID -> dense index. If the IDs are compact they are looked up by offset in a vector instead of hashing
+    vector<uint32_t> compact_node_index;
+    unordered_map<nid_t, uint32_t> node_index;
+    nid_t min_id = graph.min_node_id();
+    nid_t max_id = graph.max_node_id();
+
+    if (max_id >= min_id and size_t(max_id - min_id) < 4*handles.size()){
+        compact_node_index.resize(max_id - min_id + 1, numeric_limits<uint32_t>::max());
+        for (size_t i=0; i<handles.size(); i++){
+            compact_node_index[graph.get_id(handles[i]) - min_id] = uint32_t(i);
+        }
+    }
+    else {
+        node_index.reserve(handles.size());
+        for (size_t i=0; i<handles.size(); i++){
+            node_index[graph.get_id(handles[i])] = uint32_t(i);
+        }
+    }
+
+    auto get_index = [&](const handle_t& h){
+        auto id = graph.get_id(h);
+        return compact_node_index.empty() ? node_index.at(id) : compact_node_index[id - min_id];
+    };
+
+    vector <atomic<uint32_t> > parents(handles.size());
+    for (size_t i=0; i<handles.size(); i++){
+        parents[i].store(uint32_t(i));
+    }
+
+    // Every node is united with its neighbors on both sides, in blocks of nodes which are taken by the threads in turn
+    size_t block_size = 4096;
+    size_t n_blocks = (handles.size() + block_size - 1)/block_size;
+    atomic<size_t> job_index = 0;
+
+    auto worker = [&](){
+        size_t i = job_index.fetch_add(1);
+
+        while (i < n_blocks){
+            auto stop = min(handles.size(), (i+1)*block_size);
+
+            for (size_t j=i*block_size; j<stop; j++){
+                graph.follow_edges(handles[j], false, [&](const handle_t& other){
+                    unite(parents, uint32_t(j), get_index(other));
+                });
+                graph.follow_edges(handles[j], true, [&](const handle_t& other){
+                    unite(parents, uint32_t(j), get_index(other));
+                });
+            }
+
+            i = job_index.fetch_add(1);
+        }
+    };
+
+    n_threads = max(size_t(1), min(n_threads, n_blocks));
+
+    if (n_threads == 1){
+        worker();
+    }
+    else {
+        vector<thread> threads;
+
+        for (size_t t=0; t<n_threads; t++){
+            try {
+                threads.emplace_back(worker);
+            }
+            catch (const exception& e) {
+                cerr << e.what() << '\n';
+                exit(1);
+            }
+        }
+
+        for (auto& t: threads){
+            t.join();
+        }
+    }
+
+    // Each root is the lowest index in its set, so components are numbered in the order of their first node
+    vector<uint32_t> component_of_root(handles.size(), numeric_limits<uint32_t>::max());
+
+    for (size_t i=0; i<handles.size(); i++){
+        auto r = find_root(parents, uint32_t(i));
+
+        if (component_of_root[r] == numeric_limits<uint32_t>::max()){
+            component_of_root[r] = uint32_t(components.size());
+            components.emplace_back();
+        }
+
+        components[component_of_root[r]].emplace_back(handles[i]);
+    }
+}
+
+
+void for_each_connected_component(HandleGraph& graph, const function<void(unordered_set<nid_t>& connected_component)>& f) {
+    vector <vector<handle_t> > components;
+    find_connected_components(graph, 1, components);
+
+    for (auto& component: components){
+        unordered_set<nid_t> connected_component;
+        connected_component.reserve(component.size());
+
+        for (auto& h: component){
+            connected_component.emplace(graph.get_id(h));
+        }
 
         f(connected_component);
     }
@@ -205,7 +351,7 @@ void for_each_connected_component(HandleGraph& graph, const function<void(unorde
 void for_each_connected_component_subgraph(HandleGraph& graph,
                                            const function<void(const HandleGraph& subgraph)>& f) {
     for_each_connected_component(graph, [&](unordered_set<nid_t>& connected_component) {
-        f(SubgraphOverlay(&graph, &connected_component));
+        f(BitmapSubgraphOverlay(&graph, connected_component));
     });
 }
 
@@ -337,10 +483,9 @@ void split_connected_components(
             assert(not graphs.back().has_edge(other_handle_a, other_handle_b));
             graphs.back().create_edge(other_handle_a, other_handle_b);
             
-            if (overlaps.has_overlap(graph, handle_a, handle_b)) {
-                comp_overlaps.back().record_overlap(graphs.back(), other_handle_a, other_handle_b,
-                                                    overlaps.get_overlap(graph, handle_a, handle_b));
-            }
+            // (empty overlaps are not recorded)
+            comp_overlaps.back().record_overlap(graphs.back(), other_handle_a, other_handle_b,
+                                                overlaps.get_overlap_view(graph, handle_a, handle_b));
         },
         [&](const handle_t& handle_a, const handle_t& handle_b){
             auto id_a = graph.get_id(handle_a);
@@ -480,10 +625,9 @@ void split_connected_components(
             assert(not graphs.back().has_edge(other_handle_a, other_handle_b));
             graphs.back().create_edge(other_handle_a, other_handle_b);
             
-            if (overlaps.has_overlap(graph, handle_a, handle_b)) {
-                comp_overlaps.back().record_overlap(graphs.back(), other_handle_a, other_handle_b,
-                                                    overlaps.get_overlap(graph, handle_a, handle_b));
-            }
+            // (empty overlaps are not recorded)
+            comp_overlaps.back().record_overlap(graphs.back(), other_handle_a, other_handle_b,
+                                                overlaps.get_overlap_view(graph, handle_a, handle_b));
         });
 
         // Duplicate all the paths
@@ -620,57 +764,143 @@ void split_connected_components(
 }
 
 
+void write_connected_component_to_gfa(
+        const PathHandleGraph& graph,
+        const IncrementalIdMap<string>& id_map,
+        const Overlaps& overlaps,
+        const vector<handle_t>& component,
+        path output_path) {
+
+    RecordWriter writer(output_path);
+
+    set<string> path_names;
+
+    for (auto& h: component){
+        graph.for_each_step_on_handle(h, [&](const step_handle_t s){
+            path_names.emplace(graph.get_path_name(graph.get_path_handle_of_step(s)));
+        });
+    }
+
+    writer.write_records(component.size(), 1, [&](size_t i, string& buffer){
+        append_node_to_gfa(graph, id_map, component[i], buffer);
+    });
+
+    // Each edge is written once, from the node with the lower ID. Self loops are written from the right side, except
+    // for a reversing loop on the left side, which can only be seen from there.
+    vector<edge_t> edges;
+
+    for (auto& h: component){
+        auto id = graph.get_id(h);
+
+        graph.follow_edges(h, false, [&](const handle_t& next){
+            if (id <= graph.get_id(next)){
+                edges.emplace_back(h, next);
+            }
+        });
+
+        graph.follow_edges(h, true, [&](const handle_t& prev){
+            auto prev_id = graph.get_id(prev);
+            if (id < prev_id or (id == prev_id and graph.get_is_reverse(prev))){
+                edges.emplace_back(prev, h);
+            }
+        });
+    }
+
+    writer.write_records(edges.size(), 1, [&](size_t i, string& buffer){
+        append_edge_to_gfa(graph, id_map, overlaps, edges[i], buffer);
+    });
+
+    vector<path_handle_t> paths;
+    for (auto& path_name: path_names){
+        paths.emplace_back(graph.get_path_handle(path_name));
+    }
+
+    writer.write_records(paths.size(), 1, [&](size_t i, string& buffer){
+        append_path_to_gfa(graph, id_map, paths[i], buffer);
+    });
+
+    writer.close();
+}
+
+
 void write_connected_components_to_gfas(
         const MutablePathDeletableHandleGraph& graph,
         const IncrementalIdMap<string>& id_map,
         const Overlaps& overlaps,
-        path output_directory) {
+        path output_directory,
+        size_t n_threads) {
 
-    unordered_set<nid_t> all_nodes;
+    vector <vector<handle_t> > components;
+    find_connected_components(graph, n_threads, components);
 
-    graph.for_each_handle([&](const handle_t& h) {
-        auto n = graph.get_id(h);
-        all_nodes.emplace(n);
+    // Components are written and numbered in order of decreasing sequence length, so the longest jobs start first
+    vector <pair<size_t,size_t> > lengths;
+    lengths.reserve(components.size());
+
+    for (size_t i=0; i<components.size(); i++){
+        size_t length = 0;
+        for (auto& h: components[i]){
+            length += graph.get_length(h);
+        }
+
+        lengths.emplace_back(length, i);
+    }
+
+    sort(lengths.begin(), lengths.end(), [](const pair<size_t,size_t>& a, const pair<size_t,size_t>& b){
+        return a.first > b.first or (a.first == b.first and a.second < b.second);
     });
 
-    size_t i = 0;
-    while (not all_nodes.empty()) {
-//        cerr << "NEW CONNECTED COMPONENT" << '\n';
-        string filename_prefix = output_directory / ("component_" + to_string(i));
-        ofstream file(filename_prefix + ".gfa");
+    atomic<size_t> job_index = 0;
+    std::exception_ptr worker_exception;
+    std::mutex exception_mutex;
 
-        unordered_set<string> paths_to_be_copied;
-        unordered_set<nid_t> to_be_deleted;
+    auto worker = [&](){
+        size_t i = job_index.fetch_add(1);
 
-        auto start_node = *all_nodes.begin();
+        while (i < lengths.size()){
+            try {
+                auto& component = components[lengths[i].second];
+                path output_path = output_directory / ("component_" + to_string(i) + ".gfa");
 
-        // Duplicate all the nodes
-        for_node_in_bfs(graph, start_node, [&](const handle_t& h) {
-            auto id = graph.get_id(h);
-            if (id != start_node){
-                all_nodes.erase(id);
+                write_connected_component_to_gfa(graph, id_map, overlaps, component, output_path);
+            }
+            catch (...) {
+                std::lock_guard lock(exception_mutex);
+                if (not worker_exception){
+                    worker_exception = std::current_exception();
+                }
+                job_index = lengths.size();
             }
 
-            write_node_to_gfa(graph, id_map, h, file);
+            i = job_index.fetch_add(1);
+        }
+    };
 
-            graph.for_each_step_on_handle(h, [&](const step_handle_t s){
-                paths_to_be_copied.emplace(graph.get_path_name(graph.get_path_handle_of_step(s)));
-            });
+    n_threads = max(size_t(1), min(n_threads, lengths.size()));
 
-        });
+    if (n_threads == 1){
+        worker();
+    }
+    else {
+        vector<thread> threads;
 
-        // Duplicate all the edges
-        for_edge_in_bfs(graph, start_node, [&](const handle_t& handle_a, const handle_t& handle_b) {
-            write_edge_to_gfa(graph, id_map, overlaps, {handle_a, handle_b}, file);
-        });
+        for (size_t t=0; t<n_threads; t++){
+            try {
+                threads.emplace_back(worker);
+            }
+            catch (const exception& e) {
+                cerr << e.what() << '\n';
+                exit(1);
+            }
+        }
 
-        // Duplicate all the paths
-        for (auto& path_name: paths_to_be_copied){
-            write_path_to_gfa(graph, id_map, graph.get_path_handle(path_name), file);
+        for (auto& t: threads){
+            t.join();
         }
+    }
 
-        all_nodes.erase(start_node);
-        i++;
+    if (worker_exception){
+        std::rethrow_exception(worker_exception);
     }
 }
 
@@ -888,9 +1118,64 @@ void un_extend_paths(
 }
 
 
-void unzip(MutablePathDeletableHandleGraph& graph, IncrementalIdMap<string>& id_map, Overlaps& overlaps, bool keep_paths, bool delete_islands){
-    
-    unordered_set<handle_t> nodes_to_be_destroyed;
+/// The steps of one haplotype path, and the concatenated sequence that will replace them
+class UnzipPath {
+public:
+    path_handle_t path;
+    vector<handle_t> steps;
+    string sequence;
+};
+
+
+/// Concatenate the sequences of a path's steps, trimming the overlapped prefix of each step after the first. The
+/// output length is computed from the node lengths and overlaps before anything is copied, so the sequence is built
+/// in a single allocation, and the overlapped prefixes are never copied.
+void concatenate_path_sequence(const HandleGraph& graph, const Overlaps& overlaps, UnzipPath& unzip_path){
+    auto& steps = unzip_path.steps;
+
+    // Number of bases to skip at the start of each step
+    vector<size_t> offsets(steps.size(), 0);
+    size_t length = 0;
+
+    for (size_t i=0; i<steps.size(); i++){
+        size_t node_length = graph.get_length(steps[i]);
+
+        if (i > 0){
+            size_t length_overlapped = overlaps.get_overlap_length(graph, steps[i-1], steps[i]).second;
+            offsets[i] = min(length_overlapped, node_length);
+        }
+
+        length += node_length - offsets[i];
+    }
+
+    auto& sequence = unzip_path.sequence;
+    sequence.reserve(length);
+
+    for (size_t i=0; i<steps.size(); i++){
+        size_t node_length = graph.get_length(steps[i]);
+
+        if (offsets[i] == node_length){
+            continue;
+        }
+
+        if (offsets[i] == 0){
+            sequence += graph.get_sequence(steps[i]);
+        }
+        else {
+            sequence += graph.get_subsequence(steps[i], offsets[i], node_length - offsets[i]);
+        }
+    }
+}
+
+
+void unzip(
+        MutablePathDeletableHandleGraph& graph,
+        IncrementalIdMap<string>& id_map,
+        Overlaps& overlaps,
+        bool keep_paths,
+        bool delete_islands,
+        size_t n_threads){
+
     vector<path_handle_t> paths;
 
 //    cerr << "Paths in component:" << '\n';
@@ -898,49 +1183,104 @@ void unzip(MutablePathDeletableHandleGraph& graph, IncrementalIdMap<string>& id_
         paths.emplace_back(p);
 //        cerr << graph.get_path_name(p) << '\n';
     });
-    
-    vector<path_handle_t> haplotype_paths;
+
+    vector<UnzipPath> unzip_paths;
+    unzip_paths.reserve(paths.size());
 
     for (auto& p: paths){
-        
         // Handle empty paths as a special case
         if (graph.is_empty(p)) {
             graph.destroy_path(p);
             continue;
         }
-        
-        string path_sequence;
-        handle_t previous;
-        graph.for_each_step_in_path(p, [&](const step_handle_t s){
-            
-            handle_t h = graph.get_handle_of_step(s);
 
-            string sequence = graph.get_sequence(h);
-            if (s == graph.path_begin(graph.get_path_handle_of_step(s))) {
-                // the first iteration, no overlap
-                path_sequence = move(sequence);
+        unzip_paths.emplace_back();
+        unzip_paths.back().path = p;
+    }
+
+    // The paths only read the graph until all of their sequences have been built, so they are independent
+    atomic<size_t> job_index = 0;
+    std::exception_ptr worker_exception;
+    std::mutex exception_mutex;
+
+    auto worker = [&](){
+        size_t i = job_index.fetch_add(1);
+
+        while (i < unzip_paths.size()){
+            try {
+                auto& unzip_path = unzip_paths[i];
+
+                unzip_path.steps.reserve(graph.get_step_count(unzip_path.path));
+                graph.for_each_step_in_path(unzip_path.path, [&](const step_handle_t s){
+                    unzip_path.steps.emplace_back(graph.get_handle_of_step(s));
+                });
+
+                concatenate_path_sequence(graph, overlaps, unzip_path);
+            }
+            catch (...) {
+                std::lock_guard lock(exception_mutex);
+                if (not worker_exception){
+                    worker_exception = std::current_exception();
+                }
+                job_index = unzip_paths.size();
             }
-            else if (overlaps.has_overlap(graph, previous, h)) {
-                // we only add the part that wasn't overlapped
-                size_t length_overlapped = overlaps.get_overlap(graph, previous, h).aligned_length().second;
-                path_sequence += sequence.substr(min(length_overlapped, sequence.size()), sequence.size());
+
+            i = job_index.fetch_add(1);
+        }
+    };
+
+    n_threads = max(size_t(1), min(n_threads, unzip_paths.size()));
+
+    if (n_threads == 1){
+        worker();
+    }
+    else {
+        vector<thread> threads;
+
+        for (size_t t=0; t<n_threads; t++){
+            try {
+                threads.emplace_back(worker);
             }
-            else {
-                // we can add the whole thing
-                path_sequence += sequence;
+            catch (const exception& e) {
+                cerr << e.what() << '\n';
+                exit(1);
             }
+        }
 
-            nodes_to_be_destroyed.emplace(h);
-            previous = h;
-        });
+        for (auto& t: threads){
+            t.join();
+        }
+    }
+
+    if (worker_exception){
+        std::rethrow_exception(worker_exception);
+    }
+
+    // Nodes that have had their sequences duplicated into haplotypes. A node may be visited by more than one path, or
+    // in both orientations, so these are deduplicated by ID before destroying them.
+    vector<nid_t> nodes_to_be_destroyed;
+
+    vector<path_handle_t> haplotype_paths;
+    haplotype_paths.reserve(unzip_paths.size());
+
+    // Graph mutations are made serially, in path order
+    for (auto& unzip_path: unzip_paths){
+        auto& p = unzip_path.path;
+
+        for (auto& h: unzip_path.steps){
+            nodes_to_be_destroyed.emplace_back(graph.get_id(h));
+        }
 
         // Make the new ndoe
         string name = graph.get_path_name(p);
         int64_t new_id = id_map.insert(name);
-        handle_t haplotype_handle = graph.create_handle(path_sequence, new_id);
-        
-        auto path_start_handle = graph.get_handle_of_step(graph.path_begin(p));
-        auto path_stop_handle = graph.get_handle_of_step(graph.path_back(p));
+        handle_t haplotype_handle = graph.create_handle(unzip_path.sequence, new_id);
+
+        // Release the sequence now that the graph has its own copy
+        string().swap(unzip_path.sequence);
+
+        auto path_start_handle = unzip_path.steps.front();
+        auto path_stop_handle = unzip_path.steps.back();
         
         // Find neighboring nodes for the path and create edges to the new haplotype node (LEFT)
         graph.follow_edges(path_start_handle, true, [&](const handle_t& other) {
@@ -948,19 +1288,19 @@ void unzip(MutablePathDeletableHandleGraph& graph, IncrementalIdMap<string>& id_
                 // preserve cyclic path
                 graph.create_edge(haplotype_handle, haplotype_handle);
                 overlaps.record_overlap(graph, haplotype_handle, haplotype_handle,
-                                        overlaps.get_overlap(graph, other, path_start_handle));
+                                        overlaps.get_overlap_view(graph, other, path_start_handle));
             }
             else if (other == graph.flip(path_start_handle)) {
                 // preserve left hairpin
                 graph.create_edge(graph.flip(haplotype_handle), haplotype_handle);
                 overlaps.record_overlap(graph, graph.flip(haplotype_handle), haplotype_handle,
-                                        overlaps.get_overlap(graph, other, path_start_handle));
+                                        overlaps.get_overlap_view(graph, other, path_start_handle));
             }
             else {
                 // normal edge
                 graph.create_edge(other, haplotype_handle);
                 overlaps.record_overlap(graph, other, haplotype_handle,
-                                        overlaps.get_overlap(graph, other, path_start_handle));
+                                        overlaps.get_overlap_view(graph, other, path_start_handle));
             }
         });
         
@@ -970,13 +1310,13 @@ void unzip(MutablePathDeletableHandleGraph& graph, IncrementalIdMap<string>& id_
                 // preserve right hairpin
                 graph.create_edge(haplotype_handle, graph.flip(haplotype_handle));
                 overlaps.record_overlap(graph, haplotype_handle, graph.flip(haplotype_handle),
-                                        overlaps.get_overlap(graph, path_stop_handle, other));
+                                        overlaps.get_overlap_view(graph, path_stop_handle, other));
             }
             else {
                 // normal edge (or maybe cyclic path that has already been handled in left direction)
                 graph.create_edge(haplotype_handle, other);
                 overlaps.record_overlap(graph, haplotype_handle, other,
-                                        overlaps.get_overlap(graph, path_stop_handle, other));
+                                        overlaps.get_overlap_view(graph, path_stop_handle, other));
             }
         });
         
@@ -990,8 +1330,15 @@ void unzip(MutablePathDeletableHandleGraph& graph, IncrementalIdMap<string>& id_
         haplotype_paths.push_back(haplotype_path_handle);
     }
 
+    sort(nodes_to_be_destroyed.begin(), nodes_to_be_destroyed.end());
+    nodes_to_be_destroyed.erase(
+            unique(nodes_to_be_destroyed.begin(), nodes_to_be_destroyed.end()),
+            nodes_to_be_destroyed.end());
+
     // Destroy the nodes that have had their sequences duplicated into haplotypes
-    for (auto& h: nodes_to_be_destroyed){
+    for (auto& id: nodes_to_be_destroyed){
+        auto h = graph.get_handle(id);
+
         graph.follow_edges(h, true, [&](const handle_t& prev) {
             overlaps.remove_overlap(graph, prev, h);
         });
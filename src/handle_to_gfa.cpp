@@ -1,4 +1,5 @@
 #include "handle_to_gfa.hpp"
+#include "RecordWriter.hpp"
 #include "handlegraph/path_handle_graph.hpp"
 
 using handlegraph::PathHandleGraph;
@@ -27,53 +28,88 @@ void write_node_to_gfa(const HandleGraph& graph, const handle_t& node, ostream&
 }
 
 
+void append_node_to_gfa(const HandleGraph& graph, const IncrementalIdMap<string>& id_map, const handle_t& node, string& buffer){
+    buffer += "S\t";
+    buffer += id_map.get_name(graph.get_id(node));
+    buffer += '\t';
+    buffer += graph.get_sequence(node);
+    buffer += '\n';
+}
+
+
 void write_node_to_gfa(const HandleGraph& graph, const IncrementalIdMap<string>& id_map, const handle_t& node, ostream& output_file){
-    output_file << "S\t" << id_map.get_name(graph.get_id(node)) << '\t' << graph.get_sequence(node) << '\n';
+    string buffer;
+    append_node_to_gfa(graph, id_map, node, buffer);
+    output_file << buffer;
 }
 
 
 void write_edge_to_gfa(const HandleGraph& graph, const Overlaps& overlaps, const edge_t& edge, ostream& output_file){
     output_file << "L\t" << graph.get_id(edge.first) << '\t' << get_reversal_character(graph, edge.first) << '\t'
                 << graph.get_id(edge.second) << '\t' << get_reversal_character(graph, edge.second) << '\t'
-                << overlaps.get_overlap(graph, edge.first, edge.second).get_string() << '\n';
+                << overlaps.get_overlap_view(graph, edge.first, edge.second).get_string() << '\n';
+}
+
+
+void append_edge_to_gfa(const HandleGraph& graph, const IncrementalIdMap<string>& id_map, const Overlaps& overlaps, const edge_t& edge, string& buffer){
+    buffer += "L\t";
+    buffer += id_map.get_name(graph.get_id(edge.first));
+    buffer += '\t';
+    buffer += get_reversal_character(graph, edge.first);
+    buffer += '\t';
+    buffer += id_map.get_name(graph.get_id(edge.second));
+    buffer += '\t';
+    buffer += get_reversal_character(graph, edge.second);
+    buffer += '\t';
+    buffer += overlaps.get_overlap_view(graph, edge.first, edge.second).get_string();
+    buffer += '\n';
 }
 
 
 void write_edge_to_gfa(const HandleGraph& graph, const IncrementalIdMap<string>& id_map, const Overlaps& overlaps, const edge_t& edge, ostream& output_file){
-    output_file << "L\t" << id_map.get_name(graph.get_id(edge.first)) << '\t' << get_reversal_character(graph, edge.first) << '\t'
-                << id_map.get_name(graph.get_id(edge.second)) << '\t' << get_reversal_character(graph, edge.second) << '\t'
-                << overlaps.get_overlap(graph, edge.first, edge.second).get_string() << '\n';
+    string buffer;
+    append_edge_to_gfa(graph, id_map, overlaps, edge, buffer);
+    output_file << buffer;
 }
 
 
-void write_path_to_gfa(const PathHandleGraph& graph, const IncrementalIdMap<string>& id_map, const path_handle_t& path, ostream& output_file){
-    string path_name = graph.get_path_name(path);
+void append_path_to_gfa(const PathHandleGraph& graph, const IncrementalIdMap<string>& id_map, const path_handle_t& path, string& buffer){
     size_t n_steps = graph.get_step_count(path);
     size_t i = 0;
 
-    output_file << "P\t" << path_name << '\t';
+    buffer += "P\t";
+    buffer += graph.get_path_name(path);
+    buffer += '\t';
 
     graph.for_each_step_in_path(path, [&](const step_handle_t& s){
         auto h = graph.get_handle_of_step(s);
-        auto name = id_map.get_name(graph.get_id(h));
 
-        output_file << name << (graph.get_is_reverse(h) ? '-' : '+');
-        if (i < n_steps - 1){
-            output_file << ',';
+        if (i > 0){
+            buffer += ',';
         }
 
+        buffer += id_map.get_name(graph.get_id(h));
+        buffer += (graph.get_is_reverse(h) ? '-' : '+');
+
         i++;
     });
-    output_file << "\t";
+    buffer += '\t';
 
-    for (size_t j=0; j<n_steps-1; j++){
-        output_file << "0M";
-        if (j < n_steps - 2){
-            output_file << ',';
+    for (size_t j=0; j+1<n_steps; j++){
+        if (j > 0){
+            buffer += ',';
         }
+        buffer += "0M";
     }
 
-    output_file << "\n";
+    buffer += '\n';
+}
+
+
+void write_path_to_gfa(const PathHandleGraph& graph, const IncrementalIdMap<string>& id_map, const path_handle_t& path, ostream& output_file){
+    string buffer;
+    append_path_to_gfa(graph, id_map, path, buffer);
+    output_file << buffer;
 }
 
 
@@ -115,4 +151,55 @@ void handle_graph_to_gfa(const PathHandleGraph& graph, const IncrementalIdMap<st
     output_gfa << std::flush;
 }
 
+
+/// Same as above, but the records are formatted concurrently by n_threads into large buffers and written in order,
+/// optionally with bgzip compression
+void handle_graph_to_gfa(
+        const PathHandleGraph& graph,
+        const IncrementalIdMap<string>& id_map,
+        const Overlaps& overlaps,
+        path output_path,
+        bool compress,
+        size_t n_threads){
+
+    RecordWriter writer(output_path, compress, n_threads);
+
+    writer.write("H\tHVN:Z:1.0\n");
+
+    vector<handle_t> handles;
+    handles.reserve(graph.get_node_count());
+    graph.for_each_handle([&](const handle_t& node){
+        handles.emplace_back(node);
+    });
+
+    writer.write_records(handles.size(), n_threads, [&](size_t i, string& buffer){
+        append_node_to_gfa(graph, id_map, handles[i], buffer);
+    });
+
+    handles = {};
+
+    vector<edge_t> edges;
+    edges.reserve(graph.get_edge_count());
+    graph.for_each_edge([&](const edge_t& edge){
+        edges.emplace_back(edge);
+    });
+
+    writer.write_records(edges.size(), n_threads, [&](size_t i, string& buffer){
+        append_edge_to_gfa(graph, id_map, overlaps, edges[i], buffer);
+    });
+
+    edges = {};
+
+    vector<path_handle_t> paths;
+    graph.for_each_path_handle([&](const path_handle_t& path) {
+        paths.emplace_back(path);
+    });
+
+    writer.write_records(paths.size(), n_threads, [&](size_t i, string& buffer){
+        append_path_to_gfa(graph, id_map, paths[i], buffer);
+    });
+
+    writer.close();
+}
+
 }
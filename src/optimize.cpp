@@ -1,9 +1,11 @@
 #include "optimize.hpp"
 #include "binomial.hpp"
 
+#include <algorithm>
 #include <thread>
 #include <ostream>
 #include <queue>
+#include <cmath>
 
 using std::thread;
 using std::priority_queue;
@@ -18,6 +20,9 @@ using std::cerr;
 using std::min;
 using std::max;
 using std::ref;
+using std::sort;
+using std::sqrt;
+using std::fabs;
 
 namespace gfase{
 
@@ -84,12 +89,23 @@ void OrientationDistribution::write_contact_map(path output_path, const Incremen
         throw std::runtime_error("ERROR: could not write to file: " + output_path.string());
     }
 
-    output_file << "name_a" << ',' << "name_b" << ',' << "weight_0" << ',' << "weight_1" << ',' << "p_null" << '\n';
+    output_file << "name_a" << ',' << "name_b" << ',' << "weight_0" << ',' << "weight_1" << ',' << "p_null" << ',' << "p_value" << '\n';
+
+    // Every edge is normally observed once per sample, so this usually holds a single table for n = sample_size
+    unordered_map<int64_t, BinomialTable> tables;
 
     for(auto& [edge, weights]: edge_weights) {
-        double n = weights[0] + weights[1];
-        double k = min(weights[0], weights[1]);
-        output_file << id_map.get_name(edge.first) << ',' << id_map.get_name(edge.second) << ',' << weights[0] << ',' << weights[1] << ',' << binomial(0.5,n,k) << '\n';
+        int64_t n = weights[0] + weights[1];
+        int64_t k = min(weights[0], weights[1]);
+
+        auto result = tables.find(n);
+        if (result == tables.end()){
+            result = tables.emplace(n, BinomialTable(n, 0.5)).first;
+        }
+
+        auto& table = result->second;
+
+        output_file << id_map.get_name(edge.first) << ',' << id_map.get_name(edge.second) << ',' << weights[0] << ',' << weights[1] << ',' << table.get_probability(k) << ',' << table.get_two_sided_p_value(k) << '\n';
     }
 }
 
@@ -101,7 +117,7 @@ void random_phase_search(VectorMultiContactGraph& contact_graph, size_t m_iterat
     vector<int32_t> ids = {};
     contact_graph.get_node_ids(ids);
 
-    contact_graph.randomize_partitions();
+    // Start from whatever state the graph was seeded with (random or spectral)
     contact_graph.get_partitions(best_partitions);
 
     // True random number
@@ -214,13 +230,254 @@ void flip_component(alt_component_t& c){
 }
 
 
+/// Run a function on contiguous chunks of the range [0,n), one thread per chunk
+void for_each_chunk_in_parallel(size_t n, size_t n_threads, const function<void(size_t start, size_t stop)>& f){
+    // Don't bother splitting tiny ranges, thread launches would dominate
+    size_t n_chunks = max(size_t(1), min(n_threads, n/4096));
+    size_t chunk_size = (n + n_chunks - 1) / n_chunks;
+
+    if (n_chunks == 1){
+        f(0, n);
+        return;
+    }
+
+    vector<thread> threads;
+
+    for (size_t start=0; start<n; start+=chunk_size){
+        threads.emplace_back(f, start, min(start + chunk_size, n));
+    }
+
+    for (auto& t: threads){
+        t.join();
+    }
+}
+
+
+/// Find the sign pattern of the leading eigenvector of the contact matrix, after folding each alt component into a
+/// single variable (nodes on the opposing side of a bubble enter with negated sign). The maximizer of x'Wx over
+/// x in {-1,1}^n is approximated by the signs of the dominant eigenvector, which is found by power iteration on the
+/// matrix shifted by its Gershgorin bound so that the largest (not largest magnitude) eigenvalue dominates.
+/// \param contact_graph
+/// \param partitions one (representative id, partition) entry per alt component (or non-alt node)
+/// \param n_threads
+/// \param max_iterations upper bound on power iterations, stops earlier if the sign pattern stabilizes
+void compute_spectral_partitions(
+        const VectorMultiContactGraph& contact_graph,
+        vector <pair <int32_t,int8_t> >& partitions,
+        size_t n_threads,
+        size_t max_iterations){
+
+    // Pseudorandom generator with true random seed
+    std::random_device rd;
+    std::mt19937 rng(rd());
+
+    compute_spectral_partitions(contact_graph, partitions, rng, n_threads, max_iterations);
+}
+
+
+/// Same as above, with the starting vector of the power iteration drawn from a caller provided generator, so that
+/// results can be reproduced
+void compute_spectral_partitions(
+        const VectorMultiContactGraph& contact_graph,
+        vector <pair <int32_t,int8_t> >& partitions,
+        std::mt19937& rng,
+        size_t n_threads,
+        size_t max_iterations){
+
+    partitions.clear();
+
+    vector<int32_t> ids = {};
+    contact_graph.get_node_ids(ids);
+
+    if (ids.empty()){
+        return;
+    }
+
+    // Fold each alt component into a single variable. Ids are sorted so the last one is the max.
+    vector<uint32_t> component_of(ids.back() + 1, numeric_limits<uint32_t>::max());
+    vector<int8_t> sign_of(ids.back() + 1, 0);
+    vector<int32_t> representatives;
+    alt_component_t component;
+
+    for (auto id: ids){
+        if (component_of[id] != numeric_limits<uint32_t>::max()){
+            continue;
+        }
+
+        auto c = uint32_t(representatives.size());
+        representatives.emplace_back(id);
+
+        contact_graph.get_alt_component(id, false, component);
+
+        for (auto& a: component.first){
+            component_of[a] = c;
+            sign_of[a] = 1;
+        }
+        for (auto& b: component.second){
+            component_of[b] = c;
+            sign_of[b] = -1;
+        }
+    }
+
+    size_t n = representatives.size();
+
+    // Collect signed, folded entries and compress them into CSR form (summing duplicates)
+    vector <pair <pair<uint32_t,uint32_t>, double> > entries;
+
+    contact_graph.for_each_edge([&](const pair<int32_t,int32_t> edge, int32_t weight){
+        auto [a,b] = edge;
+        auto c_a = component_of[a];
+        auto c_b = component_of[b];
+
+        // Contacts within a component contribute a constant to the score regardless of its orientation
+        if (c_a == c_b){
+            return;
+        }
+
+        double w = double(sign_of[a]*sign_of[b])*double(weight);
+
+        entries.push_back({{c_a,c_b}, w});
+        entries.push_back({{c_b,c_a}, w});
+    });
+
+    sort(entries.begin(), entries.end(), [](
+            const pair <pair<uint32_t,uint32_t>, double>& a,
+            const pair <pair<uint32_t,uint32_t>, double>& b){
+        return a.first < b.first;
+    });
+
+    vector<size_t> row_offsets(n + 1, 0);
+    vector<uint32_t> columns;
+    vector<double> values;
+
+    for (size_t i=0; i<entries.size(); i++){
+        auto& [coord, w] = entries[i];
+
+        if (i > 0 and entries[i-1].first == coord){
+            values.back() += w;
+            continue;
+        }
+
+        row_offsets[coord.first + 1]++;
+        columns.emplace_back(coord.second);
+        values.emplace_back(w);
+    }
+
+    for (size_t r=0; r<n; r++){
+        row_offsets[r + 1] += row_offsets[r];
+    }
+
+    entries.clear();
+    entries.shrink_to_fit();
+
+    // Gershgorin bound on the spectrum, shifting by it makes the matrix PSD
+    double shift = 0;
+    for (size_t r=0; r<n; r++){
+        double row_sum = 0;
+        for (size_t k=row_offsets[r]; k<row_offsets[r+1]; k++){
+            row_sum += fabs(values[k]);
+        }
+        shift = max(shift, row_sum);
+    }
+
+    std::uniform_real_distribution<double> uniform_distribution(-1,1);
+
+    vector<double> x(n);
+    vector<double> y(n);
+
+    for (auto& item: x){
+        item = uniform_distribution(rng);
+    }
+
+    // Without any inter-component contacts there is no information and the random start is returned
+    if (shift > 0){
+        size_t n_stable = 0;
+
+        for (size_t iteration=0; iteration<max_iterations; iteration++){
+            for_each_chunk_in_parallel(n, n_threads, [&](size_t start, size_t stop){
+                for (size_t r=start; r<stop; r++){
+                    double sum = shift*x[r];
+                    for (size_t k=row_offsets[r]; k<row_offsets[r+1]; k++){
+                        sum += values[k]*x[columns[k]];
+                    }
+                    y[r] = sum;
+                }
+            });
+
+            double norm = 0;
+            for (auto& item: y){
+                norm += item*item;
+            }
+            norm = sqrt(norm);
+
+            size_t n_flipped = 0;
+            for (size_t r=0; r<n; r++){
+                y[r] /= norm;
+                n_flipped += ((y[r] < 0) != (x[r] < 0));
+            }
+
+            x.swap(y);
+
+            // Only the sign pattern is used, so there is no point in converging the magnitudes
+            if (n_flipped == 0){
+                n_stable++;
+            }
+            else{
+                n_stable = 0;
+            }
+
+            if (n_stable == 10){
+                break;
+            }
+        }
+    }
+
+    partitions.reserve(n);
+    for (size_t c=0; c<n; c++){
+        partitions.emplace_back(representatives[c], int8_t(x[c] < 0 ? -1 : 1));
+    }
+}
+
+
+/// Set the partitions of a graph from a precomputed (spectral) state, independently flipping each entry with
+/// probability `noise` so that repeated samples do not all converge to the same optimum
+void seed_partitions(
+        VectorMultiContactGraph& contact_graph,
+        const vector <pair <int32_t,int8_t> >& partitions,
+        double noise){
+
+    std::random_device rd;
+    std::mt19937 rng(rd());
+    std::bernoulli_distribution flip_distribution(noise);
+
+    for (auto [id, p]: partitions){
+        if (flip_distribution(rng)){
+            p = int8_t(-1*int(p));
+        }
+
+        contact_graph.set_partition(id, p);
+    }
+}
+
+
 void sample_with_threads(vector<VectorMultiContactGraph>& contact_graphs_per_thread,
+                         const vector <pair <int32_t,int8_t> >& spectral_partitions,
+                         double spectral_noise,
                          size_t core_iterations,
                          atomic<size_t>& job_index){
     auto i = job_index.fetch_add(1);
 
     while (i < contact_graphs_per_thread.size()){
-        random_phase_search(contact_graphs_per_thread[i], core_iterations);
+        auto& contact_graph = contact_graphs_per_thread[i];
+
+        if (spectral_partitions.empty()){
+            contact_graph.randomize_partitions();
+        }
+        else{
+            seed_partitions(contact_graph, spectral_partitions, spectral_noise);
+        }
+
+        random_phase_search(contact_graph, core_iterations);
         i = job_index.fetch_add(1);
     }
 }
@@ -231,7 +488,9 @@ void sample_orientation_distribution(
         MultiContactGraph& contact_graph,
         size_t sample_size,
         size_t n_threads,
-        size_t core_iterations
+        size_t core_iterations,
+        bool use_spectral_init,
+        double spectral_noise
         ){
 
     vector<thread> threads;
@@ -243,12 +502,21 @@ void sample_orientation_distribution(
     vector<VectorMultiContactGraph> contact_graphs_per_thread(sample_size,contact_graph);
     atomic<size_t> job_index = 0;
 
+    // Left empty if samples should start from uniformly random states
+    vector <pair <int32_t,int8_t> > spectral_partitions;
+
+    if (use_spectral_init and not contact_graphs_per_thread.empty()){
+        compute_spectral_partitions(contact_graphs_per_thread.front(), spectral_partitions, n_threads);
+    }
+
     // Launch threads
     for (uint64_t i=0; i<n_threads; i++){
         try {
             threads.emplace_back(thread(
                     sample_with_threads,
                     ref(contact_graphs_per_thread),
+                    std::cref(spectral_partitions),
+                    spectral_noise,
                     core_iterations,
                     ref(job_index)
             ));
@@ -290,7 +558,9 @@ void monte_carlo_phase_contacts(
         size_t sample_size,
         size_t n_rounds,
         size_t n_threads,
-        path output_dir
+        path output_dir,
+        bool use_spectral_init,
+        double spectral_noise
         ){
 
     // Keep the original graph for scoring purposes (some bubbles will be merged later)
@@ -310,7 +580,9 @@ void monte_carlo_phase_contacts(
                 contact_graph,
                 sample_size,
                 n_threads,
-                core_iterations);
+                core_iterations,
+                use_spectral_init,
+                spectral_noise);
 
         // Convert to non-mutable graph for efficiency of optimization
         VectorMultiContactGraph vector_contact_graph(contact_graph);
@@ -422,7 +694,9 @@ void monte_carlo_phase_contacts(
             contact_graph,
             sample_size,
             n_threads,
-            3*core_iterations);
+            3*core_iterations,
+            use_spectral_init,
+            spectral_noise);
 
     // Store best result for future use
     vector <pair <int32_t,int8_t> > best_partitions;
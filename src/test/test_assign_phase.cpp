@@ -1,10 +1,162 @@
 #include "PhaseAssign.hpp"
+#include "misc.hpp"
 
 using gfase::CigarSummary;
 using gfase::assign_phases;
+using gfase::align;
+using gfase::sam_to_sorted_bam;
+using gfase::for_entry_in_csv;
+using ghc::filesystem::remove_all;
+
+#include <random>
+#include <cmath>
+
+using std::runtime_error;
+using std::to_string;
+
+
+void write_fasta(path output_path, const vector <pair <string,string> >& sequences){
+    ofstream file(output_path);
+
+    for (auto& [name, sequence]: sequences){
+        file << '>' << name << '\n' << sequence << '\n';
+    }
+}
+
+
+void run_assign_phases(path output_dir, path pat_ref_path, path mat_ref_path, path pat_bam_path, path mat_bam_path, path query_path, map <string, vector<string> >& result){
+    unordered_map <string, array<CigarSummary,2> > phased_cigar_summaries;
+    array <set <string>, 2> phased_contigs;
+    map<string,size_t> query_lengths;
+
+    assign_phases(
+            output_dir,
+            pat_ref_path,
+            mat_ref_path,
+            pat_bam_path,
+            mat_bam_path,
+            query_path,
+            "",
+            4,
+            phased_cigar_summaries,
+            phased_contigs,
+            query_lengths,
+            false
+    );
+
+    // name,length,phase,primary_ref,mat_identity,pat_identity,color
+    for_entry_in_csv(output_dir / "phase_assignments.csv", [&](const vector<string>& tokens, size_t line){
+        if (line > 0){
+            result[tokens.at(0)] = tokens;
+        }
+    });
+}
+
+
+/// Aligning in-process with the minimap2 library must give the same assignments as the BAMs that `minimap2 -a -x
+/// asm20 --eqx` and `samtools sort` produce, which is how the BAM inputs are usually made
+void test_fasta_input_matches_bam_input(){
+    path output_dir = "test_assign_phase_synthetic";
+
+    if (exists(output_dir)){
+        remove_all(output_dir);
+    }
+
+    create_directories(output_dir);
+
+    path pat_ref_path = output_dir / "pat.fasta";
+    path mat_ref_path = output_dir / "mat.fasta";
+    path query_path = output_dir / "query.fasta";
+
+    std::mt19937 rng(17);
+    std::uniform_int_distribution<int> uniform_base(0,3);
+    std::uniform_int_distribution<size_t> uniform_snp_spacing(50,150);
+    std::uniform_int_distribution<int> coin(0,1);
+
+    // Two parental haplotypes of each chromosome, which differ by a SNP every ~100bp
+    vector <pair <string,string> > pat;
+    vector <pair <string,string> > mat;
+
+    for (size_t c=0; c<3; c++){
+        string sequence;
+        for (size_t i=0; i<30000; i++){
+            sequence += "ACGT"[uniform_base(rng)];
+        }
+
+        pat.emplace_back("pat_chr" + to_string(c), sequence);
+
+        for (size_t i=uniform_snp_spacing(rng); i<sequence.size(); i+=uniform_snp_spacing(rng)){
+            sequence[i] = "ACGT"[(string("ACGT").find(sequence[i]) + 1 + uniform_base(rng)%3) % 4];
+        }
+
+        mat.emplace_back("mat_chr" + to_string(c), sequence);
+    }
+
+    // Queries are segments of either haplotype, with some errors of their own
+    vector <pair <string,string> > queries;
+
+    for (size_t q=0; q<12; q++){
+        bool is_mat = coin(rng);
+        auto& parent = (is_mat ? mat : pat)[q % 3].second;
+
+        std::uniform_int_distribution<size_t> uniform_start(0, parent.size() - 10000);
+        auto sequence = parent.substr(uniform_start(rng), 10000);
+
+        for (size_t i=0; i<sequence.size(); i+=500){
+            sequence[i] = "ACGT"[uniform_base(rng)];
+        }
+
+        queries.emplace_back("query" + to_string(q) + (is_mat ? "_mat" : "_pat"), sequence);
+    }
+
+    write_fasta(pat_ref_path, pat);
+    write_fasta(mat_ref_path, mat);
+    write_fasta(query_path, queries);
+
+    map <string, vector<string> > fasta_result;
+    run_assign_phases(output_dir / "fasta_input", pat_ref_path, mat_ref_path, "", "", query_path, fasta_result);
+
+    auto pat_bam_path = sam_to_sorted_bam(align(output_dir, pat_ref_path, query_path, 2), 2);
+    auto mat_bam_path = sam_to_sorted_bam(align(output_dir, mat_ref_path, query_path, 2), 2);
+
+    map <string, vector<string> > bam_result;
+    run_assign_phases(output_dir / "bam_input", pat_ref_path, mat_ref_path, pat_bam_path, mat_bam_path, query_path, bam_result);
+
+    if (fasta_result.size() != queries.size() or bam_result.size() != queries.size()){
+        throw runtime_error("ERROR: expected one phase assignment per query");
+    }
+
+    for (auto& [name, expected]: bam_result){
+        auto& result = fasta_result.at(name);
+
+        // phase and primary_ref
+        for (size_t i: {2,3}){
+            if (result.at(i) != expected.at(i)){
+                throw runtime_error("ERROR: in-process alignment does not match BAM input for " + name + ": " + result.at(i) + " != " + expected.at(i));
+            }
+        }
+
+        // mat_identity and pat_identity
+        for (size_t i: {4,5}){
+            if (std::fabs(stod(result.at(i)) - stod(expected.at(i))) > 1e-6){
+                throw runtime_error("ERROR: in-process identity does not match BAM input for " + name + ": " + result.at(i) + " != " + expected.at(i));
+            }
+        }
+
+        // The queries were drawn from this parent
+        bool is_mat = name.substr(name.size() - 3) == "mat";
+        if (result.at(3).substr(0,3) != (is_mat ? "mat" : "pat")){
+            throw runtime_error("ERROR: query " + name + " has unexpected primary_ref: " + result.at(3));
+        }
+    }
+
+    std::cerr << "PASS fasta input matches bam input" << '\n';
+}
 
 
 int main(){
+    test_fasta_input_matches_bam_input();
+
     path script_path = __FILE__;
     path project_directory = script_path.parent_path().parent_path().parent_path();
 
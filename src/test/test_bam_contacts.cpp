@@ -0,0 +1,148 @@
+#include "MultiContactGraph.hpp"
+#include "IncrementalIdMap.hpp"
+#include "Filesystem.hpp"
+#include "Bam.hpp"
+
+using gfase::parse_unpaired_bam_file;
+using gfase::MultiContactGraph;
+using gfase::IncrementalIdMap;
+using ghc::filesystem::path;
+
+#include <stdexcept>
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <random>
+#include <string>
+#include <map>
+
+using std::runtime_error;
+using std::ofstream;
+using std::string;
+using std::cerr;
+using std::map;
+
+
+int main(){
+    size_t n_refs = 20;
+    size_t n_reads = 200000;
+
+    // Write a small name-grouped SAM, which htslib reads through the same interface as BAM
+    path sam_path = "test_bam_contacts.sam";
+    path sorted_sam_path = "test_bam_contacts_sorted.sam";
+    vector<string> records;
+
+    string sq_lines;
+    for (size_t i=0; i<n_refs; i++){
+        string prefix = (i % 5 == 0) ? "XX" : "PR";
+        sq_lines += "@SQ\tSN:" + prefix + ".ref" + to_string(i) + "\tLN:1000\n";
+    }
+
+    std::mt19937 rng(7);
+    std::uniform_int_distribution<size_t> uniform_ref(0, n_refs-1);
+    std::uniform_int_distribution<int> uniform_mapq(0, 60);
+    std::uniform_int_distribution<int> uniform_count(1, 3);
+
+    // Expected results, computed by name with the same filters
+    map <pair<string,string>, int32_t> expected_edges;
+    map <string, int64_t> expected_coverage;
+
+    int8_t min_mapq = 10;
+
+    for (size_t r=0; r<n_reads; r++){
+        vector<string> passing;
+
+        auto n = uniform_count(rng);
+        for (int i=0; i<n; i++){
+            auto ref = uniform_ref(rng);
+            auto mapq = uniform_mapq(rng);
+            string prefix = (ref % 5 == 0) ? "XX" : "PR";
+            string ref_name = prefix + ".ref" + to_string(ref);
+
+            // Every 7th alignment is secondary
+            int flag = ((r + i) % 7 == 0) ? 256 : 0;
+
+            records.emplace_back("read" + to_string(r) + '\t' + to_string(flag) + '\t' + ref_name + "\t1\t" + to_string(mapq) + "\t*\t*\t0\t0\t*\t*");
+
+            if (prefix == "PR" and mapq >= min_mapq and flag == 0){
+                passing.emplace_back(ref_name);
+            }
+        }
+
+        // Also sprinkle in some unmapped records
+        if (r % 11 == 0){
+            records.emplace_back("read" + to_string(r) + "\t4\t*\t0\t0\t*\t*\t0\t0\t*\t*");
+        }
+
+        for (size_t i=0; i<passing.size(); i++){
+            expected_coverage[passing[i]]++;
+
+            for (size_t j=i+1; j<passing.size(); j++){
+                auto a = std::min(passing[i], passing[j]);
+                auto b = std::max(passing[i], passing[j]);
+                expected_edges[{a,b}]++;
+            }
+        }
+    }
+
+    {
+        ofstream file(sam_path);
+        file << "@HD\tVN:1.6\tSO:queryname" << '\n' << sq_lines;
+        for (auto& record: records){
+            file << record << '\n';
+        }
+    }
+
+    // Same records, out of read name order, and declared as coordinate sorted so that they are grouped on disk
+    {
+        std::shuffle(records.begin(), records.end(), rng);
+
+        ofstream file(sorted_sam_path);
+        file << "@HD\tVN:1.6\tSO:coordinate" << '\n' << sq_lines;
+        for (auto& record: records){
+            file << record << '\n';
+        }
+    }
+
+    for (auto [input_path, n_threads]: vector <pair<path,size_t> >{
+            {sam_path, 1}, {sam_path, 2}, {sam_path, 8}, {sorted_sam_path, 1}, {sorted_sam_path, 8}}){
+        cerr << "input: " << input_path << " n_threads: " << n_threads << '\n';
+
+        IncrementalIdMap<string> id_map(false);
+        MultiContactGraph contact_graph;
+
+        parse_unpaired_bam_file(input_path, contact_graph, id_map, "PR", min_mapq, n_threads, ".");
+
+        size_t n_edges = 0;
+        contact_graph.for_each_edge([&](const pair<int32_t,int32_t> edge, int32_t weight){
+            auto a = std::min(id_map.get_name(edge.first), id_map.get_name(edge.second));
+            auto b = std::max(id_map.get_name(edge.first), id_map.get_name(edge.second));
+
+            auto result = expected_edges.find({a,b});
+
+            if (result == expected_edges.end() or result->second != weight){
+                throw runtime_error("ERROR: unexpected edge weight for " + a + "," + b + ": " + to_string(weight));
+            }
+
+            n_edges++;
+        });
+
+        if (n_edges != expected_edges.size()){
+            throw runtime_error("ERROR: expected " + to_string(expected_edges.size()) + " edges, found " + to_string(n_edges));
+        }
+
+        for (auto& [name, coverage]: expected_coverage){
+            auto id = int32_t(id_map.get_id(name));
+
+            if (contact_graph.get_node_coverage(id) != coverage){
+                throw runtime_error("ERROR: unexpected coverage for " + name + ": " + to_string(contact_graph.get_node_coverage(id)));
+            }
+        }
+
+        cerr << "n_edges: " << n_edges << '\n';
+    }
+
+    cerr << "PASS" << '\n';
+
+    return 0;
+}
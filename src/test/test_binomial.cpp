@@ -1,10 +1,18 @@
 #include "binomial.hpp"
+#include <stdexcept>
 #include <iostream>
+#include <string>
+#include <cmath>
 
+using std::runtime_error;
+using std::to_string;
 using std::cerr;
+using std::fabs;
+using std::isfinite;
 
 using gfase::binomial_coefficient;
 using gfase::binomial;
+using gfase::BinomialTable;
 
 
 int main(){
@@ -17,5 +25,57 @@ int main(){
         }
     }
 
+    cerr << "TESTING table matches direct computation:" << '\n';
+    for (int64_t n: {0, 1, 7, 30, 300, 5000}){
+        BinomialTable table(n, p);
+
+        double total = 0;
+        for (int64_t k=0; k <= n; k++){
+            auto a = table.get_probability(k);
+            auto b = binomial(p,double(n),double(k));
+
+            if (not isfinite(a) or fabs(a - b) > 1e-12){
+                throw runtime_error("ERROR: table probability does not match for n=" + to_string(n) + " k=" + to_string(k));
+            }
+
+            total += a;
+        }
+
+        if (fabs(total - 1.0) > 1e-9){
+            throw runtime_error("ERROR: probabilities do not sum to 1 for n=" + to_string(n) + ": " + to_string(total));
+        }
+
+        if (fabs(table.get_lower_tail(n) - 1.0) > 1e-9 or fabs(table.get_upper_tail(0) - 1.0) > 1e-9){
+            throw runtime_error("ERROR: tails do not sum to 1 for n=" + to_string(n));
+        }
+
+        cerr << n << '\t' << "p(k=0): " << table.get_probability(0) << '\t' << "two sided p(k=0): " << table.get_two_sided_p_value(0) << '\n';
+    }
+
+    cerr << "TESTING two sided p values:" << '\n';
+    {
+        BinomialTable table(10, p);
+
+        // P(X<=1) = 11/1024 for n=10
+        auto expected = 2*11.0/1024.0;
+        if (fabs(table.get_two_sided_p_value(1) - expected) > 1e-12){
+            throw runtime_error("ERROR: incorrect two sided p value: " + to_string(table.get_two_sided_p_value(1)));
+        }
+
+        if (table.get_two_sided_p_value(5) != 1.0){
+            throw runtime_error("ERROR: two sided p value at the mode should be capped at 1");
+        }
+
+        vector<int64_t> ks = {0,1,5,9,10};
+        vector<double> p_values;
+        table.get_two_sided_p_values(ks, p_values);
+
+        for (size_t i=0; i<ks.size(); i++){
+            cerr << ks[i] << '\t' << p_values[i] << '\n';
+        }
+    }
+
+    cerr << "PASS" << '\n';
+
     return 0;
-}
\ No newline at end of file
+}
@@ -53,6 +53,17 @@ void run_test(string& data_file,
         throw runtime_error(("ERROR: incorrect bridges detected in GFA " + data_file).c_str());
     }
     
+    // the index doesn't need the graph to be broken into connected components
+    BridgeIndex bridge_index(graph);
+    set<string> index_bridge_names;
+    for (auto bridge : bridge_index.get_bridges()) {
+        index_bridge_names.insert(id_map.get_name(graph.get_id(bridge)));
+    }
+    
+    if (index_bridge_names != correct_bridge_names) {
+        throw runtime_error(("ERROR: incorrect bridges detected by index in GFA " + data_file).c_str());
+    }
+    
     auto consolidated_bridges = consolidate_bridges(graph, bridges);
     
     set<set<string>> bridge_components;
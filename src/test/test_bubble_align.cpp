@@ -12,6 +12,12 @@ using gfase::HashResult;
 using gfase::Sequence;
 using gfase::Timer;
 
+#include <algorithm>
+#include <random>
+#include <tuple>
+
+using std::tuple;
+
 
 void infer_bubbles_from_alignment(
         path output_dir,
@@ -70,43 +76,117 @@ void infer_bubbles_from_alignment(
     MultiContactGraph alignment_graph;
     MultiContactGraph symmetrical_alignment_graph;
 
-    // Thread-related variables
-    atomic<size_t> job_index = 0;
-    vector<thread> threads;
-    mutex output_mutex;
-
-    // Launch threads
-    for (uint64_t n=0; n<n_threads; n++){
-        try {
-            threads.emplace_back(thread(
-                    construct_alignment_graph,
-                    ref(to_be_aligned),
-                    ref(graph),
-                    ref(id_map),
-                    ref(alignment_graph),
-                    min_ab_over_a,
-                    ref(output_mutex),
-                    ref(job_index)
-            ));
-        } catch (const exception &e) {
-            cerr << e.what() << "\n";
-            exit(1);
+    construct_alignment_graph(to_be_aligned, graph, id_map, alignment_graph, min_ab_over_a, n_threads);
+
+    get_best_overlaps(min_ab_over_a, id_map, alignment_graph, symmetrical_alignment_graph);
+    write_alignment_results_to_file(id_map, alignment_graph, symmetrical_alignment_graph, output_dir);
+
+    cerr << t << "Done" << '\n';
+}
+
+
+/// Alignment edges are collected per thread and merged afterwards, so the graph must not depend on the thread count.
+/// The candidates are pairs of alleles of synthetic bubbles, with some targets shared between several queries, some
+/// unrelated pairs that fail to align, and some queries too short to be aligned at all.
+void test_thread_determinism(){
+    std::mt19937 rng(17);
+    std::uniform_int_distribution<int> uniform_base(0,3);
+    std::uniform_int_distribution<size_t> uniform_length(3000,20000);
+    std::uniform_int_distribution<size_t> uniform_snp_spacing(20,80);
+
+    HashGraph graph;
+    IncrementalIdMap<string> id_map(false);
+
+    auto add_node = [&](const string& name, const string& sequence){
+        auto id = id_map.insert(name);
+        graph.create_handle(sequence, nid_t(id));
+    };
+
+    size_t n_bubbles = 60;
+    vector <pair <string,string> > alleles;
+
+    for (size_t i=0; i<n_bubbles; i++){
+        string a;
+        auto length = uniform_length(rng);
+
+        for (size_t j=0; j<length; j++){
+            a += "ACGT"[uniform_base(rng)];
         }
+
+        // The other allele has SNPs and one deletion, so it is always the shorter of the two
+        string b = a;
+        for (size_t j=uniform_snp_spacing(rng); j<b.size(); j+=uniform_snp_spacing(rng)){
+            b[j] = "ACGT"[(string("ACGT").find(b[j]) + 1 + uniform_base(rng)%3) % 4];
+        }
+        b.erase(b.size()/2, 1 + i%50);
+
+        alleles.emplace_back("a" + to_string(i), "b" + to_string(i));
+        add_node(alleles.back().first, a);
+        add_node(alleles.back().second, b);
+
+        // Too short relative to its target to pass the length ratio filter
+        add_node("short" + to_string(i), a.substr(0, 100));
     }
 
-    // Wait for threads to finish
-    for (auto& n: threads){
-        n.join();
+    vector <HashResult> to_be_aligned;
+
+    for (size_t i=0; i<n_bubbles; i++){
+        auto& [a, b] = alleles[i];
+        to_be_aligned.emplace_back(a, b, 0.9, 0.9);
+        to_be_aligned.emplace_back(a, "short" + to_string(i), 0.9, 0.9);
+
+        // An unrelated node, as a second query of the same target when it is shorter
+        auto& other = alleles[(i + 1) % n_bubbles].second;
+        auto length_a = graph.get_length(graph.get_handle(id_map.get_id(a)));
+        auto length_other = graph.get_length(graph.get_handle(id_map.get_id(other)));
+
+        if (length_other < length_a){
+            to_be_aligned.emplace_back(a, other, 0.5, 0.5);
+        }
     }
 
-    get_best_overlaps(min_ab_over_a, id_map, alignment_graph, symmetrical_alignment_graph);
-    write_alignment_results_to_file(id_map, alignment_graph, symmetrical_alignment_graph, output_dir);
+    auto get_edges = [&](size_t n_threads){
+        MultiContactGraph alignment_graph;
+        construct_alignment_graph(to_be_aligned, graph, id_map, alignment_graph, 0.2, n_threads);
+
+        vector <tuple <int32_t,int32_t,int32_t,int32_t,int32_t> > edges;
+        alignment_graph.for_each_edge([&](const pair<int32_t,int32_t> edge, int32_t weight){
+            edges.emplace_back(
+                    edge.first,
+                    edge.second,
+                    weight,
+                    alignment_graph.get_node_length(edge.first),
+                    alignment_graph.get_node_length(edge.second));
+        });
+
+        sort(edges.begin(), edges.end());
+        return edges;
+    };
+
+    auto expected = get_edges(1);
+
+    // Every bubble must be found, and nothing else
+    if (expected.size() != n_bubbles){
+        throw runtime_error("ERROR: expected one alignment edge per bubble, found: " + to_string(expected.size()));
+    }
 
-    cerr << t << "Done" << '\n';
+    for (size_t n_threads: {2,8}){
+        if (get_edges(n_threads) != expected){
+            throw runtime_error("ERROR: alignment graph with " + to_string(n_threads) + " threads does not match single threaded result");
+        }
+    }
+
+    cerr << "PASS thread determinism" << '\n';
 }
 
 
 int main (int argc, char* argv[]){
+    // Without arguments, only run the synthetic tests
+    if (argc == 1){
+        test_thread_determinism();
+        return 0;
+    }
+
     path gfa_path;
     path output_dir;
     size_t n_threads = 1;
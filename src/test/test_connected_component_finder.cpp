@@ -6,11 +6,15 @@
 
 #include "bdsg/hash_graph.hpp"
 
+#include <random>
 #include <string>
 
 using gfase::IncrementalIdMap;
 using gfase::handle_graph_to_gfa;
 using gfase::for_each_connected_component;
+using gfase::find_connected_components;
+using gfase::write_connected_components_to_gfas;
+using gfase::for_node_in_bfs;
 using gfase::split_connected_components;
 using gfase::print_graph_paths;
 using gfase::plot_graph;
@@ -28,6 +32,102 @@ using std::cerr;
 
 
 int main(){
+    // Many small components in a larger random graph, compared to the components found by BFS
+    {
+        HashGraph random_graph;
+        IncrementalIdMap<string> random_id_map;
+        Overlaps random_overlaps;
+
+        std::mt19937 rng(3);
+        size_t n_nodes = 2000;
+        std::uniform_int_distribution<size_t> uniform_node(1, n_nodes);
+        std::uniform_int_distribution<int> uniform_bool(0, 1);
+
+        for (size_t i=1; i<=n_nodes; i++){
+            random_id_map.try_insert("n" + to_string(i));
+            random_graph.create_handle("ACGT", nid_t(i));
+        }
+
+        for (size_t i=0; i<n_nodes*2/5; i++){
+            auto a = random_graph.get_handle(nid_t(uniform_node(rng)), uniform_bool(rng));
+            auto b = random_graph.get_handle(nid_t(uniform_node(rng)), uniform_bool(rng));
+            random_graph.create_edge(a, b);
+        }
+
+        unordered_set<nid_t> visited;
+        map<nid_t, nid_t> expected_component;
+        random_graph.for_each_handle([&](const handle_t& h){
+            auto start = random_graph.get_id(h);
+            if (visited.count(start)){
+                return;
+            }
+
+            for_node_in_bfs(random_graph, start, [&](const handle_t& other){
+                visited.emplace(random_graph.get_id(other));
+                expected_component[random_graph.get_id(other)] = start;
+            });
+        });
+
+        for (size_t n_threads: {1,2,7}){
+            vector <vector<handle_t> > components;
+            find_connected_components(random_graph, n_threads, components);
+
+            size_t n = 0;
+            for (auto& component: components){
+                auto start = expected_component.at(random_graph.get_id(component[0]));
+
+                for (auto& h: component){
+                    if (expected_component.at(random_graph.get_id(h)) != start){
+                        throw runtime_error("FAIL: union-find component does not match BFS for node " + to_string(random_graph.get_id(h)));
+                    }
+                }
+
+                n += component.size();
+            }
+
+            if (n != n_nodes){
+                throw runtime_error("FAIL: union-find components contain " + to_string(n) + " nodes, expected " + to_string(n_nodes));
+            }
+
+            size_t n_expected = 0;
+            for (auto& [id, start]: expected_component){
+                n_expected += (id == start);
+            }
+
+            if (components.size() != n_expected){
+                throw runtime_error("FAIL: found " + to_string(components.size()) + " components, expected " + to_string(n_expected));
+            }
+        }
+
+        // Writing all the components should preserve every node and edge exactly once
+        path output_directory = "test_connected_component_gfas";
+        ghc::filesystem::remove_all(output_directory);
+        ghc::filesystem::create_directories(output_directory);
+
+        write_connected_components_to_gfas(random_graph, random_id_map, random_overlaps, output_directory, 4);
+
+        size_t n_nodes_written = 0;
+        size_t n_edges_written = 0;
+        size_t i = 0;
+        while (exists(output_directory / ("component_" + to_string(i) + ".gfa"))){
+            HashGraph component;
+            IncrementalIdMap<string> component_id_map;
+            Overlaps component_overlaps;
+
+            gfa_to_handle_graph(component, component_id_map, component_overlaps, output_directory / ("component_" + to_string(i) + ".gfa"));
+
+            n_nodes_written += component.get_node_count();
+            n_edges_written += component.get_edge_count();
+            i++;
+        }
+
+        if (n_nodes_written != random_graph.get_node_count() or n_edges_written != random_graph.get_edge_count()){
+            throw runtime_error("FAIL: component GFAs contain " + to_string(n_nodes_written) + " nodes and " + to_string(n_edges_written) + " edges");
+        }
+
+        cerr << "Passed union-find component tests!" << '\n';
+    }
+
     path script_path = __FILE__;
     path project_directory = script_path.parent_path().parent_path().parent_path();
 
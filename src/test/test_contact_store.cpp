@@ -0,0 +1,180 @@
+#include "ContactStore.hpp"
+
+using gfase::ContactStore;
+using gfase::mapq_histogram_t;
+using gfase::n_mapq_bins;
+
+#include <stdexcept>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <random>
+#include <map>
+
+using std::runtime_error;
+using std::to_string;
+using std::cerr;
+using std::ifstream;
+using std::stringstream;
+using std::string;
+using std::map;
+using std::pair;
+
+
+int main(){
+    size_t n_names = 300;
+    size_t n_contacts = 200000;
+
+    std::mt19937 rng(11);
+    std::uniform_int_distribution<uint32_t> uniform_id(0, uint32_t(n_names - 1));
+    std::uniform_int_distribution<int> uniform_mapq(0, 60);
+
+    ContactStore contacts;
+    for (size_t i=0; i<n_names; i++){
+        contacts.names.emplace_back("contig" + to_string(i));
+    }
+
+    // Expected results, as the raw mapqs per unordered pair
+    map <pair<uint32_t,uint32_t>, vector<uint8_t> > expected;
+
+    for (size_t i=0; i<n_contacts; i++){
+        auto a = uniform_id(rng);
+        auto b = uniform_id(rng);
+        auto mapq = uint8_t(uniform_mapq(rng));
+
+        contacts.increment(a, b, mapq);
+        expected[{std::min(a,b), std::max(a,b)}].emplace_back(mapq);
+    }
+
+    if (contacts.size() != expected.size()){
+        throw runtime_error("ERROR: expected " + to_string(expected.size()) + " pairs, found " + to_string(contacts.size()));
+    }
+
+    auto check = [&](const ContactStore& store){
+        for (uint8_t min_mapq: {0, 1, 5, 10, 20, 30, 40, 60}){
+            size_t n = 0;
+
+            store.for_each_contact(min_mapq, [&](uint32_t a, uint32_t b, uint32_t count){
+                uint32_t expected_count = 0;
+                for (auto q: expected.at({a,b})){
+                    expected_count += (q >= min_mapq);
+                }
+
+                // Both orders must be able to find the same pair
+                if (count != expected_count or store.get_count(b, a, min_mapq) != expected_count){
+                    throw runtime_error("ERROR: unexpected count for " + store.names[a] + "," + store.names[b] + " at min_mapq " + to_string(min_mapq));
+                }
+
+                n++;
+            });
+
+            size_t n_expected = 0;
+            for (auto& [key, qs]: expected){
+                for (auto q: qs){
+                    if (q >= min_mapq){
+                        n_expected++;
+                        break;
+                    }
+                }
+            }
+
+            if (n != n_expected){
+                throw runtime_error("ERROR: expected " + to_string(n_expected) + " nonzero pairs at min_mapq " + to_string(min_mapq) + ", found " + to_string(n));
+            }
+        }
+    };
+
+    check(contacts);
+
+    // Splitting the counts and merging them back must give the same store
+    {
+        ContactStore a;
+        ContactStore b;
+        size_t i = 0;
+
+        contacts.for_each_contact([&](uint32_t x, uint32_t y, const mapq_histogram_t& counts){
+            (i++ % 2 == 0 ? a : b).increment(ContactStore::pack(x,y), counts);
+        });
+
+        a.merge(b);
+        a.names = contacts.names;
+        check(a);
+    }
+
+    path binary_path = "test_contact_store.bin";
+    contacts.write_to_binary(binary_path);
+
+    ContactStore loaded(binary_path);
+
+    if (loaded.names != contacts.names or loaded.size() != contacts.size()){
+        throw runtime_error("ERROR: loaded store does not match written store");
+    }
+
+    check(loaded);
+
+    if (ContactStore::get_min_bin(7) != 3 or ContactStore::get_bin(7) != 2 or ContactStore::get_bin(255) != n_mapq_bins - 1){
+        throw runtime_error("ERROR: unexpected mapq binning");
+    }
+
+    // The text format that scripts/label_edges.py parses: each pair in both directions, with a q:count list of the
+    // non-empty bins. Parsed back, it must give the same totals.
+    {
+        path csv_path = "test_contact_store.csv";
+        contacts.write_to_mapq_list_csv(csv_path);
+
+        ContactStore parsed;
+        parsed.names = contacts.names;
+
+        map<string,uint32_t> ids;
+        for (uint32_t i=0; i<contacts.names.size(); i++){
+            ids[contacts.names[i]] = i;
+        }
+
+        ifstream file(csv_path);
+        string line;
+        size_t n_lines = 0;
+        size_t n_self = 0;
+
+        while (getline(file, line)){
+            stringstream s(line);
+            string name_a;
+            string name_b;
+            string item;
+
+            getline(s, name_a, ',');
+            getline(s, name_b, ',');
+
+            auto a = ids.at(name_a);
+            auto b = ids.at(name_b);
+
+            n_self += (a == b);
+            n_lines++;
+
+            // Only count one direction, the reverse one is checked by the line count
+            while (getline(s, item, ' ')){
+                auto colon = item.find(':');
+                auto q = uint8_t(stoi(item.substr(0, colon)));
+                auto count = uint32_t(stoul(item.substr(colon + 1)));
+
+                if (count == 0 or ContactStore::get_bin(q) != ContactStore::get_min_bin(q)){
+                    throw runtime_error("ERROR: q:count entry is not a non-empty bin start: " + item);
+                }
+
+                if (a <= b){
+                    parsed.increment(a, b, q, count);
+                }
+            }
+        }
+
+        if (n_lines != 2*contacts.size() - n_self){
+            throw runtime_error("ERROR: expected every pair in both directions in contacts csv, found lines: " + to_string(n_lines));
+        }
+
+        check(parsed);
+    }
+
+    cerr << "n_pairs: " << loaded.size() << '\n';
+    cerr << "PASS" << '\n';
+
+    return 0;
+}
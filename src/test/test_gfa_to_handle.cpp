@@ -0,0 +1,205 @@
+#include "gfa_to_handle.hpp"
+#include "handle_to_gfa.hpp"
+#include "IncrementalIdMap.hpp"
+#include "Overlaps.hpp"
+#include "Filesystem.hpp"
+
+#include "bdsg/hash_graph.hpp"
+
+using gfase::gfa_to_handle_graph;
+using gfase::handle_graph_to_gfa;
+using gfase::IncrementalIdMap;
+using ghc::filesystem::exists;
+using ghc::filesystem::remove;
+using ghc::filesystem::path;
+using bdsg::HashGraph;
+
+#include <stdexcept>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <random>
+#include <string>
+#include <vector>
+#include <tuple>
+
+using std::runtime_error;
+using std::stringstream;
+using std::to_string;
+using std::ofstream;
+using std::string;
+using std::vector;
+using std::tuple;
+using std::cerr;
+
+
+string load_and_write_gfa(path gfa_path, bool ignore_singleton_paths, size_t n_threads){
+    // The reader caches its line index next to the GFA, make sure each load builds it from scratch
+    path gfa_index_path = gfa_path;
+    gfa_index_path += "i";
+
+    if (exists(gfa_index_path)){
+        remove(gfa_index_path);
+    }
+
+    HashGraph graph;
+    IncrementalIdMap<string> id_map;
+    Overlaps overlaps;
+
+    gfa_to_handle_graph(graph, id_map, overlaps, gfa_path, ignore_singleton_paths, false, n_threads);
+
+    stringstream s;
+    handle_graph_to_gfa(graph, id_map, overlaps, s);
+
+    return s.str();
+}
+
+
+int main(){
+    path gfa_path = "test_gfa_to_handle.gfa";
+
+    size_t n_nodes = 20000;
+    size_t n_links = 50000;
+    size_t n_paths = 2000;
+
+    std::mt19937 rng(11);
+    std::uniform_int_distribution<size_t> uniform_node(0,n_nodes-1);
+    std::uniform_int_distribution<size_t> uniform_length(10,200);
+    std::uniform_int_distribution<size_t> uniform_path_length(1,12);
+    std::uniform_int_distribution<int> uniform_base(0,3);
+    std::uniform_int_distribution<int> coin(0,1);
+
+    vector<string> names;
+
+    // Successors of each oriented node (2*i + reversal), so that paths can be generated along existing edges
+    vector <vector <tuple<size_t,bool,string> > > successors(2*n_nodes);
+
+    // Interleave the line types, and repeat some links with a different overlap, which only keeps the last one
+    {
+        ofstream file(gfa_path);
+        file << "H\tVN:Z:1.0\n";
+
+        for (size_t i=0; i<n_nodes; i++){
+            names.emplace_back("n" + to_string(i));
+
+            string sequence;
+            auto length = uniform_length(rng);
+            for (size_t j=0; j<length; j++){
+                sequence += "ACGT"[uniform_base(rng)];
+            }
+
+            file << "S\t" << names.back() << '\t' << sequence << "\tLN:i:" << sequence.size() << '\n';
+
+            // Links to earlier nodes
+            for (size_t l=0; l<n_links/n_nodes + coin(rng); l++){
+                std::uniform_int_distribution<size_t> uniform_prev(0,i);
+                auto a = uniform_prev(rng);
+                auto b = i;
+                bool reversal_a = coin(rng);
+                bool reversal_b = coin(rng);
+
+                string cigar;
+                switch (uniform_base(rng)){
+                    case 0: cigar = "*"; break;
+                    case 1: cigar = "0M"; break;
+                    default: cigar = to_string(uniform_base(rng) + 1) + "M";
+                }
+
+                file << "L\t" << names[a] << '\t' << (reversal_a ? '-' : '+') << '\t' << names[b] << '\t' << (reversal_b ? '-' : '+') << '\t' << cigar << '\n';
+
+                if (l == 0 and i % 97 == 0){
+                    file << "L\t" << names[a] << '\t' << (reversal_a ? '-' : '+') << '\t' << names[b] << '\t' << (reversal_b ? '-' : '+') << '\t' << "1M" << '\n';
+                }
+
+                successors[2*a + reversal_a].emplace_back(b, reversal_b, cigar);
+                successors[2*b + !reversal_b].emplace_back(a, !reversal_a, cigar);
+            }
+        }
+
+        // Random walks along the links, including singletons
+        for (size_t p=0; p<n_paths; p++){
+            auto node = uniform_node(rng);
+            bool reversal = coin(rng);
+            auto length = uniform_path_length(rng);
+
+            string steps = names[node] + (reversal ? '-' : '+');
+            string cigars;
+
+            for (size_t i=1; i<length and not successors[2*node + reversal].empty(); i++){
+                auto& s = successors[2*node + reversal];
+                std::uniform_int_distribution<size_t> uniform_successor(0,s.size()-1);
+                auto& [next_node, next_reversal, cigar] = s[uniform_successor(rng)];
+
+                node = next_node;
+                reversal = next_reversal;
+                steps += ',' + names[node] + (reversal ? '-' : '+');
+                cigars += (cigars.empty() ? "" : ",") + cigar;
+            }
+
+            file << "P\tp" << p << '\t' << steps << '\t' << (cigars.empty() ? "*" : cigars) << '\n';
+        }
+    }
+
+    // Loading with any number of threads must give the same graph, IDs, overlaps and paths as loading serially
+    for (bool ignore_singleton_paths: {true, false}){
+        auto expected = load_and_write_gfa(gfa_path, ignore_singleton_paths, 1);
+
+        if (expected.empty()){
+            throw runtime_error("ERROR: no GFA output for serial load");
+        }
+
+        for (size_t n_threads: {2,8}){
+            auto result = load_and_write_gfa(gfa_path, ignore_singleton_paths, n_threads);
+
+            if (result != expected){
+                throw runtime_error("ERROR: GFA loaded with " + to_string(n_threads) + " threads does not match serial load, ignore_singleton_paths=" + to_string(ignore_singleton_paths));
+            }
+        }
+    }
+
+    // A malformed line anywhere in the file, or an error raised while resolving it, must throw in the caller when the
+    // records are parsed in parallel
+    {
+        path malformed_path = "test_gfa_to_handle_malformed.gfa";
+
+        vector<string> bad_lines = {
+                "L\tn0\t+\tn1\n",
+                "L\tn0\t+\tmissing\t+\t0M\n",
+                "P\tbad\tn0+,n1+\t0M,0M\n",
+        };
+
+        for (auto& bad_line: bad_lines){
+            {
+                ofstream file(malformed_path);
+
+                for (size_t i=0; i<n_nodes; i++){
+                    file << "S\t" << names[i] << "\tACGT\n";
+                }
+
+                for (size_t i=1; i<n_nodes; i++){
+                    file << "L\t" << names[i-1] << "\t+\t" << names[i] << "\t+\t0M\n";
+
+                    if (i == n_nodes/2){
+                        file << bad_line;
+                    }
+                }
+            }
+
+            bool threw = false;
+            try {
+                load_and_write_gfa(malformed_path, false, 8);
+            }
+            catch (const runtime_error& e){
+                threw = true;
+            }
+
+            if (not threw){
+                throw runtime_error("ERROR: malformed GFA line did not throw with multiple threads: " + bad_line);
+            }
+        }
+    }
+
+    cerr << "PASS" << '\n';
+
+    return 0;
+}
@@ -1,6 +1,10 @@
 #include <GfaReader.hpp>
 #include <iostream>
+#include <fstream>
+#include <random>
 
+using std::runtime_error;
+using std::to_string;
 using std::cerr;
 using std::cerr;
 using std::stringstream;
@@ -50,7 +54,250 @@ void test_gfa(GfaReader& reader){
 }
 
 
+void test_views(){
+    path gfa_path = "test_gfareader_views.gfa";
+    path gfa_index_path = "test_gfareader_views.gfai";
+
+    if (exists(gfa_index_path)){
+        remove(gfa_index_path);
+    }
+
+    size_t n_nodes = 50000;
+    std::mt19937 rng(3);
+    std::uniform_int_distribution<size_t> uniform_length(1,300);
+
+    vector<string> names;
+    vector<string> sequences;
+
+    // Interleave line types, and include some empty lines, which the index skips
+    {
+        ofstream file(gfa_path);
+        file << "H\tVN:Z:1.0\n";
+
+        for (size_t i=0; i<n_nodes; i++){
+            names.emplace_back("n" + to_string(i));
+            sequences.emplace_back(uniform_length(rng), "ACGT"[i%4]);
+
+            file << "S\t" << names.back() << '\t' << sequences.back() << "\tLN:i:" << sequences.back().size() << '\n';
+
+            if (i > 0){
+                file << "L\t" << names[i-1] << "\t+\t" << names[i] << '\t' << ((i%2) ? '-' : '+') << '\t' << i%7 << "M\n";
+            }
+
+            if (i % 1000 == 0){
+                file << '\n';
+            }
+        }
+
+        file << "P\tp0\tn0+,n1-,n2+\t0M,0M\n";
+        file << "P\tp1\tn5+\t*\n";
+    }
+
+    for (size_t n_threads: {1, 4}) {
+        if (exists(gfa_index_path)){
+            remove(gfa_index_path);
+        }
+
+        GfaReader reader(gfa_path, n_threads);
+
+        if (reader.get_line_count('S') != n_nodes or reader.get_line_count('L') != n_nodes - 1 or reader.get_line_count('P') != 2){
+            throw runtime_error("ERROR: unexpected line counts in index");
+        }
+
+        vector<size_t> n_seen(n_nodes, 0);
+        reader.for_each_sequence_view(n_threads, [&](size_t thread_index, const GfaSequenceView& s){
+            if (s.name != names[s.index] or s.sequence != sequences[s.index]){
+                throw runtime_error("ERROR: sequence view does not match for index: " + to_string(s.index));
+            }
+            n_seen[s.index]++;
+        });
+
+        for (auto n: n_seen){
+            if (n != 1){
+                throw runtime_error("ERROR: sequence was not visited exactly once");
+            }
+        }
+
+        reader.for_each_link_view(n_threads, [&](size_t thread_index, const GfaLinkView& l){
+            auto i = l.index + 1;
+            if (l.node_a != names[i-1] or l.node_b != names[i] or l.reversal_a or l.reversal_b != bool(i%2) or l.cigar != to_string(i%7) + "M"){
+                throw runtime_error("ERROR: link view does not match for index: " + to_string(l.index));
+            }
+        });
+
+        size_t n_paths = 0;
+        reader.for_each_path([&](string& path_name, vector<string>& nodes, vector<bool>& reversals, vector<string>& cigars){
+            if (path_name == "p0" and (nodes != vector<string>{"n0","n1","n2"} or reversals != vector<bool>{false,true,false} or cigars.size() != 2)){
+                throw runtime_error("ERROR: path p0 parsed incorrectly");
+            }
+            n_paths++;
+        });
+
+        if (n_paths != 2){
+            throw runtime_error("ERROR: expected 2 paths");
+        }
+
+        reader.map_sequences_by_node();
+        if (reader.get_sequence_length("n123") != sequences[123].size()){
+            throw runtime_error("ERROR: unexpected sequence length for n123");
+        }
+    }
+
+    // Loading the index from disk must reproduce the generated one, and provide the name table
+    {
+        if (exists(gfa_index_path)){
+            remove(gfa_index_path);
+        }
+
+        GfaReader generated(gfa_path, 2);
+        generated.map_sequences_by_node();
+
+        GfaReader loaded(gfa_path, 2);
+
+        if (loaded.index_data == nullptr){
+            throw runtime_error("ERROR: existing index was not loaded");
+        }
+
+        loaded.map_sequences_by_node();
+
+        if (loaded.line_offsets.size() != generated.line_offsets.size() or loaded.line_indexes_by_type != generated.line_indexes_by_type){
+            throw runtime_error("ERROR: loaded index does not match generated index");
+        }
+
+        for (size_t i=0; i<loaded.line_offsets.size(); i++){
+            if (loaded.line_offsets[i].type != generated.line_offsets[i].type or loaded.line_offsets[i].offset != generated.line_offsets[i].offset){
+                throw runtime_error("ERROR: loaded line offset does not match generated offset at line: " + to_string(i));
+            }
+        }
+
+        if (loaded.sequence_line_indexes_by_node != generated.sequence_line_indexes_by_node){
+            throw runtime_error("ERROR: loaded node name table does not match");
+        }
+    }
+
+    // Editing the GFA must invalidate the index, regardless of timestamps
+    {
+        std::fstream file(gfa_path, std::ios::in | std::ios::out);
+        file.seekp(2);
+        file << 'X';
+    }
+
+    {
+        GfaReader reader(gfa_path);
+
+        if (reader.index_data != nullptr){
+            throw runtime_error("ERROR: stale index was loaded after GFA was modified");
+        }
+    }
+
+    // Indexes in the old format are regenerated
+    {
+        ofstream file(gfa_index_path);
+        file << 'H' << "01234567";
+    }
+
+    {
+        GfaReader reader(gfa_path);
+
+        if (reader.index_data != nullptr or reader.get_line_count('S') != n_nodes){
+            throw runtime_error("ERROR: old format index was not regenerated");
+        }
+    }
+
+    cerr << "PASS views" << '\n';
+}
+
+
+void test_malformed(){
+    path gfa_path = "test_gfareader_malformed.gfa";
+    path gfa_index_path = "test_gfareader_malformed.gfai";
+
+    if (exists(gfa_index_path)){
+        remove(gfa_index_path);
+    }
+
+    size_t n_nodes = 10000;
+
+    // Many valid links and paths, with a single malformed line of each type in the middle
+    {
+        ofstream file(gfa_path);
+        file << "H\tVN:Z:1.0\n";
+
+        for (size_t i=0; i<n_nodes; i++){
+            file << "S\tn" << i << "\tACGT\n";
+        }
+
+        for (size_t i=1; i<n_nodes; i++){
+            if (i == n_nodes/2){
+                file << "L\tn" << i-1 << "\t+\tn" << i << '\n';
+            }
+            else {
+                file << "L\tn" << i-1 << "\t+\tn" << i << "\t+\t0M\n";
+            }
+        }
+
+        for (size_t i=1; i<n_nodes; i++){
+            if (i == n_nodes/2){
+                file << "P\tp" << i << "\tn" << i-1 << "+,n" << i << "+\t0M,0M\n";
+            }
+            else {
+                file << "P\tp" << i << "\tn" << i-1 << "+,n" << i << "+\t0M\n";
+            }
+        }
+    }
+
+    GfaReader reader(gfa_path, 4);
+
+    // Parse errors in worker threads must reach the caller instead of terminating the process
+    bool threw = false;
+    try {
+        reader.for_each_link_view(4, [&](size_t thread_index, const GfaLinkView& l){});
+    }
+    catch (const runtime_error& e){
+        threw = true;
+    }
+
+    if (not threw){
+        throw runtime_error("ERROR: malformed link did not throw with multiple threads");
+    }
+
+    threw = false;
+    try {
+        reader.for_each_path_view(4, [&](size_t thread_index, const GfaPathView& p){});
+    }
+    catch (const runtime_error& e){
+        threw = true;
+    }
+
+    if (not threw){
+        throw runtime_error("ERROR: malformed path did not throw with multiple threads");
+    }
+
+    // An index whose counts exceed what the file could hold is rejected and regenerated, rather than allocated from.
+    // The first line type's count follows the 5 header fields and the type code.
+    {
+        std::fstream file(gfa_index_path, std::ios::in | std::ios::out | std::ios::binary);
+        uint64_t n = uint64_t(1) << 60;
+        file.seekp(6*sizeof(uint64_t));
+        file.write(reinterpret_cast<const char*>(&n), sizeof(n));
+    }
+
+    {
+        GfaReader corrupt(gfa_path);
+
+        if (corrupt.index_data != nullptr or corrupt.get_line_count('S') != n_nodes or corrupt.get_line_count('L') != n_nodes - 1){
+            throw runtime_error("ERROR: index with inconsistent counts was not regenerated");
+        }
+    }
+
+    cerr << "PASS malformed" << '\n';
+}
+
+
 int main(){
+    test_views();
+    test_malformed();
+
     path script_path = __FILE__;
     path project_directory = script_path.parent_path().parent_path().parent_path();
 
@@ -11,6 +11,7 @@
 
 #include <string>
 #include <set>
+#include <map>
 #include <iostream>
 #include <algorithm>
 #include <vector>
@@ -29,6 +30,7 @@ using std::string;
 using std::cerr;
 using std::endl;
 using std::set;
+using std::map;
 using std::vector;
 using std::pair;
 
@@ -126,11 +128,13 @@ void run_test(string& data_file,
     chainer.generate_chain_paths(graph, id_map, contact_graph);
     
     vector<vector<handle_t>> identified_phase_handle_paths;
+    map<string, vector<handle_t>> serial_chain_paths;
     graph.for_each_path_handle([&](const path_handle_t& path_handle) {
         vector<handle_t> steps;
         for (handle_t step : graph.scan_path(path_handle)) {
             steps.push_back(step);
         }
+        serial_chain_paths[graph.get_path_name(path_handle)] = steps;
         if (graph.get_id(steps.back()) < graph.get_id(steps.front())) {
             vector<handle_t> rev_steps;
             for (auto it = steps.rbegin(); it != steps.rend(); ++it) {
@@ -154,6 +158,32 @@ void run_test(string& data_file,
         }
         throw runtime_error(("ERROR: incorrect phase paths detected in GFA " + data_file).c_str());
     }
+    
+    // the threaded chainer should find exactly the same chains, with the same names
+    vector<path_handle_t> chain_paths;
+    graph.for_each_path_handle([&](const path_handle_t& path_handle) {
+        chain_paths.push_back(path_handle);
+    });
+    for (auto path_handle : chain_paths) {
+        graph.destroy_path(path_handle);
+    }
+    
+    HamiltonianChainer threaded_chainer(3);
+    threaded_chainer.min_haploid_proportion = 0.0;
+    threaded_chainer.generate_chain_paths(graph, id_map, contact_graph);
+    
+    map<string, vector<handle_t>> threaded_chain_paths;
+    graph.for_each_path_handle([&](const path_handle_t& path_handle) {
+        vector<handle_t> steps;
+        for (handle_t step : graph.scan_path(path_handle)) {
+            steps.push_back(step);
+        }
+        threaded_chain_paths[graph.get_path_name(path_handle)] = steps;
+    });
+    
+    if (threaded_chain_paths != serial_chain_paths) {
+        throw runtime_error(("ERROR: threaded chainer does not match serial chainer in GFA " + data_file).c_str());
+    }
 }
 
 int main(){
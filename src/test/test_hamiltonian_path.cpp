@@ -32,6 +32,8 @@ using std::endl;
 using std::unordered_set;
 using std::numeric_limits;
 using std::stringstream;
+using std::to_string;
+using std::vector;
 
 string path_to_string(const vector<handle_t>& path, const HandleGraph& graph,
                       const IncrementalIdMap<string>& id_map) {
@@ -267,8 +269,96 @@ void run_test(string& data_file,
     }
 }
 
+// a chain of bubbles between core nodes c_0 ... c_n. the core nodes are targets, and in
+// "phased" bubbles one allele is a target and the other is prohibited, while in "unphased"
+// bubbles both alleles are allowed but neither is required, so the walks branch
+void run_bubble_chain_test(size_t n_phased_before, size_t n_unphased, size_t n_phased_after,
+                           size_t n_threads) {
+    
+    size_t n_bubbles = n_phased_before + n_unphased + n_phased_after;
+    
+    HashGraph graph;
+    vector<handle_t> core, allele_0, allele_1;
+    for (size_t i = 0; i <= n_bubbles; ++i) {
+        core.push_back(graph.create_handle("A"));
+    }
+    for (size_t i = 0; i < n_bubbles; ++i) {
+        allele_0.push_back(graph.create_handle("C"));
+        allele_1.push_back(graph.create_handle("G"));
+        for (auto allele : {allele_0.back(), allele_1.back()}) {
+            graph.create_edge(core[i], allele);
+            graph.create_edge(allele, core[i + 1]);
+        }
+    }
+    
+    unordered_set<nid_t> target_nodes, prohibited_nodes;
+    for (auto handle : core) {
+        target_nodes.insert(graph.get_id(handle));
+    }
+    for (size_t i = 0; i < n_bubbles; ++i) {
+        if (i < n_phased_before || i >= n_phased_before + n_unphased) {
+            target_nodes.insert(graph.get_id(allele_0[i]));
+            prohibited_nodes.insert(graph.get_id(allele_1[i]));
+        }
+    }
+    unordered_set<handle_t> allowed_starts{core.front()};
+    unordered_set<handle_t> allowed_ends{core.back()};
+    
+    auto result = find_hamiltonian_path(graph, target_nodes, prohibited_nodes,
+                                        allowed_starts, allowed_ends,
+                                        numeric_limits<size_t>::max(), n_threads);
+    
+    string description = to_string(n_phased_before) + "/" + to_string(n_unphased) + "/" + to_string(n_phased_after)
+                         + " bubble chain with " + to_string(graph.get_node_count() - prohibited_nodes.size())
+                         + " allowed nodes and " + to_string(n_threads) + " threads";
+    
+    if (!result.is_solved || result.hamiltonian_path.empty()) {
+        throw runtime_error("ERROR: no Hamiltonian path found in " + description);
+    }
+    
+    // every bubble is traversed by exactly one allele
+    const auto& path = result.hamiltonian_path;
+    if (path.size() != 2 * n_bubbles + 1) {
+        throw runtime_error("ERROR: Hamiltonian path has length " + to_string(path.size()) + " instead of "
+                            + to_string(2 * n_bubbles + 1) + " in " + description);
+    }
+    for (size_t i = 0; i < path.size(); ++i) {
+        if ((i % 2 == 0 && path[i] != core[i / 2]) ||
+            (i % 2 == 1 && path[i] != allele_0[i / 2] && path[i] != allele_1[i / 2]) ||
+            prohibited_nodes.count(graph.get_id(path[i]))) {
+            throw runtime_error("ERROR: Hamiltonian path is not a walk through the bubble chain in " + description);
+        }
+    }
+    
+    // the walk is only determined up to the first unphased bubble
+    vector<handle_t> expected_prefix;
+    for (size_t i = 0; i < n_phased_before; ++i) {
+        expected_prefix.push_back(core[i]);
+        expected_prefix.push_back(allele_0[i]);
+    }
+    expected_prefix.push_back(core[n_phased_before]);
+    if (n_unphased == 0) {
+        expected_prefix = path;
+    }
+    
+    if (result.unique_prefix != expected_prefix) {
+        throw runtime_error("ERROR: unique prefix has length " + to_string(result.unique_prefix.size())
+                            + " instead of " + to_string(expected_prefix.size()) + " in " + description);
+    }
+}
+
 int main(){
     
+    // these are sized to use each of the bitset widths, and the unphased bubbles produce DP
+    // layers that are large enough to be split across threads
+    for (size_t n_threads : {1, 4}) {
+        run_bubble_chain_test(20, 0, 0, n_threads);
+        run_bubble_chain_test(2, 13, 1, n_threads);
+        run_bubble_chain_test(40, 0, 0, n_threads);
+        run_bubble_chain_test(10, 14, 6, n_threads);
+        run_bubble_chain_test(5, 15, 5, n_threads);
+    }
+    
     {
         string data_file = "data/simple_chain.gfa";
 
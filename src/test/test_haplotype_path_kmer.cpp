@@ -0,0 +1,157 @@
+#include "HaplotypePathKmer.hpp"
+#include "FixedBinarySequence.hpp"
+#include "Sequence.hpp"
+
+using gfase::HaplotypePathKmer;
+using gfase::FixedBinarySequence;
+using gfase::packed_kmer_t;
+
+#include <stdexcept>
+#include <iostream>
+#include <random>
+#include <vector>
+#include <utility>
+#include <string>
+
+using std::runtime_error;
+using std::vector;
+using std::string;
+using std::pair;
+using std::cerr;
+
+
+string random_sequence(std::mt19937& rng, size_t length){
+    std::uniform_int_distribution<int> uniform_base(0,3);
+    string s;
+
+    for (size_t i=0; i<length; i++){
+        s += "ACGT"[uniform_base(rng)];
+    }
+
+    return s;
+}
+
+
+/// Build a chain of bubbles, with one path through each side: shared -> (a|b) -> shared -> ...
+void build_bubble_chain(HashGraph& graph, std::mt19937& rng, size_t n_bubbles){
+    std::uniform_int_distribution<size_t> uniform_length(1,150);
+
+    auto p0 = graph.create_path_handle("a.0");
+    auto p1 = graph.create_path_handle("a.1");
+
+    auto prev = graph.create_handle(random_sequence(rng, uniform_length(rng)));
+    graph.append_step(p0, prev);
+    graph.append_step(p1, prev);
+
+    for (size_t i=0; i<n_bubbles; i++){
+        auto a = graph.create_handle(random_sequence(rng, uniform_length(rng)));
+        auto b = graph.create_handle(random_sequence(rng, uniform_length(rng)));
+        auto next = graph.create_handle(random_sequence(rng, uniform_length(rng)));
+
+        graph.create_edge(prev, a);
+        graph.create_edge(prev, b);
+        graph.create_edge(a, next);
+        graph.create_edge(b, next);
+
+        graph.append_step(p0, a);
+        graph.append_step(p0, next);
+        graph.append_step(p1, b);
+        graph.append_step(p1, next);
+
+        prev = next;
+    }
+}
+
+
+template <class T, size_t T2> void test_packed_iterator(const HashGraph& graph, size_t k){
+    graph.for_each_path_handle([&](const path_handle_t& p){
+        // Reference: encode each kmer from its characters, then take the lesser orientation
+        vector <FixedBinarySequence<T,T2> > expected;
+        HaplotypePathKmer kmer_a(graph, p, k);
+
+        kmer_a.for_each_haploid_kmer([&](deque<char>& sequence){
+            FixedBinarySequence<T,T2> s(sequence);
+            FixedBinarySequence<T,T2> rc;
+            s.get_reverse_complement(rc, k);
+
+            expected.emplace_back(std::min(s, rc));
+        });
+
+        size_t i = 0;
+        HaplotypePathKmer kmer_b(graph, p, k);
+
+        kmer_b.for_each_haploid_kmer<T,T2>([&](const FixedBinarySequence<T,T2>& s){
+            if (i >= expected.size() or not (s == expected[i])){
+                string a;
+                s.to_string(a, k);
+                throw runtime_error("ERROR: packed kmer " + to_string(i) + " does not match reference: " + a);
+            }
+
+            i++;
+        });
+
+        if (i != expected.size()){
+            throw runtime_error("ERROR: packed iteration found " + to_string(i) + " kmers, expected " + to_string(expected.size()));
+        }
+
+        cerr << graph.get_path_name(p) << " k=" << k << " n_kmers=" << i << '\n';
+    });
+}
+
+
+int main(){
+    std::mt19937 rng(13);
+
+    HashGraph graph;
+    build_bubble_chain(graph, rng, 100);
+
+    test_packed_iterator<uint16_t,1>(graph, 7);
+    test_packed_iterator<uint8_t,3>(graph, 11);
+    test_packed_iterator<uint64_t,1>(graph, 31);
+    test_packed_iterator<uint64_t,1>(graph, 32);
+    test_packed_iterator<uint16_t,5>(graph, 33);
+    test_packed_iterator<uint64_t,2>(graph, 55);
+    test_packed_iterator<uint64_t,2>(graph, 64);
+
+    // A non-ACGT base inside a haploid kmer should be reported
+    {
+        HashGraph n_graph;
+        auto p0 = n_graph.create_path_handle("b.0");
+        auto p1 = n_graph.create_path_handle("b.1");
+        auto start = n_graph.create_handle(random_sequence(rng, 50));
+        auto a = n_graph.create_handle("ACGTNACGT");
+        auto b = n_graph.create_handle("ACGTTACGT");
+        auto stop = n_graph.create_handle(random_sequence(rng, 50));
+
+        n_graph.create_edge(start, a);
+        n_graph.create_edge(start, b);
+        n_graph.create_edge(a, stop);
+        n_graph.create_edge(b, stop);
+
+        for (auto& [p, h]: vector <pair<path_handle_t,handle_t> >{{p0,a},{p1,b}}){
+            n_graph.append_step(p, start);
+            n_graph.append_step(p, h);
+            n_graph.append_step(p, stop);
+        }
+
+        bool threw = false;
+        try {
+            HaplotypePathKmer kmer(n_graph, p0, 21);
+            kmer.for_each_haploid_kmer([&](const packed_kmer_t& canonical_kmer){});
+        }
+        catch (runtime_error& e){
+            threw = true;
+        }
+
+        if (not threw){
+            throw runtime_error("ERROR: kmer containing N was not reported");
+        }
+
+        HaplotypePathKmer kmer(n_graph, p1, 21);
+        kmer.for_each_haploid_kmer([&](const packed_kmer_t& canonical_kmer){});
+    }
+
+    cerr << "PASS" << '\n';
+
+    return 0;
+}
@@ -0,0 +1,172 @@
+#include "Hasher2.hpp"
+#include "Sequence.hpp"
+
+using gfase::BinarySequence;
+using gfase::Hasher2;
+using gfase::Sequence;
+
+#include <stdexcept>
+#include <iostream>
+#include <random>
+#include <string>
+#include <tuple>
+#include <map>
+#include <set>
+
+using std::runtime_error;
+using std::to_string;
+using std::string;
+using std::tuple;
+using std::cerr;
+using std::map;
+using std::set;
+
+
+string random_sequence(std::mt19937& rng, size_t length){
+    std::uniform_int_distribution<int> uniform_base(0,3);
+    string s;
+
+    for (size_t i=0; i<length; i++){
+        s += "ACGT"[uniform_base(rng)];
+    }
+
+    return s;
+}
+
+
+/// Sequences derived from a few ancestors with point mutations, some reverse complemented, some containing Ns, and
+/// all containing one repeat that is too common to be used
+void generate_sequences(std::mt19937& rng, vector<Sequence>& sequences){
+    std::uniform_int_distribution<size_t> uniform_index(0,1999);
+    std::uniform_int_distribution<int> uniform_base(0,3);
+
+    auto repeat = random_sequence(rng, 60);
+
+    vector<string> ancestors;
+    for (size_t i=0; i<5; i++){
+        ancestors.emplace_back(random_sequence(rng, 2000));
+    }
+
+    for (size_t i=0; i<50; i++){
+        string s = ancestors[i % ancestors.size()];
+
+        for (size_t j=0; j<20; j++){
+            s[uniform_index(rng)] = "ACGT"[uniform_base(rng)];
+        }
+
+        if (i % 7 == 0){
+            s[uniform_index(rng)] = 'N';
+        }
+
+        s += repeat;
+
+        if (i % 3 == 0){
+            string rc;
+            gfase::get_reverse_complement(s, rc, s.size());
+            s = rc;
+        }
+
+        string name = "seq" + to_string(i);
+        sequences.emplace_back(name, s);
+    }
+}
+
+
+/// Reference: hash every kmer (and its reverse complement) with BinarySequence, group by exact hash, and count pairs
+void count_expected_overlaps(
+        const Hasher2& hasher,
+        const vector<Sequence>& sequences,
+        size_t k,
+        double sample_rate,
+        size_t n_iterations,
+        map <pair<string,string>, int64_t>& overlaps){
+
+    auto n_bins = uint64_t(round(double(numeric_limits<uint64_t>::max())*(sample_rate/double(n_iterations))));
+
+    for (size_t h=0; h<n_iterations; h++){
+        map <uint64_t, set<string> > bins;
+
+        for (auto& sequence: sequences){
+            string rc;
+            gfase::get_reverse_complement(sequence.sequence, rc, sequence.size());
+
+            for (auto& s: {sequence.sequence, rc}){
+                for (size_t i=0; i+k<=s.size(); i++){
+                    auto kmer = s.substr(i, k);
+
+                    if (kmer.find('N') != string::npos){
+                        continue;
+                    }
+
+                    auto x = hasher.hash(BinarySequence<uint64_t>(kmer), h);
+
+                    if (x < n_bins){
+                        bins[x].emplace(sequence.name);
+                    }
+                }
+            }
+        }
+
+        for (auto& [x, names]: bins){
+            if (names.size() > 30){
+                continue;
+            }
+
+            for (auto& a: names){
+                for (auto& b: names){
+                    overlaps[{a,b}]++;
+                }
+            }
+        }
+    }
+}
+
+
+int main(){
+    std::mt19937 rng(17);
+
+    vector<Sequence> sequences;
+    generate_sequences(rng, sequences);
+
+    size_t k = 21;
+    double sample_rate = 0.3;
+    size_t n_iterations = 3;
+
+    map <pair<string,string>, int64_t> expected;
+
+    for (size_t n_threads: {1,2,7}){
+        Hasher2 hasher(k, sample_rate, n_iterations, n_threads);
+
+        if (expected.empty()){
+            count_expected_overlaps(hasher, sequences, k, sample_rate, n_iterations, expected);
+        }
+
+        hasher.hash(sequences);
+
+        for (auto& [ab, count]: expected){
+            auto n_hashes = hasher.get_intersection_size(ab.first, ab.second);
+
+            if (n_hashes != count){
+                throw runtime_error("ERROR: incorrect overlap for " + ab.first + "," + ab.second + ": " + to_string(n_hashes) + ", expected " + to_string(count));
+            }
+        }
+
+        // Nothing should be reported that isn't expected
+        size_t n = 0;
+        hasher.for_each_overlap(sequences.size(), -1, [&](const string& a, const string& b, int64_t n_hashes, int64_t total_hashes){
+            auto result = expected.find({a,b});
+
+            if (result == expected.end() or result->second != n_hashes or expected.at({a,a}) != total_hashes){
+                throw runtime_error("ERROR: unexpected overlap for " + a + "," + b + ": " + to_string(n_hashes) + "/" + to_string(total_hashes));
+            }
+
+            n++;
+        });
+
+        cerr << "n_threads=" << n_threads << " n_overlaps=" << n << '\n';
+    }
+
+    cerr << "PASS" << '\n';
+
+    return 0;
+}
@@ -210,6 +210,84 @@ int main(){
     }
     cerr << "Passed CIGAR tests!" << endl;
     
+    // arena tests
+    {
+        HashGraph graph;
+        Overlaps overlaps;
+        
+        vector<handle_t> handles;
+        for (size_t i = 0; i < 100; ++i) {
+            handles.push_back(graph.create_handle("ACGTACGTAC"));
+        }
+        
+        // asymmetric CIGARs, recorded in both orientations of the edge
+        vector<vector<pair<int, char>>> cigars{
+            {{2, 'M'}, {1, 'I'}, {3, 'M'}},
+            {{4, 'M'}, {2, 'D'}},
+            {{1, 'X'}, {5, '='}}
+        };
+        vector<pair<edge_t, size_t>> recorded;
+        for (size_t i = 0; i + 1 < handles.size(); ++i) {
+            edge_t e(handles[i], i % 2 ? graph.flip(handles[i + 1]) : handles[i + 1]);
+            graph.create_edge(e.first, e.second);
+            
+            stringstream s;
+            for (auto p : cigars[i % cigars.size()]) {
+                s << p.first << p.second;
+            }
+            
+            if (i % 3 == 0) {
+                overlaps.record_overlap(graph, graph.flip(e.second), graph.flip(e.first), Cigar(s.str()).reverse());
+            }
+            else {
+                overlaps.record_overlap(graph, e.first, e.second, s.str());
+            }
+            recorded.emplace_back(e, i % cigars.size());
+        }
+        
+        // remove and overwrite enough overlaps that the arena gets compacted
+        for (size_t round = 0; round < 30; ++round) {
+            for (size_t i = 0; i < recorded.size(); ++i) {
+                auto& e = recorded[i].first;
+                if ((i + round) % 4 == 0) {
+                    overlaps.remove_overlap(graph, e.first, e.second);
+                    overlaps.record_overlap(graph, e.first, e.second, overlaps.get_overlap_view(graph, e.first, e.second));
+                    overlaps.record_overlap(graph, e.first, e.second, Cigar(vector<CigarOperation>()));
+                }
+                auto& correct = cigars[recorded[i].second];
+                stringstream s;
+                for (auto p : correct) {
+                    s << p.first << p.second;
+                }
+                overlaps.record_overlap(graph, e.first, e.second, s.str());
+                // re-recording a view from this Overlaps must not invalidate it
+                overlaps.record_overlap(graph, e.first, e.second, overlaps.get_overlap_view(graph, e.first, e.second));
+            }
+        }
+        
+        for (auto& [e, c] : recorded) {
+            auto correct = cigars[c];
+            auto rev_correct = reverse_ops(correct);
+            
+            auto cigar = overlaps.get_overlap(graph, e.first, e.second);
+            test_cigar_internal(cigar, correct);
+            auto rev_cigar = overlaps.get_overlap(graph, graph.flip(e.second), graph.flip(e.first));
+            test_cigar_internal(rev_cigar, rev_correct);
+            
+            auto view = overlaps.get_overlap_view(graph, e.first, e.second);
+            auto view_cigar = view.get_cigar();
+            test_cigar_internal(view_cigar, correct);
+            assert(view.get_string() == cigar.get_string());
+            assert(view.aligned_length() == cigar.aligned_length());
+            assert(overlaps.get_overlap_length(graph, e.first, e.second) == cigar.aligned_length());
+            assert(overlaps.get_overlap_length(graph, graph.flip(e.second), graph.flip(e.first)) == rev_cigar.aligned_length());
+        }
+        
+        assert(overlaps.get_overlap_view(graph, handles[0], handles[2]).empty());
+        assert(overlaps.get_overlap_length(graph, handles[0], handles[2]) == make_pair(size_t(0), size_t(0)));
+    }
+    cerr << "Passed overlap arena tests!" << endl;
+    
     // overlap tests
     {
         string file = "data/simple_chain.gfa";
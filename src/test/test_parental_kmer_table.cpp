@@ -0,0 +1,283 @@
+#include "ParentalKmerTable.hpp"
+#include "FixedBinarySequence.hpp"
+#include "KmerSets.hpp"
+#include "Sequence.hpp"
+
+using gfase::ParentalKmerTable;
+using gfase::FixedBinarySequence;
+using gfase::KmerSets;
+using gfase::packed_kmer_t;
+
+#include <stdexcept>
+#include <iostream>
+#include <fstream>
+#include <random>
+#include <string>
+#include <map>
+#include <set>
+
+using std::runtime_error;
+using std::ofstream;
+using std::string;
+using std::cerr;
+using std::map;
+using std::set;
+
+
+string random_sequence(std::mt19937& rng, size_t length){
+    std::uniform_int_distribution<int> uniform_base(0,3);
+    string s;
+
+    for (size_t i=0; i<length; i++){
+        s += "ACGT"[uniform_base(rng)];
+    }
+
+    return s;
+}
+
+
+void test_table(std::mt19937& rng, size_t k){
+    std::uniform_int_distribution<int> uniform_flag(1,2);
+
+    ParentalKmerTable table;
+    map <string,uint8_t> expected;
+    vector<string> kmers;
+
+    for (size_t i=0; i<50000; i++){
+        // Reuse some kmers so that both flags get set on them
+        string s = (i % 7 == 0 and not kmers.empty()) ? kmers[i % kmers.size()] : random_sequence(rng, k);
+        string s_rc;
+        gfase::get_reverse_complement(s, s_rc, k);
+
+        auto flag = uint8_t(uniform_flag(rng));
+
+        packed_kmer_t kmer;
+        packed_kmer_t canonical_kmer;
+        gfase::to_packed_kmer(s, kmer);
+        gfase::get_canonical(kmer, canonical_kmer, k);
+
+        table.insert(canonical_kmer, flag);
+        expected[std::min(s, s_rc)] |= flag;
+        kmers.emplace_back(s);
+    }
+
+    if (table.size() != expected.size()){
+        throw runtime_error("ERROR: table has " + to_string(table.size()) + " kmers, expected " + to_string(expected.size()));
+    }
+
+    for (auto& [s, flags]: expected){
+        // Query with the reverse complement, to check that canonicalization agrees in both directions
+        string s_rc;
+        gfase::get_reverse_complement(s, s_rc, k);
+
+        packed_kmer_t kmer;
+        packed_kmer_t canonical_kmer;
+        gfase::to_packed_kmer(s_rc, kmer);
+        gfase::get_canonical(kmer, canonical_kmer, k);
+
+        if (table.get_flags(canonical_kmer) != flags){
+            throw runtime_error("ERROR: incorrect flags for kmer: " + s);
+        }
+    }
+
+    for (size_t i=0; i<50000; i++){
+        auto s = random_sequence(rng, k);
+        string s_rc;
+        gfase::get_reverse_complement(s, s_rc, k);
+
+        packed_kmer_t kmer;
+        packed_kmer_t canonical_kmer;
+        gfase::to_packed_kmer(s, kmer);
+        gfase::get_canonical(kmer, canonical_kmer, k);
+
+        auto result = expected.find(std::min(s, s_rc));
+        uint8_t flags = (result == expected.end()) ? 0 : result->second;
+
+        if (table.get_flags(canonical_kmer) != flags){
+            throw runtime_error("ERROR: incorrect flags for queried kmer: " + s);
+        }
+    }
+
+    cerr << "k=" << k << " n_kmers=" << table.size() << " n_bytes=" << table.get_memory_usage() << '\n';
+}
+
+
+void test_text_and_binary(std::mt19937& rng){
+    size_t k = 27;
+    path fasta_path = "test_parental_kmer_table.fa";
+    path list_path = "test_parental_kmer_table.txt";
+    path binary_path = "test_parental_kmer_table.pkt";
+
+    map <string,uint8_t> expected;
+
+    {
+        ofstream fasta_file(fasta_path);
+        ofstream list_file(list_path);
+
+        for (size_t i=0; i<30000; i++){
+            auto s = random_sequence(rng, k);
+            string s_rc;
+            gfase::get_reverse_complement(s, s_rc, k);
+
+            fasta_file << ">" << i << '\n' << s << '\n';
+            expected[std::min(s, s_rc)] |= ParentalKmerTable::paternal_flag;
+
+            // Plain list with a count column and windows line endings, sharing some kmers with the FASTA
+            if (i % 5 == 0){
+                std::swap(s, s_rc);
+            }
+            else{
+                s = random_sequence(rng, k);
+                s_rc.clear();
+                gfase::get_reverse_complement(s, s_rc, k);
+            }
+
+            list_file << s << '\t' << i << "\r\n";
+            expected[std::min(s, s_rc)] |= ParentalKmerTable::maternal_flag;
+        }
+    }
+
+    auto check = [&](const ParentalKmerTable& table){
+        if (table.size() != expected.size() or table.get_k() != k){
+            throw runtime_error("ERROR: table has " + to_string(table.size()) + " kmers, expected " + to_string(expected.size()));
+        }
+
+        for (auto& [s, flags]: expected){
+            packed_kmer_t kmer;
+            gfase::to_packed_kmer(s, kmer);
+
+            if (table.get_flags(kmer) != flags){
+                throw runtime_error("ERROR: incorrect flags for kmer: " + s);
+            }
+        }
+    };
+
+    for (size_t n_threads: {1,3,8}){
+        ParentalKmerTable table;
+        table.load_kmers_from_text(fasta_path, ParentalKmerTable::paternal_flag, n_threads);
+        table.load_kmers_from_text(list_path, ParentalKmerTable::maternal_flag, n_threads);
+        check(table);
+
+        table.write_to_binary(binary_path);
+    }
+
+    ParentalKmerTable mapped_table(binary_path);
+    check(mapped_table);
+
+    if (not mapped_table.is_mapped() or
+        mapped_table.count(ParentalKmerTable::paternal_flag) != 30000 or
+        mapped_table.count(ParentalKmerTable::maternal_flag) != 30000){
+        throw runtime_error("ERROR: mapped table has incorrect counts");
+    }
+
+    // Mismatched k is an error
+    {
+        ofstream file(list_path);
+        file << random_sequence(rng, k) << '\n' << random_sequence(rng, k + 1) << '\n';
+    }
+
+    bool threw = false;
+    try {
+        ParentalKmerTable table;
+        table.load_kmers_from_text(list_path, ParentalKmerTable::paternal_flag, 2);
+    }
+    catch (runtime_error& e){
+        threw = true;
+    }
+
+    if (not threw){
+        throw runtime_error("ERROR: kmers of unequal length were not reported");
+    }
+}
+
+
+void test_kmer_sets(std::mt19937& rng){
+    size_t k = 31;
+    path paternal_path = "test_parental_kmer_table_pat.fa";
+    path maternal_path = "test_parental_kmer_table_mat.fa";
+
+    set<string> paternal;
+    set<string> maternal;
+
+    {
+        ofstream pat_file(paternal_path);
+        ofstream mat_file(maternal_path);
+
+        for (size_t i=0; i<2000; i++){
+            auto s = random_sequence(rng, k);
+            pat_file << ">" << i << '\n' << s << '\n';
+            paternal.emplace(s);
+
+            // Some kmers are shared, in the opposite orientation
+            if (i % 10 == 0){
+                string s_rc;
+                gfase::get_reverse_complement(s, s_rc, k);
+                mat_file << ">" << i << '\n' << s_rc << '\n';
+                maternal.emplace(s_rc);
+            }
+            else{
+                s = random_sequence(rng, k);
+                mat_file << ">" << i << '\n' << s << '\n';
+                maternal.emplace(s);
+            }
+        }
+    }
+
+    KmerSets <FixedBinarySequence <uint64_t,1> > ks(paternal_path, maternal_path, '.', 4);
+
+    // The same kmers from a binary table
+    path binary_path = "test_parental_kmer_table_sets.pkt";
+    {
+        ParentalKmerTable table;
+        table.load_kmers_from_text(paternal_path, ParentalKmerTable::paternal_flag, 2);
+        table.load_kmers_from_text(maternal_path, ParentalKmerTable::maternal_flag, 2);
+        table.write_to_binary(binary_path);
+    }
+
+    KmerSets <FixedBinarySequence <uint64_t,1> > ks_db;
+    ks_db.load_kmer_db(binary_path);
+
+    if (ks_db.get_k() != k or ks_db.n_paternal_kmers() != ks.n_paternal_kmers() or ks_db.n_maternal_kmers() != ks.n_maternal_kmers()){
+        throw runtime_error("ERROR: KmerSets loaded from binary table does not match KmerSets loaded from text");
+    }
+
+    vector<string> queries(paternal.begin(), paternal.end());
+    queries.insert(queries.end(), maternal.begin(), maternal.end());
+    for (size_t i=0; i<2000; i++){
+        queries.emplace_back(random_sequence(rng, k));
+    }
+
+    for (auto& s: queries){
+        string s_rc;
+        gfase::get_reverse_complement(s, s_rc, k);
+
+        bool is_pat = paternal.count(s) or paternal.count(s_rc);
+        bool is_mat = maternal.count(s) or maternal.count(s_rc);
+
+        FixedBinarySequence<uint64_t,1> kmer(s);
+
+        if (ks.is_paternal(kmer) != is_pat or ks.is_maternal(kmer) != is_mat){
+            throw runtime_error("ERROR: KmerSets classification does not match reference for kmer: " + s);
+        }
+
+        if (ks_db.is_paternal(kmer) != is_pat or ks_db.is_maternal(kmer) != is_mat){
+            throw runtime_error("ERROR: KmerSets (binary) classification does not match reference for kmer: " + s);
+        }
+    }
+}
+
+
+int main(){
+    std::mt19937 rng(5);
+
+    for (size_t k: {7, 21, 31, 32, 33, 55, 63}){
+        test_table(rng, k);
+    }
+
+    test_text_and_binary(rng);
+    test_kmer_sets(rng);
+
+    cerr << "PASS" << '\n';
+
+    return 0;
+}
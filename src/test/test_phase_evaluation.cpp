@@ -0,0 +1,240 @@
+#include "PhaseEvaluation.hpp"
+#include "ContactStore.hpp"
+#include "Filesystem.hpp"
+
+using gfase::ContactEvaluation;
+using gfase::ContactStore;
+using gfase::Histogram;
+using gfase::evaluate_contacts;
+using gfase::mapq_bin_starts;
+using gfase::n_mapq_bins;
+using ghc::filesystem::path;
+
+#include <stdexcept>
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <random>
+#include <string>
+#include <map>
+
+using std::runtime_error;
+using std::to_string;
+using std::ofstream;
+using std::string;
+using std::cerr;
+using std::map;
+using std::pair;
+
+
+void compare_histograms(const Histogram& a, const Histogram& b, const string& name){
+    if (a.frequencies != b.frequencies){
+        for (size_t i=0; i<a.frequencies.size(); i++){
+            if (a.frequencies[i] != b.frequencies[i]){
+                throw runtime_error("ERROR: " + name + " differs at " + to_string(i) + ": " + to_string(a.frequencies[i]) + " != " + to_string(b.frequencies[i]));
+            }
+        }
+    }
+}
+
+
+void compare_evaluations(const ContactEvaluation& a, const ContactEvaluation& b){
+    compare_histograms(a.n_consistent_contacts, b.n_consistent_contacts, "n_consistent_contacts");
+    compare_histograms(a.n_inconsistent_contacts, b.n_inconsistent_contacts, "n_inconsistent_contacts");
+    compare_histograms(a.subread_lengths, b.subread_lengths, "subread_lengths");
+    compare_histograms(a.subread_counts, b.subread_counts, "subread_counts");
+    compare_histograms(a.gap_lengths, b.gap_lengths, "gap_lengths");
+    compare_histograms(a.mapqs, b.mapqs, "mapqs");
+
+    if (a.total_alignments != b.total_alignments){
+        throw runtime_error("ERROR: total_alignments differs: " + to_string(a.total_alignments) + " != " + to_string(b.total_alignments));
+    }
+}
+
+
+int main(){
+    size_t n_refs = 20;
+    size_t n_reads = 100000;
+
+    path sam_path = "test_phase_evaluation.sam";
+    path sorted_sam_path = "test_phase_evaluation_sorted.sam";
+    vector<string> records;
+
+    std::mt19937 rng(11);
+    std::uniform_int_distribution<size_t> uniform_ref(0, n_refs-1);
+    std::uniform_int_distribution<int> uniform_mapq(0, 60);
+    std::uniform_int_distribution<int> uniform_count(1, 4);
+    std::uniform_int_distribution<int> uniform_phase(-1, 1);
+    std::uniform_int_distribution<int> uniform_position(1, 10000000);
+    std::uniform_int_distribution<int> uniform_length(0, 5000);
+
+    vector<string> names;
+    string sq_lines;
+    for (size_t i=0; i<n_refs; i++){
+        names.emplace_back("ref" + to_string(i));
+        sq_lines += "@SQ\tSN:" + names.back() + "\tLN:20000000\n";
+    }
+
+    // Every 4th contig is left out of the phasing, and so is considered unphased
+    map<string,int8_t> phases;
+    for (size_t i=0; i<n_refs; i++){
+        if (i % 4 != 3){
+            phases[names[i]] = int8_t(uniform_phase(rng));
+        }
+    }
+
+    auto get_phase = [&](const string& name){
+        auto result = phases.find(name);
+        return result == phases.end() ? int8_t(0) : result->second;
+    };
+
+    int8_t min_mapq = 5;
+
+    // Expected results, computed by name with the same filters
+    ContactEvaluation expected;
+    ContactStore contacts;
+    contacts.names = names;
+
+    // Reference and query coordinates of each passing alignment
+    class Span {
+    public:
+        int ref_start;
+        int ref_stop;
+        int query_length;
+    };
+
+    for (size_t r=0; r<n_reads; r++){
+        vector <pair<size_t,int> > passing;
+        vector<Span> spans;
+
+        auto n = uniform_count(rng);
+        for (int i=0; i<n; i++){
+            auto ref = uniform_ref(rng);
+            auto mapq = uniform_mapq(rng);
+
+            // Every 9th alignment is secondary, and every other one is reversed
+            int flag = ((r + i) % 9 == 0) ? 256 : 0;
+            flag |= ((r + i) % 2 == 0) ? 16 : 0;
+
+            // Clipped alignment with an insertion and a deletion
+            auto position = uniform_position(rng);
+            auto clip = uniform_length(rng);
+            auto match_a = uniform_length(rng) + 1;
+            auto insert = uniform_length(rng) + 1;
+            auto match_b = uniform_length(rng) + 1;
+            auto deletion = uniform_length(rng) + 1;
+            auto hard_clip = uniform_length(rng) + 1;
+
+            string cigar = to_string(clip) + "S" + to_string(match_a) + "M" + to_string(insert) + "I"
+                    + to_string(match_b) + "=" + to_string(deletion) + "D1X" + to_string(hard_clip) + "H";
+
+            records.emplace_back("read" + to_string(r) + '\t' + to_string(flag) + '\t' + names[ref] + '\t' + to_string(position) + '\t' + to_string(mapq) + '\t' + cigar + "\t*\t0\t0\t*\t*");
+
+            if (mapq >= min_mapq and (flag & 256) == 0){
+                passing.emplace_back(ref, mapq);
+
+                // SAM positions are 1-based
+                auto ref_start = position - 1;
+                auto ref_stop = ref_start + match_a + match_b + deletion + 1;
+                spans.push_back({ref_start, ref_stop, match_a + insert + match_b + 1});
+            }
+        }
+
+        if (passing.empty()){
+            continue;
+        }
+
+        expected.subread_counts.update(passing.size());
+        expected.total_alignments += passing.size();
+
+        if (passing.size() == 1){
+            continue;
+        }
+
+        for (size_t i=0; i<passing.size(); i++){
+            expected.mapqs.update(passing[i].second);
+            expected.subread_lengths.update(spans[i].query_length);
+
+            for (size_t j=i+1; j<passing.size(); j++){
+                if (passing[i].first == passing[j].first){
+                    auto a_middle = (spans[i].ref_start + spans[i].ref_stop)/2;
+                    auto b_middle = (spans[j].ref_start + spans[j].ref_stop)/2;
+                    expected.gap_lengths.update(std::max(a_middle, b_middle) - std::min(a_middle, b_middle));
+                }
+
+                auto mapq = std::min(passing[i].second, passing[j].second);
+                auto p_a = get_phase(names[passing[i].first]);
+                auto p_b = get_phase(names[passing[j].first]);
+
+                if (p_a != 0 and p_b != 0){
+                    if (p_a == p_b){
+                        expected.n_consistent_contacts.update(mapq);
+                    }
+                    else{
+                        expected.n_inconsistent_contacts.update(mapq);
+                    }
+                }
+
+                contacts.increment(uint32_t(passing[i].first), uint32_t(passing[j].first), uint8_t(mapq));
+            }
+        }
+    }
+
+    {
+        ofstream file(sam_path);
+        file << "@HD\tVN:1.6\tSO:queryname" << '\n' << sq_lines;
+        for (auto& record: records){
+            file << record << '\n';
+        }
+    }
+
+    {
+        std::shuffle(records.begin(), records.end(), rng);
+
+        ofstream file(sorted_sam_path);
+        file << "@HD\tVN:1.6\tSO:coordinate" << '\n' << sq_lines;
+        for (auto& record: records){
+            file << record << '\n';
+        }
+    }
+
+    for (auto [input_path, n_threads]: vector <pair<path,size_t> >{
+            {sam_path, 1}, {sam_path, 3}, {sam_path, 8}, {sorted_sam_path, 1}, {sorted_sam_path, 8}}){
+        cerr << "input: " << input_path << " n_threads: " << n_threads << '\n';
+
+        ContactEvaluation evaluation;
+        evaluate_contacts(input_path, get_phase, min_mapq, n_threads, ".", evaluation);
+
+        compare_evaluations(evaluation, expected);
+    }
+
+    // Evaluating from the store only resolves mapq to the lower bound of each bin
+    ContactEvaluation binned;
+    for (size_t i=0; i<expected.n_consistent_contacts.frequencies.size(); i++){
+        auto b = ContactStore::get_bin(uint8_t(i));
+        binned.n_consistent_contacts.update(mapq_bin_starts[b], expected.n_consistent_contacts.frequencies[i]);
+        binned.n_inconsistent_contacts.update(mapq_bin_starts[b], expected.n_inconsistent_contacts.frequencies[i]);
+    }
+
+    ContactEvaluation evaluation;
+    evaluate_contacts(contacts, get_phase, evaluation);
+
+    compare_evaluations(evaluation, binned);
+
+    // Reverse CDFs at the bin boundaries are exact
+    vector<int32_t> a;
+    vector<int32_t> b;
+    evaluation.n_consistent_contacts.get_reverse_cdf(a);
+    expected.n_consistent_contacts.get_reverse_cdf(b);
+
+    for (size_t i=0; i<n_mapq_bins; i++){
+        auto mapq = mapq_bin_starts[i];
+        if (mapq < a.size() and a[mapq] != b[mapq]){
+            throw runtime_error("ERROR: reverse CDF differs at mapq " + to_string(mapq));
+        }
+    }
+
+    cerr << "PASS" << '\n';
+
+    return 0;
+}
@@ -0,0 +1,186 @@
+#include "RecordWriter.hpp"
+#include "handle_to_gfa.hpp"
+#include "IncrementalIdMap.hpp"
+#include "Overlaps.hpp"
+
+#include "bdsg/hash_graph.hpp"
+
+using gfase::RecordWriter;
+using gfase::IncrementalIdMap;
+using gfase::append_fasta_record;
+using gfase::handle_graph_to_gfa;
+using handlegraph::handle_t;
+using handlegraph::nid_t;
+using bdsg::HashGraph;
+
+#include <stdexcept>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <random>
+#include <string>
+#include <vector>
+
+using std::runtime_error;
+using std::stringstream;
+using std::to_string;
+using std::ifstream;
+using std::string;
+using std::vector;
+using std::cerr;
+
+
+string read_file(path file_path, bool compressed){
+    string result;
+
+    if (compressed){
+        BGZF* file = bgzf_open(file_path.string().c_str(), "r");
+
+        if (file == nullptr){
+            throw runtime_error("ERROR: could not read file: " + file_path.string());
+        }
+
+        vector<char> buffer(65536);
+        ssize_t n;
+        while ((n = bgzf_read(file, buffer.data(), buffer.size())) > 0){
+            result.append(buffer.data(), size_t(n));
+        }
+
+        bgzf_close(file);
+    }
+    else {
+        ifstream file(file_path);
+        stringstream s;
+        s << file.rdbuf();
+        result = s.str();
+    }
+
+    return result;
+}
+
+
+int main(){
+    std::mt19937 rng(5);
+    std::uniform_int_distribution<int> uniform_base(0,3);
+    std::uniform_int_distribution<size_t> uniform_length(0,300);
+
+    vector<string> names;
+    vector<string> sequences;
+
+    for (size_t i=0; i<5000; i++){
+        // A few very long records among many short ones, so the buffer sizes have to adapt
+        auto length = (i % 1000 == 7) ? size_t(5'000'000) : uniform_length(rng);
+
+        string s;
+        for (size_t j=0; j<length; j++){
+            s += "ACGT"[uniform_base(rng)];
+        }
+
+        names.emplace_back("seq" + to_string(i));
+        sequences.emplace_back(s);
+    }
+
+    for (size_t line_width: {0,1,60,80}){
+        string expected;
+        for (size_t i=0; i<names.size(); i++){
+            append_fasta_record(expected, names[i], sequences[i], line_width);
+        }
+
+        // Wrapped lines should be full except for the last line of each record, and reassemble the sequence
+        if (line_width > 0){
+            stringstream s(expected);
+            string line;
+            size_t i = 0;
+            string sequence;
+            size_t n_records = 0;
+
+            auto check = [&](){
+                if (n_records > 0 and sequence != sequences[i-1]){
+                    throw runtime_error("ERROR: wrapped sequence does not match for record " + to_string(i-1));
+                }
+            };
+
+            while (getline(s, line)){
+                if (line[0] == '>'){
+                    check();
+                    sequence.clear();
+                    n_records++;
+                    i++;
+                }
+                else {
+                    if (line.size() > line_width){
+                        throw runtime_error("ERROR: line longer than " + to_string(line_width));
+                    }
+                    sequence += line;
+                }
+            }
+            check();
+
+            if (n_records != names.size()){
+                throw runtime_error("ERROR: expected " + to_string(names.size()) + " records, found " + to_string(n_records));
+            }
+        }
+
+        for (bool compress: {false, true}){
+            for (size_t n_threads: {1,2,7}){
+                path output_path = "test_record_writer.fasta";
+                if (compress){
+                    output_path += ".gz";
+                }
+
+                RecordWriter writer(output_path, compress, n_threads);
+                writer.write_records(names.size(), n_threads, [&](size_t i, string& buffer){
+                    append_fasta_record(buffer, names[i], sequences[i], line_width);
+                });
+                writer.close();
+
+                if (read_file(output_path, compress) != expected){
+                    throw runtime_error("ERROR: output does not match for line_width=" + to_string(line_width) + " compress=" + to_string(compress) + " n_threads=" + to_string(n_threads));
+                }
+            }
+        }
+
+        cerr << "line_width=" << line_width << " PASS" << '\n';
+    }
+
+    // The parallel GFA writer should produce exactly the same file as the stream version
+    HashGraph graph;
+    IncrementalIdMap<string> id_map;
+    Overlaps overlaps;
+
+    std::uniform_int_distribution<size_t> uniform_node(0,199);
+    vector<handle_t> handles;
+    for (size_t i=0; i<200; i++){
+        auto id = id_map.try_insert("node" + to_string(i));
+        handles.emplace_back(graph.create_handle(sequences[i].empty() ? "A" : sequences[i], nid_t(id)));
+    }
+
+    for (size_t i=0; i<400; i++){
+        auto a = handles[uniform_node(rng)];
+        auto b = handles[uniform_node(rng)];
+        graph.create_edge(i % 3 ? a : graph.flip(a), b);
+    }
+
+    for (size_t p=0; p<10; p++){
+        auto path = graph.create_path_handle("path" + to_string(p));
+        for (size_t i=0; i<=p; i++){
+            graph.append_step(path, handles[p*20 + i]);
+        }
+    }
+
+    stringstream s;
+    handle_graph_to_gfa(graph, id_map, overlaps, s);
+
+    for (size_t n_threads: {1,4}){
+        path output_path = "test_record_writer.gfa";
+        handle_graph_to_gfa(graph, id_map, overlaps, output_path, false, n_threads);
+
+        if (read_file(output_path, false) != s.str()){
+            throw runtime_error("ERROR: GFA output does not match for n_threads=" + to_string(n_threads));
+        }
+    }
+
+    cerr << "PASS" << '\n';
+
+    return 0;
+}
@@ -0,0 +1,101 @@
+#include "VectorMultiContactGraph.hpp"
+#include "MultiContactGraph.hpp"
+#include "optimize.hpp"
+
+using gfase::VectorMultiContactGraph;
+using gfase::MultiContactGraph;
+using gfase::compute_spectral_partitions;
+using gfase::seed_partitions;
+
+#include <iostream>
+#include <random>
+
+using std::cerr;
+
+
+int main(){
+    size_t n_bubbles = 200;
+
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<int> coin(0,1);
+    std::uniform_int_distribution<size_t> uniform_bubble(0,n_bubbles-1);
+
+    // Plant a phasing: node 2i is on haplotype planted[2i], and its alt 2i+1 is on the other one
+    vector<int8_t> planted(2*n_bubbles);
+    MultiContactGraph g;
+
+    for (size_t i=0; i<n_bubbles; i++){
+        auto a = int32_t(2*i);
+        auto b = int32_t(2*i + 1);
+
+        planted[a] = int8_t(coin(rng) ? 1 : -1);
+        planted[b] = int8_t(-1*int(planted[a]));
+
+        g.insert_node(a);
+        g.insert_node(b);
+        g.add_alt(a,b);
+    }
+
+    // Strong cis contacts between neighboring bubbles and some random long range ones, plus weak trans noise
+    auto add_contacts = [&](size_t i, size_t j){
+        if (i == j){
+            return;
+        }
+
+        for (int32_t a: {int32_t(2*i), int32_t(2*i+1)}){
+            for (int32_t b: {int32_t(2*j), int32_t(2*j+1)}){
+                int32_t weight = (planted[a] == planted[b]) ? 10 : 1;
+                g.try_insert_edge(a, b, weight);
+            }
+        }
+    };
+
+    for (size_t i=0; i+1<n_bubbles; i++){
+        add_contacts(i, i+1);
+    }
+
+    for (size_t i=0; i<n_bubbles; i++){
+        add_contacts(i, uniform_bubble(rng));
+    }
+
+    VectorMultiContactGraph vg(g);
+
+    for (size_t n_threads: {1,4}) {
+        // Fixed seed for the starting vector of the power iteration, so that the test is reproducible
+        std::mt19937 spectral_rng(17);
+
+        vector <pair <int32_t,int8_t> > partitions;
+        compute_spectral_partitions(vg, partitions, spectral_rng, n_threads);
+
+        cerr << "n_threads: " << n_threads << '\n';
+        cerr << "n_partitions: " << partitions.size() << '\n';
+
+        if (partitions.size() != n_bubbles){
+            throw runtime_error("ERROR: expected one partition per bubble, found: " + to_string(partitions.size()));
+        }
+
+        // Global orientation is arbitrary, so compare against the first bubble
+        int8_t orientation = partitions[0].second * planted[partitions[0].first];
+
+        for (auto& [id, p]: partitions){
+            if (p * planted[id] != orientation){
+                throw runtime_error("ERROR: spectral partition does not match planted partition for node: " + to_string(id));
+            }
+        }
+
+        // Seeding with no noise should reproduce the spectral state exactly, and keep alts opposed
+        seed_partitions(vg, partitions, 0);
+
+        for (size_t id=0; id<2*n_bubbles; id++){
+            if (vg.get_partition(int32_t(id)) * planted[id] != orientation){
+                throw runtime_error("ERROR: seeded partition does not match planted partition for node: " + to_string(id));
+            }
+        }
+
+        cerr << "score: " << vg.compute_total_consistency_score() << '\n';
+    }
+
+    cerr << "PASS" << '\n';
+
+    return 0;
+}
@@ -0,0 +1,161 @@
+#include "SubgraphOverlay.hpp"
+
+#include "bdsg/hash_graph.hpp"
+
+using gfase::SubgraphOverlay;
+using gfase::BitmapSubgraphOverlay;
+using bdsg::HashGraph;
+
+#include <stdexcept>
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include <mutex>
+
+using std::runtime_error;
+using std::to_string;
+using std::string;
+using std::vector;
+using std::mutex;
+using std::pair;
+using std::cerr;
+
+
+vector <pair<nid_t,bool> > get_neighbors(const HandleGraph& graph, const handle_t& handle, bool go_left){
+    vector <pair<nid_t,bool> > result;
+
+    graph.follow_edges(handle, go_left, [&](const handle_t& h){
+        result.emplace_back(graph.get_id(h), graph.get_is_reverse(h));
+    });
+
+    std::sort(result.begin(), result.end());
+
+    return result;
+}
+
+
+vector<nid_t> get_ids(const HandleGraph& graph, bool parallel){
+    vector<nid_t> result;
+    mutex m;
+
+    graph.for_each_handle([&](const handle_t& h){
+        std::lock_guard lock(m);
+        result.emplace_back(graph.get_id(h));
+    }, parallel);
+
+    return result;
+}
+
+
+/// Build a random graph with IDs spaced by `id_step` and compare a bitmap overlay of a random half of the nodes
+/// against the hash set overlay of the same nodes
+void test_overlay(nid_t id_step, size_t seed){
+    size_t n_nodes = 3000;
+    size_t n_edges = 8000;
+
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<size_t> uniform_node(0,n_nodes-1);
+    std::uniform_int_distribution<int> coin(0,1);
+
+    HashGraph graph;
+    vector<handle_t> handles;
+
+    for (size_t i=0; i<n_nodes; i++){
+        handles.emplace_back(graph.create_handle("ACGT", nid_t(1 + i*id_step)));
+    }
+
+    for (size_t i=0; i<n_edges; i++){
+        auto a = graph.get_handle(graph.get_id(handles[uniform_node(rng)]), coin(rng));
+        auto b = graph.get_handle(graph.get_id(handles[uniform_node(rng)]), coin(rng));
+        graph.create_edge(a, b);
+    }
+
+    unordered_set<nid_t> subset;
+    for (auto& h: handles){
+        if (coin(rng)){
+            subset.emplace(graph.get_id(h));
+        }
+    }
+
+    SubgraphOverlay expected(&graph, &subset);
+    BitmapSubgraphOverlay result(&graph, subset);
+
+    string context = " (id_step=" + to_string(id_step) + ")";
+
+    if (result.get_node_count() != expected.get_node_count() or result.min_node_id() != expected.min_node_id() or result.max_node_id() != expected.max_node_id()){
+        throw runtime_error("ERROR: node count or ID range does not match" + context);
+    }
+
+    // Every ID in the backing graph, the gaps between them, and IDs outside the range
+    for (nid_t id=0; id<=graph.max_node_id() + id_step; id++){
+        if (result.has_node(id) != expected.has_node(id)){
+            throw runtime_error("ERROR: has_node does not match for node " + to_string(id) + context);
+        }
+    }
+
+    // Edges in both directions from both orientations, including from nodes outside the subset
+    for (auto& h: handles){
+        for (auto& oriented: {h, graph.flip(h)}){
+            for (bool go_left: {false, true}){
+                if (get_neighbors(result, oriented, go_left) != get_neighbors(expected, oriented, go_left)){
+                    throw runtime_error("ERROR: follow_edges does not match for node " + to_string(graph.get_id(h)) + " go_left=" + to_string(go_left) + context);
+                }
+            }
+        }
+    }
+
+    // Serial iteration is in ID order, parallel iteration visits the same nodes in any order
+    vector<nid_t> expected_ids(subset.begin(), subset.end());
+    std::sort(expected_ids.begin(), expected_ids.end());
+
+    if (get_ids(result, false) != expected_ids){
+        throw runtime_error("ERROR: serial for_each_handle does not match" + context);
+    }
+
+    for (auto& overlay: vector<const HandleGraph*>{&expected, &result}){
+        auto ids = get_ids(*overlay, true);
+        std::sort(ids.begin(), ids.end());
+
+        if (ids != expected_ids){
+            throw runtime_error("ERROR: parallel for_each_handle does not match" + context);
+        }
+    }
+
+    // Stopping early
+    size_t n_visited = 0;
+    bool finished = result.for_each_handle([&](const handle_t& h){
+        n_visited++;
+        return n_visited < 10;
+    });
+
+    if (finished or n_visited != 10){
+        throw runtime_error("ERROR: for_each_handle did not stop early" + context);
+    }
+
+    cerr << "PASS id_step=" << id_step << '\n';
+}
+
+
+int main(){
+    // Dense IDs use the bitmap, sparse ones fall back to searching the member list
+    test_overlay(1, 7);
+    test_overlay(1000, 13);
+
+    // Empty subgraph
+    {
+        HashGraph graph;
+        auto h = graph.create_handle("ACGT", 5);
+        unordered_set<nid_t> subset;
+        BitmapSubgraphOverlay result(&graph, subset);
+
+        if (result.has_node(5) or result.get_node_count() != 0 or not get_ids(result, false).empty() or not get_neighbors(result, h, false).empty()){
+            throw runtime_error("ERROR: empty subgraph overlay is not empty");
+        }
+    }
+
+    cerr << "PASS" << '\n';
+
+    return 0;
+}